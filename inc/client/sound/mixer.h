@@ -0,0 +1,51 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef MIXER_H
+#define MIXER_H
+
+//
+// sound mixing kernels used by the DMA sound engine,
+// implementation is selected at runtime depending on CPU features
+//
+
+// samples are accumulated with 8 bits of fractional precision, vector
+// versions are only used for volumes and scales in 0-65534 range
+typedef struct samplepair_s {
+    int         left;
+    int         right;
+} samplepair_t;
+
+typedef struct {
+    const char  *name;
+    // adds (sample - 128) * scale
+    void        (*Paint8)(samplepair_t *samp, const uint8_t *sfx, int count,
+                          int leftscale, int rightscale);
+    // adds (sample * vol) >> 8
+    void        (*Paint16)(samplepair_t *samp, const int16_t *sfx, int count,
+                           int leftvol, int rightvol);
+    // writes interleaved 16-bit stereo, clipping accumulated samples
+    void        (*Transfer16)(int16_t *out, const samplepair_t *samp, int count);
+} mixops_t;
+
+extern mixops_t     mixops;
+
+void Mixer_Init(void);
+
+// returns implementations supported by this CPU, for testing
+const mixops_t *Mixer_GetImpl(int index);
+
+#endif // MIXER_H
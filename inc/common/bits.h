@@ -0,0 +1,51 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef BITS_H
+#define BITS_H
+
+//
+// bitset kernels for visibility masks and area bits,
+// implementation is selected at runtime depending on CPU features
+//
+
+typedef struct {
+    const char  *name;
+    void        (*Or)(byte *dst, const byte *src, size_t len);
+    void        (*And)(byte *dst, const byte *src, size_t len);
+    size_t      (*Count)(const byte *src, size_t len);
+    void        (*MatchInts)(byte *dst, const int *src, int count, int value);
+} bitops_t;
+
+extern bitops_t     bitops;
+
+// dst |= src
+#define Bits_Or(dst, src, len)      bitops.Or(dst, src, len)
+// dst &= src
+#define Bits_And(dst, src, len)     bitops.And(dst, src, len)
+// returns number of bits set
+#define Bits_Count(src, len)        bitops.Count(src, len)
+// sets bit i of dst if src[i] == value, clears it otherwise,
+// writes (count + 7) / 8 bytes
+#define Bits_MatchInts(dst, src, count, value) \
+    bitops.MatchInts(dst, src, count, value)
+
+void Bits_Init(void);
+
+// returns implementations supported by this CPU, for testing
+const bitops_t *Bits_GetImpl(int index);
+
+#endif // BITS_H
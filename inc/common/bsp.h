@@ -129,6 +129,8 @@ typedef struct mnode_s {
     int                 numfaces;
     mface_t             *firstface;
 #endif
+
+    struct cnode_s      *cnode;     // collision node
 } mnode_t;
 
 typedef struct {
@@ -140,7 +142,6 @@ typedef struct {
     int                 contents;
     int                 numsides;
     mbrushside_t        *firstbrushside;
-    int                 checkcount;        // to avoid repeated testings
 } mbrush_t;
 
 typedef struct {
@@ -164,8 +165,53 @@ typedef struct {
     mface_t         **firstleafface;
     int             numleaffaces;
 #endif
+
+    struct cnode_s  *cnode;     // collision node
 } mleaf_t;
 
+//
+// compact collision representation used by trace code, built at load time
+//
+
+typedef struct {
+    cplane_t            plane;      // signbits select box corner to test
+    csurface_t          *surface;
+} cbrushside_t;
+
+typedef struct {
+    vec3_t              mins, maxs; // from axial sides, for early rejection
+    int                 contents;
+    int                 numsides;
+    cbrushside_t        *firstside;
+    int                 checkcount; // to avoid repeated testings
+} cbrush_t;
+
+#define CNODE_LEAF  -1
+
+// nodes and leafs of each model are stored in the same array in depth first
+// order, children are referenced by offset relative to their parent
+typedef struct cnode_s {
+    union {
+        struct {
+            vec3_t      normal;
+            float       dist;
+        };
+        struct {
+            int         contents;   // leafs only
+            int         numbrushes;
+            cbrush_t    **firstbrush;
+        };
+    };
+    int                 type;       // plane type, or CNODE_LEAF
+    int                 signbits;
+    int                 children[2];
+} cnode_t;
+
+static inline cnode_t *BSP_CollisionNode(mnode_t *node)
+{
+    return node->plane ? node->cnode : ((mleaf_t *)node)->cnode;
+}
+
 typedef struct {
     unsigned    portalnum;
     unsigned    otherarea;
@@ -229,10 +275,22 @@ typedef struct bsp_s {
     int             numbrushes;
     mbrush_t        *brushes;
 
+    int             numcnodes;
+    cnode_t         *cnodes;
+    cbrush_t        *cbrushes;
+    cbrushside_t    *cbrushsides;
+    cbrush_t        **cleafbrushes;
+
     int             numvisibility;
     int             visrowsize;
     dvis_t          *vis;
 
+    // fully decompressed PVS and PHS rows, if within memory budget
+    byte            *vismatrix;
+    size_t          visstride;
+    unsigned        vislookups;     // statistics only, updated atomically
+    unsigned        visdecompressed;
+
     int             numentitychars;
     char            *entitystring;
 
@@ -284,6 +342,10 @@ void BSP_TransformedLightPoint(lightpoint_t *point, vec3_t start, vec3_t end,
 #endif
 
 byte *BSP_ClusterVis(bsp_t *bsp, byte *mask, int cluster, int vis);
+const byte *BSP_GetClusterVis(bsp_t *bsp, byte *mask, int cluster, int vis);
+
+#define BSP_VisRow(bsp, cluster, vis) \
+    ((bsp)->vismatrix + ((cluster) * 2 + (vis)) * (bsp)->visstride)
 mleaf_t *BSP_PointLeaf(mnode_t *node, vec3_t p);
 mmodel_t *BSP_InlineModel(bsp_t *bsp, const char *name);
 
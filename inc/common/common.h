@@ -84,6 +84,17 @@ void        Com_EndRedirect(void);
 
 void        Com_AbortFunc(void (*func)(void *), void *arg);
 
+// error caught on a worker thread, to be raised by main thread
+typedef struct {
+    qboolean        failed;
+    error_type_t    code;
+    char            msg[MAXERRORMSG];
+} deferred_error_t;
+
+void        Com_DeferErrors(void (*func)(void *, int), void *arg, int index,
+                            deferred_error_t *err);
+void        Com_RaiseDeferred(const deferred_error_t *err);
+
 #ifdef _WIN32
 void        Com_AbortFrame(void);
 #endif
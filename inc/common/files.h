@@ -69,11 +69,13 @@ typedef struct file_info_s {
 #define FS_SEARCH_DIRSONLY      0x00001000
 #define FS_SEARCH_MASK          0x00001f00
 
-// bits 8 - 11, flag
+// bits 8 - 12, flag
 #define FS_FLAG_GZIP            0x00000100
 #define FS_FLAG_EXCL            0x00000200
 #define FS_FLAG_TEXT            0x00000400
 #define FS_FLAG_DEFLATE         0x00000800
+#define FS_FLAG_MMAP            0x00001000  // FS_LoadFileEx may return read-only
+                                            // view that is not NUL terminated
 
 //
 // Limit the maximum file size FS_LoadFile can handle, as a protection from
@@ -89,7 +91,6 @@ typedef struct file_info_s {
 #define FS_Mallocz(size)        Z_TagMallocz(size, TAG_FILESYSTEM)
 #define FS_CopyString(string)   Z_TagCopyString(string, TAG_FILESYSTEM)
 #define FS_LoadFile(path, buf)  FS_LoadFileEx(path, buf, 0, TAG_FILESYSTEM)
-#define FS_FreeFile(buf)        Z_Free(buf)
 
 // just regular malloc for now
 #define FS_AllocTempMem(size)   FS_Malloc(size)
@@ -134,6 +135,7 @@ qerror_t FS_FilterFile(qhandle_t f);
     FS_FileExistsEx(path, 0)
 
 ssize_t FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag);
+void    FS_FreeFile(void *buf);
 // a NULL buffer will just return the file length without loading
 // length < 0 indicates error
 
@@ -156,6 +158,7 @@ ssize_t FS_Tell(qhandle_t f);
 qerror_t FS_Seek(qhandle_t f, off_t offset);
 
 ssize_t  FS_Length(qhandle_t f);
+qerror_t FS_ModTime(qhandle_t f, time_t *mtime);
 
 qboolean FS_WildCmp(const char *filter, const char *string);
 qboolean FS_ExtCmp(const char *extension, const char *string);
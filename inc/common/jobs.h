@@ -0,0 +1,55 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef JOBS_H
+#define JOBS_H
+
+//
+// background job scheduler with a pool of worker threads
+//
+
+// counts jobs that are queued or running, zero initialize before use
+typedef struct {
+    int         pending;
+} jobgroup_t;
+
+typedef struct {
+    const char  *name;              // for statistics, must be static string
+    void        (*work_cb)(void *); // called on worker thread
+    void        (*done_cb)(void *); // called on main thread, optional
+    void        *cb_arg;
+    jobgroup_t  *group;             // optional
+} job_t;
+
+void    Job_Init(void);
+void    Job_Shutdown(void);
+
+// job structure is copied, may be called from any thread
+void    Job_Queue(const job_t *job);
+
+// runs queued jobs on the calling thread until work callbacks of all jobs in
+// the group have finished (or all jobs, if group is NULL). done callbacks
+// are not run, unless main thread runs out of records to queue them.
+void    Job_Wait(jobgroup_t *group);
+
+// runs done callbacks of finished jobs, called from main loop once per frame
+void    Job_Complete(void);
+
+// prints from other threads are buffered and flushed from Job_Complete
+qboolean    Job_IsMainThread(void);
+void        Job_Print(print_type_t type, const char *fmt, va_list argptr);
+
+#endif // JOBS_H
@@ -77,7 +77,9 @@ typedef enum {
     MSG_ES_REMOVE       = (1 << 7)
 } msgEsFlags_t;
 
-extern sizebuf_t    msg_write;
+// writing buffer is per thread, server worker threads
+// point it to their own storage before encoding frames
+extern q_threadlocal sizebuf_t  msg_write;
 extern byte         msg_write_buffer[MAX_MSGLEN];
 
 extern sizebuf_t    msg_read;
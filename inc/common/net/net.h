@@ -59,6 +59,14 @@ typedef struct {
     qboolean wantread: 1;
     qboolean wantwrite: 1;
     qboolean wantexcept: 1;
+#if USE_EPOLL
+    qboolean dirty: 1;      // want flags need to be synced with epoll set
+    qboolean polled: 1;     // registered in epoll set
+    qboolean nopoll: 1;     // can't be polled, always ready (regular file)
+    qboolean pollread: 1;
+    qboolean pollwrite: 1;
+    qboolean pollexcept: 1;
+#endif
 } ioentry_t;
 
 typedef enum {
@@ -238,6 +246,13 @@ qboolean    NET_GetAddress(netsrc_t sock, netadr_t *adr);
 void        NET_GetPackets(netsrc_t sock, void (*packet_cb)(void));
 qboolean    NET_SendPacket(netsrc_t sock, const void *data,
                            size_t len, const netadr_t *to);
+#if USE_MMSG
+void        NET_BatchPackets(netsrc_t sock);
+void        NET_FlushPackets(netsrc_t sock);
+#else
+#define     NET_BatchPackets(sock)      (void)0
+#define     NET_FlushPackets(sock)      (void)0
+#endif
 
 char        *NET_AdrToString(const netadr_t *a);
 qboolean    NET_StringToAdr(const char *s, netadr_t *a, int default_port);
@@ -0,0 +1,36 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef HQ2X_H
+#define HQ2X_H
+
+//
+// HQ2x/HQ4x pixel art upscaling filters, output is 2x/4x the input size
+//
+
+void HQ2x_Init(void);
+
+// large images are split into row bands rendered by worker threads
+void HQ2x_Render(uint32_t *output, const uint32_t *input, int width, int height);
+void HQ4x_Render(uint32_t *output, const uint32_t *input, int width, int height);
+
+#if USE_TESTS
+// single threaded versions comparing pixels one at a time
+void HQ2x_RenderRef(uint32_t *output, const uint32_t *input, int width, int height);
+void HQ4x_RenderRef(uint32_t *output, const uint32_t *input, int width, int height);
+#endif
+
+#endif // HQ2X_H
@@ -0,0 +1,56 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#ifndef PIXELS_H
+#define PIXELS_H
+
+//
+// RGBA image processing kernels used for texture uploads,
+// implementation is selected at runtime depending on CPU features
+//
+
+#define MAX_RESAMPLE_WIDTH  4096
+
+typedef struct {
+    const char  *name;
+    void        (*Resample)(const byte *in, int inwidth, int inheight,
+                            byte *out, int outwidth, int outheight);
+    void        (*MipMap)(byte *out, byte *in, int width, int height);
+    void        (*LightScale)(byte *data, int count, const byte *table);
+    void        (*GrayScale)(byte *data, int count, float colorscale);
+} pixelops_t;
+
+extern pixelops_t   pixelops;
+
+// bilinear resample, outwidth must not exceed MAX_RESAMPLE_WIDTH
+#define Pixels_Resample(in, inwidth, inheight, out, outwidth, outheight) \
+    pixelops.Resample(in, inwidth, inheight, out, outwidth, outheight)
+// 2x2 box filter, out may be equal to in
+#define Pixels_MipMap(out, in, width, height) \
+    pixelops.MipMap(out, in, width, height)
+// maps RGB components through table, alpha is preserved
+#define Pixels_LightScale(data, count, table) \
+    pixelops.LightScale(data, count, table)
+// moves RGB components towards luminance, alpha is preserved
+#define Pixels_GrayScale(data, count, colorscale) \
+    pixelops.GrayScale(data, count, colorscale)
+
+void Pixels_Init(void);
+
+// returns implementations supported by this CPU, for testing
+const pixelops_t *Pixels_GetImpl(int index);
+
+#endif // PIXELS_H
@@ -197,6 +197,12 @@ qhandle_t R_RegisterImage(const char *name, imagetype_t type,
 void    R_SetSky(const char *name, float rotate, vec3_t axis);
 void    R_EndRegistration(void);
 
+#if USE_TESTS
+// expands 8-bit PCX to RGBA using palette from the same file,
+// returned pixels are freed with Z_Free
+uint32_t *R_DecodePCX(byte *rawdata, size_t rawlen, int *width, int *height);
+#endif
+
 #define R_RegisterPic(name)     R_RegisterImage(name, IT_PIC, IF_PERMANENT, NULL)
 #define R_RegisterPic2(name)    R_RegisterImage(name, IT_PIC, IF_NONE, NULL)
 #define R_RegisterFont(name)    R_RegisterImage(name, IT_FONT, IF_PERMANENT, NULL)
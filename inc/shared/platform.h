@@ -127,6 +127,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define q_unused            __attribute__((unused))
 
+#define q_threadlocal       __thread
+
 #else /* __GNUC__ */
 
 #define q_printf(f, a)
@@ -149,4 +151,6 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define q_unused
 
+#define q_threadlocal       __declspec(thread)
+
 #endif /* !__GNUC__ */
@@ -35,6 +35,7 @@ void    Sys_FreeLibrary(void *handle);
 void    *Sys_GetProcAddress(void *handle, const char *sym);
 
 unsigned    Sys_Milliseconds(void);
+unsigned    Sys_Microseconds(void);
 void    Sys_Sleep(int msec);
 
 void    Sys_Init(void);
@@ -61,20 +62,40 @@ void    Sys_ListFiles_r(listfiles_t *list, const char *path, int depth);
 
 void    Sys_DebugBreak(void);
 
+// maps entire file read-only into memory, returns NULL on failure
+void    *Sys_MapFile(FILE *fp, size_t size);
+void    Sys_UnmapFile(void *base, size_t size);
+
 #if USE_AC_CLIENT
 qboolean Sys_GetAntiCheatAPI(void);
 #endif
 
-#if USE_CLIENT
-typedef struct asyncwork_s {
-    void (*work_cb)(void *);
-    void (*done_cb)(void *);
-    void *cb_arg;
-    struct asyncwork_s *next;
-} asyncwork_t;
+#define MAX_WORKER_THREADS  32
 
-void Sys_QueueAsyncWork(asyncwork_t *work);
-#endif
+// runs func(arg, 0) to func(arg, numthreads - 1) concurrently and waits for
+// all of them to finish. calling thread runs index 0.
+void Sys_RunThreads(int numthreads, void (*func)(void *, int), void *arg);
+
+typedef struct systhread_s   systhread_t;
+typedef struct sysmutex_s    sysmutex_t;
+typedef struct syssem_s      syssem_t;
+
+// returns NULL if thread couldn't be created
+systhread_t *Sys_CreateThread(void (*func)(void *), void *arg);
+void    Sys_JoinThread(systhread_t *thread);
+
+sysmutex_t *Sys_CreateMutex(void);
+void    Sys_DestroyMutex(sysmutex_t *mutex);
+void    Sys_LockMutex(sysmutex_t *mutex);
+void    Sys_UnlockMutex(sysmutex_t *mutex);
+
+// counting semaphore, initially zero
+syssem_t *Sys_CreateSemaphore(void);
+void    Sys_DestroySemaphore(syssem_t *sem);
+void    Sys_PostSemaphore(syssem_t *sem, int count);
+void    Sys_WaitSemaphore(syssem_t *sem);
+
+int     Sys_NumProcessors(void);
 
 extern cvar_t   *sys_basedir;
 extern cvar_t   *sys_libdir;
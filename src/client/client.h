@@ -97,6 +97,18 @@ typedef struct {
     unsigned    cmdNumber;    // current cmdNumber for this frame
 } client_history_t;
 
+// grid of solid entities used for prediction, covers the entire
+// map in XY plane with cells of 256x256 units
+#define SOLID_GRID_SIZE     32
+#define SOLID_GRID_SHIFT    8
+#define SOLID_GRID_WORDS    (MAX_PACKET_ENTITIES / 32)
+
+typedef struct {
+    usercmd_t       cmd;    // command this state was predicted with
+    pmove_state_t   s;
+    vec3_t          viewangles;
+} client_predict_t;
+
 typedef struct {
     qboolean        valid;
 
@@ -167,10 +179,24 @@ typedef struct client_state_s {
     vec3_t      predicted_velocity;
     vec3_t      prediction_error;
 
+    // pmove results for unacknowledged cmds, reused until the base state changes
+    client_predict_t    predicted_states[CMD_BACKUP];
+    pmove_state_t       predicted_base;
+    int                 predicted_frame;    // server frame number of base state
+    unsigned            predicted_ack;      // last cmd included in base state
+    unsigned            predicted_count;    // number of cached cmds after ack
+    int                 predicted_pmoves;   // pmoves run in the last frame
+
     // rebuilt each valid frame
     centity_t       *solidEntities[MAX_PACKET_ENTITIES];
     int             numSolidEntities;
 
+    // absolute bounds of solid entities and a coarse grid of them,
+    // each cell is a bitmask of indices into solidEntities
+    vec3_t          solidMins[MAX_PACKET_ENTITIES];
+    vec3_t          solidMaxs[MAX_PACKET_ENTITIES];
+    uint32_t        solidGrid[SOLID_GRID_SIZE][SOLID_GRID_SIZE][SOLID_GRID_WORDS];
+
     entity_state_t  baselines[MAX_EDICTS];
 
     entity_state_t  entityStates[MAX_PARSE_ENTITIES];
@@ -729,6 +755,7 @@ void CL_InitTEnts(void);
 void CL_PredictAngles(void);
 void CL_PredictMovement(void);
 void CL_CheckPredictionError(void);
+void CL_LinkSolidEntities(void);
 
 
 //
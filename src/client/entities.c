@@ -390,6 +390,9 @@ void CL_DeltaFrame(void)
         entity_event(state->number);
     }
 
+    // sort solid entities for prediction
+    CL_LinkSolidEntities();
+
     if (cls.demo.recording && !cls.demo.paused && !cls.demo.seeking && CL_FRAMESYNC) {
         CL_EmitDemoFrame();
     }
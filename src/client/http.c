@@ -752,6 +752,7 @@ static qboolean finish_download(void)
     qboolean    fatal_error = qfalse;
     const char  *err;
     print_type_t level;
+    qerror_t    ret;
 
     do {
         msg = curl_multi_info_read(curl_multi, &msgs_in_queue);
@@ -862,12 +863,14 @@ fail2:
                    cls.download.pending == 1 ? "" : "s");
 
         if (dl->path[0]) {
-            //rename the temp file
-            Q_snprintf(temp, sizeof(temp), "%s/%s", fs_gamedir, dl->queue->path);
+            //rename the temp file, through the filesystem so that it
+            //becomes visible to lookups immediately
+            Q_snprintf(temp, sizeof(temp), "%s.tmp", dl->queue->path);
 
-            if (rename(dl->path, temp))
+            ret = FS_RenameFile(temp, dl->queue->path);
+            if (ret)
                 Com_EPrintf("[HTTP] Failed to rename '%s' to '%s': %s\n",
-                            dl->path, dl->queue->path, strerror(errno));
+                            dl->path, dl->queue->path, Q_ErrorString(ret));
             dl->path[0] = 0;
 
             //a pak file is very special...
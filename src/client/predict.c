@@ -71,6 +71,106 @@ void CL_CheckPredictionError(void)
     VectorScale(delta, 0.125f, cl.prediction_error);
 }
 
+static inline int CL_GridCell(vec_t v)
+{
+    v = (v + 4096) * (1.0f / (1 << SOLID_GRID_SHIFT));
+    if (!(v > 0))
+        return 0;
+    if (v >= SOLID_GRID_SIZE)
+        return SOLID_GRID_SIZE - 1;
+    return (int)v;
+}
+
+/*
+====================
+CL_LinkSolidEntities
+
+Calculates absolute bounds of solid entities and sorts them into grid cells,
+so that traces only need to clip against entities near the move.
+Called once per frame after solid entities have been updated.
+====================
+*/
+void CL_LinkSolidEntities(void)
+{
+    int         i, j, x, y, x1, y1, x2, y2;
+    centity_t   *ent;
+    mmodel_t    *cmodel;
+    vec_t       *mins, *maxs, radius;
+
+    memset(cl.solidGrid, 0, sizeof(cl.solidGrid));
+
+    for (i = 0; i < cl.numSolidEntities; i++) {
+        ent = cl.solidEntities[i];
+        mins = cl.solidMins[i];
+        maxs = cl.solidMaxs[i];
+
+        if (ent->current.solid == PACKED_BSP) {
+            // special value for bmodel
+            cmodel = cl.model_clip[ent->current.modelindex];
+            if (!cmodel) {
+                ClearBounds(mins, maxs);
+                continue;
+            }
+            if (ent->current.angles[0] || ent->current.angles[1] || ent->current.angles[2]) {
+                // expand for rotation
+                radius = RadiusFromBounds(cmodel->mins, cmodel->maxs);
+                for (j = 0; j < 3; j++) {
+                    mins[j] = ent->current.origin[j] - radius;
+                    maxs[j] = ent->current.origin[j] + radius;
+                }
+            } else {
+                VectorAdd(ent->current.origin, cmodel->mins, mins);
+                VectorAdd(ent->current.origin, cmodel->maxs, maxs);
+            }
+        } else {
+            VectorAdd(ent->current.origin, ent->mins, mins);
+            VectorAdd(ent->current.origin, ent->maxs, maxs);
+        }
+
+        // expand a bit to account for epsilons
+        for (j = 0; j < 3; j++) {
+            mins[j] -= 1;
+            maxs[j] += 1;
+        }
+
+        x1 = CL_GridCell(mins[0]);
+        y1 = CL_GridCell(mins[1]);
+        x2 = CL_GridCell(maxs[0]);
+        y2 = CL_GridCell(maxs[1]);
+
+        for (x = x1; x <= x2; x++)
+            for (y = y1; y <= y2; y++)
+                cl.solidGrid[x][y][i >> 5] |= 1U << (i & 31);
+    }
+}
+
+// sets bits of solid entities whose bounds touch the box
+static void CL_SolidEntitiesInBox(const vec3_t mins, const vec3_t maxs, uint32_t *mask)
+{
+    int     i, j, x, y, x1, y1, x2, y2;
+
+    x1 = CL_GridCell(mins[0]);
+    y1 = CL_GridCell(mins[1]);
+    x2 = CL_GridCell(maxs[0]);
+    y2 = CL_GridCell(maxs[1]);
+
+    memset(mask, 0, sizeof(mask[0]) * SOLID_GRID_WORDS);
+    for (x = x1; x <= x2; x++)
+        for (y = y1; y <= y2; y++)
+            for (i = 0; i < SOLID_GRID_WORDS; i++)
+                mask[i] |= cl.solidGrid[x][y][i];
+
+    for (i = 0; i < cl.numSolidEntities; i++) {
+        if (!(mask[i >> 5] & (1U << (i & 31))))
+            continue;
+        for (j = 0; j < 3; j++)
+            if (mins[j] > cl.solidMaxs[i][j] || maxs[j] < cl.solidMins[i][j])
+                break;
+        if (j < 3)
+            mask[i >> 5] &= ~(1U << (i & 31));
+    }
+}
+
 /*
 ====================
 CL_ClipMoveToEntities
@@ -84,8 +184,26 @@ static void CL_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
     mnode_t     *headnode;
     centity_t   *ent;
     mmodel_t    *cmodel;
+    vec3_t      boxmins, boxmaxs;
+    uint32_t    mask[SOLID_GRID_WORDS];
+
+    // only clip against entities touching the move
+    for (i = 0; i < 3; i++) {
+        if (end[i] > start[i]) {
+            boxmins[i] = start[i] + mins[i];
+            boxmaxs[i] = end[i] + maxs[i];
+        } else {
+            boxmins[i] = end[i] + mins[i];
+            boxmaxs[i] = start[i] + maxs[i];
+        }
+    }
+
+    CL_SolidEntitiesInBox(boxmins, boxmaxs, mask);
 
     for (i = 0; i < cl.numSolidEntities; i++) {
+        if (!(mask[i >> 5] & (1U << (i & 31))))
+            continue;
+
         ent = cl.solidEntities[i];
 
         if (ent->current.solid == PACKED_BSP) {
@@ -136,10 +254,16 @@ static int CL_PointContents(vec3_t point)
     centity_t   *ent;
     mmodel_t    *cmodel;
     int         contents;
+    uint32_t    mask[SOLID_GRID_WORDS];
 
     contents = CM_PointContents(point, cl.bsp->nodes);
 
+    CL_SolidEntitiesInBox(point, point, mask);
+
     for (i = 0; i < cl.numSolidEntities; i++) {
+        if (!(mask[i >> 5] & (1U << (i & 31))))
+            continue;
+
         ent = cl.solidEntities[i];
 
         if (ent->current.solid != PACKED_BSP) // special value for bmodel
@@ -172,12 +296,28 @@ void CL_PredictAngles(void)
     cl.predicted_angles[2] = cl.viewangles[2] + SHORT2ANGLE(cl.frame.ps.pmove.delta_angles[2]);
 }
 
+static qboolean CL_SameBaseState(const pmove_state_t *a, const pmove_state_t *b)
+{
+    return a->pm_type == b->pm_type
+        && VectorCompare(a->origin, b->origin)
+        && VectorCompare(a->velocity, b->velocity)
+        && a->pm_flags == b->pm_flags
+        && a->pm_time == b->pm_time
+        && a->gravity == b->gravity
+        && VectorCompare(a->delta_angles, b->delta_angles);
+}
+
 void CL_PredictMovement(void)
 {
-    unsigned    ack, current, frame;
+    unsigned    ack, current, frame, count;
     pmove_t     pm;
+    pmove_state_t   base;
+    client_predict_t    *p;
+    usercmd_t   *cmd;
     int         step, oldz;
 
+    cl.predicted_pmoves = 0;
+
     if (cls.state != ca_active) {
         return;
     }
@@ -213,20 +353,45 @@ void CL_PredictMovement(void)
     X86_PUSH_FPCW;
     X86_SINGLE_FPCW;
 
+    base = cl.frame.ps.pmove;
+#if USE_SMOOTH_DELTA_ANGLES
+    VectorCopy(cl.delta_angles, base.delta_angles);
+#endif
+
+    // cached results are only valid for the same base state and server frame,
+    // since solid entities the player clips against are rebuilt on each frame
+    if (cl.predicted_frame != cl.frame.number || cl.predicted_ack != ack ||
+        !CL_SameBaseState(&cl.predicted_base, &base)) {
+        cl.predicted_base = base;
+        cl.predicted_frame = cl.frame.number;
+        cl.predicted_ack = ack;
+        cl.predicted_count = 0;
+    }
+
     // copy current state to pmove
     memset(&pm, 0, sizeof(pm));
     pm.trace = CL_Trace;
     pm.pointcontents = CL_PointContents;
+    pm.s = base;
 
-    pm.s = cl.frame.ps.pmove;
-#if USE_SMOOTH_DELTA_ANGLES
-    VectorCopy(cl.delta_angles, pm.s.delta_angles);
-#endif
+    // run frames, starting from the first one not cached
+    for (count = 0; ++ack <= current; count++) {
+        p = &cl.predicted_states[ack & CMD_MASK];
+        cmd = &cl.cmds[ack & CMD_MASK];
 
-    // run frames
-    while (++ack <= current) {
-        pm.cmd = cl.cmds[ack & CMD_MASK];
-        Pmove(&pm, &cl.pmp);
+        if (count < cl.predicted_count && !memcmp(&p->cmd, cmd, sizeof(*cmd))) {
+            pm.s = p->s;
+            VectorCopy(p->viewangles, pm.viewangles);
+        } else {
+            pm.cmd = *cmd;
+            Pmove(&pm, &cl.pmp);
+            cl.predicted_pmoves++;
+
+            p->cmd = *cmd;
+            p->s = pm.s;
+            VectorCopy(pm.viewangles, p->viewangles);
+            cl.predicted_count = count + 1;
+        }
 
         // save for debug checking
         VectorCopy(pm.s.origin, cl.predicted_origins[ack & CMD_MASK]);
@@ -239,6 +404,7 @@ void CL_PredictMovement(void)
         pm.cmd.sidemove = cl.localmove[1];
         pm.cmd.upmove = cl.localmove[2];
         Pmove(&pm, &cl.pmp);
+        cl.predicted_pmoves++;
         frame = current;
 
         // save for debug checking
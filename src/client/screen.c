@@ -504,6 +504,14 @@ static void SCR_DrawNet(void)
             R_DrawFill8(x, y, LAG_WIDTH, LAG_HEIGHT, 4);
         }
         SCR_LagDraw(x, y);
+
+        // draw number of pmoves run for prediction
+        if (scr_lag_draw->integer > 2) {
+            char buffer[16];
+
+            Q_scnprintf(buffer, sizeof(buffer), "%d", cl.predicted_pmoves);
+            SCR_DrawString(x + 1, y + 1, UI_ALTCOLOR, buffer);
+        }
     }
 
     // draw phone jack
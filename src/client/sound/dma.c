@@ -18,18 +18,71 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // snd_dma.c -- main control for any streaming sound output device
 
 #include "sound.h"
+#include "system/system.h"
+
+#define MAX_MIX_CMDS    1024    // must be power of two
+#define MIXER_SLEEP     5       // msec between mixer thread updates
+
+#define load_acquire(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define store_release(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+typedef enum {
+    MIX_START,
+    MIX_STOP,
+    MIX_VOLUME,
+    MIX_STOPALL,
+    MIX_PARAMS
+} mixcmdtype_t;
+
+typedef struct {
+    mixcmdtype_t    type;
+    int             index;
+    mixchannel_t    chan;       // for MIX_START and MIX_VOLUME
+    mixparams_t     params;     // for MIX_PARAMS
+} mixcmd_t;
+
+// The main thread still picks and spatializes channels and issues
+// playsounds, then sends the differences to the mixer thread. Commands go
+// through a single producer, single consumer ring. The lock is only held
+// by the mixer thread while painting, and by the main thread for calls
+// into the DMA driver.
+static struct {
+    systhread_t     *thread;
+    sysmutex_t      *lock;
+    int             terminate;
+    int             paintedtime;    // published by mixer thread
+
+    mixcmd_t        cmds[MAX_MIX_CMDS];
+    unsigned        head;           // written by main thread
+    unsigned        tail;           // written by mixer thread
+
+    // owned by mixer thread
+    mixchannel_t    chans[MAX_CHANNELS];
+    mixparams_t     params;
+    int             time;
+
+    // owned by main thread, last state sent to mixer thread
+    mixchannel_t    sent[MAX_CHANNELS];
+    mixparams_t     sentparams;
+} mixer;
 
 dma_t       dma;
 
 cvar_t      *s_khz;
 cvar_t      *s_testsound;
+cvar_t      *s_simd;
 #if USE_DSOUND
 static cvar_t       *s_direct;
 #endif
 static cvar_t       *s_mixahead;
+static cvar_t       *s_mixthread;
 
 static snddmaAPI_t snddma;
 
+static void DMA_StartMixer(void);
+static void DMA_StopMixer(void);
+static void DMA_PushCommand(const mixcmd_t *cmd);
+
 void DMA_SoundInfo(void)
 {
     Com_Printf("%5d channels\n", dma.channels);
@@ -48,6 +101,10 @@ qboolean DMA_Init(void)
     s_khz = Cvar_Get("s_khz", "22", CVAR_ARCHIVE | CVAR_SOUND);
     s_mixahead = Cvar_Get("s_mixahead", "0.2", CVAR_ARCHIVE);
     s_testsound = Cvar_Get("s_testsound", "0", 0);
+    s_simd = Cvar_Get("s_simd", "1", 0);
+    s_mixthread = Cvar_Get("s_mixthread", "0", CVAR_ARCHIVE | CVAR_SOUND);
+
+    Mixer_Init();
 
 #if USE_DSOUND
     s_direct = Cvar_Get("s_direct", "1", CVAR_SOUND);
@@ -73,11 +130,15 @@ qboolean DMA_Init(void)
 
     Com_Printf("sound sampling rate: %i\n", dma.speed);
 
+    if (s_mixthread->integer)
+        DMA_StartMixer();
+
     return qtrue;
 }
 
 void DMA_Shutdown(void)
 {
+    DMA_StopMixer();
     snddma.Shutdown();
     s_numchannels = 0;
 }
@@ -86,7 +147,11 @@ void DMA_Activate(void)
 {
     if (snddma.Activate) {
         S_StopAllSounds();
+        if (mixer.thread)
+            Sys_LockMutex(mixer.lock);
         snddma.Activate(s_active);
+        if (mixer.thread)
+            Sys_UnlockMutex(mixer.lock);
     }
 }
 
@@ -112,7 +177,17 @@ int DMA_DriftBeginofs(float timeofs)
 
 void DMA_ClearBuffer(void)
 {
-    int     clear;
+    mixcmd_t    cmd;
+    int         clear;
+
+    if (mixer.thread) {
+        // channels may reference sounds that are about to be freed.
+        // mixer thread reads this before painting again.
+        cmd.type = MIX_STOPALL;
+        DMA_PushCommand(&cmd);
+        memset(mixer.sent, 0, sizeof(mixer.sent));
+        Sys_LockMutex(mixer.lock);
+    }
 
     if (dma.samplebits == 8)
         clear = 0x80;
@@ -123,9 +198,12 @@ void DMA_ClearBuffer(void)
     if (dma.buffer)
         memset(dma.buffer, clear, dma.samples * dma.samplebits / 8);
     snddma.Submit();
+
+    if (mixer.thread)
+        Sys_UnlockMutex(mixer.lock);
 }
 
-static int DMA_GetTime(void)
+static int DMA_GetTime(int *painted)
 {
     static  int     buffers;
     static  int     oldsamplepos;
@@ -135,11 +213,14 @@ static int DMA_GetTime(void)
 // calls to S_Update.  Oh well.
     if (dma.samplepos < oldsamplepos) {
         buffers++;                  // buffer wrapped
-        if (paintedtime > 0x40000000) {
+        if (*painted > 0x40000000) {
             // time to chop things off to avoid 32 bit limits
             buffers = 0;
-            paintedtime = fullsamples;
-            S_StopAllSounds();
+            *painted = fullsamples;
+            if (mixer.thread)
+                memset(mixer.chans, 0, sizeof(mixer.chans));
+            else
+                S_StopAllSounds();
         }
     }
     oldsamplepos = dma.samplepos;
@@ -147,27 +228,22 @@ static int DMA_GetTime(void)
     return buffers * fullsamples + dma.samplepos / dma.channels;
 }
 
-void DMA_Update(void)
+static int DMA_GetEndTime(int *painted, float mixahead)
 {
     int soundtime, endtime;
     int samps;
 
-    snddma.BeginPainting();
-
-    if (!dma.buffer)
-        return;
-
 // Updates DMA time
-    soundtime = DMA_GetTime();
+    soundtime = DMA_GetTime(painted);
 
 // check to make sure that we haven't overshot
-    if (paintedtime < soundtime) {
+    if (*painted < soundtime) {
         Com_DPrintf("S_Update_ : overflow\n");
-        paintedtime = soundtime;
+        *painted = soundtime;
     }
 
 // mix ahead of current position
-    endtime = soundtime + Cvar_ClampValue(s_mixahead, 0, 1) * dma.speed;
+    endtime = soundtime + mixahead * dma.speed;
 
     // mix to an even submission block size
     endtime = ALIGN(endtime, dma.submission_chunk);
@@ -175,6 +251,238 @@ void DMA_Update(void)
     if (endtime - soundtime > samps)
         endtime = soundtime + samps;
 
+    return endtime;
+}
+
+/*
+===============================================================================
+
+MIXER THREAD
+
+===============================================================================
+*/
+
+static void DMA_PushCommand(const mixcmd_t *cmd)
+{
+    unsigned head = mixer.head;
+
+    // wait for mixer thread to make room, shouldn't normally happen
+    while (head - load_acquire(&mixer.tail) >= MAX_MIX_CMDS)
+        Sys_Sleep(1);
+
+    mixer.cmds[head & (MAX_MIX_CMDS - 1)] = *cmd;
+    store_release(&mixer.head, head + 1);
+}
+
+static void DMA_StartChannel(mixchannel_t *ch, const mixchannel_t *src)
+{
+    *ch = *src;
+
+    if (ch->autosound) {
+        // position follows global time, so moving between channels is seamless
+        ch->pos = mixer.time % ch->sc->length;
+        ch->begin = mixer.time;
+        ch->end = mixer.time + ch->sc->length - ch->pos;
+    } else {
+        // may start a few samples late
+        if (ch->begin < mixer.time)
+            ch->begin = mixer.time;
+        ch->pos = 0;
+        ch->end = ch->begin + ch->sc->length;
+    }
+}
+
+static void DMA_ReadCommands(void)
+{
+    unsigned tail = mixer.tail;
+    unsigned head = load_acquire(&mixer.head);
+    const mixcmd_t *cmd;
+    mixchannel_t *ch;
+
+    for (; tail != head; tail++) {
+        cmd = &mixer.cmds[tail & (MAX_MIX_CMDS - 1)];
+        ch = &mixer.chans[cmd->index];
+
+        switch (cmd->type) {
+        case MIX_START:
+            DMA_StartChannel(ch, &cmd->chan);
+            break;
+        case MIX_STOP:
+            ch->sc = NULL;
+            break;
+        case MIX_VOLUME:
+            ch->leftvol = cmd->chan.leftvol;
+            ch->rightvol = cmd->chan.rightvol;
+            break;
+        case MIX_STOPALL:
+            memset(mixer.chans, 0, sizeof(mixer.chans));
+            break;
+        case MIX_PARAMS:
+            mixer.params = cmd->params;
+            break;
+        }
+    }
+
+    store_release(&mixer.tail, tail);
+}
+
+static void DMA_MixerThread(void *arg)
+{
+    int endtime;
+
+    while (!load_acquire(&mixer.terminate)) {
+        Sys_LockMutex(mixer.lock);
+
+        DMA_ReadCommands();
+
+        snddma.BeginPainting();
+        if (dma.buffer) {
+            endtime = DMA_GetEndTime(&mixer.time, mixer.params.mixahead);
+            S_PaintMixChannels(mixer.chans, &mixer.params, &mixer.time, endtime);
+            snddma.Submit();
+        }
+
+        store_release(&mixer.paintedtime, mixer.time);
+
+        Sys_UnlockMutex(mixer.lock);
+
+        Sys_Sleep(MIXER_SLEEP);
+    }
+}
+
+static void DMA_GetParams(mixparams_t *params)
+{
+    S_GetMixParams(params);
+    params->mixahead = Cvar_ClampValue(s_mixahead, 0, 1);
+}
+
+static void DMA_StartMixer(void)
+{
+    memset(&mixer, 0, sizeof(mixer));
+    mixer.time = mixer.paintedtime = paintedtime;
+    DMA_GetParams(&mixer.params);
+    mixer.sentparams = mixer.params;
+
+    mixer.lock = Sys_CreateMutex();
+    mixer.thread = Sys_CreateThread(DMA_MixerThread, NULL);
+    if (!mixer.thread) {
+        Com_WPrintf("Couldn't create sound mixer thread\n");
+        Sys_DestroyMutex(mixer.lock);
+        mixer.lock = NULL;
+        return;
+    }
+
+    Com_Printf("Mixing sound on a separate thread\n");
+}
+
+static void DMA_StopMixer(void)
+{
+    if (!mixer.thread)
+        return;
+
+    store_release(&mixer.terminate, 1);
+    Sys_JoinThread(mixer.thread);
+    Sys_DestroyMutex(mixer.lock);
+    mixer.thread = NULL;
+    mixer.lock = NULL;
+}
+
+// sends channel changes made by the main thread since last frame
+static void DMA_SendCommands(void)
+{
+    mixparams_t     params;
+    mixchannel_t    *sent;
+    channel_t       *ch;
+    sfxcache_t      *sc;
+    mixcmd_t        cmd;
+    int             i;
+
+    DMA_GetParams(&params);
+    if (params.ops != mixer.sentparams.ops ||
+        params.volume != mixer.sentparams.volume ||
+        params.testsound != mixer.sentparams.testsound ||
+        params.mixahead != mixer.sentparams.mixahead) {
+        cmd.type = MIX_PARAMS;
+        cmd.params = params;
+        DMA_PushCommand(&cmd);
+        mixer.sentparams = params;
+    }
+
+    memset(&cmd, 0, sizeof(cmd));
+
+    for (i = 0, ch = channels; i < s_numchannels; i++, ch++) {
+        sent = &mixer.sent[i];
+        sc = ch->sfx ? ch->sfx->cache : NULL;
+        cmd.index = i;
+
+        if (!sc) {
+            if (sent->sc) {
+                cmd.type = MIX_STOP;
+                DMA_PushCommand(&cmd);
+                sent->sc = NULL;
+            }
+            continue;
+        }
+
+        if (sc != sent->sc || ch->begin != sent->begin || ch->autosound != sent->autosound) {
+            cmd.type = MIX_START;
+        } else if (ch->leftvol != sent->leftvol || ch->rightvol != sent->rightvol) {
+            cmd.type = MIX_VOLUME;
+        } else {
+            continue;
+        }
+
+        cmd.chan.sc = sc;
+        cmd.chan.leftvol = ch->leftvol;
+        cmd.chan.rightvol = ch->rightvol;
+        cmd.chan.begin = ch->begin;
+        cmd.chan.autosound = ch->autosound;
+        DMA_PushCommand(&cmd);
+        *sent = cmd.chan;
+    }
+}
+
+/*
+==================
+DMA_SyncMixer
+
+Updates paintedtime from the mixer thread. Returns qfalse if mixing
+is done on the main thread.
+==================
+*/
+qboolean DMA_SyncMixer(void)
+{
+    int time;
+
+    if (!mixer.thread)
+        return qfalse;
+
+    time = load_acquire(&mixer.paintedtime);
+    if (time < paintedtime) {
+        // mixer thread chopped time to avoid 32 bit limits
+        S_StopAllSounds();
+    }
+    paintedtime = time;
+
+    return qtrue;
+}
+
+void DMA_Update(void)
+{
+    int endtime;
+
+    if (mixer.thread) {
+        DMA_SendCommands();
+        return;
+    }
+
+    snddma.BeginPainting();
+
+    if (!dma.buffer)
+        return;
+
+    endtime = DMA_GetEndTime(&paintedtime, Cvar_ClampValue(s_mixahead, 0, 1));
+
     S_PaintChannels(endtime);
 
     snddma.Submit();
@@ -794,7 +794,13 @@ void S_IssuePlaysound(playsound_t *ps)
 #endif
 
     ch->pos = 0;
+#if USE_SNDDMA
+    // issued ahead of time when mixing on another thread
+    ch->begin = max(ps->begin, paintedtime);
+    ch->end = ch->begin + sc->length;
+#else
     ch->end = paintedtime + sc->length;
+#endif
 
     // free the playsound
     S_FreePlaysound(ps);
@@ -1060,6 +1066,32 @@ static void S_AddLoopSounds(void)
     }
 }
 
+/*
+=================
+S_ExpireChannel
+
+Mixer thread doesn't report back, so follow channel end time here.
+Returns qtrue if the channel has stopped.
+=================
+*/
+static qboolean S_ExpireChannel(channel_t *ch)
+{
+    sfxcache_t  *sc = ch->sfx->cache;
+    int         length;
+
+    if (ch->end > paintedtime)
+        return qfalse;
+
+    if (sc && sc->loopstart >= 0 && sc->loopstart < sc->length) {
+        length = sc->length - sc->loopstart;
+        ch->end += ((paintedtime - ch->end) / length + 1) * length;
+        return qfalse;
+    }
+
+    memset(ch, 0, sizeof(*ch));
+    return qtrue;
+}
+
 #endif
 
 /*
@@ -1074,6 +1106,7 @@ void S_Update(void)
 #if USE_SNDDMA
     int         i;
     channel_t   *ch;
+    qboolean    threaded;
 #endif
 
     if (cvar_modified & CVAR_SOUND) {
@@ -1113,6 +1146,13 @@ void S_Update(void)
     if (s_volume->modified)
         S_InitScaletable();
 
+    // mixer thread can't issue playsounds, start them ahead of time
+    threaded = DMA_SyncMixer();
+    if (threaded) {
+        while (s_pendingplays.next != &s_pendingplays)
+            S_IssuePlaysound(s_pendingplays.next);
+    }
+
     // update spatialization for dynamic sounds
     ch = channels;
     for (i = 0; i < s_numchannels; i++, ch++) {
@@ -1123,6 +1163,8 @@ void S_Update(void)
             memset(ch, 0, sizeof(*ch));
             continue;
         }
+        if (threaded && S_ExpireChannel(ch))
+            continue;
         S_Spatialize(ch);         // respatialize channel
         if (!ch->leftvol && !ch->rightvol) {
             memset(ch, 0, sizeof(*ch));
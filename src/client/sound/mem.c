@@ -310,7 +310,7 @@ sfxcache_t *S_LoadSound(sfx_t *s)
     else
         name = s->name;
 
-    len = FS_LoadFile(name, (void **)&data);
+    len = FS_LoadFileEx(name, (void **)&data, FS_FLAG_MMAP, TAG_FILESYSTEM);
     if (!data) {
         s->error = len;
         return NULL;
@@ -21,30 +21,17 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #define    PAINTBUFFER_SIZE    2048
 
-static int snd_scaletable[32][256];
 static int snd_vol;
 
-static void WriteLinearBlast(int16_t *out, samplepair_t *samp, int count)
-{
-    int i, val;
-
-    for (i = 0; i < count; i++, samp++, out += 2) {
-        val = samp->left >> 8;
-        out[0] = clamp(val, INT16_MIN, INT16_MAX);
-
-        val = samp->right >> 8;
-        out[1] = clamp(val, INT16_MIN, INT16_MAX);
-    }
-}
-
-static void TransferStereo16(samplepair_t *samp, int endtime)
+static void TransferStereo16(const mixparams_t *params, samplepair_t *samp,
+                             int starttime, int endtime)
 {
     int lpos;
     int ltime;
     int16_t *out;
     int count;
 
-    for (ltime = paintedtime; ltime < endtime;) {
+    for (ltime = starttime; ltime < endtime;) {
         // handle recirculating buffer issues
         lpos = ltime & ((dma.samples >> 1) - 1);
 
@@ -55,14 +42,14 @@ static void TransferStereo16(samplepair_t *samp, int endtime)
             count = endtime - ltime;
 
         // write a linear blast of samples
-        WriteLinearBlast(out, samp, count);
+        params->ops->Transfer16(out, samp, count);
 
         samp += count;
         ltime += count;
     }
 }
 
-static void TransferStereo(samplepair_t *samp, int endtime)
+static void TransferStereo(samplepair_t *samp, int starttime, int endtime)
 {
     int out_idx, out_mask;
     int count;
@@ -70,9 +57,9 @@ static void TransferStereo(samplepair_t *samp, int endtime)
     int step;
 
     p = (int *)samp;
-    count = (endtime - paintedtime) * dma.channels;
+    count = (endtime - starttime) * dma.channels;
     out_mask = dma.samples - 1;
-    out_idx = paintedtime * dma.channels & out_mask;
+    out_idx = starttime * dma.channels & out_mask;
     step = 3 - dma.channels;
 
     if (dma.samplebits == 16) {
@@ -96,23 +83,24 @@ static void TransferStereo(samplepair_t *samp, int endtime)
     }
 }
 
-static void TransferPaintBuffer(samplepair_t *samp, int endtime)
+static void TransferPaintBuffer(const mixparams_t *params, samplepair_t *samp,
+                                int starttime, int endtime)
 {
-    if (s_testsound->integer) {
+    if (params->testsound) {
         int i;
 
         // write a fixed sine wave
-        for (i = paintedtime; i < endtime; i++) {
-            samp[i].left = samp[i].right = sin(i * 0.1) * 20000 * 256;
+        for (i = starttime; i < endtime; i++) {
+            samp[i - starttime].left = samp[i - starttime].right = sin(i * 0.1) * 20000 * 256;
         }
     }
 
     if (dma.samplebits == 16 && dma.channels == 2) {
         // optimized case
-        TransferStereo16(samp, endtime);
+        TransferStereo16(params, samp, starttime, endtime);
     } else {
         // general case
-        TransferStereo(samp, endtime);
+        TransferStereo(samp, starttime, endtime);
     }
 }
 
@@ -125,57 +113,28 @@ CHANNEL MIXING
 ===============================================================================
 */
 
-static void Paint8(channel_t *ch, sfxcache_t *sc, int count, samplepair_t *samp)
-{
-    int data;
-    int *lscale, *rscale;
-    uint8_t *sfx;
-    int i;
-
-    if (ch->leftvol > 255)
-        ch->leftvol = 255;
-    if (ch->rightvol > 255)
-        ch->rightvol = 255;
-
-    lscale = snd_scaletable[ch->leftvol >> 3];
-    rscale = snd_scaletable[ch->rightvol >> 3];
-    sfx = (uint8_t *)sc->data + ch->pos;
-
-    for (i = 0; i < count; i++, samp++) {
-        data = *sfx++;
-        samp->left += lscale[data];
-        samp->right += rscale[data];
-    }
-
-    ch->pos += count;
-}
-
-static void Paint16(channel_t *ch, sfxcache_t *sc, int count, samplepair_t *samp)
+static void PaintChannel(const mixparams_t *params, sfxcache_t *sc, int pos,
+                         int leftvol, int rightvol, int count, samplepair_t *samp)
 {
-    int data;
-    int left, right;
-    int leftvol, rightvol;
-    int16_t *sfx;
-    int i;
-
-    leftvol = ch->leftvol * snd_vol;
-    rightvol = ch->rightvol * snd_vol;
-    sfx = (int16_t *)sc->data + ch->pos;
-
-    for (i = 0; i < count; i++, samp++) {
-        data = *sfx++;
-        left = (data * leftvol) >> 8;
-        right = (data * rightvol) >> 8;
-        samp->left += left;
-        samp->right += right;
+    if (sc->width == 1) {
+        if (leftvol > 255)
+            leftvol = 255;
+        if (rightvol > 255)
+            rightvol = 255;
+
+        params->ops->Paint8(samp, sc->data + pos, count,
+                            (leftvol >> 3) * 8 * params->volume,
+                            (rightvol >> 3) * 8 * params->volume);
+    } else {
+        params->ops->Paint16(samp, (int16_t *)sc->data + pos, count,
+                             leftvol * params->volume, rightvol * params->volume);
     }
-
-    ch->pos += count;
 }
 
 void S_PaintChannels(int endtime)
 {
     samplepair_t paintbuffer[PAINTBUFFER_SIZE];
+    mixparams_t params;
     int i;
     int end;
     channel_t *ch;
@@ -183,6 +142,8 @@ void S_PaintChannels(int endtime)
     int ltime, count;
     playsound_t *ps;
 
+    S_GetMixParams(&params);
+
     while (paintedtime < endtime) {
         // if paintbuffer is smaller than DMA buffer
         end = endtime;
@@ -228,12 +189,9 @@ void S_PaintChannels(int endtime)
                     break;
 
                 if (count > 0 && ch->sfx) {
-                    samplepair_t *samp = &paintbuffer[ltime - paintedtime];
-                    if (sc->width == 1)
-                        Paint8(ch, sc, count, samp);
-                    else
-                        Paint16(ch, sc, count, samp);
-
+                    PaintChannel(&params, sc, ch->pos, ch->leftvol, ch->rightvol,
+                                 count, &paintbuffer[ltime - paintedtime]);
+                    ch->pos += count;
                     ltime += count;
                 }
 
@@ -256,25 +214,105 @@ void S_PaintChannels(int endtime)
         }
 
         // transfer out according to DMA format
-        TransferPaintBuffer(paintbuffer, end);
+        TransferPaintBuffer(&params, paintbuffer, paintedtime, end);
         paintedtime = end;
     }
 }
 
-void S_InitScaletable(void)
+/*
+===============
+S_PaintMixChannels
+
+Mixer thread version of S_PaintChannels. Channels are started by the main
+thread ahead of time and wait for their begin time here.
+===============
+*/
+void S_PaintMixChannels(mixchannel_t *chans, const mixparams_t *params,
+                        int *painted, int endtime)
 {
-    int        i, j;
-    int        scale;
+    samplepair_t paintbuffer[PAINTBUFFER_SIZE];
+    int i;
+    int end;
+    mixchannel_t *ch;
+    sfxcache_t *sc;
+    int ltime, count;
 
-    Cvar_ClampValue(s_volume, 0, 1);
+    while (*painted < endtime) {
+        // if paintbuffer is smaller than DMA buffer
+        end = endtime;
+        if (end - *painted > PAINTBUFFER_SIZE)
+            end = *painted + PAINTBUFFER_SIZE;
 
-    snd_vol = s_volume->value * 256;
-    for (i = 0; i < 32; i++) {
-        scale = i * 8 * snd_vol;
-        for (j = 0; j < 256; j++) {
-            snd_scaletable[i][j] = (j - 128) * scale;
+        // stop at the next waiting channel
+        for (i = 0, ch = chans; i < MAX_CHANNELS; i++, ch++) {
+            if (ch->sc && ch->begin > *painted && ch->begin < end)
+                end = ch->begin;
         }
+
+        // clear the paint buffer
+        memset(paintbuffer, 0, (end - *painted) * sizeof(samplepair_t));
+
+        // paint in the channels.
+        for (i = 0, ch = chans; i < MAX_CHANNELS; i++, ch++) {
+            ltime = *painted;
+
+            while (ltime < end) {
+                sc = ch->sc;
+                if (!sc || ch->begin > ltime)
+                    break;
+
+                // max painting is to the end of the buffer
+                count = end - ltime;
+
+                // might be stopped by running out of data
+                if (ch->end - ltime < count)
+                    count = ch->end - ltime;
+
+                if (count > 0) {
+                    // silent channels still advance
+                    if (ch->leftvol || ch->rightvol)
+                        PaintChannel(params, sc, ch->pos, ch->leftvol, ch->rightvol,
+                                     count, &paintbuffer[ltime - *painted]);
+                    ch->pos += count;
+                    ltime += count;
+                }
+
+                // if at end of loop, restart
+                if (ltime >= ch->end) {
+                    if (ch->autosound) {
+                        // autolooping sounds always go back to start
+                        ch->pos = 0;
+                        ch->end = ltime + sc->length;
+                    } else if (sc->loopstart >= 0 && sc->loopstart < sc->length) {
+                        ch->pos = sc->loopstart;
+                        ch->end = ltime + sc->length - ch->pos;
+                    } else {
+                        // channel just stopped
+                        ch->sc = NULL;
+                    }
+                }
+            }
+        }
+
+        // transfer out according to DMA format
+        TransferPaintBuffer(params, paintbuffer, *painted, end);
+        *painted = end;
     }
+}
+
+void S_GetMixParams(mixparams_t *params)
+{
+    // scalar kernels are kept selectable for comparison
+    params->ops = s_simd->integer ? &mixops : Mixer_GetImpl(0);
+    params->volume = snd_vol;
+    params->testsound = !!s_testsound->integer;
+}
+
+void S_InitScaletable(void)
+{
+    Cvar_ClampValue(s_volume, 0, 1);
+
+    snd_vol = s_volume->value * 256;
 
     s_volume->modified = qfalse;
 }
@@ -0,0 +1,221 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "shared/shared.h"
+#include "common/common.h"
+#include "client/sound/mixer.h"
+
+#if (defined __GNUC__) && ((defined __i386__) || (defined __x86_64__))
+#define USE_MIXER_X86   1
+#include <immintrin.h>
+#define TARGET(x)   __attribute__((target(x)))
+#endif
+
+// all implementations must produce bit identical results, vector versions
+// accumulate in 32-bit integers just like scalar code
+
+/*
+===============================================================================
+
+SCALAR
+
+===============================================================================
+*/
+
+static void Paint8_C(samplepair_t *samp, const uint8_t *sfx, int count,
+                     int leftscale, int rightscale)
+{
+    int i, data;
+
+    for (i = 0; i < count; i++, samp++) {
+        data = sfx[i] - 128;
+        samp->left += data * leftscale;
+        samp->right += data * rightscale;
+    }
+}
+
+static void Paint16_C(samplepair_t *samp, const int16_t *sfx, int count,
+                      int leftvol, int rightvol)
+{
+    int i, data;
+
+    for (i = 0; i < count; i++, samp++) {
+        data = sfx[i];
+        samp->left += (data * leftvol) >> 8;
+        samp->right += (data * rightvol) >> 8;
+    }
+}
+
+static void Transfer16_C(int16_t *out, const samplepair_t *samp, int count)
+{
+    int i, val;
+
+    for (i = 0; i < count; i++, samp++, out += 2) {
+        val = samp->left >> 8;
+        out[0] = clamp(val, INT16_MIN, INT16_MAX);
+
+        val = samp->right >> 8;
+        out[1] = clamp(val, INT16_MIN, INT16_MAX);
+    }
+}
+
+static const mixops_t mixops_c = {
+    "scalar", Paint8_C, Paint16_C, Transfer16_C
+};
+
+#if USE_MIXER_X86
+
+/*
+===============================================================================
+
+SSE2
+
+===============================================================================
+*/
+
+// volume doesn't fit into signed 16 bits, so it is split into two halves
+// and pmaddwd computes data * lo + data * hi. order of the result is
+// left and right for 2 samples, matching samplepair_t layout.
+static inline TARGET("sse2") __m128i split_volumes(int left, int right)
+{
+    int lo_l = min(left, INT16_MAX);
+    int lo_r = min(right, INT16_MAX);
+
+    return _mm_setr_epi16(lo_l, left - lo_l, lo_r, right - lo_r,
+                          lo_l, left - lo_l, lo_r, right - lo_r);
+}
+
+// expands 4 16-bit samples into pmaddwd operands for 2 samples each
+static inline TARGET("sse2") void paint_4(samplepair_t *samp, __m128i data,
+                                          __m128i vols, int shift)
+{
+    __m128i x = _mm_unpacklo_epi16(data, data);
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi32(x, x), vols);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi32(x, x), vols);
+    __m128i *dst = (__m128i *)samp;
+
+    lo = _mm_sra_epi32(lo, _mm_cvtsi32_si128(shift));
+    hi = _mm_sra_epi32(hi, _mm_cvtsi32_si128(shift));
+    _mm_storeu_si128(dst + 0, _mm_add_epi32(_mm_loadu_si128(dst + 0), lo));
+    _mm_storeu_si128(dst + 1, _mm_add_epi32(_mm_loadu_si128(dst + 1), hi));
+}
+
+static TARGET("sse2") void Paint8_SSE2(samplepair_t *samp, const uint8_t *sfx,
+                                       int count, int leftscale, int rightscale)
+{
+    __m128i vols, bias, zero, data;
+    uint32_t bits;
+    int i;
+
+    if ((unsigned)leftscale > 2 * INT16_MAX || (unsigned)rightscale > 2 * INT16_MAX) {
+        Paint8_C(samp, sfx, count, leftscale, rightscale);
+        return;
+    }
+
+    vols = split_volumes(leftscale, rightscale);
+    bias = _mm_set1_epi16(128);
+    zero = _mm_setzero_si128();
+
+    for (i = 0; i < (count & ~3); i += 4) {
+        memcpy(&bits, sfx + i, sizeof(bits));
+        data = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bits), zero);
+        paint_4(samp + i, _mm_sub_epi16(data, bias), vols, 0);
+    }
+
+    Paint8_C(samp + i, sfx + i, count - i, leftscale, rightscale);
+}
+
+static TARGET("sse2") void Paint16_SSE2(samplepair_t *samp, const int16_t *sfx,
+                                        int count, int leftvol, int rightvol)
+{
+    __m128i vols;
+    int i;
+
+    if ((unsigned)leftvol > 2 * INT16_MAX || (unsigned)rightvol > 2 * INT16_MAX) {
+        Paint16_C(samp, sfx, count, leftvol, rightvol);
+        return;
+    }
+
+    vols = split_volumes(leftvol, rightvol);
+
+    for (i = 0; i < (count & ~3); i += 4) {
+        paint_4(samp + i, _mm_loadl_epi64((const __m128i *)(sfx + i)), vols, 8);
+    }
+
+    Paint16_C(samp + i, sfx + i, count - i, leftvol, rightvol);
+}
+
+// packssdw saturates just like clamp() in scalar code
+static TARGET("sse2") void Transfer16_SSE2(int16_t *out, const samplepair_t *samp, int count)
+{
+    const __m128i *src = (const __m128i *)samp;
+    __m128i a, b;
+    int i;
+
+    for (i = 0; i < (count & ~3); i += 4, src += 2) {
+        a = _mm_srai_epi32(_mm_loadu_si128(src + 0), 8);
+        b = _mm_srai_epi32(_mm_loadu_si128(src + 1), 8);
+        _mm_storeu_si128((__m128i *)(out + i * 2), _mm_packs_epi32(a, b));
+    }
+
+    Transfer16_C(out + i * 2, samp + i, count - i);
+}
+
+static const mixops_t mixops_sse2 = {
+    "sse2", Paint8_SSE2, Paint16_SSE2, Transfer16_SSE2
+};
+
+#endif // USE_MIXER_X86
+
+/*
+===============================================================================
+
+DISPATCH
+
+===============================================================================
+*/
+
+mixops_t    mixops = {
+    "scalar", Paint8_C, Paint16_C, Transfer16_C
+};
+
+static const mixops_t *mixops_impls[2];
+static int mixops_numimpls;
+
+const mixops_t *Mixer_GetImpl(int index)
+{
+    if (index < 0 || index >= mixops_numimpls)
+        return NULL;
+
+    return mixops_impls[index];
+}
+
+void Mixer_Init(void)
+{
+    mixops_numimpls = 0;
+    mixops_impls[mixops_numimpls++] = &mixops_c;
+
+#if USE_MIXER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        mixops_impls[mixops_numimpls++] = &mixops_sse2;
+#endif
+
+    // last one is the fastest
+    mixops = *mixops_impls[mixops_numimpls - 1];
+
+    Com_DPrintf("Using %s mixer kernels\n", mixops.name);
+}
@@ -22,14 +22,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #if USE_SNDDMA
 #include "client/sound/dma.h"
+#include "client/sound/mixer.h"
 #endif
 
-// !!! if this is changed, the asm code must change !!!
-typedef struct samplepair_s {
-    int         left;
-    int         right;
-} samplepair_t;
-
 typedef struct sfxcache_s {
     int         length;
     int         loopstart;
@@ -79,12 +74,35 @@ typedef struct channel_s {
     float       master_vol;     // 0.0-1.0 master volume
     qboolean    fixed_origin;   // use origin instead of fetching entnum's origin
     qboolean    autosound;      // from an entity->sound, cleared each frame
+#if USE_SNDDMA
+    int         begin;          // start time in global paintsamples
+#endif
 #if USE_OPENAL
     int         autoframe;
     int         srcnum;
 #endif
 } channel_t;
 
+#if USE_SNDDMA
+// playback state of a channel owned by the mixer thread
+typedef struct {
+    sfxcache_t  *sc;
+    int         leftvol;        // 0-255 volume
+    int         rightvol;       // 0-255 volume
+    int         begin;          // start time in global paintsamples
+    int         end;            // end time in global paintsamples
+    int         pos;            // sample position in sfx
+    qboolean    autosound;      // position follows global paintsamples
+} mixchannel_t;
+
+typedef struct {
+    const mixops_t  *ops;
+    int             volume;     // s_volume scaled to 0-256
+    qboolean        testsound;
+    float           mixahead;   // seconds, set by DMA code
+} mixparams_t;
+#endif
+
 typedef struct {
     char    *name;
     int     rate;
@@ -110,6 +128,7 @@ void DMA_Activate(void);
 int DMA_DriftBeginofs(float timeofs);
 void DMA_ClearBuffer(void);
 void DMA_Update(void);
+qboolean DMA_SyncMixer(void);
 #endif
 
 #if USE_OPENAL
@@ -163,6 +182,7 @@ extern cvar_t   *s_volume;
 #if USE_SNDDMA
 extern cvar_t   *s_khz;
 extern cvar_t   *s_testsound;
+extern cvar_t   *s_simd;
 #endif
 extern cvar_t   *s_ambient;
 extern cvar_t   *s_show;
@@ -177,5 +197,8 @@ void S_IssuePlaysound(playsound_t *ps);
 void S_BuildSoundList(int *sounds);
 #if USE_SNDDMA
 void S_InitScaletable(void);
+void S_GetMixParams(mixparams_t *params);
 void S_PaintChannels(int endtime);
+void S_PaintMixChannels(mixchannel_t *chans, const mixparams_t *params,
+                        int *painted, int endtime);
 #endif
@@ -0,0 +1,364 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "shared/shared.h"
+#include "common/bits.h"
+#include "common/common.h"
+
+#if (defined __GNUC__) && ((defined __i386__) || (defined __x86_64__))
+#define USE_BITS_X86    1
+#include <immintrin.h>
+#define TARGET(x)   __attribute__((target(x)))
+#elif (defined __GNUC__) && (defined __ARM_NEON)
+#define USE_BITS_NEON   1
+#include <arm_neon.h>
+#endif
+
+/*
+===============================================================================
+
+SCALAR
+
+===============================================================================
+*/
+
+static inline uint64_t load64(const byte *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store64(byte *p, uint64_t v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline int popcount64(uint64_t v)
+{
+#ifdef __GNUC__
+    return __builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (v * 0x0101010101010101ULL) >> 56;
+#endif
+}
+
+static inline int popcount8(byte v)
+{
+    return popcount64(v);
+}
+
+static void Or_C(byte *dst, const byte *src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8)
+        store64(dst + i, load64(dst + i) | load64(src + i));
+    for (; i < len; i++)
+        dst[i] |= src[i];
+}
+
+static void And_C(byte *dst, const byte *src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8)
+        store64(dst + i, load64(dst + i) & load64(src + i));
+    for (; i < len; i++)
+        dst[i] &= src[i];
+}
+
+static size_t Count_C(const byte *src, size_t len)
+{
+    size_t i, count = 0;
+
+    for (i = 0; i + 8 <= len; i += 8)
+        count += popcount64(load64(src + i));
+    for (; i < len; i++)
+        count += popcount8(src[i]);
+
+    return count;
+}
+
+static void MatchInts_C(byte *dst, const int *src, int count, int value)
+{
+    int i, j, bits;
+
+    for (i = 0; i < count; i += 8) {
+        bits = 0;
+        for (j = 0; j < 8 && i + j < count; j++)
+            if (src[i + j] == value)
+                bits |= 1 << j;
+        dst[i >> 3] = bits;
+    }
+}
+
+static const bitops_t bitops_c = {
+    "scalar", Or_C, And_C, Count_C, MatchInts_C
+};
+
+#if USE_BITS_X86
+
+/*
+===============================================================================
+
+SSE2
+
+===============================================================================
+*/
+
+TARGET("sse2")
+static void Or_SSE2(byte *dst, const byte *src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_or_si128(a, b));
+    }
+    Or_C(dst + i, src + i, len - i);
+}
+
+TARGET("sse2")
+static void And_SSE2(byte *dst, const byte *src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_and_si128(a, b));
+    }
+    And_C(dst + i, src + i, len - i);
+}
+
+// bit counting within bytes, then horizontal sum with psadbw
+TARGET("sse2")
+static size_t Count_SSE2(const byte *src, size_t len)
+{
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+    __m128i sum = _mm_setzero_si128();
+    uint64_t total[2];
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi16(v, 1), m1));
+        v = _mm_add_epi8(_mm_and_si128(v, m2), _mm_and_si128(_mm_srli_epi16(v, 2), m2));
+        v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi16(v, 4)), m4);
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+
+    _mm_storeu_si128((__m128i *)total, sum);
+    return total[0] + total[1] + Count_C(src + i, len - i);
+}
+
+TARGET("sse2")
+static void MatchInts_SSE2(byte *dst, const int *src, int count, int value)
+{
+    __m128i v = _mm_set1_epi32(value);
+    int i, lo, hi;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        lo = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+            _mm_loadu_si128((const __m128i *)(src + i)), v)));
+        hi = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(
+            _mm_loadu_si128((const __m128i *)(src + i + 4)), v)));
+        dst[i >> 3] = lo | (hi << 4);
+    }
+
+    if (i < count)
+        MatchInts_C(dst + (i >> 3), src + i, count - i, value);
+}
+
+static const bitops_t bitops_sse2 = {
+    "sse2", Or_SSE2, And_SSE2, Count_SSE2, MatchInts_SSE2
+};
+
+/*
+===============================================================================
+
+AVX2
+
+===============================================================================
+*/
+
+TARGET("avx2")
+static void Or_AVX2(byte *dst, const byte *src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_or_si256(a, b));
+    }
+    Or_C(dst + i, src + i, len - i);
+}
+
+TARGET("avx2")
+static void And_AVX2(byte *dst, const byte *src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(dst + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_and_si256(a, b));
+    }
+    And_C(dst + i, src + i, len - i);
+}
+
+// nibble lookup with pshufb, then horizontal sum with psadbw
+TARGET("avx2")
+static size_t Count_AVX2(const byte *src, size_t len)
+{
+    const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                         0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i m4 = _mm256_set1_epi8(0x0f);
+    __m256i sum = _mm256_setzero_si256();
+    uint64_t total[4];
+    size_t i;
+
+    for (i = 0; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, m4));
+        __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), m4));
+        sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_add_epi8(lo, hi),
+                                                    _mm256_setzero_si256()));
+    }
+
+    _mm256_storeu_si256((__m256i *)total, sum);
+    return total[0] + total[1] + total[2] + total[3] + Count_C(src + i, len - i);
+}
+
+TARGET("avx2")
+static void MatchInts_AVX2(byte *dst, const int *src, int count, int value)
+{
+    __m256i v = _mm256_set1_epi32(value);
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        dst[i >> 3] = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(
+            _mm256_loadu_si256((const __m256i *)(src + i)), v)));
+    }
+
+    if (i < count)
+        MatchInts_C(dst + (i >> 3), src + i, count - i, value);
+}
+
+static const bitops_t bitops_avx2 = {
+    "avx2", Or_AVX2, And_AVX2, Count_AVX2, MatchInts_AVX2
+};
+
+#endif // USE_BITS_X86
+
+#if USE_BITS_NEON
+
+/*
+===============================================================================
+
+NEON
+
+===============================================================================
+*/
+
+static void Or_NEON(byte *dst, const byte *src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16)
+        vst1q_u8(dst + i, vorrq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+    Or_C(dst + i, src + i, len - i);
+}
+
+static void And_NEON(byte *dst, const byte *src, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16)
+        vst1q_u8(dst + i, vandq_u8(vld1q_u8(dst + i), vld1q_u8(src + i)));
+    And_C(dst + i, src + i, len - i);
+}
+
+static size_t Count_NEON(const byte *src, size_t len)
+{
+    uint64x2_t sum = vdupq_n_u64(0);
+    size_t i;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+        uint8x16_t v = vcntq_u8(vld1q_u8(src + i));
+        sum = vaddq_u64(sum, vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(v))));
+    }
+
+    return vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1) + Count_C(src + i, len - i);
+}
+
+static const bitops_t bitops_neon = {
+    "neon", Or_NEON, And_NEON, Count_NEON, MatchInts_C
+};
+
+#endif // USE_BITS_NEON
+
+/*
+===============================================================================
+
+DISPATCH
+
+===============================================================================
+*/
+
+bitops_t bitops = {
+    "scalar", Or_C, And_C, Count_C, MatchInts_C
+};
+
+static const bitops_t *bitops_impls[4];
+static int bitops_numimpls;
+
+const bitops_t *Bits_GetImpl(int index)
+{
+    if (index < 0 || index >= bitops_numimpls)
+        return NULL;
+
+    return bitops_impls[index];
+}
+
+void Bits_Init(void)
+{
+    bitops_numimpls = 0;
+    bitops_impls[bitops_numimpls++] = &bitops_c;
+
+#if USE_BITS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        bitops_impls[bitops_numimpls++] = &bitops_sse2;
+    if (__builtin_cpu_supports("avx2"))
+        bitops_impls[bitops_numimpls++] = &bitops_avx2;
+#elif USE_BITS_NEON
+    bitops_impls[bitops_numimpls++] = &bitops_neon;
+#endif
+
+    // last one is the fastest
+    bitops = *bitops_impls[bitops_numimpls - 1];
+
+    Com_DPrintf("Using %s bitset kernels\n", bitops.name);
+}
@@ -26,6 +26,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/common.h"
 #include "common/files.h"
 #include "common/bsp.h"
+#include "common/bits.h"
 #include "common/math.h"
 #include "common/utils.h"
 #include "common/mdfour.h"
@@ -34,6 +35,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 extern mtexinfo_t nulltexinfo;
 
 static cvar_t *map_visibility_patch;
+static cvar_t *map_visibility_cache;
 
 /*
 ===============================================================================
@@ -241,7 +243,6 @@ LOAD(Brushes)
         out->firstbrushside = bsp->brushsides + firstside;
         out->numsides = numsides;
         out->contents = LittleLong(in->contents);
-        out->checkcount = 0;
     }
 
     return Q_ERR_SUCCESS;
@@ -902,6 +903,150 @@ static qerror_t BSP_ValidateTree(bsp_t *bsp)
     return Q_ERR_SUCCESS;
 }
 
+/*
+===============================================================================
+
+COLLISION REPRESENTATION
+
+===============================================================================
+*/
+
+#define CBRUSH_NO_BOUNDS    1e30f
+
+static cnode_t *BSP_BuildCollisionLeaf(bsp_t *bsp, mleaf_t *leaf)
+{
+    cnode_t *out = bsp->cnodes + bsp->numcnodes++;
+
+    out->contents = leaf->contents;
+    out->numbrushes = leaf->numleafbrushes;
+    out->firstbrush = bsp->cleafbrushes + (leaf->firstleafbrush - bsp->leafbrushes);
+    out->type = CNODE_LEAF;
+    out->signbits = 0;
+    out->children[0] = out->children[1] = 0;
+
+    leaf->cnode = out;
+    return out;
+}
+
+// stores the node, then children[0] subtree, then children[1] subtree.
+// recurses only into children[0], like BSP_SetParent does.
+static cnode_t *BSP_BuildCollisionNode(bsp_t *bsp, mnode_t *node)
+{
+    cnode_t *first, *parent, *out;
+    mnode_t *next;
+
+    first = parent = NULL;
+    while (node) {
+        next = NULL;
+        out = BSP_CollisionNode(node);
+        if (out) {
+            // already built
+        } else if (node->plane) {
+            out = bsp->cnodes + bsp->numcnodes++;
+            VectorCopy(node->plane->normal, out->normal);
+            out->dist = node->plane->dist;
+            out->type = node->plane->type;
+            out->signbits = node->plane->signbits;
+            node->cnode = out;
+
+            out->children[0] = BSP_BuildCollisionNode(bsp, node->children[0]) - out;
+            next = node->children[1];
+        } else {
+            out = BSP_BuildCollisionLeaf(bsp, (mleaf_t *)node);
+        }
+
+        if (parent) {
+            parent->children[1] = out - parent;
+        } else {
+            first = out;
+        }
+
+        parent = out;
+        node = next;
+    }
+
+    return first;
+}
+
+static void BSP_BuildCollisionBrush(bsp_t *bsp, cbrush_t *out, mbrush_t *in)
+{
+    cbrushside_t    *side;
+    vec_t           *n;
+    int             i, j;
+
+    out->contents = in->contents;
+    out->numsides = in->numsides;
+    out->firstside = bsp->cbrushsides + (in->firstbrushside - bsp->brushsides);
+    out->checkcount = 0;
+
+    // brush is entirely behind each of its axial sides
+    for (j = 0; j < 3; j++) {
+        out->mins[j] = -CBRUSH_NO_BOUNDS;
+        out->maxs[j] = CBRUSH_NO_BOUNDS;
+    }
+
+    for (i = 0, side = out->firstside; i < out->numsides; i++, side++) {
+        n = side->plane.normal;
+        for (j = 0; j < 3; j++) {
+            if (n[(j + 1) % 3] || n[(j + 2) % 3]) {
+                continue;
+            }
+            if (n[j] == 1) {
+                out->maxs[j] = min(out->maxs[j], side->plane.dist);
+            } else if (n[j] == -1) {
+                out->mins[j] = max(out->mins[j], -side->plane.dist);
+            }
+        }
+    }
+}
+
+/*
+==================
+BSP_BuildCollision
+
+Builds compact collision representation used by trace code. Planes are copied
+into nodes and brush sides to avoid pointer chasing, and nodes are reordered
+so that tree traversal mostly moves forward in memory.
+==================
+*/
+static void BSP_BuildCollision(bsp_t *bsp)
+{
+    mbrushside_t    *in;
+    cbrushside_t    *out;
+    int             i;
+
+    bsp->cbrushsides = ALLOC(sizeof(*out) * bsp->numbrushsides);
+    for (i = 0, in = bsp->brushsides, out = bsp->cbrushsides; i < bsp->numbrushsides; i++, in++, out++) {
+        out->plane = *in->plane;
+        out->surface = &in->texinfo->c;
+    }
+
+    bsp->cbrushes = ALLOC(sizeof(cbrush_t) * bsp->numbrushes);
+    for (i = 0; i < bsp->numbrushes; i++) {
+        BSP_BuildCollisionBrush(bsp, &bsp->cbrushes[i], &bsp->brushes[i]);
+    }
+
+    bsp->cleafbrushes = ALLOC(sizeof(cbrush_t *) * bsp->numleafbrushes);
+    for (i = 0; i < bsp->numleafbrushes; i++) {
+        bsp->cleafbrushes[i] = bsp->cbrushes + (bsp->leafbrushes[i] - bsp->brushes);
+    }
+
+    // models first, then whatever nodes and leafs are not referenced by them
+    bsp->cnodes = ALLOC(sizeof(cnode_t) * (bsp->numnodes + bsp->numleafs));
+    bsp->numcnodes = 0;
+    for (i = 0; i < bsp->nummodels; i++) {
+        BSP_BuildCollisionNode(bsp, bsp->models[i].headnode);
+    }
+    for (i = 0; i < bsp->numnodes; i++) {
+        BSP_BuildCollisionNode(bsp, &bsp->nodes[i]);
+    }
+    for (i = 0; i < bsp->numleafs; i++) {
+        if (!bsp->leafs[i].cnode) {
+            BSP_BuildCollisionLeaf(bsp, &bsp->leafs[i]);
+        }
+    }
+}
+
 // also calculates the last portal number used
 // by CM code to allocate portalopen[] array
 static qerror_t BSP_ValidateAreaPortals(bsp_t *bsp)
@@ -927,6 +1072,204 @@ static qerror_t BSP_ValidateAreaPortals(bsp_t *bsp)
     return Q_ERR_SUCCESS;
 }
 
+static byte *BSP_DecompressVis(bsp_t *bsp, byte *mask, int cluster, int vis)
+{
+    byte    *in, *out, *in_end, *out_end;
+    int     c;
+
+    // decompress vis
+    in_end = (byte *)bsp->vis + bsp->numvisibility;
+    in = (byte *)bsp->vis + bsp->vis->bitofs[cluster][vis];
+    out_end = mask + bsp->visrowsize;
+    out = mask;
+    do {
+        if (in >= in_end) {
+            goto overrun;
+        }
+        if (*in) {
+            *out++ = *in++;
+            continue;
+        }
+
+        if (in + 1 >= in_end) {
+            goto overrun;
+        }
+        c = in[1];
+        in += 2;
+        if (out + c > out_end) {
+overrun:
+            c = out_end - out;
+        }
+        while (c--) {
+            *out++ = 0;
+        }
+    } while (out < out_end);
+
+    // apply our ugly PVS patches
+    if (map_visibility_patch->integer) {
+        if (bsp->checksum == 0x1e5b50c5) {
+            // q2dm3, pent bridge
+            if (cluster == 345 || cluster == 384) {
+                Q_SetBit(mask, 466);
+                Q_SetBit(mask, 484);
+                Q_SetBit(mask, 692);
+            }
+        } else if (bsp->checksum == 0x04cfa792) {
+            // q2dm1, above lower RL
+            if (cluster == 395) {
+                Q_SetBit(mask, 176);
+                Q_SetBit(mask, 183);
+            }
+        } else if (bsp->checksum == 0x2c3ab9b0) {
+            // q2dm8, CG/RG area
+            if (cluster == 629 || cluster == 631 ||
+                cluster == 633 || cluster == 639) {
+                Q_SetBit(mask, 908);
+                Q_SetBit(mask, 909);
+                Q_SetBit(mask, 910);
+                Q_SetBit(mask, 915);
+                Q_SetBit(mask, 923);
+                Q_SetBit(mask, 924);
+                Q_SetBit(mask, 927);
+                Q_SetBit(mask, 930);
+                Q_SetBit(mask, 938);
+                Q_SetBit(mask, 939);
+                Q_SetBit(mask, 947);
+            }
+        }
+    }
+
+    return mask;
+}
+
+// server worker threads look up visibility concurrently
+#define stat_inc(p)     __atomic_fetch_add(p, 1, __ATOMIC_RELAXED)
+
+// returns qfalse if cluster is -1, or there is no visibility info
+static qboolean BSP_CheckCluster(bsp_t *bsp, int cluster)
+{
+    if (!bsp || !bsp->vis) {
+        return qfalse;
+    }
+    if (cluster == -1) {
+        return qfalse;
+    }
+    if (cluster < 0 || cluster >= bsp->vis->numclusters) {
+        Com_Error(ERR_DROP, "%s: bad cluster", __func__);
+    }
+    return qtrue;
+}
+
+/*
+==================
+BSP_ClusterVis
+
+Decompresses PVS or PHS row of the given cluster into mask.
+==================
+*/
+byte *BSP_ClusterVis(bsp_t *bsp, byte *mask, int cluster, int vis)
+{
+    if (!BSP_CheckCluster(bsp, cluster)) {
+        if (!bsp || !bsp->vis) {
+            return memset(mask, 0xff, VIS_MAX_BYTES);
+        }
+        return memset(mask, 0, bsp->visrowsize);
+    }
+
+    if (bsp->vismatrix) {
+        stat_inc(&bsp->vislookups);
+        return memcpy(mask, BSP_VisRow(bsp, cluster, vis), bsp->visrowsize);
+    }
+
+    stat_inc(&bsp->visdecompressed);
+    return BSP_DecompressVis(bsp, mask, cluster, vis);
+}
+
+/*
+==================
+BSP_GetClusterVis
+
+Same as BSP_ClusterVis, but returns a pointer into decompressed visibility
+matrix if it is available, and only uses mask as a fallback. Returned row is
+padded with zeros to VIS_FAST_LONGS.
+==================
+*/
+const byte *BSP_GetClusterVis(bsp_t *bsp, byte *mask, int cluster, int vis)
+{
+    if (bsp && bsp->vismatrix && BSP_CheckCluster(bsp, cluster)) {
+        stat_inc(&bsp->vislookups);
+        return BSP_VisRow(bsp, cluster, vis);
+    }
+
+    return BSP_ClusterVis(bsp, mask, cluster, vis);
+}
+
+// decompresses all PVS and PHS rows at once if memory budget allows
+static void BSP_BuildVisMatrix(bsp_t *bsp)
+{
+    size_t  size, budget;
+    int     i;
+
+    if (!bsp->vis) {
+        return;
+    }
+
+    budget = (size_t)Cvar_ClampInteger(map_visibility_cache, 0, 4096) << 20;
+    bsp->visstride = ALIGN(VIS_FAST_LONGS(bsp) * sizeof(uint_fast32_t), 8);
+    size = (size_t)bsp->vis->numclusters * 2 * bsp->visstride;
+    if (!size || size > budget) {
+        return;
+    }
+
+    bsp->vismatrix = Z_Mallocz(size);
+    for (i = 0; i < bsp->vis->numclusters; i++) {
+        BSP_DecompressVis(bsp, bsp->vismatrix + (i * 2 + DVIS_PVS) * bsp->visstride, i, DVIS_PVS);
+        BSP_DecompressVis(bsp, bsp->vismatrix + (i * 2 + DVIS_PHS) * bsp->visstride, i, DVIS_PHS);
+    }
+}
+
+// returns average number of clusters potentially visible from each cluster
+static float BSP_AverageVis(bsp_t *bsp, int vis)
+{
+    size_t  total;
+    int     i;
+
+    if (!bsp->vismatrix) {
+        return 0;
+    }
+
+    total = 0;
+    for (i = 0; i < bsp->vis->numclusters; i++) {
+        total += Bits_Count(BSP_VisRow(bsp, i, vis), bsp->visrowsize);
+    }
+
+    return (float)total / bsp->vis->numclusters;
+}
+
+static void BSP_VisStats_f(void)
+{
+    bsp_t *bsp;
+
+    if (LIST_EMPTY(&bsp_cache)) {
+        Com_Printf("BSP cache is empty\n");
+        return;
+    }
+
+    Com_Printf("clusters    matrix avgpvs avgphs lookups decompressed name\n"
+               "-------- --------- ------ ------ ------- ------------ ----\n");
+    LIST_FOR_EACH(bsp_t, bsp, &bsp_cache, entry) {
+        if (!bsp->vis) {
+            Com_Printf("%8d %9s %6s %6s %7s %12s %s\n",
+                       0, "-", "-", "-", "-", "-", bsp->name);
+            continue;
+        }
+        Com_Printf("%8d %9"PRIz" %6.1f %6.1f %7u %12u %s\n", bsp->vis->numclusters,
+                   bsp->vismatrix ? (size_t)bsp->vis->numclusters * 2 * bsp->visstride : 0,
+                   BSP_AverageVis(bsp, DVIS_PVS), BSP_AverageVis(bsp, DVIS_PHS),
+                   bsp->vislookups, bsp->visdecompressed, bsp->name);
+    }
+}
+
 void BSP_Free(bsp_t *bsp)
 {
     if (!bsp) {
@@ -936,6 +1279,7 @@ void BSP_Free(bsp_t *bsp)
         Com_Error(ERR_FATAL, "%s: negative refcount", __func__);
     }
     if (--bsp->refcount == 0) {
+        Z_Free(bsp->vismatrix);
         Hunk_Free(&bsp->hunk);
         List_Remove(&bsp->entry);
         Z_Free(bsp);
@@ -980,7 +1324,7 @@ qerror_t BSP_Load(const char *name, bsp_t **bsp_p)
     //
     // load the file
     //
-    filelen = FS_LoadFile(name, (void **)&buf);
+    filelen = FS_LoadFileEx(name, (void **)&buf, FS_FLAG_MMAP, TAG_FILESYSTEM);
     if (!buf) {
         return filelen;
     }
@@ -1022,6 +1366,12 @@ qerror_t BSP_Load(const char *name, bsp_t **bsp_p)
         memsize += count * info->memsize;
     }
 
+    // collision representation is built after loading
+    memsize += (lumpcount[LUMP_NODES] + lumpcount[LUMP_LEAFS]) * sizeof(cnode_t);
+    memsize += lumpcount[LUMP_BRUSHES] * sizeof(cbrush_t);
+    memsize += lumpcount[LUMP_BRUSHSIDES] * sizeof(cbrushside_t);
+    memsize += lumpcount[LUMP_LEAFBRUSHES] * sizeof(cbrush_t *);
+
     // load into hunk
     len = strlen(name);
     bsp = Z_Mallocz(sizeof(*bsp) + len);
@@ -1052,8 +1402,12 @@ qerror_t BSP_Load(const char *name, bsp_t **bsp_p)
         goto fail1;
     }
 
+    BSP_BuildCollision(bsp);
+
     Hunk_End(&bsp->hunk);
 
+    BSP_BuildVisMatrix(bsp);
+
     List_Append(&bsp_cache, &bsp->entry);
 
     FS_FreeFile(buf);
@@ -1189,86 +1543,6 @@ void BSP_TransformedLightPoint(lightpoint_t *point, vec3_t start, vec3_t end,
 
 #endif
 
-byte *BSP_ClusterVis(bsp_t *bsp, byte *mask, int cluster, int vis)
-{
-    byte    *in, *out, *in_end, *out_end;
-    int     c;
-
-    if (!bsp || !bsp->vis) {
-        return memset(mask, 0xff, VIS_MAX_BYTES);
-    }
-    if (cluster == -1) {
-        return memset(mask, 0, bsp->visrowsize);
-    }
-    if (cluster < 0 || cluster >= bsp->vis->numclusters) {
-        Com_Error(ERR_DROP, "%s: bad cluster", __func__);
-    }
-
-    // decompress vis
-    in_end = (byte *)bsp->vis + bsp->numvisibility;
-    in = (byte *)bsp->vis + bsp->vis->bitofs[cluster][vis];
-    out_end = mask + bsp->visrowsize;
-    out = mask;
-    do {
-        if (in >= in_end) {
-            goto overrun;
-        }
-        if (*in) {
-            *out++ = *in++;
-            continue;
-        }
-
-        if (in + 1 >= in_end) {
-            goto overrun;
-        }
-        c = in[1];
-        in += 2;
-        if (out + c > out_end) {
-overrun:
-            c = out_end - out;
-        }
-        while (c--) {
-            *out++ = 0;
-        }
-    } while (out < out_end);
-
-    // apply our ugly PVS patches
-    if (map_visibility_patch->integer) {
-        if (bsp->checksum == 0x1e5b50c5) {
-            // q2dm3, pent bridge
-            if (cluster == 345 || cluster == 384) {
-                Q_SetBit(mask, 466);
-                Q_SetBit(mask, 484);
-                Q_SetBit(mask, 692);
-            }
-        } else if (bsp->checksum == 0x04cfa792) {
-            // q2dm1, above lower RL
-            if (cluster == 395) {
-                Q_SetBit(mask, 176);
-                Q_SetBit(mask, 183);
-            }
-        } else if (bsp->checksum == 0x2c3ab9b0) {
-            // q2dm8, CG/RG area
-            if (cluster == 629 || cluster == 631 ||
-                cluster == 633 || cluster == 639) {
-                Q_SetBit(mask, 908);
-                Q_SetBit(mask, 909);
-                Q_SetBit(mask, 910);
-                Q_SetBit(mask, 915);
-                Q_SetBit(mask, 923);
-                Q_SetBit(mask, 924);
-                Q_SetBit(mask, 927);
-                Q_SetBit(mask, 930);
-                Q_SetBit(mask, 938);
-                Q_SetBit(mask, 939);
-                Q_SetBit(mask, 947);
-            }
-        }
-    }
-
-    return mask;
-}
-
 mleaf_t *BSP_PointLeaf(mnode_t *node, vec3_t p)
 {
     float d;
@@ -1310,8 +1584,10 @@ mmodel_t *BSP_InlineModel(bsp_t *bsp, const char *name)
 void BSP_Init(void)
 {
     map_visibility_patch = Cvar_Get("map_visibility_patch", "1", 0);
+    map_visibility_cache = Cvar_Get("map_visibility_cache", "32", 0);
 
     Cmd_AddCommand("bsplist", BSP_List_f);
+    Cmd_AddCommand("bspvisstats", BSP_VisStats_f);
 
     List_Init(&bsp_cache);
 }
@@ -18,6 +18,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // cmodel.c -- model loading
 
 #include "shared/shared.h"
+#include "common/bits.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/cmodel.h"
@@ -26,10 +27,12 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/math.h"
 #include "common/zone.h"
 #include "system/hunk.h"
+#include "system/system.h"
 
 mtexinfo_t nulltexinfo;
 
 static mleaf_t      nullleaf;
+static cnode_t      nullcnode;
 
 static int          floodvalid;
 static int          checkcount;
@@ -118,6 +121,12 @@ static mbrushside_t box_brushsides[6];
 static mleaf_t  box_leaf;
 static mleaf_t  box_emptyleaf;
 
+// collision representation of the above, [6] is box_leaf, [7] is box_emptyleaf
+static cnode_t      box_cnodes[8];
+static cbrush_t     box_cbrush;
+static cbrush_t     *box_cleafbrush;
+static cbrushside_t box_cbrushsides[6];
+
 /*
 ===================
 CM_InitBoxHull
@@ -133,6 +142,7 @@ static void CM_InitBoxHull(void)
     mnode_t     *c;
     cplane_t    *p;
     mbrushside_t    *s;
+    cnode_t     *n;
 
     box_headnode = &box_nodes[0];
 
@@ -176,6 +186,39 @@ static void CM_InitBoxHull(void)
         VectorClear(p->normal);
         p->normal[i >> 1] = -1;
     }
+
+    // collision representation
+    box_cbrush.numsides = 6;
+    box_cbrush.firstside = &box_cbrushsides[0];
+    box_cbrush.contents = CONTENTS_MONSTER;
+
+    box_cleafbrush = &box_cbrush;
+
+    n = &box_cnodes[6];
+    n->contents = CONTENTS_MONSTER;
+    n->numbrushes = 1;
+    n->firstbrush = &box_cleafbrush;
+    n->type = CNODE_LEAF;
+    box_leaf.cnode = n;
+
+    n = &box_cnodes[7];
+    n->type = CNODE_LEAF;
+    box_emptyleaf.cnode = n;
+
+    for (i = 0; i < 6; i++) {
+        side = i & 1;
+
+        box_cbrushsides[i].plane = *box_brushsides[i].plane;
+        box_cbrushsides[i].surface = &nulltexinfo.c;
+
+        n = &box_cnodes[i];
+        VectorCopy(box_nodes[i].plane->normal, n->normal);
+        n->type = box_nodes[i].plane->type;
+        n->signbits = box_nodes[i].plane->signbits;
+        n->children[side] = 7 - i;
+        n->children[side ^ 1] = 1;
+        box_nodes[i].cnode = n;
+    }
 }
 
 
@@ -202,6 +245,23 @@ mnode_t *CM_HeadnodeForBox(vec3_t mins, vec3_t maxs)
     box_planes[10].dist = mins[2];
     box_planes[11].dist = -mins[2];
 
+    box_cnodes[0].dist = maxs[0];
+    box_cnodes[1].dist = mins[0];
+    box_cnodes[2].dist = maxs[1];
+    box_cnodes[3].dist = mins[1];
+    box_cnodes[4].dist = maxs[2];
+    box_cnodes[5].dist = mins[2];
+
+    box_cbrushsides[0].plane.dist = maxs[0];
+    box_cbrushsides[1].plane.dist = -mins[0];
+    box_cbrushsides[2].plane.dist = maxs[1];
+    box_cbrushsides[3].plane.dist = -mins[1];
+    box_cbrushsides[4].plane.dist = maxs[2];
+    box_cbrushsides[5].plane.dist = -mins[2];
+
+    VectorCopy(mins, box_cbrush.mins);
+    VectorCopy(maxs, box_cbrush.maxs);
+
     return box_headnode;
 }
 
@@ -221,53 +281,58 @@ CM_BoxLeafnums
 Fills in a list of all the leafs touched
 =============
 */
-static int      leaf_count, leaf_maxcount;
-static mleaf_t  **leaf_list;
-static float    *leaf_mins, *leaf_maxs;
-static mnode_t  *leaf_topnode;
-
-static void CM_BoxLeafs_r(mnode_t *node)
+typedef struct {
+    int         count, maxcount;
+    mleaf_t     **list;
+    float       *mins, *maxs;
+    mnode_t     *topnode;
+} boxleafs_t;
+
+// state is passed explicitly to allow concurrent calls from server threads
+static void CM_BoxLeafs_r(boxleafs_t *bl, mnode_t *node)
 {
     int     s;
 
     while (node->plane) {
-        s = BoxOnPlaneSideFast(leaf_mins, leaf_maxs, node->plane);
+        s = BoxOnPlaneSideFast(bl->mins, bl->maxs, node->plane);
         if (s == 1) {
             node = node->children[0];
         } else if (s == 2) {
             node = node->children[1];
         } else {
             // go down both
-            if (!leaf_topnode) {
-                leaf_topnode = node;
+            if (!bl->topnode) {
+                bl->topnode = node;
             }
-            CM_BoxLeafs_r(node->children[0]);
+            CM_BoxLeafs_r(bl, node->children[0]);
             node = node->children[1];
         }
     }
 
-    if (leaf_count < leaf_maxcount) {
-        leaf_list[leaf_count++] = (mleaf_t *)node;
+    if (bl->count < bl->maxcount) {
+        bl->list[bl->count++] = (mleaf_t *)node;
     }
 }
 
 static int CM_BoxLeafs_headnode(vec3_t mins, vec3_t maxs, mleaf_t **list, int listsize,
                                 mnode_t *headnode, mnode_t **topnode)
 {
-    leaf_list = list;
-    leaf_count = 0;
-    leaf_maxcount = listsize;
-    leaf_mins = mins;
-    leaf_maxs = maxs;
+    boxleafs_t  bl;
+
+    bl.list = list;
+    bl.count = 0;
+    bl.maxcount = listsize;
+    bl.mins = mins;
+    bl.maxs = maxs;
 
-    leaf_topnode = NULL;
+    bl.topnode = NULL;
 
-    CM_BoxLeafs_r(headnode);
+    CM_BoxLeafs_r(&bl, headnode);
 
     if (topnode)
-        *topnode = leaf_topnode;
+        *topnode = bl.topnode;
 
-    return leaf_count;
+    return bl.count;
 }
 
 int CM_BoxLeafs(cm_t *cm, vec3_t mins, vec3_t maxs, mleaf_t **list, int listsize, mnode_t **topnode)
@@ -352,6 +417,7 @@ BOX TRACING
 static vec3_t   trace_start, trace_end;
 static vec3_t   trace_mins, trace_maxs;
 static vec3_t   trace_extents;
+static vec3_t   trace_absmins, trace_absmaxs;
 
 static trace_t  *trace_trace;
 static int      trace_contents;
@@ -363,7 +429,7 @@ CM_ClipBoxToBrush
 ================
 */
 static void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
-                              trace_t *trace, mbrush_t *brush)
+                              trace_t *trace, cbrush_t *brush)
 {
     int         i, j;
     cplane_t    *plane, *clipplane;
@@ -373,7 +439,7 @@ static void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
     float       d1, d2;
     qboolean    getout, startout;
     float       f;
-    mbrushside_t    *side, *leadside;
+    cbrushside_t    *side, *leadside;
 
     enterfrac = -1;
     leavefrac = 1;
@@ -386,9 +452,9 @@ static void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
     startout = qfalse;
     leadside = NULL;
 
-    side = brush->firstbrushside;
+    side = brush->firstside;
     for (i = 0; i < brush->numsides; i++, side++) {
-        plane = side->plane;
+        plane = &side->plane;
 
         // FIXME: special case for axial
 
@@ -462,7 +528,7 @@ static void CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1, vec3_t p2,
                 enterfrac = 0;
             trace->fraction = enterfrac;
             trace->plane = *clipplane;
-            trace->surface = &(leadside->texinfo->c);
+            trace->surface = leadside->surface;
             trace->contents = brush->contents;
         }
     }
@@ -474,21 +540,21 @@ CM_TestBoxInBrush
 ================
 */
 static void CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
-                              trace_t *trace, mbrush_t *brush)
+                              trace_t *trace, cbrush_t *brush)
 {
     int         i, j;
     cplane_t    *plane;
     float       dist;
     vec3_t      ofs;
     float       d1;
-    mbrushside_t    *side;
+    cbrushside_t    *side;
 
     if (!brush->numsides)
         return;
 
-    side = brush->firstbrushside;
+    side = brush->firstside;
     for (i = 0; i < brush->numsides; i++, side++) {
-        plane = side->plane;
+        plane = &side->plane;
 
         // FIXME: special case for axial
 
@@ -521,21 +587,36 @@ static void CM_TestBoxInBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 }
 
 
+/*
+================
+CM_BrushOutside
+
+Returns true if brush bounds are more than 1 unit away from the swept box.
+Such brush can't affect the trace, so it is not worth clipping against.
+================
+*/
+static inline qboolean CM_BrushOutside(const cbrush_t *brush)
+{
+    return trace_absmins[0] > brush->maxs[0] || trace_absmaxs[0] < brush->mins[0]
+        || trace_absmins[1] > brush->maxs[1] || trace_absmaxs[1] < brush->mins[1]
+        || trace_absmins[2] > brush->maxs[2] || trace_absmaxs[2] < brush->mins[2];
+}
+
 /*
 ================
 CM_TraceToLeaf
 ================
 */
-static void CM_TraceToLeaf(mleaf_t *leaf)
+static void CM_TraceToLeaf(cnode_t *leaf)
 {
     int         k;
-    mbrush_t    *b, **leafbrush;
+    cbrush_t    *b, **leafbrush;
 
     if (!(leaf->contents & trace_contents))
         return;
     // trace line against all brushes in the leaf
-    leafbrush = leaf->firstleafbrush;
-    for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
+    leafbrush = leaf->firstbrush;
+    for (k = 0; k < leaf->numbrushes; k++, leafbrush++) {
         b = *leafbrush;
         if (b->checkcount == checkcount)
             continue;   // already checked this brush in another leaf
@@ -543,6 +624,8 @@ static void CM_TraceToLeaf(mleaf_t *leaf)
 
         if (!(b->contents & trace_contents))
             continue;
+        if (CM_BrushOutside(b))
+            continue;
         CM_ClipBoxToBrush(trace_mins, trace_maxs, trace_start, trace_end, trace_trace, b);
         if (!trace_trace->fraction)
             return;
@@ -556,16 +639,16 @@ static void CM_TraceToLeaf(mleaf_t *leaf)
 CM_TestInLeaf
 ================
 */
-static void CM_TestInLeaf(mleaf_t *leaf)
+static void CM_TestInLeaf(cnode_t *leaf)
 {
     int         k;
-    mbrush_t    *b, **leafbrush;
+    cbrush_t    *b, **leafbrush;
 
     if (!(leaf->contents & trace_contents))
         return;
     // trace line against all brushes in the leaf
-    leafbrush = leaf->firstleafbrush;
-    for (k = 0; k < leaf->numleafbrushes; k++, leafbrush++) {
+    leafbrush = leaf->firstbrush;
+    for (k = 0; k < leaf->numbrushes; k++, leafbrush++) {
         b = *leafbrush;
         if (b->checkcount == checkcount)
             continue;   // already checked this brush in another leaf
@@ -573,6 +656,8 @@ static void CM_TestInLeaf(mleaf_t *leaf)
 
         if (!(b->contents & trace_contents))
             continue;
+        if (CM_BrushOutside(b))
+            continue;
         CM_TestBoxInBrush(trace_mins, trace_maxs, trace_start, trace_trace, b);
         if (!trace_trace->fraction)
             return;
@@ -587,9 +672,8 @@ CM_RecursiveHullCheck
 
 ==================
 */
-static void CM_RecursiveHullCheck(mnode_t *node, float p1f, float p2f, vec3_t p1, vec3_t p2)
+static void CM_RecursiveHullCheck(cnode_t *node, float p1f, float p2f, vec3_t p1, vec3_t p2)
 {
-    cplane_t    *plane;
     float       t1, t2, offset;
     float       frac, frac2;
     float       idist;
@@ -601,10 +685,8 @@ static void CM_RecursiveHullCheck(mnode_t *node, float p1f, float p2f, vec3_t p1
         return;     // already hit something nearer
 
 recheck:
-    // if plane is NULL, we are in a leaf node
-    plane = node->plane;
-    if (!plane) {
-        CM_TraceToLeaf((mleaf_t *)node);
+    if (node->type == CNODE_LEAF) {
+        CM_TraceToLeaf(node);
         return;
     }
 
@@ -612,28 +694,28 @@ recheck:
     // find the point distances to the seperating plane
     // and the offset for the size of the box
     //
-    if (plane->type < 3) {
-        t1 = p1[plane->type] - plane->dist;
-        t2 = p2[plane->type] - plane->dist;
-        offset = trace_extents[plane->type];
+    if (node->type < 3) {
+        t1 = p1[node->type] - node->dist;
+        t2 = p2[node->type] - node->dist;
+        offset = trace_extents[node->type];
     } else {
-        t1 = PlaneDiff(p1, plane);
-        t2 = PlaneDiff(p2, plane);
+        t1 = PlaneDiff(p1, node);
+        t2 = PlaneDiff(p2, node);
         if (trace_ispoint)
             offset = 0;
         else
-            offset = fabs(trace_extents[0] * plane->normal[0]) +
-                     fabs(trace_extents[1] * plane->normal[1]) +
-                     fabs(trace_extents[2] * plane->normal[2]);
+            offset = fabs(trace_extents[0] * node->normal[0]) +
+                     fabs(trace_extents[1] * node->normal[1]) +
+                     fabs(trace_extents[2] * node->normal[2]);
     }
 
     // see which sides we need to consider
     if (t1 >= offset && t2 >= offset) {
-        node = node->children[0];
+        node += node->children[0];
         goto recheck;
     }
     if (t1 < -offset && t2 < -offset) {
-        node = node->children[1];
+        node += node->children[1];
         goto recheck;
     }
 
@@ -660,7 +742,7 @@ recheck:
     midf = p1f + (p2f - p1f) * frac;
     LerpVector(p1, p2, frac, mid);
 
-    CM_RecursiveHullCheck(node->children[side], p1f, midf, p1, mid);
+    CM_RecursiveHullCheck(node + node->children[side], p1f, midf, p1, mid);
 
     // go past the node
     clamp(frac2, 0, 1);
@@ -668,7 +750,7 @@ recheck:
     midf = p1f + (p2f - p1f) * frac2;
     LerpVector(p1, p2, frac2, mid);
 
-    CM_RecursiveHullCheck(node->children[side ^ 1], midf, p2f, mid, p2);
+    CM_RecursiveHullCheck(node + node->children[side ^ 1], midf, p2f, mid, p2);
 }
 
 
@@ -684,6 +766,8 @@ void CM_BoxTrace(trace_t *trace, vec3_t start, vec3_t end,
                  vec3_t mins, vec3_t maxs,
                  mnode_t *headnode, int brushmask)
 {
+    int     i;
+
     checkcount++;       // for multi-check avoidance
 
     // fill in a default trace
@@ -702,12 +786,18 @@ void CM_BoxTrace(trace_t *trace, vec3_t start, vec3_t end,
     VectorCopy(mins, trace_mins);
     VectorCopy(maxs, trace_maxs);
 
+    // bounds of the swept box, with 1 unit margin
+    for (i = 0; i < 3; i++) {
+        trace_absmins[i] = min(start[i], end[i]) + mins[i] - 1;
+        trace_absmaxs[i] = max(start[i], end[i]) + maxs[i] + 1;
+    }
+
     //
     // check for position test special case
     //
     if (start[0] == end[0] && start[1] == end[1] && start[2] == end[2]) {
         mleaf_t     *leafs[1024];
-        int     i, numleafs;
+        int     numleafs;
         vec3_t  c1, c2;
 
         VectorAdd(start, mins, c1);
@@ -719,7 +809,7 @@ void CM_BoxTrace(trace_t *trace, vec3_t start, vec3_t end,
 
         numleafs = CM_BoxLeafs_headnode(c1, c2, leafs, 1024, headnode, NULL);
         for (i = 0; i < numleafs; i++) {
-            CM_TestInLeaf(leafs[i]);
+            CM_TestInLeaf(leafs[i]->cnode);
             if (trace_trace->allsolid)
                 break;
         }
@@ -744,7 +834,7 @@ void CM_BoxTrace(trace_t *trace, vec3_t start, vec3_t end,
     //
     // general sweeping through world
     //
-    CM_RecursiveHullCheck(headnode, 0, 1, start, end);
+    CM_RecursiveHullCheck(BSP_CollisionNode(headnode), 0, 1, start, end);
 
     if (trace_trace->fraction == 1)
         VectorCopy(end, trace_trace->endpos);
@@ -925,8 +1015,6 @@ This is used by the client refreshes to cull visibility
 int CM_WriteAreaBits(cm_t *cm, byte *buffer, int area)
 {
     bsp_t   *cache = cm->cache;
-    int     i;
-    int     floodnum;
     int     bytes;
 
     if (!cache) {
@@ -939,14 +1027,7 @@ int CM_WriteAreaBits(cm_t *cm, byte *buffer, int area)
         // for debugging, send everything
         memset(buffer, 255, bytes);
     } else {
-        memset(buffer, 0, bytes);
-
-        floodnum = cm->floodnums[area];
-        for (i = 0; i < cache->numareas; i++) {
-            if (cm->floodnums[i] == floodnum) {
-                Q_SetBit(buffer, i);
-            }
-        }
+        Bits_MatchInts(buffer, cm->floodnums, cache->numareas, cm->floodnums[area]);
     }
 
     return bytes;
@@ -1013,7 +1094,7 @@ Returns qtrue if any leaf under headnode has a cluster that
 is potentially visible
 =============
 */
-qboolean CM_HeadnodeVisible(mnode_t *node, byte *visbits)
+qboolean CM_HeadnodeVisible(mnode_t *node, const byte *visbits)
 {
     mleaf_t *leaf;
     int     cluster;
@@ -1047,8 +1128,8 @@ byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org)
     byte    temp[VIS_MAX_BYTES];
     mleaf_t *leafs[64];
     int     clusters[64];
-    int     i, j, count, longs;
-    uint_fast32_t *src, *dst;
+    int     i, j, count;
+    size_t  bytes;
     vec3_t  mins, maxs;
 
     if (!cm->cache) {   // map not loaded
@@ -1066,7 +1147,7 @@ byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org)
     count = CM_BoxLeafs(cm, mins, maxs, leafs, 64, NULL);
     if (count < 1)
         Com_Error(ERR_DROP, "CM_FatPVS: leaf count < 1");
-    longs = VIS_FAST_LONGS(cm->cache);
+    bytes = VIS_FAST_LONGS(cm->cache) * sizeof(uint_fast32_t);
 
     // convert leafs to clusters
     for (i = 0; i < count; i++) {
@@ -1082,11 +1163,7 @@ byte *CM_FatPVS(cm_t *cm, byte *mask, const vec3_t org)
                 goto nextleaf; // already have the cluster we want
             }
         }
-        src = (uint_fast32_t *)BSP_ClusterVis(cm->cache, temp, clusters[i], DVIS_PVS);
-        dst = (uint_fast32_t *)mask;
-        for (j = 0; j < longs; j++) {
-            *dst++ |= *src++;
-        }
+        Bits_Or(mask, BSP_GetClusterVis(cm->cache, temp, clusters[i], DVIS_PVS), bytes);
 
 nextleaf:;
     }
@@ -1094,6 +1171,151 @@ nextleaf:;
     return mask;
 }
 
+/*
+===============================================================================
+
+BENCHMARK
+
+===============================================================================
+*/
+
+#define BENCH_MAX_TRACES    (1 << 20)
+
+typedef struct {
+    vec3_t  start, end;
+    int     box;
+} benchtrace_t;
+
+static const vec3_t bench_boxes[][2] = {
+    { {   0,   0,   0 }, {  0,  0,  0 } },    // point
+    { { -16, -16, -24 }, { 16, 16, 32 } },    // player
+    { {  -4,  -4,  -4 }, {  4,  4,  4 } },    // projectile
+    { { -32, -32, -24 }, { 32, 32, 64 } },    // large monster
+};
+
+static uint32_t bench_seed;
+
+static float bench_rand(float lo, float hi)
+{
+    bench_seed = bench_seed * 1664525 + 1013904223;
+    return lo + (hi - lo) * (bench_seed >> 8) * (1.0f / (1 << 24));
+}
+
+static uint32_t bench_hash(uint32_t hash, const void *data, size_t len)
+{
+    const byte *p = data;
+
+    while (len--) {
+        hash = (hash ^ *p++) * 16777619;
+    }
+
+    return hash;
+}
+
+/*
+==================
+CM_Bench_f
+
+Fires random box traces through the given map and prints trace rate.
+Checksum of trace results is printed to verify changes to trace code.
+==================
+*/
+static void CM_Bench_f(void)
+{
+    char            path[MAX_QPATH];
+    bsp_t           *bsp;
+    qerror_t        ret;
+    benchtrace_t    *traces, *t;
+    trace_t         tr;
+    mnode_t         *headnode;
+    vec_t           *mins, *maxs;
+    vec3_t          ofs;
+    uint32_t        hash;
+    unsigned        start, msec;
+    int             i, j, count, hits, solid;
+
+    if (Cmd_Argc() < 2) {
+        Com_Printf("Usage: %s <map> [count]\n", Cmd_Argv(0));
+        return;
+    }
+
+    if (Q_concat(path, sizeof(path), "maps/", Cmd_Argv(1), ".bsp", NULL) >= sizeof(path)) {
+        Com_Printf("Oversize map name\n");
+        return;
+    }
+
+    count = 100000;
+    if (Cmd_Argc() > 2) {
+        count = atoi(Cmd_Argv(2));
+        clamp(count, 1, BENCH_MAX_TRACES);
+    }
+
+    ret = BSP_Load(path, &bsp);
+    if (!bsp) {
+        Com_EPrintf("Couldn't load %s: %s\n", path, Q_ErrorString(ret));
+        return;
+    }
+
+    // generate traces in advance: one half crosses the map, the other half
+    // are short moves, every eighth is a position test
+    mins = bsp->models[0].mins;
+    maxs = bsp->models[0].maxs;
+    traces = Z_Malloc(sizeof(*traces) * count);
+    bench_seed = 1;
+    for (i = 0, t = traces; i < count; i++, t++) {
+        for (j = 0; j < 3; j++) {
+            t->start[j] = bench_rand(mins[j], maxs[j]);
+            if (!(i & 7))
+                t->end[j] = t->start[j];
+            else if (i & 1)
+                t->end[j] = bench_rand(mins[j], maxs[j]);
+            else
+                t->end[j] = t->start[j] + bench_rand(-64, 64);
+        }
+        t->box = (i >> 3) % q_countof(bench_boxes);
+    }
+
+    headnode = bsp->nodes;
+    hits = solid = 0;
+    start = Sys_Milliseconds();
+    for (i = 0, t = traces; i < count; i++, t++) {
+        CM_BoxTrace(&tr, t->start, t->end,
+                    (vec_t *)bench_boxes[t->box][0],
+                    (vec_t *)bench_boxes[t->box][1],
+                    headnode, MASK_PLAYERSOLID);
+        if (tr.fraction < 1)
+            hits++;
+        if (tr.startsolid)
+            solid++;
+    }
+    msec = Sys_Milliseconds() - start;
+
+    // checksum results in a separate pass
+    hash = 2166136261;
+    for (i = 0, t = traces; i < count; i++, t++) {
+        CM_BoxTrace(&tr, t->start, t->end,
+                    (vec_t *)bench_boxes[t->box][0],
+                    (vec_t *)bench_boxes[t->box][1],
+                    headnode, MASK_PLAYERSOLID);
+        VectorSubtract(tr.endpos, t->start, ofs);
+        hash = bench_hash(hash, &tr.fraction, sizeof(tr.fraction));
+        hash = bench_hash(hash, ofs, sizeof(ofs));
+        hash = bench_hash(hash, tr.plane.normal, sizeof(tr.plane.normal));
+        hash = bench_hash(hash, &tr.plane.dist, sizeof(tr.plane.dist));
+        hash = bench_hash(hash, &tr.contents, sizeof(tr.contents));
+        hash = bench_hash(hash, tr.surface->name, strlen(tr.surface->name));
+        j = tr.allsolid | (tr.startsolid << 1);
+        hash = bench_hash(hash, &j, sizeof(j));
+    }
+
+    Z_Free(traces);
+    BSP_Free(bsp);
+
+    Com_Printf("%d traces in %u ms, %.0f traces/sec\n", count, msec,
+               msec ? count * 1000.0 / msec : 0.0);
+    Com_Printf("%d hit, %d started in solid, checksum %08x\n", hits, solid, hash);
+}
+
 /*
 =============
 CM_Init
@@ -1104,7 +1326,11 @@ void CM_Init(void)
     CM_InitBoxHull();
 
     nullleaf.cluster = -1;
+    nullleaf.cnode = &nullcnode;
+    nullcnode.type = CNODE_LEAF;
 
     map_noareas = Cvar_Get("map_noareas", "0", 0);
     map_allsolid_bug = Cvar_Get("map_allsolid_bug", "1", 0);
+
+    Cmd_AddCommand("cm_bench", CM_Bench_f);
 }
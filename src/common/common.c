@@ -22,6 +22,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "shared/shared.h"
 
+#include "common/bits.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/cmodel.h"
@@ -31,6 +32,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/field.h"
 #include "common/fifo.h"
 #include "common/files.h"
+#include "common/jobs.h"
 #include "common/math.h"
 #include "common/mdfour.h"
 #include "common/msg.h"
@@ -53,6 +55,9 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 static jmp_buf  com_abortframe;    // an ERR_DROP occured, exit the entire frame
 
+static q_threadlocal jmp_buf            com_deferframe;
+static q_threadlocal deferred_error_t   *com_deferred;
+
 static void     (*com_abort_func)(void *);
 static void     *com_abort_arg;
 
@@ -400,6 +405,14 @@ void Com_LPrintf(print_type_t type, const char *fmt, ...)
     char        msg[MAXPRINTMSG];
     size_t      len;
 
+    // console is not thread safe
+    if (q_unlikely(!Job_IsMainThread())) {
+        va_start(argptr, fmt);
+        Job_Print(type, fmt, argptr);
+        va_end(argptr);
+        return;
+    }
+
     // may be entered recursively only once
     if (com_printEntered >= 2) {
         return;
@@ -483,6 +496,19 @@ void Com_Error(error_type_t code, const char *fmt, ...)
     char            msg[MAXERRORMSG];
     va_list         argptr;
     size_t          len;
+    deferred_error_t    *err;
+
+    // don't unwind the stack of another thread, save the error instead
+    if (com_deferred) {
+        err = com_deferred;
+        com_deferred = NULL;
+        err->failed = qtrue;
+        err->code = code;
+        va_start(argptr, fmt);
+        Q_vsnprintf(err->msg, sizeof(err->msg), fmt, argptr);
+        va_end(argptr);
+        longjmp(com_deferframe, -1);
+    }
 
     // may not be entered recursively
     if (com_errorEntered) {
@@ -576,6 +602,40 @@ void Com_AbortFunc(void (*func)(void *), void *arg)
     com_abort_arg = arg;
 }
 
+/*
+=============
+Com_DeferErrors
+
+Calls func so that Com_Error returns here instead of exiting the frame.
+Used by parallel code called through Sys_RunThreads, which may be running
+on any thread, including main one. Error is saved into err.
+=============
+*/
+void Com_DeferErrors(void (*func)(void *, int), void *arg, int index,
+                     deferred_error_t *err)
+{
+    err->failed = qfalse;
+    if (!setjmp(com_deferframe)) {
+        com_deferred = err;
+        func(arg, index);
+    }
+    com_deferred = NULL;
+}
+
+/*
+=============
+Com_RaiseDeferred
+
+Raises error saved by Com_DeferErrors, if any. Must be called by main thread.
+=============
+*/
+void Com_RaiseDeferred(const deferred_error_t *err)
+{
+    if (err->failed) {
+        Com_Error(err->code, "%s", err->msg);
+    }
+}
+
 #ifdef _WIN32
 void Com_AbortFrame(void)
 {
@@ -606,6 +666,7 @@ void Com_Quit(const char *reason, error_type_t type)
 
     SV_Shutdown(buffer, type);
     CL_Shutdown();
+    Job_Shutdown();
     NET_Shutdown();
     logfile_close();
     FS_Shutdown();
@@ -1004,6 +1065,8 @@ void Qcommon_Init(int argc, char **argv)
 
     Netchan_Init();
     NET_Init();
+    Job_Init();
+    Bits_Init();
     BSP_Init();
     CM_Init();
     SV_Init();
@@ -1064,6 +1127,9 @@ void Qcommon_Frame(void)
         return;            // an ERR_DROP was thrown
     }
 
+    // run completion callbacks of finished background jobs
+    Job_Complete();
+
 #if USE_CLIENT
     time_before = time_event = time_between = time_after = 0;
 
@@ -120,6 +120,8 @@ typedef struct {
     filetype_t  type;       // FS_PAK or FS_ZIP
     unsigned    refcount;   // for tracking pack users
     FILE        *fp;
+    byte        *map;       // read-only mapping of the entire pack, if any
+    size_t      mapsize;
     unsigned    num_files;
     packfile_t  *files;
     packfile_t  **file_hash;
@@ -148,8 +150,27 @@ typedef struct {
     qerror_t    error;      // stream error indicator from read/write operation
     size_t      rest_out;   // remaining unread length for FS_PAK/FS_ZIP
     size_t      length;     // total cached file length
+    const byte  *view;      // entry data if pack is memory mapped
 } file_t;
 
+// zero-copy buffer returned by FS_LoadFileEx, holds pack reference
+typedef struct {
+    const void  *base;
+    pack_t      *pack;
+} fileview_t;
+
+#define MAX_FILE_VIEWS  64
+
+// location of a file in one of the search paths
+typedef struct indexfile_s {
+    struct indexfile_s  *hash_next;
+    searchpath_t        *search;
+    packfile_t          *entry;     // NULL for files in directory tree
+    unsigned            order;      // search path position, lower wins
+    size_t              namelen;
+    const char          *name;
+} indexfile_t;
+
 typedef struct {
     list_t  entry;
     size_t  targlen;
@@ -170,6 +191,15 @@ static list_t       fs_soft_links;
 
 static file_t       fs_files[MAX_FILE_HANDLES];
 
+static fileview_t   fs_views[MAX_FILE_VIEWS];
+static int          fs_num_views;
+
+// merged index of all search paths, built when search path is set up
+static indexfile_t  **fs_index;
+static unsigned     fs_index_size;
+static unsigned     fs_index_count;
+static sysmutex_t   *fs_index_lock;
+
 #ifdef _DEBUG
 static int          fs_count_read;
 static int          fs_count_open;
@@ -190,6 +220,9 @@ static int          fs_count_strlwr;
 static cvar_t       *fs_debug;
 #endif
 
+static cvar_t       *fs_mmap;
+static cvar_t       *fs_index_files;
+
 cvar_t              *fs_game;
 
 #if USE_ZLIB
@@ -535,7 +568,7 @@ static qerror_t seek_pak_file(file_t *file, off_t offset)
         return Q_ERR_INVAL;
 
     filepos = entry->filepos + offset;
-    if (fseek(file->fp, filepos, SEEK_SET) == -1)
+    if (!file->view && fseek(file->fp, filepos, SEEK_SET) == -1)
         return Q_Errno();
 
     file->rest_out = entry->filelen - offset;
@@ -830,6 +863,34 @@ static qerror_t get_fp_info(FILE *fp, file_info_t *info)
     return Q_ERR_SUCCESS;
 }
 
+/*
+============
+FS_ModTime
+
+Returns modification time of the underlying file (or pack file for files
+opened from a pack).
+============
+*/
+qerror_t FS_ModTime(qhandle_t f, time_t *mtime)
+{
+    file_t *file = file_for_handle(f);
+    file_info_t info;
+    qerror_t ret;
+
+    if (!file)
+        return Q_ERR_BADF;
+
+    if (!file->fp)
+        return Q_ERR_NOSYS;
+
+    ret = get_fp_info(file->fp, &info);
+    if (ret)
+        return ret;
+
+    *mtime = info.mtime;
+    return Q_ERR_SUCCESS;
+}
+
 FILE *Q_fopen(const char *path, const char *mode)
 {
 #ifndef _GNU_SOURCE
@@ -873,6 +934,180 @@ FILE *Q_fopen(const char *path, const char *mode)
     return fopen(path, mode);
 }
 
+/*
+============================================================================
+
+GLOBAL FILE INDEX
+
+Maps each path to all of its locations across search paths, sorted by
+search path precedence, so that lookups don't have to probe every pack
+and hit the disk for each directory in the search path. The index is
+built once the search path is set up, and directory trees are scanned at
+that point. Files created through the filesystem afterwards are added to
+the index, which is locked since files may be opened from any thread.
+Files created by external means are not seen until ‘fs_restart’. Symbolic
+links are expanded before looking up the index and don't change it.
+
+============================================================================
+*/
+
+static void index_free(void)
+{
+    indexfile_t *file, *next;
+    unsigned i;
+
+    if (!fs_index)
+        return;
+
+    Sys_LockMutex(fs_index_lock);
+
+    for (i = 0; i < fs_index_size; i++) {
+        for (file = fs_index[i]; file; file = next) {
+            next = file->hash_next;
+            Z_Free(file);
+        }
+    }
+
+    Z_Free(fs_index);
+    fs_index = NULL;
+    fs_index_size = 0;
+    fs_index_count = 0;
+
+    Sys_UnlockMutex(fs_index_lock);
+}
+
+static void index_add(searchpath_t *search, unsigned order, packfile_t *entry,
+                      const char *name, size_t namelen)
+{
+    indexfile_t *file, **prev;
+    unsigned hash;
+
+    hash = FS_HashPathLen(name, namelen, fs_index_size);
+
+    // keep bucket sorted by precedence, skip duplicates
+    for (prev = &fs_index[hash]; (file = *prev) != NULL; prev = &file->hash_next) {
+        if (file->order > order)
+            break;
+        if (file->search == search && file->namelen == namelen &&
+            !FS_pathcmp(file->name, name))
+            return;
+    }
+
+    if (entry) {
+        file = FS_Malloc(sizeof(*file));
+        file->name = entry->name;
+    } else {
+        file = FS_Malloc(sizeof(*file) + namelen + 1);
+        file->name = memcpy(file + 1, name, namelen + 1);
+    }
+    file->search = search;
+    file->entry = entry;
+    file->order = order;
+    file->namelen = namelen;
+    file->hash_next = *prev;
+    *prev = file;
+
+    fs_index_count++;
+}
+
+static void index_build(void)
+{
+    searchpath_t *search;
+    listfiles_t *lists;
+    pack_t *pack;
+    unsigned i, j, order, total;
+
+    for (order = 0, search = fs_searchpaths; search; search = search->next)
+        order++;
+
+    // scan directory trees
+    lists = FS_Mallocz(sizeof(*lists) * order);
+    total = 0;
+    for (i = 0, search = fs_searchpaths; search; search = search->next, i++) {
+        if (search->pack) {
+            total += search->pack->num_files;
+            continue;
+        }
+        lists[i].filter = "*";
+        lists[i].flags = FS_SEARCH_BYFILTER | FS_SEARCH_SAVEPATH;
+        lists[i].baselen = strlen(search->filename) + 1;
+        Sys_ListFiles_r(&lists[i], search->filename, 0);
+        total += lists[i].count;
+    }
+
+    Sys_LockMutex(fs_index_lock);
+
+    fs_index_size = npot32(total / 2 + 1);
+    fs_index = FS_Mallocz(sizeof(fs_index[0]) * fs_index_size);
+
+    // add in reverse order so that insertion at bucket head is the common case
+    for (i = order; i-- > 0;) {
+        for (j = 0, search = fs_searchpaths; j < i; j++)
+            search = search->next;
+        pack = search->pack;
+        if (pack) {
+            for (j = 0; j < pack->num_files; j++) {
+                index_add(search, i, &pack->files[j],
+                          pack->files[j].name, pack->files[j].namelen);
+            }
+        } else {
+            for (j = 0; j < lists[i].count; j++) {
+                index_add(search, i, NULL, lists[i].files[j],
+                          strlen(lists[i].files[j]));
+                Z_Free(lists[i].files[j]);
+            }
+            Z_Free(lists[i].files);
+        }
+    }
+
+    Sys_UnlockMutex(fs_index_lock);
+
+    Z_Free(lists);
+
+    FS_DPrintf("%s: %u files, %u hash\n", __func__, fs_index_count, fs_index_size);
+}
+
+// adds file just created in the directory tree
+static void index_add_path(const char *fullpath)
+{
+    searchpath_t *search;
+    unsigned order;
+    size_t len;
+
+    if (!fs_index)
+        return;
+
+    Sys_LockMutex(fs_index_lock);
+    for (order = 0, search = fs_searchpaths; search; search = search->next, order++) {
+        if (search->pack)
+            continue;
+        len = strlen(search->filename);
+        if (!strncmp(fullpath, search->filename, len) && fullpath[len] == '/')
+            index_add(search, order, NULL, fullpath + len + 1, strlen(fullpath + len + 1));
+    }
+    Sys_UnlockMutex(fs_index_lock);
+}
+
+// returns true if directory scan could have found the file.
+// dotfiles are skipped and recursion depth is limited.
+static qboolean index_covers(const char *path)
+{
+    const char *s;
+    int depth = 0;
+
+    if (*path == '.')
+        return qfalse;
+
+    for (s = path; *s; s++) {
+        if (*s == '/') {
+            if (s[1] == '.' || ++depth >= MAX_LISTED_DEPTH)
+                return qfalse;
+        }
+    }
+
+    return qtrue;
+}
+
 static ssize_t open_file_write(file_t *file, const char *name)
 {
     char normalized[MAX_OSPATH], fullpath[MAX_OSPATH];
@@ -954,6 +1189,8 @@ static ssize_t open_file_write(file_t *file, const char *name)
         goto fail1;
     }
 
+    index_add_path(fullpath);
+
 #ifndef _WIN32
     // check if this is a regular file
     ret = get_fp_info(fp, NULL);
@@ -1143,6 +1380,14 @@ static ssize_t read_zip_file(file_t *file, void *buf, size_t len)
                 break;
             }
 
+            if (file->view) {
+                // inflate straight from the mapping
+                z->next_in = (Bytef *)file->view + file->entry->complen - s->rest_in;
+                z->avail_in = (uInt)s->rest_in;
+                s->rest_in = 0;
+                goto decompress;
+            }
+
             // fill in the temp buffer
             block = ZIP_BUFSIZE;
             if (block > s->rest_in) {
@@ -1162,6 +1407,7 @@ static ssize_t read_zip_file(file_t *file, void *buf, size_t len)
             z->avail_in = result;
         }
 
+decompress:
         ret = inflate(z, Z_SYNC_FLUSH);
         if (ret == Z_STREAM_END) {
             break;
@@ -1187,6 +1433,25 @@ static ssize_t read_zip_file(file_t *file, void *buf, size_t len)
 
 #endif
 
+// returns pointer to entry data within the pack mapping, if valid
+static const byte *pack_view(pack_t *pack, packfile_t *entry)
+{
+    size_t len = entry->filelen;
+
+    if (!pack->map)
+        return NULL;
+
+#if USE_ZLIB
+    if (pack->type == FS_ZIP)
+        len = entry->complen;
+#endif
+
+    if (entry->filepos > pack->mapsize || len > pack->mapsize - entry->filepos)
+        return NULL;
+
+    return pack->map + entry->filepos;
+}
+
 // open a new file on the pakfile
 static ssize_t open_from_pak(file_t *file, pack_t *pack, packfile_t *entry, qboolean unique)
 {
@@ -1213,7 +1478,9 @@ static ssize_t open_from_pak(file_t *file, pack_t *pack, packfile_t *entry, qboo
     }
 #endif
 
-    if (fseek(fp, (long)entry->filepos, SEEK_SET) == -1) {
+    file->view = pack_view(pack, entry);
+
+    if (!file->view && fseek(fp, (long)entry->filepos, SEEK_SET) == -1) {
         ret = Q_Errno();
         goto fail2;
     }
@@ -1296,6 +1563,109 @@ fail:
     return ret;
 }
 
+// same as open_file_read, but only visits search paths that have the file
+static ssize_t open_indexed_file(file_t *file, const char *normalized, size_t namelen, qboolean unique)
+{
+    char            fullpath[MAX_OSPATH];
+    indexfile_t     *index;
+    searchpath_t    *search;
+    ssize_t         ret;
+    int             valid;
+    size_t          len;
+
+    FS_COUNT_READ;
+
+    valid = PATH_NOT_CHECKED;
+
+    // index entries are only freed when search path changes, so the lock
+    // doesn't need to be held while opening the file
+    Sys_LockMutex(fs_index_lock);
+    index = fs_index[FS_HashPathLen(normalized, namelen, fs_index_size)];
+    for (; index; index = index->hash_next) {
+        if (index->namelen != namelen) {
+            continue;
+        }
+
+        search = index->search;
+        if (file->mode & FS_PATH_MASK) {
+            if ((file->mode & search->mode & FS_PATH_MASK) == 0) {
+                continue;
+            }
+        }
+
+        if (index->entry) {
+            if ((file->mode & FS_TYPE_MASK) == FS_TYPE_REAL) {
+                continue;
+            }
+#if USE_ZLIB
+            if ((file->mode & FS_FLAG_DEFLATE) &&
+                (search->pack->type != FS_ZIP || index->entry->compmtd != Z_DEFLATED)) {
+                continue;
+            }
+#endif
+        } else {
+            if ((file->mode & FS_TYPE_MASK) == FS_TYPE_PAK) {
+                continue;
+            }
+#if USE_ZLIB
+            if (file->mode & FS_FLAG_DEFLATE) {
+                continue;
+            }
+#endif
+        }
+
+        FS_COUNT_STRCMP;
+        if (FS_pathcmp(index->name, normalized)) {
+            continue;
+        }
+
+        // found it!
+        Sys_UnlockMutex(fs_index_lock);
+
+        if (index->entry) {
+            return open_from_pak(file, search->pack, index->entry, unique);
+        }
+
+        if (valid == PATH_NOT_CHECKED) {
+            valid = FS_ValidatePath(normalized);
+        }
+        if (valid == PATH_INVALID) {
+            Sys_LockMutex(fs_index_lock);
+            continue;
+        }
+
+        // use the name as found on disk
+        len = Q_concat(fullpath, sizeof(fullpath),
+                       search->filename, "/", index->name, NULL);
+        if (len >= sizeof(fullpath)) {
+            ret = Q_ERR_NAMETOOLONG;
+            goto fail;
+        }
+
+        // file may have been removed since the index was built
+        ret = open_from_disk(file, fullpath);
+        if (ret != Q_ERR_NOENT)
+            return ret;
+
+        Sys_LockMutex(fs_index_lock);
+    }
+    Sys_UnlockMutex(fs_index_lock);
+
+    // return error if path is invalid for directory tree
+    if (valid == PATH_NOT_CHECKED && (file->mode & FS_TYPE_MASK) != FS_TYPE_PAK
+#if USE_ZLIB
+        && !(file->mode & FS_FLAG_DEFLATE)
+#endif
+       ) {
+        valid = FS_ValidatePath(normalized);
+    }
+    ret = valid ? Q_ERR_NOENT : Q_ERR_INVALID_PATH;
+
+fail:
+    FS_DPrintf("%s: %s: %s\n", __func__, normalized, Q_ErrorString(ret));
+    return ret;
+}
+
 // Finds the file in the search path.
 // Fills file_t and returns file length.
 // Used for streaming data out of either a pak file or a seperate file.
@@ -1310,6 +1680,13 @@ static ssize_t open_file_read(file_t *file, const char *normalized, size_t namel
     int             valid;
     size_t          len;
 
+    // files in the directory tree may be created at any time by external
+    // means, so lookups restricted to them don't use the index
+    if (fs_index && (file->mode & FS_TYPE_MASK) != FS_TYPE_REAL &&
+        index_covers(normalized)) {
+        return open_indexed_file(file, normalized, namelen, unique);
+    }
+
     FS_COUNT_READ;
 
     hash = FS_HashPath(normalized, 0);
@@ -1455,6 +1832,12 @@ static ssize_t read_pak_file(file_t *file, void *buf, size_t len)
         return 0;
     }
 
+    if (file->view) {
+        memcpy(buf, file->view + file->length - file->rest_out, len);
+        file->rest_out -= len;
+        return len;
+    }
+
     result = fread(buf, 1, len, file->fp);
     if (result != len) {
         file->error = FS_ERR_READ(file->fp);
@@ -1796,12 +2179,33 @@ qhandle_t FS_EasyOpenFile(char *buf, size_t size, unsigned mode,
     return easy_open_write(buf, size, mode, dir, name, ext);
 }
 
+// registers zero-copy buffer so that FS_FreeFile can release it
+static qboolean add_file_view(const void *base, pack_t *pack)
+{
+    fileview_t *view;
+    int i;
+
+    for (i = 0, view = fs_views; i < MAX_FILE_VIEWS; i++, view++) {
+        if (!view->base) {
+            view->base = base;
+            view->pack = pack_get(pack);
+            fs_num_views++;
+            return qtrue;
+        }
+    }
+
+    return qfalse;
+}
+
 /*
 ============
 FS_LoadFile
 
 opens non-unique file handle as an optimization
 a NULL buffer will just return the file length without loading
+with FS_FLAG_MMAP, uncompressed pack entries are returned as read-only
+views into the pack mapping instead of being copied, callers that modify
+the buffer must load it without this flag
 ============
 */
 ssize_t FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t tag)
@@ -1848,6 +2252,16 @@ ssize_t FS_LoadFileEx(const char *path, void **buffer, unsigned flags, memtag_t
         goto done;
     }
 
+    // return view into the mapping if caller doesn't need a private copy.
+    // loaders access data through structure pointers, so it must be aligned.
+    if ((flags & FS_FLAG_MMAP) && file->type == FS_PAK && file->view &&
+        !((uintptr_t)file->view & 3)) {
+        if (add_file_view(file->view, file->pack)) {
+            *buffer = (void *)file->view;
+            goto done;
+        }
+    }
+
     // allocate chunk of memory, +1 for NUL
     buf = Z_TagMalloc(len + 1, tag);
 
@@ -1867,6 +2281,37 @@ done:
     return len;
 }
 
+/*
+============
+FS_FreeFile
+
+Frees buffer returned by FS_LoadFileEx, which may be a view into the
+memory mapped pack if FS_FLAG_MMAP was given.
+============
+*/
+void FS_FreeFile(void *buf)
+{
+    fileview_t *view;
+    int i;
+
+    if (!buf)
+        return;
+
+    if (fs_num_views) {
+        for (i = 0, view = fs_views; i < MAX_FILE_VIEWS; i++, view++) {
+            if (view->base == buf) {
+                pack_put(view->pack);
+                view->base = NULL;
+                view->pack = NULL;
+                fs_num_views--;
+                return;
+            }
+        }
+    }
+
+    Z_Free(buf);
+}
+
 /*
 ================
 FS_WriteFile
@@ -1969,6 +2414,7 @@ qerror_t FS_RenameFile(const char *from, const char *to)
     if (rename(frompath, topath))
         return Q_Errno();
 
+    index_add_path(topath);
     return Q_ERR_SUCCESS;
 }
 
@@ -2014,6 +2460,8 @@ static void pack_put(pack_t *pack)
     }
     if (!--pack->refcount) {
         FS_DPrintf("Freeing packfile %s\n", pack->filename);
+        if (pack->map)
+            Sys_UnmapFile(pack->map, pack->mapsize);
         fclose(pack->fp);
         Z_Free(pack);
     }
@@ -2037,6 +2485,8 @@ static pack_t *pack_alloc(FILE *fp, filetype_t type, const char *name,
     pack->type = type;
     pack->refcount = 0;
     pack->fp = fp;
+    pack->map = NULL;
+    pack->mapsize = 0;
     pack->num_files = num_files;
     pack->hash_size = hash_size;
     pack->files = (packfile_t *)(pack + 1);
@@ -2049,6 +2499,36 @@ static pack_t *pack_alloc(FILE *fp, filetype_t type, const char *name,
     return pack;
 }
 
+// maps the entire pack into memory for zero-copy reads, if possible
+static void pack_map(pack_t *pack)
+{
+    file_info_t info;
+    packfile_t *file;
+    size_t len;
+    unsigned i;
+
+    if (get_fp_info(pack->fp, &info))
+        return;
+
+    // don't map packs whose directory points past the end of file
+    for (i = 0, file = pack->files; i < pack->num_files; i++, file++) {
+        len = file->filelen;
+#if USE_ZLIB
+        if (pack->type == FS_ZIP)
+            len = file->complen;
+#endif
+        if (file->filepos > info.size || len > info.size - file->filepos) {
+            Com_WPrintf("Not mapping %s: %s is past end of file\n",
+                        pack->filename, file->name);
+            return;
+        }
+    }
+
+    pack->map = Sys_MapFile(pack->fp, info.size);
+    if (pack->map)
+        pack->mapsize = info.size;
+}
+
 // normalizes and inserts the filename into hash table
 static void pack_hash_file(pack_t *pack, packfile_t *file)
 {
@@ -2483,6 +2963,9 @@ static void q_printf(2, 3) add_game_dir(unsigned mode, const char *fmt, ...)
     FS_ReplaceSeparators(fs_gamedir, '/');
 #endif
 
+    // search path is changing
+    index_free();
+
     // add the directory to the search path
     search = FS_Malloc(sizeof(searchpath_t) + len);
     search->mode = mode;
@@ -2520,6 +3003,8 @@ static void q_printf(2, 3) add_game_dir(unsigned mode, const char *fmt, ...)
             pack = load_pak_file(path);
         if (!pack)
             continue;
+        if (fs_mmap->integer)
+            pack_map(pack);
         search = FS_Malloc(sizeof(searchpath_t));
         search->mode = mode;
         search->filename[0] = 0;
@@ -3166,7 +3651,8 @@ static void FS_Path_f(void)
             else
 #endif
                 numFilesInPAK += s->pack->num_files;
-            Com_Printf("%s (%i files)\n", s->pack->filename, s->pack->num_files);
+            Com_Printf("%s (%i files%s)\n", s->pack->filename, s->pack->num_files,
+                       s->pack->map ? ", mapped" : "");
         } else {
             Com_Printf("%s\n", s->filename);
         }
@@ -3406,6 +3892,8 @@ static void free_all_paths(void)
 {
     searchpath_t *path, *next;
 
+    index_free();
+
     for (path = fs_searchpaths; path; path = next) {
         next = path->next;
         free_search_path(path);
@@ -3418,6 +3906,8 @@ static void free_game_paths(void)
 {
     searchpath_t *path, *next;
 
+    index_free();
+
     for (path = fs_searchpaths; path != fs_base_searchpaths; path = next) {
         next = path->next;
         free_search_path(path);
@@ -3474,6 +3964,12 @@ static void setup_game_paths(void)
 
     // this var is used by the game library to find it's home directory
     Cvar_FullSet("fs_gamedir", fs_gamedir, CVAR_ROM, FROM_CODE);
+
+    // build the index now that search path is complete, rather than on
+    // first lookup, which may come from any thread
+    if (fs_index_files->integer) {
+        index_build();
+    }
 }
 
 /*
@@ -3639,6 +4135,12 @@ void FS_Init(void)
     fs_debug = Cvar_Get("fs_debug", "0", 0);
 #endif
 
+    fs_mmap = Cvar_Get("fs_mmap", "1", 0);
+    fs_index_files = Cvar_Get("fs_index", "1", 0);
+    if (!fs_index_lock) {
+        fs_index_lock = Sys_CreateMutex();
+    }
+
     // get the game cvar and start the filesystem
     fs_game = Cvar_Get("game", DEFGAME, CVAR_LATCH | CVAR_SERVERINFO);
     fs_game->changed = fs_game_changed;
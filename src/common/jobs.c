@@ -0,0 +1,661 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+//
+// jobs.c -- background job scheduler
+//
+// Each worker thread owns a deque of jobs. Jobs queued from a worker go to
+// its own deque and are popped LIFO by the owner; idle workers steal from
+// the other end of other deques. Deque 0 belongs to the main thread (and any
+// other thread that is not a worker) and is drained by workers FIFO.
+//
+// Job nodes come from a fixed pool, so that queueing from worker threads
+// never touches the zone allocator. Jobs with done callbacks also reserve a
+// record from a second pool when queued, which they keep until the callback
+// runs. Finished jobs only hold records, so an exhausted node pool always
+// drains without the main thread, which may be blocked in Job_Wait. Main
+// thread runs done callbacks itself when it runs out of records, including
+// in Job_Wait, because queueing workers can't free them.
+//
+
+#include "shared/shared.h"
+#include "common/cmd.h"
+#include "common/common.h"
+#include "common/cvar.h"
+#include "common/jobs.h"
+#include "common/zone.h"
+#include "system/system.h"
+
+#define MAX_JOBS        1024    // must be power of two
+#define MAX_JOB_STATS   32
+#define MAX_JOB_PRINTS  0x4000  // bytes of deferred messages
+
+typedef struct jobdone_s {
+    job_t       job;
+    struct jobdone_s *next;
+} jobdone_t;
+
+typedef struct jobnode_s {
+    job_t       job;
+    unsigned    queued;         // time of queueing, microseconds
+    jobdone_t   *done;          // reserved if job has done callback
+    struct jobnode_s *next;
+} jobnode_t;
+
+typedef struct {
+    sysmutex_t  *lock;
+    jobnode_t   *ring[MAX_JOBS];
+    unsigned    head;           // stolen from here
+    unsigned    tail;           // pushed and popped by owner here
+} jobdeque_t;
+
+typedef struct {
+    const char  *name;
+    unsigned    count;
+    unsigned    maxtime;
+    uint64_t    runtime;        // total time in work callback
+    uint64_t    waittime;       // total time spent in queue
+} jobstat_t;
+
+static struct {
+    qboolean    initialized;
+    qboolean    terminate;
+
+    sysmutex_t  *lock;          // protects everything below
+    syssem_t    *wake;          // posted once per queued job
+    syssem_t    *done;          // posted for waiters when a job finishes
+
+    systhread_t *threads[MAX_WORKER_THREADS];
+    int         numworkers;
+
+    jobdeque_t  *deques;        // numworkers + 1
+    int         numdeques;
+
+    jobnode_t   nodes[MAX_JOBS];
+    jobnode_t   *free;
+    jobdone_t   dones[MAX_JOBS];
+    jobdone_t   *free_dones;
+    jobdone_t   *done_head;
+    jobdone_t   **done_tail;
+
+    int         pending;        // queued or running
+    int         waiters;
+
+    jobstat_t   stats[MAX_JOB_STATS];
+    int         numstats;
+    unsigned    queued;
+    unsigned    stolen;
+    unsigned    helped;         // run by waiting thread
+
+    char        prints[MAX_JOB_PRINTS];     // print type byte + string
+    size_t      printlen;
+    unsigned    printdrops;
+} jobs;
+
+static q_threadlocal int        job_self;   // deque index of this thread
+static q_threadlocal qboolean   job_main;   // runs done callbacks
+
+static cvar_t   *com_job_threads;
+
+/*
+===============================================================================
+
+DEQUES
+
+===============================================================================
+*/
+
+static void push_job(jobdeque_t *dq, jobnode_t *node)
+{
+    Sys_LockMutex(dq->lock);
+    dq->ring[dq->tail++ & (MAX_JOBS - 1)] = node;
+    Sys_UnlockMutex(dq->lock);
+}
+
+static jobnode_t *pop_job(jobdeque_t *dq)
+{
+    jobnode_t *node = NULL;
+
+    Sys_LockMutex(dq->lock);
+    if (dq->head != dq->tail)
+        node = dq->ring[--dq->tail & (MAX_JOBS - 1)];
+    Sys_UnlockMutex(dq->lock);
+
+    return node;
+}
+
+static jobnode_t *steal_job(jobdeque_t *dq)
+{
+    jobnode_t *node = NULL;
+
+    Sys_LockMutex(dq->lock);
+    if (dq->head != dq->tail)
+        node = dq->ring[dq->head++ & (MAX_JOBS - 1)];
+    Sys_UnlockMutex(dq->lock);
+
+    return node;
+}
+
+static jobnode_t *take_job(int self)
+{
+    jobnode_t *node;
+    int i, index;
+
+    if ((node = pop_job(&jobs.deques[self])) != NULL)
+        return node;
+
+    for (i = 1; i < jobs.numdeques; i++) {
+        index = (self + i) % jobs.numdeques;
+        if ((node = steal_job(&jobs.deques[index])) != NULL) {
+            if (index) {
+                Sys_LockMutex(jobs.lock);
+                jobs.stolen++;
+                Sys_UnlockMutex(jobs.lock);
+            }
+            return node;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+===============================================================================
+
+EXECUTION
+
+===============================================================================
+*/
+
+static jobstat_t *find_stat(const char *name)
+{
+    jobstat_t *stat;
+    int i;
+
+    if (!name)
+        name = "unnamed";
+
+    for (i = 0, stat = jobs.stats; i < jobs.numstats; i++, stat++)
+        if (stat->name == name || !strcmp(stat->name, name))
+            return stat;
+
+    if (jobs.numstats == MAX_JOB_STATS)
+        return NULL;
+
+    stat = &jobs.stats[jobs.numstats++];
+    stat->name = name;
+    return stat;
+}
+
+static void free_node(jobnode_t *node)
+{
+    node->next = jobs.free;
+    jobs.free = node;
+}
+
+static void free_done(jobdone_t *done)
+{
+    done->next = jobs.free_dones;
+    jobs.free_dones = done;
+}
+
+static void run_job(jobnode_t *node)
+{
+    jobstat_t *stat;
+    jobdone_t *done = node->done;
+    unsigned start, time;
+
+    start = Sys_Microseconds();
+    node->job.work_cb(node->job.cb_arg);
+    time = Sys_Microseconds() - start;
+
+    if (done) {
+        done->job = node->job;
+        done->next = NULL;
+    }
+
+    Sys_LockMutex(jobs.lock);
+    if ((stat = find_stat(node->job.name)) != NULL) {
+        stat->count++;
+        stat->runtime += time;
+        stat->waittime += start - node->queued;
+        stat->maxtime = max(stat->maxtime, time);
+    }
+
+    if (node->job.group)
+        node->job.group->pending--;
+    jobs.pending--;
+
+    if (done) {
+        *jobs.done_tail = done;
+        jobs.done_tail = &done->next;
+    }
+    free_node(node);
+
+    if (jobs.waiters)
+        Sys_PostSemaphore(jobs.done, jobs.waiters);
+    Sys_UnlockMutex(jobs.lock);
+}
+
+static void worker_func(void *arg)
+{
+    jobnode_t *node;
+
+    job_self = (int)(intptr_t)arg;
+
+    while (1) {
+        Sys_WaitSemaphore(jobs.wake);
+        if (jobs.terminate)
+            break;
+        if ((node = take_job(job_self)) != NULL)
+            run_job(node);
+    }
+}
+
+static jobnode_t *alloc_node(void)
+{
+    jobnode_t *node;
+
+    while (1) {
+        Sys_LockMutex(jobs.lock);
+        if ((node = jobs.free) != NULL)
+            jobs.free = node->next;
+        Sys_UnlockMutex(jobs.lock);
+        if (node)
+            return node;
+
+        // pool exhausted, make progress on our own
+        if ((node = take_job(job_self)) != NULL) {
+            run_job(node);
+            continue;
+        }
+
+        // remaining nodes are held by running jobs
+        Sys_Sleep(1);
+    }
+}
+
+static void run_done_callbacks(void);
+
+static jobdone_t *alloc_done(void)
+{
+    jobdone_t *done;
+    jobnode_t *node;
+
+    while (1) {
+        Sys_LockMutex(jobs.lock);
+        if ((done = jobs.free_dones) != NULL)
+            jobs.free_dones = done->next;
+        Sys_UnlockMutex(jobs.lock);
+        if (done)
+            return done;
+
+        // records are freed by running done callbacks
+        if (job_main && jobs.done_head) {
+            run_done_callbacks();
+            continue;
+        }
+
+        if ((node = take_job(job_self)) != NULL) {
+            run_job(node);
+            continue;
+        }
+
+        // remaining records are held by running jobs, or by finished jobs
+        // waiting for main thread
+        Sys_Sleep(1);
+    }
+}
+
+void Job_Queue(const job_t *job)
+{
+    jobnode_t *node;
+
+    if (!jobs.initialized) {
+        job->work_cb(job->cb_arg);
+        if (job->done_cb)
+            job->done_cb(job->cb_arg);
+        return;
+    }
+
+    node = alloc_node();
+    node->job = *job;
+    node->queued = Sys_Microseconds();
+    node->done = job->done_cb ? alloc_done() : NULL;
+
+    Sys_LockMutex(jobs.lock);
+    if (job->group)
+        job->group->pending++;
+    jobs.pending++;
+    jobs.queued++;
+    Sys_UnlockMutex(jobs.lock);
+
+    push_job(&jobs.deques[job_self], node);
+
+    if (jobs.numworkers)
+        Sys_PostSemaphore(jobs.wake, 1);
+}
+
+static qboolean group_pending(jobgroup_t *group)
+{
+    return group ? group->pending : jobs.pending;
+}
+
+void Job_Wait(jobgroup_t *group)
+{
+    jobnode_t *node;
+
+    if (!jobs.initialized)
+        return;
+
+    while (1) {
+        Sys_LockMutex(jobs.lock);
+        if (!group_pending(group)) {
+            Sys_UnlockMutex(jobs.lock);
+            break;
+        }
+        Sys_UnlockMutex(jobs.lock);
+
+        // workers may be waiting for done records
+        if (job_main && !jobs.free_dones && jobs.done_head) {
+            run_done_callbacks();
+            continue;
+        }
+
+        // help running jobs instead of sleeping
+        if ((node = take_job(job_self)) != NULL) {
+            Sys_LockMutex(jobs.lock);
+            jobs.helped++;
+            Sys_UnlockMutex(jobs.lock);
+            run_job(node);
+            continue;
+        }
+
+        // nothing to run, wait for some job to finish
+        Sys_LockMutex(jobs.lock);
+        if (!group_pending(group)) {
+            Sys_UnlockMutex(jobs.lock);
+            break;
+        }
+        jobs.waiters++;
+        Sys_UnlockMutex(jobs.lock);
+
+        Sys_WaitSemaphore(jobs.done);
+
+        Sys_LockMutex(jobs.lock);
+        jobs.waiters--;
+        Sys_UnlockMutex(jobs.lock);
+    }
+}
+
+static void run_done_callbacks(void)
+{
+    jobdone_t *done;
+    job_t job;
+
+    while (1) {
+        Sys_LockMutex(jobs.lock);
+        if ((done = jobs.done_head) != NULL) {
+            if (!(jobs.done_head = done->next))
+                jobs.done_tail = &jobs.done_head;
+            job = done->job;
+            free_done(done);
+        }
+        Sys_UnlockMutex(jobs.lock);
+
+        if (!done)
+            break;
+
+        // may queue more jobs
+        job.done_cb(job.cb_arg);
+    }
+}
+
+qboolean Job_IsMainThread(void)
+{
+    return !jobs.initialized || job_main;
+}
+
+void Job_Print(print_type_t type, const char *fmt, va_list argptr)
+{
+    char msg[MAXPRINTMSG];
+    size_t len;
+
+    len = Q_vscnprintf(msg, sizeof(msg), fmt, argptr) + 1;
+
+    Sys_LockMutex(jobs.lock);
+    if (jobs.printlen + len + 1 > sizeof(jobs.prints)) {
+        jobs.printdrops++;
+    } else {
+        jobs.prints[jobs.printlen++] = type;
+        memcpy(jobs.prints + jobs.printlen, msg, len);
+        jobs.printlen += len;
+    }
+    Sys_UnlockMutex(jobs.lock);
+}
+
+static void flush_prints(void)
+{
+    char buffer[MAX_JOB_PRINTS], *s;
+    print_type_t type;
+    size_t len;
+    unsigned drops;
+
+    Sys_LockMutex(jobs.lock);
+    len = jobs.printlen;
+    memcpy(buffer, jobs.prints, len);
+    jobs.printlen = 0;
+    drops = jobs.printdrops;
+    jobs.printdrops = 0;
+    Sys_UnlockMutex(jobs.lock);
+
+    for (s = buffer; s < buffer + len; s += strlen(s) + 1) {
+        type = *s++;
+        Com_LPrintf(type, "%s", s);
+    }
+
+    if (drops)
+        Com_WPrintf("%u messages from worker threads dropped\n", drops);
+}
+
+void Job_Complete(void)
+{
+    jobnode_t *node;
+
+    if (!jobs.initialized)
+        return;
+
+    // without workers, jobs are run here
+    if (!jobs.numworkers) {
+        while ((node = take_job(0)) != NULL)
+            run_job(node);
+    }
+
+    if (jobs.printlen)
+        flush_prints();
+
+    if (jobs.done_head)
+        run_done_callbacks();
+}
+
+/*
+===============================================================================
+
+WORKER THREADS
+
+===============================================================================
+*/
+
+static void start_workers(void)
+{
+    int i, count = com_job_threads->integer;
+
+    if (count < 0)
+        count = Sys_NumProcessors() - 1;
+    clamp(count, 0, MAX_WORKER_THREADS);
+
+    // at least one worker unless explicitly disabled
+    if (!count && com_job_threads->integer < 0)
+        count = 1;
+
+    jobs.numdeques = count + 1;
+    jobs.deques = Z_Mallocz(sizeof(jobs.deques[0]) * jobs.numdeques);
+    for (i = 0; i < jobs.numdeques; i++)
+        jobs.deques[i].lock = Sys_CreateMutex();
+
+    for (i = 0; i < count; i++) {
+        jobs.threads[i] = Sys_CreateThread(worker_func, (void *)(intptr_t)(i + 1));
+        if (!jobs.threads[i]) {
+            Com_EPrintf("Couldn't create job worker thread\n");
+            break;
+        }
+    }
+    jobs.numworkers = i;
+
+    Com_DPrintf("%s: %d worker threads\n", __func__, jobs.numworkers);
+}
+
+static void stop_workers(void)
+{
+    int i;
+
+    // finish everything queued
+    Job_Wait(NULL);
+
+    jobs.terminate = qtrue;
+    Sys_PostSemaphore(jobs.wake, jobs.numworkers);
+    for (i = 0; i < jobs.numworkers; i++)
+        Sys_JoinThread(jobs.threads[i]);
+    jobs.terminate = qfalse;
+    jobs.numworkers = 0;
+
+    for (i = 0; i < jobs.numdeques; i++)
+        Sys_DestroyMutex(jobs.deques[i].lock);
+    Z_Free(jobs.deques);
+    jobs.deques = NULL;
+    jobs.numdeques = 0;
+}
+
+static void com_job_threads_changed(cvar_t *self)
+{
+    if (jobs.initialized) {
+        stop_workers();
+        start_workers();
+    }
+}
+
+/*
+===============================================================================
+
+STATISTICS
+
+===============================================================================
+*/
+
+static void Job_Stats_f(void)
+{
+    jobstat_t stats[MAX_JOB_STATS], *stat;
+    unsigned queued, stolen, helped;
+    int i, numstats, numworkers, pending;
+
+    if (!strcmp(Cmd_Argv(1), "reset")) {
+        Sys_LockMutex(jobs.lock);
+        jobs.numstats = 0;
+        jobs.queued = jobs.stolen = jobs.helped = 0;
+        Sys_UnlockMutex(jobs.lock);
+        return;
+    }
+
+    // don't print with the lock held, workers would wait for console
+    Sys_LockMutex(jobs.lock);
+    numstats = jobs.numstats;
+    memcpy(stats, jobs.stats, sizeof(stats[0]) * numstats);
+    numworkers = jobs.numworkers;
+    queued = jobs.queued;
+    stolen = jobs.stolen;
+    helped = jobs.helped;
+    pending = jobs.pending;
+    Sys_UnlockMutex(jobs.lock);
+
+    Com_Printf("%d worker threads, %u jobs queued, %u stolen, %u helped, %d pending\n",
+               numworkers, queued, stolen, helped, pending);
+    if (numstats) {
+        Com_Printf(
+            "name                  count   avg us   max us  wait us  total ms\n"
+            "-------------------- ------- -------- -------- -------- ---------\n");
+    }
+    for (i = 0, stat = stats; i < numstats; i++, stat++) {
+        Com_Printf("%-20.20s %7u %8u %8u %8u %9u\n", stat->name, stat->count,
+                   (unsigned)(stat->runtime / stat->count), stat->maxtime,
+                   (unsigned)(stat->waittime / stat->count),
+                   (unsigned)(stat->runtime / 1000));
+    }
+}
+
+/*
+===============================================================================
+
+INIT / SHUTDOWN
+
+===============================================================================
+*/
+
+void Job_Init(void)
+{
+    int i;
+
+    com_job_threads = Cvar_Get("com_job_threads", "-1", 0);
+    com_job_threads->changed = com_job_threads_changed;
+
+    Cmd_AddCommand("jobstats", Job_Stats_f);
+
+    // workers may allocate memory
+    Z_InitLock();
+
+    jobs.lock = Sys_CreateMutex();
+    jobs.wake = Sys_CreateSemaphore();
+    jobs.done = Sys_CreateSemaphore();
+
+    jobs.free = NULL;
+    jobs.free_dones = NULL;
+    for (i = MAX_JOBS - 1; i >= 0; i--) {
+        free_node(&jobs.nodes[i]);
+        free_done(&jobs.dones[i]);
+    }
+    jobs.done_head = NULL;
+    jobs.done_tail = &jobs.done_head;
+
+    job_main = qtrue;
+    start_workers();
+
+    jobs.initialized = qtrue;
+}
+
+void Job_Shutdown(void)
+{
+    if (!jobs.initialized)
+        return;
+
+    stop_workers();
+    flush_prints();
+    run_done_callbacks();
+
+    jobs.initialized = qfalse;
+
+    Sys_DestroyMutex(jobs.lock);
+    Sys_DestroySemaphore(jobs.wake);
+    Sys_DestroySemaphore(jobs.done);
+}
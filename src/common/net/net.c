@@ -20,6 +20,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // net.c
 //
 
+#if USE_MMSG
+#define _GNU_SOURCE     // for recvmmsg and sendmmsg
+#endif
+
 #include "shared/shared.h"
 #include "common/common.h"
 #include "common/cvar.h"
@@ -50,6 +54,10 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <sys/ioctl.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#if USE_EPOLL
+#include <sys/epoll.h>
+#include <poll.h>
+#endif
 #ifdef __linux__
 #include <linux/types.h>
 #if USE_ICMP
@@ -64,6 +72,17 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 // prevents infinite retry loops caused by broken TCP/IP stacks
 #define MAX_ERROR_RETRIES   64
 
+#if USE_MMSG
+// max number of datagrams moved by a single recvmmsg/sendmmsg call
+#define MAX_MMSG_PACKETS    64
+
+typedef struct {
+    netadr_t    addr;
+    size_t      len;
+    byte        data[MAX_PACKETLEN];
+} udppacket_t;
+#endif
+
 #if USE_CLIENT
 
 #define MAX_LOOPBACK    4
@@ -119,7 +138,14 @@ static qsocket_t    tcp6_socket = -1;
 static qhandle_t    net_logFile;
 #endif
 
-static ioentry_t    io_entries[FD_SETSIZE];
+// epoll is not limited by FD_SETSIZE
+#if USE_EPOLL
+#define MAX_IO_ENTRIES  16384
+#else
+#define MAX_IO_ENTRIES  FD_SETSIZE
+#endif
+
+static ioentry_t    io_entries[MAX_IO_ENTRIES];
 static int          io_numfds;
 
 // current rate measurement
@@ -139,6 +165,25 @@ static uint64_t     net_bytes_rcvd;
 static uint64_t     net_bytes_sent;
 static uint64_t     net_packets_rcvd;
 static uint64_t     net_packets_sent;
+#if USE_MMSG
+static uint64_t     net_mmsg_recv_calls;
+static uint64_t     net_mmsg_recv_packets;
+static uint64_t     net_mmsg_send_calls;
+static uint64_t     net_mmsg_send_packets;
+#endif
+
+#if USE_MMSG
+// packets received by the last recvmmsg call
+static udppacket_t  net_recvq[MAX_MMSG_PACKETS];
+
+// outgoing packets queued between NET_BatchPackets and NET_FlushPackets
+static struct {
+    qboolean    active[NS_COUNT];
+    int         numpackets;
+    qsocket_t   socks[MAX_MMSG_PACKETS];
+    udppacket_t packets[MAX_MMSG_PACKETS];
+} net_sendq;
+#endif
 
 //=============================================================================
 
@@ -516,6 +561,14 @@ static void NET_Stats_f(void)
                net_packets_sent, net_packets_sent / diff);
     Com_Printf("Packets rcvd: %"PRIu64" (%"PRIu64" packets/sec)\n",
                net_packets_rcvd, net_packets_rcvd / diff);
+#if USE_MMSG
+    Com_Printf("Batched sends: %"PRIu64" packets in %"PRIu64" calls (%.1f per call)\n",
+               net_mmsg_send_packets, net_mmsg_send_calls,
+               net_mmsg_send_calls ? (double)net_mmsg_send_packets / net_mmsg_send_calls : 0.0);
+    Com_Printf("Batched recvs: %"PRIu64" packets in %"PRIu64" calls (%.1f per call)\n",
+               net_mmsg_recv_packets, net_mmsg_recv_calls,
+               net_mmsg_recv_calls ? (double)net_mmsg_recv_packets / net_mmsg_recv_calls : 0.0);
+#endif
 #if USE_ICMP
     Com_Printf("Total errors: %"PRIu64"/%"PRIu64"/%"PRIu64" (send/recv/icmp)\n",
                net_send_errors, net_recv_errors, net_icmp_errors);
@@ -673,6 +726,7 @@ ioentry_t *NET_AddFd(qsocket_t fd)
     ioentry_t *e = os_add_io(fd);
 
     e->inuse = qtrue;
+    os_touch_io(e);
     return e;
 }
 
@@ -688,6 +742,7 @@ void NET_RemoveFd(qsocket_t fd)
     ioentry_t *e = os_get_io(fd);
     int i;
 
+    os_remove_io(e);
     memset(e, 0, sizeof(*e));
 
     for (i = io_numfds - 1; i >= 0; i--) {
@@ -704,11 +759,35 @@ void NET_RemoveFd(qsocket_t fd)
 =============
 NET_Sleep
 
-Sleeps msec or until some file descriptor is ready. Implementation is not
-terribly efficient, but that's fine for a small number of descriptors we
-typically have.
+Sleeps msec or until some file descriptor is ready.
 =============
 */
+#if USE_EPOLL
+int NET_Sleep(int msec)
+{
+    int ret, ready;
+
+    ready = os_begin_poll();
+
+    if (!io_numfds) {
+        // don't bother with epoll
+        Sys_Sleep(msec);
+        return 0;
+    }
+
+    ret = os_poll(ready ? 0 : msec);
+    if (ret == -1) {
+        Com_EPrintf("%s: %s\n", __func__, NET_ErrorString());
+        return ret;
+    }
+
+    return ret + ready;
+}
+#else
+/*
+Implementation is not terribly efficient, but that's fine for a small number
+of descriptors we typically have.
+*/
 int NET_Sleep(int msec)
 {
     struct timeval tv;
@@ -765,6 +844,7 @@ int NET_Sleep(int msec)
 
     return ret;
 }
+#endif
 
 #if USE_AC_SERVER
 
@@ -775,6 +855,32 @@ NET_Sleepv
 Sleeps msec or until some file descriptor from a given subset is ready
 =============
 */
+#if USE_EPOLL
+int NET_Sleepv(int msec, ...)
+{
+    va_list argptr;
+    qsocket_t fds[MAX_IO_EVENTS];
+    int nfds, ret;
+
+    os_begin_poll();
+
+    va_start(argptr, msec);
+    for (nfds = 0; nfds < MAX_IO_EVENTS; nfds++) {
+        fds[nfds] = va_arg(argptr, qsocket_t);
+        if (fds[nfds] == -1) {
+            break;
+        }
+    }
+    va_end(argptr);
+
+    ret = os_poll_subset(msec, fds, nfds);
+    if (ret == -1) {
+        Com_EPrintf("%s: %s\n", __func__, NET_ErrorString());
+    }
+
+    return ret;
+}
+#else
 int NET_Sleepv(int msec, ...)
 {
     va_list argptr;
@@ -838,10 +944,72 @@ int NET_Sleepv(int msec, ...)
     return ret;
 }
 
+#endif // !USE_EPOLL
+
 #endif // USE_AC_SERVER
 
 //=============================================================================
 
+#if USE_MMSG
+
+static void NET_GetUdpPackets(qsocket_t sock, void (*packet_cb)(void))
+{
+    ioentry_t *e;
+    udppacket_t *p;
+    int i, ret;
+
+    if (sock == -1)
+        return;
+
+    e = os_get_io(sock);
+    if (!e->canread)
+        return;
+
+    while (1) {
+        ret = os_udp_recvmmsg(sock, net_recvq, MAX_MMSG_PACKETS);
+        if (ret == NET_AGAIN) {
+            e->canread = qfalse;
+            break;
+        }
+
+        if (ret == NET_ERROR) {
+            Com_DPrintf("%s: %s\n", __func__, NET_ErrorString());
+            net_recv_errors++;
+            break;
+        }
+
+        net_mmsg_recv_calls++;
+        net_mmsg_recv_packets += ret;
+
+        for (i = 0, p = net_recvq; i < ret; i++, p++) {
+            net_from = p->addr;
+
+#ifdef _DEBUG
+            if (net_log_enable->integer)
+                NET_LogPacket(&net_from, "UDP recv", p->data, p->len);
+#endif
+
+            net_rate_rcvd += p->len;
+            net_bytes_rcvd += p->len;
+            net_packets_rcvd++;
+
+            memcpy(msg_read_buffer, p->data, p->len);
+            SZ_Init(&msg_read, msg_read_buffer, sizeof(msg_read_buffer));
+            msg_read.cursize = p->len;
+
+            (*packet_cb)();
+        }
+
+        // socket has been drained, avoid extra syscall
+        if (ret < MAX_MMSG_PACKETS) {
+            e->canread = qfalse;
+            break;
+        }
+    }
+}
+
+#else
+
 static void NET_GetUdpPackets(qsocket_t sock, void (*packet_cb)(void))
 {
     ioentry_t *e;
@@ -884,6 +1052,8 @@ static void NET_GetUdpPackets(qsocket_t sock, void (*packet_cb)(void))
     }
 }
 
+#endif // !USE_MMSG
+
 /*
 =============
 NET_GetPackets
@@ -909,6 +1079,94 @@ void NET_GetPackets(netsrc_t sock, void (*packet_cb)(void))
     NET_GetUdpPackets(udp6_sockets[sock], packet_cb);
 }
 
+#if USE_MMSG
+
+static void NET_SendQueue(void)
+{
+    udppacket_t *p;
+    qsocket_t s;
+    int i, j, n, ret;
+
+    i = 0;
+    while (i < net_sendq.numpackets) {
+        // send the run of packets going through the same socket
+        s = net_sendq.socks[i];
+        for (n = 1; i + n < net_sendq.numpackets; n++)
+            if (net_sendq.socks[i + n] != s)
+                break;
+
+        ret = os_udp_sendmmsg(s, &net_sendq.packets[i], n);
+        if (ret == NET_AGAIN || ret == NET_ERROR || ret == 0) {
+            // drop the first packet and retry with the rest
+            if (ret != NET_AGAIN) {
+                Com_DPrintf("%s: %s to %s\n", __func__, NET_ErrorString(),
+                            NET_AdrToString(&net_sendq.packets[i].addr));
+                net_send_errors++;
+            }
+            i++;
+            continue;
+        }
+
+        net_mmsg_send_calls++;
+        net_mmsg_send_packets += ret;
+
+        for (j = 0, p = &net_sendq.packets[i]; j < ret; j++, p++) {
+#ifdef _DEBUG
+            if (net_log_enable->integer)
+                NET_LogPacket(&p->addr, "UDP send", p->data, p->len);
+#endif
+            net_rate_sent += p->len;
+            net_bytes_sent += p->len;
+            net_packets_sent++;
+        }
+
+        i += ret;
+    }
+
+    net_sendq.numpackets = 0;
+}
+
+static void NET_QueuePacket(qsocket_t s, const void *data,
+                            size_t len, const netadr_t *to)
+{
+    udppacket_t *p;
+
+    if (net_sendq.numpackets == MAX_MMSG_PACKETS)
+        NET_SendQueue();
+
+    net_sendq.socks[net_sendq.numpackets] = s;
+    p = &net_sendq.packets[net_sendq.numpackets++];
+    p->addr = *to;
+    p->len = len;
+    memcpy(p->data, data, len);
+}
+
+/*
+=============
+NET_BatchPackets
+
+Queues UDP packets sent to the given socket until NET_FlushPackets is
+called, then transmits them with as few system calls as possible.
+=============
+*/
+void NET_BatchPackets(netsrc_t sock)
+{
+    net_sendq.active[sock] = qtrue;
+}
+
+/*
+=============
+NET_FlushPackets
+=============
+*/
+void NET_FlushPackets(netsrc_t sock)
+{
+    net_sendq.active[sock] = qfalse;
+    NET_SendQueue();
+}
+
+#endif // USE_MMSG
+
 /*
 =============
 NET_SendPacket
@@ -951,6 +1209,13 @@ qboolean NET_SendPacket(netsrc_t sock, const void *data,
     if (s == -1)
         return qfalse;
 
+#if USE_MMSG
+    if (net_sendq.active[sock]) {
+        NET_QueuePacket(s, data, len, to);
+        return qtrue;
+    }
+#endif
+
     ret = os_udp_send(s, data, len, to);
     if (ret == NET_AGAIN)
         return qfalse;
@@ -1318,6 +1583,12 @@ void NET_Config(netflag_t flag)
     }
 
     if (flag == NET_NONE) {
+#if USE_MMSG
+        // discard packets queued for sockets being closed
+        memset(net_sendq.active, 0, sizeof(net_sendq.active));
+        net_sendq.numpackets = 0;
+#endif
+
         // shut down any existing sockets
         for (sock = 0; sock < NS_COUNT; sock++) {
             if (udp_sockets[sock] != -1) {
@@ -1612,6 +1883,7 @@ neterr_t NET_RunConnect(netstream_t *s)
 #ifdef _WIN32
     e->wantexcept = qfalse;
 #endif
+    os_touch_io(e);
     return NET_OK;
 
 fail:
@@ -1621,6 +1893,7 @@ fail:
 #ifdef _WIN32
     e->wantexcept = qfalse;
 #endif
+    os_touch_io(e);
     return NET_ERROR;
 }
 
@@ -1641,6 +1914,8 @@ void NET_UpdateStream(netstream_t *s)
 
     FIFO_Peek(&s->send, &len);
     e->wantwrite = len ? qtrue : qfalse;
+
+    os_touch_io(e);
 }
 
 // returns NET_OK only when there was some data read
@@ -1687,6 +1962,7 @@ neterr_t NET_RunStream(netstream_t *s)
                 FIFO_Reserve(&s->recv, &len);
                 if (!len) {
                     e->wantread = qfalse;
+                    os_touch_io(e);
                 }
             }
         }
@@ -1722,6 +1998,7 @@ neterr_t NET_RunStream(netstream_t *s)
                 FIFO_Peek(&s->send, &len);
                 if (!len) {
                     e->wantwrite = qfalse;
+                    os_touch_io(e);
                 }
 
             }
@@ -1733,12 +2010,14 @@ neterr_t NET_RunStream(netstream_t *s)
 closed:
     s->state = NS_CLOSED;
     e->wantread = qfalse;
+    os_touch_io(e);
     return NET_CLOSED;
 
 error:
     s->state = NS_BROKEN;
     e->wantread = qfalse;
     e->wantwrite = qfalse;
+    os_touch_io(e);
     return NET_ERROR;
 }
 
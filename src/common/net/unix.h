@@ -102,6 +102,7 @@ static qboolean process_error_queue(qsocket_t sock, const netadr_t *to)
 #endif
 }
 
+#if !USE_MMSG
 static ssize_t os_udp_recv(qsocket_t sock, void *data,
                            size_t len, netadr_t *from)
 {
@@ -133,6 +134,7 @@ static ssize_t os_udp_recv(qsocket_t sock, void *data,
 
     return NET_ERROR;
 }
+#endif
 
 static ssize_t os_udp_send(qsocket_t sock, const void *data,
                            size_t len, const netadr_t *to)
@@ -163,6 +165,95 @@ static ssize_t os_udp_send(qsocket_t sock, const void *data,
     return NET_ERROR;
 }
 
+#if USE_MMSG
+
+static int os_udp_recvmmsg(qsocket_t sock, udppacket_t *packets, int count)
+{
+    struct mmsghdr hdrs[MAX_MMSG_PACKETS];
+    struct iovec iovs[MAX_MMSG_PACKETS];
+    struct sockaddr_storage addrs[MAX_MMSG_PACKETS];
+    int i, ret, tries;
+
+    for (tries = 0; tries < MAX_ERROR_RETRIES; tries++) {
+        memset(hdrs, 0, sizeof(hdrs[0]) * count);
+        memset(addrs, 0, sizeof(addrs[0]) * count);
+        for (i = 0; i < count; i++) {
+            iovs[i].iov_base = packets[i].data;
+            iovs[i].iov_len = sizeof(packets[i].data);
+            hdrs[i].msg_hdr.msg_name = &addrs[i];
+            hdrs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            hdrs[i].msg_hdr.msg_iov = &iovs[i];
+            hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        ret = recvmmsg(sock, hdrs, count, 0, NULL);
+        if (ret >= 0) {
+            for (i = 0; i < ret; i++) {
+                NET_SockadrToNetadr(&addrs[i], &packets[i].addr);
+                packets[i].len = hdrs[i].msg_len;
+            }
+            return ret;
+        }
+
+        net_error = errno;
+
+        // wouldblock is silent
+        if (net_error == EWOULDBLOCK)
+            return NET_AGAIN;
+
+        if (!process_error_queue(sock, NULL))
+            break;
+    }
+
+    return NET_ERROR;
+}
+
+// returns number of packets sent, which may be less than count.
+// on failure, error applies to the first packet.
+static int os_udp_sendmmsg(qsocket_t sock, udppacket_t *packets, int count)
+{
+    struct mmsghdr hdrs[MAX_MMSG_PACKETS];
+    struct iovec iovs[MAX_MMSG_PACKETS];
+    struct sockaddr_storage addrs[MAX_MMSG_PACKETS];
+    int i, ret, tries;
+
+    memset(hdrs, 0, sizeof(hdrs[0]) * count);
+    for (i = 0; i < count; i++) {
+        iovs[i].iov_base = packets[i].data;
+        iovs[i].iov_len = packets[i].len;
+        hdrs[i].msg_hdr.msg_name = &addrs[i];
+        hdrs[i].msg_hdr.msg_namelen = NET_NetadrToSockadr(&packets[i].addr, &addrs[i]);
+        hdrs[i].msg_hdr.msg_iov = &iovs[i];
+        hdrs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    for (tries = 0; tries < MAX_ERROR_RETRIES; tries++) {
+        ret = sendmmsg(sock, hdrs, count, 0);
+        if (ret >= 0) {
+            for (i = 0; i < ret; i++) {
+                if (hdrs[i].msg_len < packets[i].len)
+                    Com_WPrintf("%s: short send to %s\n", __func__,
+                                NET_AdrToString(&packets[i].addr));
+                packets[i].len = hdrs[i].msg_len;
+            }
+            return ret;
+        }
+
+        net_error = errno;
+
+        // wouldblock is silent
+        if (net_error == EWOULDBLOCK)
+            return NET_AGAIN;
+
+        if (!process_error_queue(sock, &packets[0].addr))
+            break;
+    }
+
+    return NET_ERROR;
+}
+
+#endif // USE_MMSG
+
 static neterr_t os_get_error(void)
 {
     net_error = errno;
@@ -318,7 +409,7 @@ static qsocket_t os_socket(int domain, int type, int protocol)
 
 static ioentry_t *_os_get_io(qsocket_t fd, const char *func)
 {
-    if (fd < 0 || fd >= FD_SETSIZE)
+    if (fd < 0 || fd >= MAX_IO_ENTRIES)
         Com_Error(ERR_FATAL, "%s: fd out of range: %d", func, fd);
 
     return &io_entries[fd];
@@ -343,6 +434,229 @@ static qsocket_t os_get_fd(ioentry_t *e)
     return e - io_entries;
 }
 
+#if USE_EPOLL
+
+// Descriptors stay registered in epoll set across NET_Sleep calls. Whenever
+// want flags of io entry change, it is put on the dirty list and epoll set is
+// updated before the next wait.
+
+#define MAX_IO_EVENTS   64
+
+static int                  io_epfd = -1;
+
+static qsocket_t            io_dirty[MAX_IO_ENTRIES];
+static int                  io_numdirty;
+
+// descriptors that have can* flags set
+static struct epoll_event   io_events[MAX_IO_EVENTS];
+static int                  io_numevents;
+
+static void os_touch_io(ioentry_t *e)
+{
+    if (!e->dirty) {
+        e->dirty = qtrue;
+        io_dirty[io_numdirty++] = os_get_fd(e);
+    }
+}
+
+static void os_update_io(ioentry_t *e)
+{
+    struct epoll_event ev;
+    qsocket_t fd = os_get_fd(e);
+    int op, ret;
+
+    if (e->nopoll)
+        return;
+
+    if (e->polled && e->pollread == e->wantread &&
+        e->pollwrite == e->wantwrite && e->pollexcept == e->wantexcept)
+        return;
+
+    if (!e->wantread && !e->wantwrite && !e->wantexcept) {
+        // don't keep it in the set, otherwise errors and hangups
+        // would be reported even with empty event mask
+        if (e->polled)
+            epoll_ctl(io_epfd, EPOLL_CTL_DEL, fd, NULL);
+        e->polled = qfalse;
+        return;
+    }
+
+    if (io_epfd == -1) {
+        io_epfd = epoll_create1(EPOLL_CLOEXEC);
+        if (io_epfd == -1)
+            Com_Error(ERR_FATAL, "%s: epoll_create1: %s", __func__, strerror(errno));
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    if (e->wantread) ev.events |= EPOLLIN;
+    if (e->wantwrite) ev.events |= EPOLLOUT;
+    if (e->wantexcept) ev.events |= EPOLLPRI;
+    ev.data.fd = fd;
+
+    op = e->polled ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    ret = epoll_ctl(io_epfd, op, fd, &ev);
+    if (ret == -1 && (errno == ENOENT || errno == EEXIST)) {
+        // descriptor was closed and reused behind our back
+        op = (op == EPOLL_CTL_ADD) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        ret = epoll_ctl(io_epfd, op, fd, &ev);
+    }
+
+    if (ret == -1) {
+        // regular files can't be polled, but select() reports them as
+        // always ready, so do the same
+        if (errno != EPERM)
+            Com_EPrintf("%s: epoll_ctl: %s\n", __func__, strerror(errno));
+        e->nopoll = qtrue;
+        e->polled = qfalse;
+        return;
+    }
+
+    e->polled = qtrue;
+    e->pollread = e->wantread;
+    e->pollwrite = e->wantwrite;
+    e->pollexcept = e->wantexcept;
+}
+
+static void os_remove_io(ioentry_t *e)
+{
+    if (e->polled)
+        epoll_ctl(io_epfd, EPOLL_CTL_DEL, os_get_fd(e), NULL);
+}
+
+static void os_set_events(ioentry_t *e, uint32_t events)
+{
+    if (e->wantread && (events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+        e->canread = qtrue;
+    if (e->wantwrite && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+        e->canwrite = qtrue;
+    if (e->wantexcept && (events & EPOLLPRI))
+        e->canexcept = qtrue;
+}
+
+// clears can* flags set by the previous call, then syncs epoll set.
+// returns number of descriptors that are always ready.
+static int os_begin_poll(void)
+{
+    ioentry_t *e;
+    int i, j, ready;
+
+    for (i = 0; i < io_numevents; i++) {
+        e = os_get_io(io_events[i].data.fd);
+        e->canread = qfalse;
+        e->canwrite = qfalse;
+        e->canexcept = qfalse;
+    }
+    io_numevents = 0;
+
+    for (i = j = ready = 0; i < io_numdirty; i++) {
+        e = os_get_io(io_dirty[i]);
+        if (!e->dirty)
+            continue;   // removed and possibly re-added
+        e->dirty = qfalse;
+        if (!e->inuse)
+            continue;
+
+        os_update_io(e);
+        if (!e->nopoll)
+            continue;
+
+        // keep it on the dirty list forever
+        e->dirty = qtrue;
+        io_dirty[j++] = io_dirty[i];
+
+        e->canread = e->wantread;
+        e->canwrite = e->wantwrite;
+        e->canexcept = qfalse;
+        if (e->wantread || e->wantwrite)
+            ready++;
+    }
+    io_numdirty = j;
+
+    return ready;
+}
+
+static int os_poll(int msec)
+{
+    ioentry_t *e;
+    int i, ret;
+
+    if (io_epfd == -1) {
+        Sys_Sleep(msec);
+        return 0;
+    }
+
+    ret = epoll_wait(io_epfd, io_events, MAX_IO_EVENTS, msec);
+    if (ret == -1) {
+        net_error = errno;
+        if (net_error == EINTR)
+            return 0;
+        return ret;
+    }
+
+    io_numevents = ret;
+    for (i = 0; i < ret; i++) {
+        e = os_get_io(io_events[i].data.fd);
+        if (e->inuse)
+            os_set_events(e, io_events[i].events);
+    }
+
+    return ret;
+}
+
+#if USE_AC_SERVER
+// waits on a subset of descriptors only
+static int os_poll_subset(int msec, qsocket_t *fds, int nfds)
+{
+    struct pollfd pfds[MAX_IO_EVENTS];
+    struct epoll_event *ev;
+    ioentry_t *e;
+    int i, n, ret;
+
+    for (i = n = 0; i < nfds && n < MAX_IO_EVENTS; i++) {
+        e = os_get_io(fds[i]);
+        if (!e->inuse)
+            continue;
+        pfds[n].fd = fds[i];
+        pfds[n].events = 0;
+        pfds[n].revents = 0;
+        if (e->wantread) pfds[n].events |= POLLIN;
+        if (e->wantwrite) pfds[n].events |= POLLOUT;
+        if (e->wantexcept) pfds[n].events |= POLLPRI;
+        n++;
+    }
+
+    ret = poll(pfds, n, msec);
+    if (ret == -1) {
+        net_error = errno;
+        if (net_error == EINTR)
+            return 0;
+        return ret;
+    }
+
+    for (i = 0; i < n && io_numevents < MAX_IO_EVENTS; i++) {
+        if (!pfds[i].revents)
+            continue;
+        // remember it so that flags are cleared by the next call
+        ev = &io_events[io_numevents++];
+        ev->data.fd = pfds[i].fd;
+        ev->events = 0;
+        if (pfds[i].revents & POLLIN) ev->events |= EPOLLIN;
+        if (pfds[i].revents & POLLOUT) ev->events |= EPOLLOUT;
+        if (pfds[i].revents & POLLPRI) ev->events |= EPOLLPRI;
+        if (pfds[i].revents & POLLERR) ev->events |= EPOLLERR;
+        if (pfds[i].revents & POLLHUP) ev->events |= EPOLLHUP;
+        os_set_events(os_get_io(pfds[i].fd), ev->events);
+    }
+
+    return ret;
+}
+#endif
+
+#else
+
+#define os_touch_io(e)  (void)0
+#define os_remove_io(e) (void)0
+
 static int os_select(int nfds, fd_set *rfds, fd_set *wfds,
                      fd_set *efds, struct timeval *tv)
 {
@@ -357,6 +671,8 @@ static int os_select(int nfds, fd_set *rfds, fd_set *wfds,
     return ret;
 }
 
+#endif // !USE_EPOLL
+
 static void os_net_init(void)
 {
 }
@@ -369,6 +369,9 @@ static qsocket_t os_get_fd(ioentry_t *e)
     return e->fd;
 }
 
+#define os_touch_io(e)  (void)0
+#define os_remove_io(e) (void)0
+
 static int os_select(int nfds, fd_set *rfds, fd_set *wfds,
                      fd_set *efds, struct timeval *tv)
 {
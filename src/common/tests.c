@@ -17,12 +17,18 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "shared/shared.h"
+#include "common/bits.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/common.h"
 #include "common/files.h"
+#include "common/jobs.h"
 #include "common/tests.h"
+#include "format/wal.h"
 #include "refresh/refresh.h"
+#include "refresh/pixels.h"
+#include "refresh/hq2x.h"
+#include "client/sound/mixer.h"
 #include "system/system.h"
 
 // test error shutdown procedures
@@ -492,6 +498,603 @@ static void Com_TestSnprintf_f(void)
     Com_Printf("%d failures, %d strings tested\n", errors, num_snprintf_tests * 2);
 }
 
+// verifies bitset kernels against scalar versions and measures their speed
+static void Com_TestBits_f(void)
+{
+    static byte     a[VIS_MAX_BYTES + 16], b[VIS_MAX_BYTES + 16];
+    static byte     c[VIS_MAX_BYTES + 16], d[VIS_MAX_BYTES + 16];
+    static int      ints[MAX_MAP_AREAS + 7];
+    const bitops_t  *ref, *impl;
+    int             i, n, ofs, iterations, errors, tests;
+    size_t          len;
+    unsigned        start, t[4];
+    volatile size_t sink;
+
+    iterations = 10000;
+    if (Cmd_Argc() > 1) {
+        iterations = atoi(Cmd_Argv(1));
+        clamp(iterations, 1, 1000000);
+    }
+
+    for (i = 0; i < sizeof(a); i++) {
+        a[i] = rand();
+        b[i] = rand() & rand() & rand();
+    }
+    for (i = 0; i < q_countof(ints); i++) {
+        ints[i] = rand() % 4;
+    }
+
+    ref = Bits_GetImpl(0);
+    errors = tests = 0;
+
+    // check all lengths and misalignments around vector widths
+    for (n = 1; (impl = Bits_GetImpl(n)) != NULL; n++) {
+        for (len = 0; len <= 100; len++) {
+            for (ofs = 0; ofs < 4; ofs++) {
+                memcpy(c, a, sizeof(c));
+                memcpy(d, a, sizeof(d));
+                ref->Or(c + ofs, b + ofs, len);
+                impl->Or(d + ofs, b + ofs, len);
+                errors += !!memcmp(c, d, sizeof(c));
+
+                ref->And(c + ofs, b + ofs, len);
+                impl->And(d + ofs, b + ofs, len);
+                errors += !!memcmp(c, d, sizeof(c));
+
+                errors += ref->Count(a + ofs, len) != impl->Count(a + ofs, len);
+
+                memset(c, 0, sizeof(c));
+                memset(d, 0, sizeof(d));
+                ref->MatchInts(c, ints + ofs, len, 1);
+                impl->MatchInts(d, ints + ofs, len, 1);
+                errors += !!memcmp(c, d, sizeof(c));
+
+                tests += 4;
+            }
+        }
+    }
+
+    Com_Printf("%d failures, %d kernels tested\n", errors, tests);
+
+    // measure speed on full size visibility rows
+    Com_Printf("impl       or    and  count  match (msec for %d iterations)\n", iterations);
+    for (n = 0; (impl = Bits_GetImpl(n)) != NULL; n++) {
+        memset(d, 0, sizeof(d));
+
+        start = Sys_Milliseconds();
+        for (i = 0; i < iterations; i++)
+            impl->Or(c, a, VIS_MAX_BYTES);
+        t[0] = Sys_Milliseconds() - start;
+
+        start = Sys_Milliseconds();
+        for (i = 0; i < iterations; i++)
+            impl->And(c, a, VIS_MAX_BYTES);
+        t[1] = Sys_Milliseconds() - start;
+
+        start = Sys_Milliseconds();
+        for (i = 0, sink = 0; i < iterations; i++)
+            sink += impl->Count(a, VIS_MAX_BYTES);
+        t[2] = Sys_Milliseconds() - start;
+
+        start = Sys_Milliseconds();
+        for (i = 0; i < iterations; i++)
+            impl->MatchInts(c, ints, MAX_MAP_AREAS, i & 3);
+        t[3] = Sys_Milliseconds() - start;
+
+        Com_Printf("%-6s %6u %6u %6u %6u\n", impl->name, t[0], t[1], t[2], t[3]);
+    }
+}
+
+#if USE_REF
+
+#define MAX_TEST_IMAGES     256
+#define MAX_TEST_IMAGE_SIZE 512
+
+typedef struct {
+    int     width, height;
+    byte    *data;
+} testimage_t;
+
+static testimage_t  test_images[MAX_TEST_IMAGES];
+static int          num_test_images;
+
+// expands world textures found in the filesystem to RGBA using a made up
+// palette, since pixel values don't affect speed. makes up random images
+// if there are no textures.
+static void load_test_images(void)
+{
+    testimage_t *image;
+    miptex_t    *mt;
+    void        **list;
+    byte        *src;
+    int         i, j, w, h, count;
+    ssize_t     len;
+
+    list = FS_ListFiles("textures", ".wal", FS_SEARCH_SAVEPATH, &count);
+    for (i = 0; i < count && num_test_images < MAX_TEST_IMAGES; i++) {
+        len = FS_LoadFile(list[i], (void **)&mt);
+        if (!mt)
+            continue;
+        w = LittleLong(mt->width);
+        h = LittleLong(mt->height);
+        j = LittleLong(mt->offsets[0]);
+        if (w >= 1 && w <= MAX_TEST_IMAGE_SIZE && h >= 1 && h <= MAX_TEST_IMAGE_SIZE &&
+            j >= sizeof(*mt) && j <= len && w * h <= len - j) {
+            image = &test_images[num_test_images++];
+            image->width = w;
+            image->height = h;
+            image->data = Z_Malloc(w * h * 4);
+            src = (byte *)mt + j;
+            for (j = 0; j < w * h; j++) {
+                image->data[j * 4 + 0] = src[j];
+                image->data[j * 4 + 1] = src[j] * 3;
+                image->data[j * 4 + 2] = src[j] * 7;
+                image->data[j * 4 + 3] = src[j] == 255 ? 0 : 255;
+            }
+        }
+        FS_FreeFile(mt);
+    }
+    FS_FreeList(list);
+
+    if (num_test_images) {
+        Com_Printf("Using %d textures\n", num_test_images);
+        return;
+    }
+
+    while (num_test_images < 64) {
+        image = &test_images[num_test_images++];
+        image->width = 16 << (rand() % 5);
+        image->height = 16 << (rand() % 5);
+        image->data = Z_Malloc(image->width * image->height * 4);
+        for (j = 0; j < image->width * image->height * 4; j++)
+            image->data[j] = rand();
+    }
+
+    Com_Printf("Using %d random images\n", num_test_images);
+}
+
+// verifies image processing kernels against scalar versions and measures
+// their speed over the texture set
+static void Com_TestPixels_f(void)
+{
+    static const int mipsizes[][2] = {
+        {1, 1}, {1, 2}, {2, 1}, {2, 2}, {1, 8}, {4, 4}, {6, 2}, {8, 8}, {10, 6},
+        {16, 16}, {18, 4}, {24, 3}, {32, 32}, {34, 10}, {64, 128}, {256, 256}
+    };
+    static const int resamplesizes[][4] = {
+        {13, 7, 16, 8}, {320, 240, 512, 256}, {100, 100, 64, 64}, {3, 5, 1, 1},
+        {1, 1, 9, 3}, {640, 480, 1024, 512}, {17, 33, 32, 64}, {256, 256, 200, 100}
+    };
+    static const float colorscales[] = { 0, 0.25f, 0.5f, 0.777f, 1 };
+    const pixelops_t    *ref, *impl;
+    testimage_t *image;
+    byte        *src, *a, *b, *work, table[256];
+    int         i, j, n, w, h, iterations, errors, tests;
+    size_t      size;
+    unsigned    start, t[4];
+
+    iterations = 10;
+    if (Cmd_Argc() > 1) {
+        iterations = atoi(Cmd_Argv(1));
+        clamp(iterations, 1, 10000);
+    }
+
+    // renderer may not be running
+    Pixels_Init();
+
+    size = 1024 * 1024 * 4 + 64;
+    src = Z_Malloc(size);
+    a = Z_Malloc(size);
+    b = Z_Malloc(size);
+    for (i = 0; i < size; i++)
+        src[i] = rand();
+    for (i = 0; i < 256; i++)
+        table[i] = rand();
+
+    ref = Pixels_GetImpl(0);
+    errors = tests = 0;
+
+    for (n = 1; (impl = Pixels_GetImpl(n)) != NULL; n++) {
+        // mipmap is done in place during uploads
+        for (i = 0; i < q_countof(mipsizes); i++) {
+            w = mipsizes[i][0];
+            h = mipsizes[i][1];
+            memcpy(a, src, size);
+            memcpy(b, src, size);
+            ref->MipMap(a, a, w, h);
+            impl->MipMap(b, b, w, h);
+            errors += !!memcmp(a, b, size);
+            ref->MipMap(a + w * h * 4, src, w, h);
+            impl->MipMap(b + w * h * 4, src, w, h);
+            errors += !!memcmp(a, b, size);
+            tests += 2;
+        }
+
+        for (i = 0; i < q_countof(resamplesizes); i++) {
+            memset(a, 0, size);
+            memset(b, 0, size);
+            ref->Resample(src, resamplesizes[i][0], resamplesizes[i][1],
+                          a, resamplesizes[i][2], resamplesizes[i][3]);
+            impl->Resample(src, resamplesizes[i][0], resamplesizes[i][1],
+                           b, resamplesizes[i][2], resamplesizes[i][3]);
+            errors += !!memcmp(a, b, size);
+            tests++;
+        }
+
+        // check all counts around vector widths, and a misaligned large one
+        for (i = 0; i <= 80; i++) {
+            j = i < 80 ? i : 10000;
+            memcpy(a, src, size);
+            memcpy(b, src, size);
+            ref->LightScale(a + 4, j, table);
+            impl->LightScale(b + 4, j, table);
+            errors += !!memcmp(a, b, size);
+            tests++;
+
+            for (w = 0; w < q_countof(colorscales); w++) {
+                memcpy(a, src, size);
+                memcpy(b, src, size);
+                ref->GrayScale(a + 4, j, colorscales[w]);
+                impl->GrayScale(b + 4, j, colorscales[w]);
+                errors += !!memcmp(a, b, size);
+                tests++;
+            }
+        }
+    }
+
+    Com_Printf("%d failures, %d kernels tested\n", errors, tests);
+
+    if (!num_test_images)
+        load_test_images();
+
+    // resample to next power of two up, then generate full mipmap chain
+    Com_Printf("impl   resample  mipmap lightscale grayscale (msec for %d iterations)\n", iterations);
+    work = a;
+    for (n = 0; (impl = Pixels_GetImpl(n)) != NULL; n++) {
+        start = Sys_Milliseconds();
+        for (i = 0; i < iterations; i++) {
+            for (j = 0, image = test_images; j < num_test_images; j++, image++) {
+                impl->Resample(image->data, image->width, image->height, work,
+                               npot32(image->width + 1), npot32(image->height + 1));
+            }
+        }
+        t[0] = Sys_Milliseconds() - start;
+
+        start = Sys_Milliseconds();
+        for (i = 0; i < iterations; i++) {
+            for (j = 0, image = test_images; j < num_test_images; j++, image++) {
+                w = image->width;
+                h = image->height;
+                impl->MipMap(work, image->data, w, h);
+                while (w > 2 || h > 2) {
+                    w = max(w >> 1, 1);
+                    h = max(h >> 1, 1);
+                    impl->MipMap(work, work, w, h);
+                }
+            }
+        }
+        t[1] = Sys_Milliseconds() - start;
+
+        start = Sys_Milliseconds();
+        for (i = 0; i < iterations; i++) {
+            for (j = 0, image = test_images; j < num_test_images; j++, image++) {
+                impl->LightScale(image->data, image->width * image->height, table);
+            }
+        }
+        t[2] = Sys_Milliseconds() - start;
+
+        start = Sys_Milliseconds();
+        for (i = 0; i < iterations; i++) {
+            for (j = 0, image = test_images; j < num_test_images; j++, image++) {
+                impl->GrayScale(image->data, image->width * image->height, 0.5f);
+            }
+        }
+        t[3] = Sys_Milliseconds() - start;
+
+        Com_Printf("%-6s %8u %7u %10u %9u\n", impl->name, t[0], t[1], t[2], t[3]);
+    }
+
+    Z_Free(src);
+    Z_Free(a);
+    Z_Free(b);
+}
+
+// blocky random image with a few colors and transparent holes
+static uint32_t *make_test_pic(int w, int h)
+{
+    uint32_t    *pic = Z_Malloc(w * h * 4);
+    uint32_t    colors[8];
+    int         i, x, y;
+
+    for (i = 0; i < 8; i++)
+        colors[i] = MakeColor(rand(), rand(), rand(), i ? 255 : 0);
+
+    for (y = 0; y < h; y++) {
+        for (x = 0; x < w; x++) {
+            if (rand() % 4)
+                pic[y * w + x] = colors[((x / 3) ^ (y / 2)) & 7];
+            else
+                pic[y * w + x] = colors[rand() & 7];
+        }
+    }
+
+    return pic;
+}
+
+// verifies threaded and vectorized HQ2x/HQ4x against reference versions
+static void Com_TestHQx_f(void)
+{
+    static const int sizes[][2] = {
+        {1, 1}, {1, 7}, {7, 1}, {2, 2}, {3, 5}, {9, 9}, {17, 4}, {64, 64}, {128, 96}, {320, 240}
+    };
+    void        **list;
+    uint32_t    *pic, *a, *b;
+    int         i, w, h, count, errors, tests;
+    ssize_t     len;
+    byte        *raw;
+    unsigned    start, t[4];
+
+    HQ2x_Init();
+
+    list = FS_ListFiles("pics", ".pcx", FS_SEARCH_SAVEPATH, &count);
+    errors = tests = 0;
+    t[0] = t[1] = t[2] = t[3] = 0;
+
+    for (i = 0; i < count + q_countof(sizes); i++) {
+        if (i < count) {
+            len = FS_LoadFile(list[i], (void **)&raw);
+            if (!raw)
+                continue;
+            pic = R_DecodePCX(raw, len, &w, &h);
+            FS_FreeFile(raw);
+            if (!pic)
+                continue;
+        } else {
+            w = sizes[i - count][0];
+            h = sizes[i - count][1];
+            pic = make_test_pic(w, h);
+        }
+
+        a = Z_Malloc(w * h * 4 * 16);
+        b = Z_Malloc(w * h * 4 * 16);
+
+        start = Sys_Milliseconds();
+        HQ2x_RenderRef(a, pic, w, h);
+        t[0] += Sys_Milliseconds() - start;
+
+        start = Sys_Milliseconds();
+        HQ2x_Render(b, pic, w, h);
+        t[1] += Sys_Milliseconds() - start;
+
+        if (memcmp(a, b, w * h * 4 * 4)) {
+            Com_EPrintf("HQ2x mismatch on %dx%d image %s\n", w, h, i < count ? (char *)list[i] : "");
+            errors++;
+        }
+
+        start = Sys_Milliseconds();
+        HQ4x_RenderRef(a, pic, w, h);
+        t[2] += Sys_Milliseconds() - start;
+
+        start = Sys_Milliseconds();
+        HQ4x_Render(b, pic, w, h);
+        t[3] += Sys_Milliseconds() - start;
+
+        if (memcmp(a, b, w * h * 4 * 16)) {
+            Com_EPrintf("HQ4x mismatch on %dx%d image %s\n", w, h, i < count ? (char *)list[i] : "");
+            errors++;
+        }
+
+        Z_Free(a);
+        Z_Free(b);
+        Z_Free(pic);
+        tests++;
+    }
+
+    FS_FreeList(list);
+
+    Com_Printf("%d failures, %d images tested\n", errors, tests);
+    Com_Printf("HQ2x: %u msec reference, %u msec threaded\n", t[0], t[1]);
+    Com_Printf("HQ4x: %u msec reference, %u msec threaded\n", t[2], t[3]);
+}
+
+#endif // USE_REF
+
+#if USE_SNDDMA
+
+#define MIXTEST_RATE    22050
+#define MIXTEST_BLOCK   2048    // paint buffer size of DMA sound engine
+
+typedef struct {
+    void    *data;
+    int     width;
+    int     length;
+    int     pos;
+    int     leftvol;
+    int     rightvol;
+} mixchan_t;
+
+// paints channels looping random 8 and 16 bit sounds into a memory buffer
+// instead of DMA buffer, comparing vectorized mixer against scalar one
+static void Com_TestMixer_f(void)
+{
+    mixchan_t       *chans, *ch;
+    const mixops_t  *impl;
+    samplepair_t    *paint;
+    int16_t         *ref, *out;
+    int             i, j, k, n, t, total, count, numchans, seconds, errors;
+    unsigned        start, msec;
+
+    numchans = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 32;
+    clamp(numchans, 1, 256);
+    seconds = Cmd_Argc() > 2 ? atoi(Cmd_Argv(2)) : 10;
+    clamp(seconds, 1, 600);
+
+    // sound system may not be running
+    Mixer_Init();
+
+    chans = Z_Mallocz(sizeof(*chans) * numchans);
+    for (i = 0, ch = chans; i < numchans; i++, ch++) {
+        ch->width = (i & 1) + 1;
+        ch->length = MIXTEST_RATE / 5 + rand() % (MIXTEST_RATE * 2);
+        ch->data = Z_Malloc(ch->length * ch->width);
+        for (j = 0; j < ch->length * ch->width; j++)
+            ((byte *)ch->data)[j] = rand();
+        // mixed at maximum s_volume, some channels silent on one side
+        ch->leftvol = i % 7 ? rand() & 255 : 0;
+        ch->rightvol = rand() & 255;
+    }
+
+    total = seconds * MIXTEST_RATE;
+    paint = Z_Malloc(sizeof(*paint) * MIXTEST_BLOCK);
+    ref = Z_Malloc(sizeof(*ref) * total * 2);
+    out = Z_Malloc(sizeof(*out) * total * 2);
+    errors = 0;
+
+    Com_Printf("%d channels, %d seconds at %d Hz\n", numchans, seconds, MIXTEST_RATE);
+
+    for (n = 0; (impl = Mixer_GetImpl(n)) != NULL; n++) {
+        for (i = 0; i < numchans; i++)
+            chans[i].pos = 0;
+
+        start = Sys_Milliseconds();
+        for (t = 0; t < total; t += count) {
+            count = min(MIXTEST_BLOCK, total - t);
+            memset(paint, 0, sizeof(*paint) * count);
+
+            for (i = 0, ch = chans; i < numchans; i++, ch++) {
+                for (j = 0; j < count; j += k) {
+                    k = min(count - j, ch->length - ch->pos);
+                    if (ch->width == 1)
+                        impl->Paint8(paint + j, (uint8_t *)ch->data + ch->pos, k,
+                                     (ch->leftvol >> 3) * 8 * 256,
+                                     (ch->rightvol >> 3) * 8 * 256);
+                    else
+                        impl->Paint16(paint + j, (int16_t *)ch->data + ch->pos, k,
+                                      ch->leftvol * 256, ch->rightvol * 256);
+                    ch->pos += k;
+                    if (ch->pos == ch->length)
+                        ch->pos = 0;
+                }
+            }
+
+            impl->Transfer16(out + t * 2, paint, count);
+        }
+        msec = Sys_Milliseconds() - start;
+
+        if (impl == Mixer_GetImpl(0)) {
+            memcpy(ref, out, sizeof(*out) * total * 2);
+        } else if (memcmp(ref, out, sizeof(*out) * total * 2)) {
+            Com_EPrintf("%s mixer output differs from scalar\n", impl->name);
+            errors++;
+        }
+
+        Com_Printf("%-6s %6u msec\n", impl->name, msec);
+    }
+
+    Com_Printf("%d failures\n", errors);
+
+    for (i = 0; i < numchans; i++)
+        Z_Free(chans[i].data);
+    Z_Free(chans);
+    Z_Free(paint);
+    Z_Free(ref);
+    Z_Free(out);
+}
+
+#endif // USE_SNDDMA
+
+#define NUM_TEST_JOBS   3000
+
+static struct {
+    byte        slots[NUM_TEST_JOBS * 2];
+    jobgroup_t  groups[2];
+    int         done;
+} jobtest;
+
+static void job_slot_cb(void *arg)
+{
+    jobtest.slots[(intptr_t)arg]++;
+}
+
+static void job_done_cb(void *arg)
+{
+    jobtest.done++;
+}
+
+// queues the second half of slots from a worker thread. each has a done
+// callback, so both pools run out while main thread waits for the group.
+static void job_spawn_cb(void *arg)
+{
+    int i;
+
+    for (i = NUM_TEST_JOBS; i < NUM_TEST_JOBS * 2; i++) {
+        job_t job = {
+            .name = "test_nested",
+            .work_cb = job_slot_cb,
+            .done_cb = job_done_cb,
+            .cb_arg = (void *)(intptr_t)i,
+            .group = &jobtest.groups[1],
+        };
+        Job_Queue(&job);
+    }
+}
+
+static void Com_TestJobs_f(void)
+{
+    int i, errors = 0;
+    unsigned start, end;
+
+    memset(&jobtest, 0, sizeof(jobtest));
+
+    start = Sys_Milliseconds();
+
+    job_t spawn = {
+        .name = "test_spawn",
+        .work_cb = job_spawn_cb,
+        .group = &jobtest.groups[1],
+    };
+    Job_Queue(&spawn);
+
+    for (i = 0; i < NUM_TEST_JOBS; i++) {
+        job_t job = {
+            .name = "test",
+            .work_cb = job_slot_cb,
+            .done_cb = i & 1 ? job_done_cb : NULL,
+            .cb_arg = (void *)(intptr_t)i,
+            .group = &jobtest.groups[0],
+        };
+        Job_Queue(&job);
+    }
+
+    Job_Wait(&jobtest.groups[0]);
+    for (i = 0; i < NUM_TEST_JOBS; i++) {
+        if (jobtest.slots[i] != 1) {
+            Com_EPrintf("slot %d run %d times\n", i, jobtest.slots[i]);
+            errors++;
+        }
+    }
+
+    Job_Wait(&jobtest.groups[1]);
+    for (i = NUM_TEST_JOBS; i < NUM_TEST_JOBS * 2; i++) {
+        if (jobtest.slots[i] != 1) {
+            Com_EPrintf("nested slot %d run %d times\n", i, jobtest.slots[i]);
+            errors++;
+        }
+    }
+
+    Job_Complete();
+    if (jobtest.done != NUM_TEST_JOBS / 2 + NUM_TEST_JOBS) {
+        Com_EPrintf("%d done callbacks, expected %d\n", jobtest.done,
+                    NUM_TEST_JOBS / 2 + NUM_TEST_JOBS);
+        errors++;
+    }
+
+    end = Sys_Milliseconds();
+
+    Com_Printf("%d msec, %d failures, %d jobs tested\n",
+               end - start, errors, NUM_TEST_JOBS * 2 + 1);
+}
+
 #if USE_REF
 static void Com_TestModels_f(void)
 {
@@ -536,6 +1139,15 @@ void TST_Init(void)
     Cmd_AddCommand("normtest", Com_TestNorm_f);
     Cmd_AddCommand("infotest", Com_TestInfo_f);
     Cmd_AddCommand("snprintftest", Com_TestSnprintf_f);
+    Cmd_AddCommand("bitstest", Com_TestBits_f);
+#if USE_REF
+    Cmd_AddCommand("pixelstest", Com_TestPixels_f);
+    Cmd_AddCommand("hqxtest", Com_TestHQx_f);
+#endif
+#if USE_SNDDMA
+    Cmd_AddCommand("mixtest", Com_TestMixer_f);
+#endif
+    Cmd_AddCommand("jobtest", Com_TestJobs_f);
 #if USE_REF
     Cmd_AddCommand("modeltest", Com_TestModels_f);
 #endif
@@ -19,6 +19,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/shared.h"
 #include "common/common.h"
 #include "common/zone.h"
+#include "system/system.h"
 
 #define Z_MAGIC     0x1d0d
 
@@ -49,6 +50,7 @@ typedef struct {
 static zhead_t      z_chain;
 static zstatic_t    z_static[11];
 static zstats_t     z_stats[TAG_MAX];
+static sysmutex_t   *z_lock;    // created once worker threads may allocate
 
 static const char   z_tagnames[TAG_MAX][8] = {
     "game",
@@ -79,6 +81,18 @@ static inline void Z_CountAlloc(zhead_t *z)
     s->bytes += z->size;
 }
 
+static inline void Z_Lock(void)
+{
+    if (z_lock)
+        Sys_LockMutex(z_lock);
+}
+
+static inline void Z_Unlock(void)
+{
+    if (z_lock)
+        Sys_UnlockMutex(z_lock);
+}
+
 static inline void Z_Validate(zhead_t *z, const char *func)
 {
     if (z->magic != Z_MAGIC) {
@@ -94,6 +108,7 @@ void Z_LeakTest(memtag_t tag)
     zhead_t *z;
     size_t numLeaks = 0, numBytes = 0;
 
+    Z_Lock();
     Z_FOR_EACH(z) {
         Z_Validate(z, __func__);
         if (z->tag == tag) {
@@ -101,6 +116,7 @@ void Z_LeakTest(memtag_t tag)
             numBytes += z->size;
         }
     }
+    Z_Unlock();
 
     if (numLeaks) {
         Com_WPrintf("************* Z_LeakTest *************\n"
@@ -128,11 +144,15 @@ void Z_Free(void *ptr)
 
     Z_Validate(z, __func__);
 
+    Z_Lock();
     Z_CountFree(z);
-
     if (z->tag != TAG_STATIC) {
         z->prev->next = z->next;
         z->next->prev = z->prev;
+    }
+    Z_Unlock();
+
+    if (z->tag != TAG_STATIC) {
         z->magic = 0xdead;
         z->tag = TAG_FREE;
         free(z);
@@ -174,6 +194,8 @@ void *Z_Realloc(void *ptr, size_t size)
         Com_Error(ERR_FATAL, "%s: couldn't realloc static memory", __func__);
     }
 
+    // neighbours point to the old block until relinked
+    Z_Lock();
     Z_CountFree(z);
 
     z = realloc(z, size);
@@ -186,6 +208,7 @@ void *Z_Realloc(void *ptr, size_t size)
     z->next->prev = z;
 
     Z_CountAlloc(z);
+    Z_Unlock();
 
     return z + 1;
 }
@@ -227,12 +250,19 @@ void Z_FreeTags(memtag_t tag)
 {
     zhead_t *z, *n;
 
+    Z_Lock();
     Z_FOR_EACH_SAFE(z, n) {
         Z_Validate(z, __func__);
         if (z->tag == tag) {
-            Z_Free(z + 1);
+            Z_CountFree(z);
+            z->prev->next = z->next;
+            z->next->prev = z->prev;
+            z->magic = 0xdead;
+            z->tag = TAG_FREE;
+            free(z);
         }
     }
+    Z_Unlock();
 }
 
 /*
@@ -265,16 +295,18 @@ void *Z_TagMalloc(size_t size, memtag_t tag)
     z->tag = tag;
     z->size = size;
 
+    if (z_perturb && z_perturb->integer) {
+        memset(z + 1, z_perturb->integer, size - sizeof(*z));
+    }
+
+    Z_Lock();
     z->next = z_chain.next;
     z->prev = &z_chain;
     z_chain.next->prev = z;
     z_chain.next = z;
 
-    if (z_perturb && z_perturb->integer) {
-        memset(z + 1, z_perturb->integer, size - sizeof(*z));
-    }
-
     Z_CountAlloc(z);
+    Z_Unlock();
 
     return z + 1;
 }
@@ -357,6 +389,20 @@ void Z_Init(void)
     }
 }
 
+/*
+========================
+Z_InitLock
+
+Makes allocator safe to use from multiple threads.
+========================
+*/
+void Z_InitLock(void)
+{
+    if (!z_lock) {
+        z_lock = Sys_CreateMutex();
+    }
+}
+
 /*
 ================
 Z_TagCopyString
@@ -94,7 +94,6 @@ typedef struct {
     uint32_t        inverse_intensity_66;
     uint32_t        inverse_intensity_100;
     float           sintab[256];
-    byte            latlngtab[NUMVERTEXNORMALS][2];
     byte            lightstylemap[MAX_LIGHTSTYLES];
 } glStatic_t;
 
@@ -236,11 +235,6 @@ typedef struct maliastc_s {
     float   st[2];
 } maliastc_t;
 
-typedef struct masliasvert_s {
-    short   pos[3];
-    byte    norm[2]; // lat, lng
-} maliasvert_t;
-
 typedef struct maliasframe_s {
     vec3_t  scale;
     vec3_t  translate;
@@ -253,7 +247,11 @@ typedef struct maliasmesh_s {
     int             numtris;
     int             numindices;
     QGL_INDEX_TYPE  *indices;
-    maliasvert_t    *verts;
+    // vertices are stored as separate x, y and z arrays for each frame,
+    // padded to vertstride elements so that SIMD code can read past the end
+    int             vertstride;
+    int16_t         *positions;
+    int8_t          *normals;   // unit vectors scaled by 127
     maliastc_t      *tcoords;
     image_t         *skins[MAX_ALIAS_SKINS];
     int             numskins;
@@ -584,11 +582,8 @@ void R_SetSky(const char *name, float rotate, vec3_t axis);
  *
  */
 void GL_DrawAliasModel(model_t *model);
+void GL_InitMeshes(void);
 
-/*
- * hq2x.c
- *
- */
-void HQ2x_Render(uint32_t *output, const uint32_t *input, int width, int height);
-void HQ4x_Render(uint32_t *output, const uint32_t *input, int width, int height);
-void HQ2x_Init(void);
+// for benchmarking, index 0 is the scalar version
+const char *GL_TessImplName(int index);
+unsigned GL_TessAliasModel(const model_t *model, int index, int iterations, float *maxerror);
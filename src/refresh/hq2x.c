@@ -26,7 +26,17 @@ written by Maxim Stepin (MaxSt). it is not 100% identical, but very similar.
 */
 
 #include "shared/shared.h"
+#include "common/common.h"
 #include "common/cvar.h"
+#include "refresh/hq2x.h"
+#include "common/jobs.h"
+#include "common/zone.h"
+
+#if (defined __GNUC__) && ((defined __i386__) || (defined __x86_64__))
+#define USE_HQX_X86 1
+#include <immintrin.h>
+#define TARGET(x)   __attribute__((target(x)))
+#endif
 
 static const uint8_t hqTable[256] = {
     1, 1, 2,  4, 1, 1, 2,  4, 3,  5,  7,  8, 3,  5, 13, 15,
@@ -353,105 +363,442 @@ static q_noinline void hq4x_blend(int rule, uint32_t *p00, uint32_t *p01, uint32
     }
 }
 
+/*
+===============================================================================
+
+PATTERN DETECTION
+
+Each pixel is compared against its 8 neighbours. Pixels are converted to
+YCbCr once per row instead of once per comparison, then compared several
+at a time. Results are identical to calling diff() for each pair.
+
+===============================================================================
+*/
+
+// converted row of pixels, index -1 and width replicate edge pixels
+typedef struct {
+    int32_t     *y, *cb, *cr;
+    int32_t     *z;     // -1 for transparent pixels, 0 otherwise
+} hqxrow_t;
+
+typedef void (*hqxpatterns_t)(int *patterns, const hqxrow_t *prev,
+                              const hqxrow_t *cur, const hqxrow_t *next, int width);
+
+static void convert_row(hqxrow_t *row, const uint32_t *in, int width)
+{
+    color_t c;
+    int x;
+
+    for (x = -1; x <= width; x++) {
+        c.u32 = in[x < 0 ? 0 : x < width ? x : width - 1];
+        row->y[x]  = yccTable[0][c.u8[0]] + yccTable[1][c.u8[1]] + yccTable[2][c.u8[2]];
+        row->cb[x] = yccTable[3][c.u8[0]] + yccTable[4][c.u8[1]] + yccTable[5][c.u8[2]];
+        row->cr[x] = yccTable[5][c.u8[0]] + yccTable[6][c.u8[1]] + yccTable[7][c.u8[2]];
+        row->z[x]  = c.u8[3] ? 0 : -1;
+    }
+}
+
+static inline int diff_row(const hqxrow_t *a, int i, const hqxrow_t *b, int j)
+{
+    if (a->z[i] & b->z[j])
+        return 0;
+
+    if (a->z[i] | b->z[j])
+        return 1;
+
+    if (abs(a->y[i] - b->y[j]) > maxY)
+        return 1;
+
+    if (abs(a->cb[i] - b->cb[j]) > maxCb)
+        return 1;
+
+    if (abs(a->cr[i] - b->cr[j]) > maxCr)
+        return 1;
+
+    return 0;
+}
+
+static void patterns_c(int *patterns, const hqxrow_t *prev, const hqxrow_t *cur,
+                       const hqxrow_t *next, int x, int width)
+{
+    int pattern;
+
+    for (; x < width; x++) {
+        pattern  = diff_row(cur, x, prev, x - 1) << 0;
+        pattern |= diff_row(cur, x, prev, x    ) << 1;
+        pattern |= diff_row(cur, x, prev, x + 1) << 2;
+        pattern |= diff_row(cur, x, cur,  x - 1) << 3;
+        pattern |= diff_row(cur, x, cur,  x + 1) << 4;
+        pattern |= diff_row(cur, x, next, x - 1) << 5;
+        pattern |= diff_row(cur, x, next, x    ) << 6;
+        pattern |= diff_row(cur, x, next, x + 1) << 7;
+        patterns[x] = pattern;
+    }
+}
+
+static void Patterns_C(int *patterns, const hqxrow_t *prev, const hqxrow_t *cur,
+                       const hqxrow_t *next, int width)
+{
+    patterns_c(patterns, prev, cur, next, 0, width);
+}
+
+#if USE_HQX_X86
+
+TARGET("sse2")
+static inline __m128i diff_sse2(const __m128i *e, const hqxrow_t *row, int x)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i ny  = _mm_loadu_si128((const __m128i *)(row->y + x));
+    __m128i ncb = _mm_loadu_si128((const __m128i *)(row->cb + x));
+    __m128i ncr = _mm_loadu_si128((const __m128i *)(row->cr + x));
+    __m128i nz  = _mm_loadu_si128((const __m128i *)(row->z + x));
+    __m128i both = _mm_and_si128(e[3], nz);
+    __m128i either = _mm_or_si128(e[3], nz);
+    __m128i d, far;
+
+    // no abs in SSE2, check both signs of difference instead
+    d = _mm_sub_epi32(e[0], ny);
+    far = _mm_or_si128(_mm_cmpgt_epi32(d, e[4]), _mm_cmpgt_epi32(_mm_sub_epi32(zero, d), e[4]));
+    d = _mm_sub_epi32(e[1], ncb);
+    far = _mm_or_si128(far, _mm_cmpgt_epi32(d, e[5]));
+    far = _mm_or_si128(far, _mm_cmpgt_epi32(_mm_sub_epi32(zero, d), e[5]));
+    d = _mm_sub_epi32(e[2], ncr);
+    far = _mm_or_si128(far, _mm_cmpgt_epi32(d, e[6]));
+    far = _mm_or_si128(far, _mm_cmpgt_epi32(_mm_sub_epi32(zero, d), e[6]));
+
+    return _mm_or_si128(_mm_andnot_si128(both, either), _mm_andnot_si128(either, far));
+}
+
+TARGET("sse2")
+static void Patterns_SSE2(int *patterns, const hqxrow_t *prev, const hqxrow_t *cur,
+                          const hqxrow_t *next, int width)
+{
+    __m128i e[7], p;
+    int x;
+
+    e[4] = _mm_set1_epi32(maxY);
+    e[5] = _mm_set1_epi32(maxCb);
+    e[6] = _mm_set1_epi32(maxCr);
+
+    for (x = 0; x + 4 <= width; x += 4) {
+        e[0] = _mm_loadu_si128((const __m128i *)(cur->y + x));
+        e[1] = _mm_loadu_si128((const __m128i *)(cur->cb + x));
+        e[2] = _mm_loadu_si128((const __m128i *)(cur->cr + x));
+        e[3] = _mm_loadu_si128((const __m128i *)(cur->z + x));
+
+        p = _mm_and_si128(diff_sse2(e, prev, x - 1), _mm_set1_epi32(0x01));
+        p = _mm_or_si128(p, _mm_and_si128(diff_sse2(e, prev, x    ), _mm_set1_epi32(0x02)));
+        p = _mm_or_si128(p, _mm_and_si128(diff_sse2(e, prev, x + 1), _mm_set1_epi32(0x04)));
+        p = _mm_or_si128(p, _mm_and_si128(diff_sse2(e, cur,  x - 1), _mm_set1_epi32(0x08)));
+        p = _mm_or_si128(p, _mm_and_si128(diff_sse2(e, cur,  x + 1), _mm_set1_epi32(0x10)));
+        p = _mm_or_si128(p, _mm_and_si128(diff_sse2(e, next, x - 1), _mm_set1_epi32(0x20)));
+        p = _mm_or_si128(p, _mm_and_si128(diff_sse2(e, next, x    ), _mm_set1_epi32(0x40)));
+        p = _mm_or_si128(p, _mm_and_si128(diff_sse2(e, next, x + 1), _mm_set1_epi32(0x80)));
+        _mm_storeu_si128((__m128i *)(patterns + x), p);
+    }
+    patterns_c(patterns, prev, cur, next, x, width);
+}
+
+TARGET("avx2")
+static inline __m256i diff_avx2(const __m256i *e, const hqxrow_t *row, int x)
+{
+    __m256i ny  = _mm256_loadu_si256((const __m256i *)(row->y + x));
+    __m256i ncb = _mm256_loadu_si256((const __m256i *)(row->cb + x));
+    __m256i ncr = _mm256_loadu_si256((const __m256i *)(row->cr + x));
+    __m256i nz  = _mm256_loadu_si256((const __m256i *)(row->z + x));
+    __m256i both = _mm256_and_si256(e[3], nz);
+    __m256i either = _mm256_or_si256(e[3], nz);
+    __m256i far;
+
+    far = _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_sub_epi32(e[0], ny)), e[4]);
+    far = _mm256_or_si256(far, _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_sub_epi32(e[1], ncb)), e[5]));
+    far = _mm256_or_si256(far, _mm256_cmpgt_epi32(_mm256_abs_epi32(_mm256_sub_epi32(e[2], ncr)), e[6]));
+
+    return _mm256_or_si256(_mm256_andnot_si256(both, either), _mm256_andnot_si256(either, far));
+}
+
+TARGET("avx2")
+static void Patterns_AVX2(int *patterns, const hqxrow_t *prev, const hqxrow_t *cur,
+                          const hqxrow_t *next, int width)
+{
+    __m256i e[7], p;
+    int x;
+
+    e[4] = _mm256_set1_epi32(maxY);
+    e[5] = _mm256_set1_epi32(maxCb);
+    e[6] = _mm256_set1_epi32(maxCr);
+
+    for (x = 0; x + 8 <= width; x += 8) {
+        e[0] = _mm256_loadu_si256((const __m256i *)(cur->y + x));
+        e[1] = _mm256_loadu_si256((const __m256i *)(cur->cb + x));
+        e[2] = _mm256_loadu_si256((const __m256i *)(cur->cr + x));
+        e[3] = _mm256_loadu_si256((const __m256i *)(cur->z + x));
+
+        p = _mm256_and_si256(diff_avx2(e, prev, x - 1), _mm256_set1_epi32(0x01));
+        p = _mm256_or_si256(p, _mm256_and_si256(diff_avx2(e, prev, x    ), _mm256_set1_epi32(0x02)));
+        p = _mm256_or_si256(p, _mm256_and_si256(diff_avx2(e, prev, x + 1), _mm256_set1_epi32(0x04)));
+        p = _mm256_or_si256(p, _mm256_and_si256(diff_avx2(e, cur,  x - 1), _mm256_set1_epi32(0x08)));
+        p = _mm256_or_si256(p, _mm256_and_si256(diff_avx2(e, cur,  x + 1), _mm256_set1_epi32(0x10)));
+        p = _mm256_or_si256(p, _mm256_and_si256(diff_avx2(e, next, x - 1), _mm256_set1_epi32(0x20)));
+        p = _mm256_or_si256(p, _mm256_and_si256(diff_avx2(e, next, x    ), _mm256_set1_epi32(0x40)));
+        p = _mm256_or_si256(p, _mm256_and_si256(diff_avx2(e, next, x + 1), _mm256_set1_epi32(0x80)));
+        _mm256_storeu_si256((__m256i *)(patterns + x), p);
+    }
+    patterns_c(patterns, prev, cur, next, x, width);
+}
+
+#endif // USE_HQX_X86
+
+static hqxpatterns_t    hqx_patterns = Patterns_C;
+
+#if USE_TESTS
+// compares pixels directly, as the original implementation did
+static void patterns_ref(int *patterns, const uint32_t *input, int width, int height, int y)
+{
+    const uint32_t *in = input + y * width;
+    int prevline = (y == 0 ? 0 : width);
+    int nextline = (y == height - 1 ? 0 : width);
+    int x, pattern;
+
+    for (x = 0; x < width; x++, in++) {
+        int prev = (x == 0 ? 0 : 1);
+        int next = (x == width - 1 ? 0 : 1);
+        uint32_t E = *in;
+
+        pattern  = diff(E, *(in - prevline - prev)) << 0;
+        pattern |= diff(E, *(in - prevline)) << 1;
+        pattern |= diff(E, *(in - prevline + next)) << 2;
+        pattern |= diff(E, *(in - prev)) << 3;
+        pattern |= diff(E, *(in + next)) << 4;
+        pattern |= diff(E, *(in + nextline - prev)) << 5;
+        pattern |= diff(E, *(in + nextline)) << 6;
+        pattern |= diff(E, *(in + nextline + next)) << 7;
+        patterns[x] = pattern;
+    }
+}
+#endif
+
+/*
+===============================================================================
+
+RENDERING
+
+===============================================================================
+*/
+
+static void hq2x_row(uint32_t *output, const uint32_t *input, const int *patterns,
+                     int width, int height, int y)
+{
+    const uint32_t *in = input + y * width;
+    uint32_t *out0 = output + (y * 2 + 0) * width * 2;
+    uint32_t *out1 = output + (y * 2 + 1) * width * 2;
+    int x;
+
+    int prevline = (y == 0 ? 0 : width);
+    int nextline = (y == height - 1 ? 0 : width);
+
+    for (x = 0; x < width; x++) {
+        int prev = (x == 0 ? 0 : 1);
+        int next = (x == width - 1 ? 0 : 1);
+
+        uint32_t A = *(in - prevline - prev);
+        uint32_t B = *(in - prevline);
+        uint32_t C = *(in - prevline + next);
+        uint32_t D = *(in - prev);
+        uint32_t E = *(in);
+        uint32_t F = *(in + next);
+        uint32_t G = *(in + nextline - prev);
+        uint32_t H = *(in + nextline);
+        uint32_t I = *(in + nextline + next);
+
+        int pattern = patterns[x];
+
+        *(out0 + 0) = hq2x_blend(hqTable[pattern], E, A, B, D, F, H); pattern = rotTable[pattern];
+        *(out0 + 1) = hq2x_blend(hqTable[pattern], E, C, F, B, H, D); pattern = rotTable[pattern];
+        *(out1 + 1) = hq2x_blend(hqTable[pattern], E, I, H, F, D, B); pattern = rotTable[pattern];
+        *(out1 + 0) = hq2x_blend(hqTable[pattern], E, G, D, H, B, F);
+
+        in++;
+        out0 += 2;
+        out1 += 2;
+    }
+}
+
+static void hq4x_row(uint32_t *output, const uint32_t *input, const int *patterns,
+                     int width, int height, int y)
+{
+    const uint32_t *in = input + y * width;
+    uint32_t *out0 = output + (y * 4 + 0) * width * 4;
+    uint32_t *out1 = output + (y * 4 + 1) * width * 4;
+    uint32_t *out2 = output + (y * 4 + 2) * width * 4;
+    uint32_t *out3 = output + (y * 4 + 3) * width * 4;
+    int x;
+
+    int prevline = (y == 0 ? 0 : width);
+    int nextline = (y == height - 1 ? 0 : width);
+
+    for (x = 0; x < width; x++) {
+        int prev = (x == 0 ? 0 : 1);
+        int next = (x == width - 1 ? 0 : 1);
+
+        uint32_t A = *(in - prevline - prev);
+        uint32_t B = *(in - prevline);
+        uint32_t C = *(in - prevline + next);
+        uint32_t D = *(in - prev);
+        uint32_t E = *(in);
+        uint32_t F = *(in + next);
+        uint32_t G = *(in + nextline - prev);
+        uint32_t H = *(in + nextline);
+        uint32_t I = *(in + nextline + next);
+
+        int pattern = patterns[x];
+
+        hq4x_blend(hqTable[pattern], out0 + 0, out0 + 1, out1 + 0, out1 + 1, E, A, B, D, F, H); pattern = rotTable[pattern];
+        hq4x_blend(hqTable[pattern], out0 + 3, out1 + 3, out0 + 2, out1 + 2, E, C, F, B, H, D); pattern = rotTable[pattern];
+        hq4x_blend(hqTable[pattern], out3 + 3, out3 + 2, out2 + 3, out2 + 2, E, I, H, F, D, B); pattern = rotTable[pattern];
+        hq4x_blend(hqTable[pattern], out3 + 0, out2 + 0, out3 + 1, out2 + 1, E, G, D, H, B, F);
+
+        in++;
+        out0 += 4;
+        out1 += 4;
+        out2 += 4;
+        out3 += 4;
+    }
+}
+
+#define HQX_BAND_PIXELS     4096
+#define HQX_MAX_BANDS       64
+
+typedef struct {
+    uint32_t        *output;
+    const uint32_t  *input;
+    int             width, height;
+    int             y0, y1;
+    int             scale;
+} hqxband_t;
+
+static void render_band(void *arg)
+{
+    hqxband_t   *band = arg;
+    int         width = band->width;
+    int         height = band->height;
+    int         stride = width + 2;
+    int         i, y, prev, next;
+    int32_t     *buffer;
+    int         *patterns;
+    hqxrow_t    rows[3];
+
+    buffer = Z_Malloc(sizeof(*buffer) * stride * 12 + sizeof(*patterns) * width);
+    for (i = 0; i < 3; i++) {
+        rows[i].y  = buffer + stride * (i * 4 + 0) + 1;
+        rows[i].cb = buffer + stride * (i * 4 + 1) + 1;
+        rows[i].cr = buffer + stride * (i * 4 + 2) + 1;
+        rows[i].z  = buffer + stride * (i * 4 + 3) + 1;
+    }
+    patterns = (int *)(buffer + stride * 12);
+
+    // sliding window of 3 converted rows, row y lives in slot y % 3
+    prev = max(band->y0 - 1, 0);
+    convert_row(&rows[prev % 3], band->input + prev * width, width);
+    convert_row(&rows[band->y0 % 3], band->input + band->y0 * width, width);
+
+    for (y = band->y0; y < band->y1; y++) {
+        prev = max(y - 1, 0);
+        next = min(y + 1, height - 1);
+        if (next != y)
+            convert_row(&rows[next % 3], band->input + next * width, width);
+
+        hqx_patterns(patterns, &rows[prev % 3], &rows[y % 3], &rows[next % 3], width);
+
+        if (band->scale == 4)
+            hq4x_row(band->output, band->input, patterns, width, height, y);
+        else
+            hq2x_row(band->output, band->input, patterns, width, height, y);
+    }
+
+    Z_Free(buffer);
+}
+
+static void render(uint32_t *output, const uint32_t *input, int width, int height, int scale)
+{
+    hqxband_t   bands[HQX_MAX_BANDS];
+    jobgroup_t  group = { 0 };
+    job_t       job;
+    int         i, y, rows, numbands;
+
+    if (width < 1 || height < 1)
+        return;
+
+    rows = max((HQX_BAND_PIXELS + width - 1) / width,
+               (height + HQX_MAX_BANDS - 1) / HQX_MAX_BANDS);
+
+    numbands = 0;
+    for (y = 0; y < height; y += rows) {
+        hqxband_t *band = &bands[numbands++];
+        band->output = output;
+        band->input = input;
+        band->width = width;
+        band->height = height;
+        band->y0 = y;
+        band->y1 = min(y + rows, height);
+        band->scale = scale;
+    }
+
+    // small images are not worth the overhead
+    if (numbands == 1) {
+        render_band(&bands[0]);
+        return;
+    }
+
+    job.name = "hqx_band";
+    job.work_cb = render_band;
+    job.done_cb = NULL;
+    job.group = &group;
+    for (i = 0; i < numbands; i++) {
+        job.cb_arg = &bands[i];
+        Job_Queue(&job);
+    }
+
+    Job_Wait(&group);
+}
+
 void HQ2x_Render(uint32_t *output, const uint32_t *input, int width, int height)
 {
-    int x, y;
+    render(output, input, width, height, 2);
+}
+
+void HQ4x_Render(uint32_t *output, const uint32_t *input, int width, int height)
+{
+    render(output, input, width, height, 4);
+}
+
+#if USE_TESTS
+void HQ2x_RenderRef(uint32_t *output, const uint32_t *input, int width, int height)
+{
+    int *patterns = Z_Malloc(sizeof(*patterns) * width);
+    int y;
 
     for (y = 0; y < height; y++) {
-        const uint32_t *in = input + y * width;
-        uint32_t *out0 = output + (y * 2 + 0) * width * 2;
-        uint32_t *out1 = output + (y * 2 + 1) * width * 2;
-
-        int prevline = (y == 0 ? 0 : width);
-        int nextline = (y == height - 1 ? 0 : width);
-
-        for (x = 0; x < width; x++) {
-            int prev = (x == 0 ? 0 : 1);
-            int next = (x == width - 1 ? 0 : 1);
-
-            uint32_t A = *(in - prevline - prev);
-            uint32_t B = *(in - prevline);
-            uint32_t C = *(in - prevline + next);
-            uint32_t D = *(in - prev);
-            uint32_t E = *(in);
-            uint32_t F = *(in + next);
-            uint32_t G = *(in + nextline - prev);
-            uint32_t H = *(in + nextline);
-            uint32_t I = *(in + nextline + next);
-
-            int pattern;
-            pattern  = diff(E, A) << 0;
-            pattern |= diff(E, B) << 1;
-            pattern |= diff(E, C) << 2;
-            pattern |= diff(E, D) << 3;
-            pattern |= diff(E, F) << 4;
-            pattern |= diff(E, G) << 5;
-            pattern |= diff(E, H) << 6;
-            pattern |= diff(E, I) << 7;
-
-            *(out0 + 0) = hq2x_blend(hqTable[pattern], E, A, B, D, F, H); pattern = rotTable[pattern];
-            *(out0 + 1) = hq2x_blend(hqTable[pattern], E, C, F, B, H, D); pattern = rotTable[pattern];
-            *(out1 + 1) = hq2x_blend(hqTable[pattern], E, I, H, F, D, B); pattern = rotTable[pattern];
-            *(out1 + 0) = hq2x_blend(hqTable[pattern], E, G, D, H, B, F);
-
-            in++;
-            out0 += 2;
-            out1 += 2;
-        }
+        patterns_ref(patterns, input, width, height, y);
+        hq2x_row(output, input, patterns, width, height, y);
     }
+
+    Z_Free(patterns);
 }
 
-void HQ4x_Render(uint32_t *output, const uint32_t *input, int width, int height)
+void HQ4x_RenderRef(uint32_t *output, const uint32_t *input, int width, int height)
 {
-    int x, y;
+    int *patterns = Z_Malloc(sizeof(*patterns) * width);
+    int y;
 
     for (y = 0; y < height; y++) {
-        const uint32_t *in = input + y * width;
-        uint32_t *out0 = output + (y * 4 + 0) * width * 4;
-        uint32_t *out1 = output + (y * 4 + 1) * width * 4;
-        uint32_t *out2 = output + (y * 4 + 2) * width * 4;
-        uint32_t *out3 = output + (y * 4 + 3) * width * 4;
-
-        int prevline = (y == 0 ? 0 : width);
-        int nextline = (y == height - 1 ? 0 : width);
-
-        for (x = 0; x < width; x++) {
-            int prev = (x == 0 ? 0 : 1);
-            int next = (x == width - 1 ? 0 : 1);
-
-            uint32_t A = *(in - prevline - prev);
-            uint32_t B = *(in - prevline);
-            uint32_t C = *(in - prevline + next);
-            uint32_t D = *(in - prev);
-            uint32_t E = *(in);
-            uint32_t F = *(in + next);
-            uint32_t G = *(in + nextline - prev);
-            uint32_t H = *(in + nextline);
-            uint32_t I = *(in + nextline + next);
-
-            int pattern;
-            pattern  = diff(E, A) << 0;
-            pattern |= diff(E, B) << 1;
-            pattern |= diff(E, C) << 2;
-            pattern |= diff(E, D) << 3;
-            pattern |= diff(E, F) << 4;
-            pattern |= diff(E, G) << 5;
-            pattern |= diff(E, H) << 6;
-            pattern |= diff(E, I) << 7;
-
-            hq4x_blend(hqTable[pattern], out0 + 0, out0 + 1, out1 + 0, out1 + 1, E, A, B, D, F, H); pattern = rotTable[pattern];
-            hq4x_blend(hqTable[pattern], out0 + 3, out1 + 3, out0 + 2, out1 + 2, E, C, F, B, H, D); pattern = rotTable[pattern];
-            hq4x_blend(hqTable[pattern], out3 + 3, out3 + 2, out2 + 3, out2 + 2, E, I, H, F, D, B); pattern = rotTable[pattern];
-            hq4x_blend(hqTable[pattern], out3 + 0, out2 + 0, out3 + 1, out2 + 1, E, G, D, H, B, F);
-
-            in++;
-            out0 += 4;
-            out1 += 4;
-            out2 += 4;
-            out3 += 4;
-        }
+        patterns_ref(patterns, input, width, height, y);
+        hq4x_row(output, input, patterns, width, height, y);
     }
+
+    Z_Free(patterns);
 }
+#endif
 
 #define FIX(x)      (int)((x) * (1 << 16))
 
@@ -484,4 +831,12 @@ void HQ2x_Init(void)
         yccTable[6][n] = -FIX(0.41869f) * n;
         yccTable[7][n] = -FIX(0.08131f) * n;
     }
+
+#if USE_HQX_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        hqx_patterns = Patterns_AVX2;
+    else if (__builtin_cpu_supports("sse2"))
+        hqx_patterns = Patterns_SSE2;
+#endif
 }
@@ -25,6 +25,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "common/common.h"
 #include "common/cvar.h"
 #include "common/files.h"
+#include "common/jobs.h"
 #include "system/system.h"
 #include "format/pcx.h"
 #include "format/wal.h"
@@ -1210,12 +1211,13 @@ static void make_screenshot(const char *name, const char *ext,
     };
 
     if (async) {
-        asyncwork_t work = {
+        job_t job = {
+            .name = "screenshot",
             .work_cb = screenshot_work_cb,
             .done_cb = screenshot_done_cb,
             .cb_arg = Z_CopyStruct(&s),
         };
-        Sys_QueueAsyncWork(&work);
+        Job_Queue(&job);
     } else {
         screenshot_work_cb(&s);
         screenshot_done_cb(&s);
@@ -1460,54 +1462,286 @@ static image_t *lookup_image(const char *name,
     return NULL;
 }
 
+/*
+=========================================================
+
+ASYNCHRONOUS DECODING
+
+Between R_BeginRegistration and R_EndRegistration, image files are read on
+the main thread and decoded by worker threads into a private copy of image_t.
+GL upload happens on the main thread when the image is first needed, or when
+registration ends.
+
+=========================================================
+*/
+
+typedef struct imgload_s {
+    list_t          entry;
+    image_t         *image;
+    image_t         work;       // filled in by decoder
+    imageformat_t   fmt;
+    imageformat_t   orig;       // 8-bit format to recover dimensions from
+    qboolean        fallback;   // extension was replaced, try other formats
+    byte            *data;
+    size_t          len;
+    byte            *pic;
+    qerror_t        ret;
+    unsigned        time;       // decode time, microseconds
+    jobgroup_t      group;
+} imgload_t;
+
+static LIST_DECL(img_pending);
+static qboolean img_async;
+
+static struct {
+    int         images;
+    int         failed;
+    unsigned    read;       // microseconds
+    unsigned    decode;
+    unsigned    wait;
+    unsigned    upload;
+    unsigned    start;      // milliseconds
+} img_stats;
+
+static cvar_t   *r_async_images;
+static cvar_t   *r_loadstats;
+
+#if USE_PNG || USE_JPG || USE_TGA
+static void get_image_dimensions(imageformat_t fmt, image_t *image);
+static int try_next_formats(imageformat_t fmt, image_t *image, byte **pic);
+#endif
+
+static void decode_work_cb(void *arg)
+{
+    imgload_t *load = arg;
+    unsigned start = Sys_Microseconds();
+
+    load->ret = img_loaders[load->fmt].load(load->data, load->len, &load->work, &load->pic);
+    load->time = Sys_Microseconds() - start;
+}
+
+static void queue_decode(imageformat_t fmt, image_t *image, byte *data, size_t len)
+{
+    imgload_t *load = Z_Mallocz(sizeof(*load));
+
+    load->image = image;
+    load->work = *image;
+    load->fmt = fmt;
+    load->orig = IM_MAX;
+    load->data = data;
+    load->len = len;
+
+    List_Append(&img_pending, &load->entry);
+    image->load = load;
+
+    job_t job = {
+        .name = "image_decode",
+        .work_cb = decode_work_cb,
+        .cb_arg = load,
+        .group = &load->group,
+    };
+    Job_Queue(&job);
+}
+
+static void upload_image(image_t *image, byte *pic)
+{
+    unsigned start = Sys_Microseconds();
+
+    IMG_Load(image, pic);
+
+    img_stats.upload += Sys_Microseconds() - start;
+    img_stats.images++;
+}
+
+static void finish_decode(imgload_t *load)
+{
+    image_t *image = load->image;
+    image_t *ntx = R_NOTEXTURE;
+    unsigned start;
+
+    start = Sys_Microseconds();
+    Job_Wait(&load->group);
+    img_stats.wait += Sys_Microseconds() - start;
+    img_stats.decode += load->time;
+
+    FS_FreeFile(load->data);
+    List_Remove(&load->entry);
+    image->load = NULL;
+
+#if USE_PNG || USE_JPG || USE_TGA
+    // broken 32-bit replacement, fall back to remaining formats
+    if (load->ret < 0 && load->fallback && load->fmt > IM_WAL) {
+        Com_WPrintf("Couldn't load %s: %s\n", image->name, Q_ErrorString(load->ret));
+
+        load->work = *image;
+        load->work.load = NULL;
+        load->ret = try_next_formats(load->fmt, &load->work, &load->pic);
+        memcpy(image->name, load->work.name, sizeof(image->name));
+        if (load->ret <= IM_WAL) {
+            load->orig = IM_MAX;    // got the 8-bit image itself
+        }
+    }
+#endif
+
+    if (load->ret < 0) {
+        // don't spam about missing images
+        if (load->ret != Q_ERR_NOENT) {
+            Com_EPrintf("Couldn't load %s: %s\n", image->name, Q_ErrorString(load->ret));
+            img_stats.failed++;
+        }
+
+        // too late to fail registration, make it look like R_NOTEXTURE
+        image->width = image->upload_width = ntx->width;
+        image->height = image->upload_height = ntx->height;
+        image->texnum = ntx->texnum;
+        image->sl = image->tl = 0;
+        image->sh = image->th = 1;
+    } else {
+        image->width = load->work.width;
+        image->height = load->work.height;
+        image->upload_width = load->work.upload_width;
+        image->upload_height = load->work.upload_height;
+        image->flags |= load->work.flags;
+#if USE_PNG || USE_JPG || USE_TGA
+        if (load->orig != IM_MAX) {
+            get_image_dimensions(load->orig, image);
+        }
+#endif
+        upload_image(image, load->pic);
+    }
+
+    Z_Free(load);
+}
+
+/*
+===============
+IMG_FinishLoad
+
+Waits for the image to be decoded and uploads it.
+===============
+*/
+void IMG_FinishLoad(image_t *image)
+{
+    if (image->load) {
+        finish_decode(image->load);
+    }
+}
+
+/*
+===============
+IMG_FinishLoading
+
+Uploads all pending images.
+===============
+*/
+void IMG_FinishLoading(void)
+{
+    while (!LIST_EMPTY(&img_pending)) {
+        finish_decode(LIST_FIRST(imgload_t, &img_pending, entry));
+    }
+}
+
+void IMG_BeginRegistration(void)
+{
+    IMG_FinishLoading();
+
+    img_async = !!r_async_images->integer;
+
+    memset(&img_stats, 0, sizeof(img_stats));
+    img_stats.start = Sys_Milliseconds();
+}
+
+void IMG_EndRegistration(void)
+{
+    IMG_FinishLoading();
+
+    img_async = qfalse;
+
+    if (r_loadstats->integer && img_stats.images) {
+        Com_Printf("%d images loaded in %u msec, %d failed\n"
+                   "read %u, decode %u (all threads), wait %u, upload %u msec\n",
+                   img_stats.images, Sys_Milliseconds() - img_stats.start,
+                   img_stats.failed, img_stats.read / 1000,
+                   img_stats.decode / 1000, img_stats.wait / 1000,
+                   img_stats.upload / 1000);
+    }
+}
+
 static int _try_image_format(imageformat_t fmt, image_t *image, byte **pic)
 {
     byte        *data;
     ssize_t     len;
     qerror_t    ret;
+    unsigned    start;
 
     // load the file
-    len = FS_LoadFile(image->name, (void **)&data);
+    start = Sys_Microseconds();
+    len = FS_LoadFileEx(image->name, (void **)&data, FS_FLAG_MMAP, TAG_FILESYSTEM);
+    img_stats.read += Sys_Microseconds() - start;
     if (!data) {
         return len;
     }
 
+    // decompress the image later
+    if (img_async) {
+        queue_decode(fmt, image, data, len);
+        return fmt;
+    }
+
     // decompress the image
+    start = Sys_Microseconds();
     ret = img_loaders[fmt].load(data, len, image, pic);
+    img_stats.decode += Sys_Microseconds() - start;
 
     FS_FreeFile(data);
 
-    return ret < 0 ? ret : fmt;
+    if (ret < 0) {
+        return ret;
+    }
+
+    return fmt;
 }
 
 static int try_image_format(imageformat_t fmt, image_t *image, byte **pic)
 {
+    qerror_t ret;
+
     // replace the extension
     memcpy(image->name + image->baselen + 1, img_loaders[fmt].ext, 4);
-    return _try_image_format(fmt, image, pic);
+    ret = _try_image_format(fmt, image, pic);
+
+    // like synchronous search, keep looking if decoding fails
+    if (image->load) {
+        image->load->fallback = qtrue;
+    }
+
+    return ret;
 }
 
 
 #if USE_PNG || USE_JPG || USE_TGA
 
-// tries to load the image with a different extension
-static int try_other_formats(imageformat_t orig, image_t *image, byte **pic)
+static int try_formats_from(int start, imageformat_t orig, image_t *image, byte **pic)
 {
     imageformat_t   fmt;
     qerror_t        ret;
     int             i;
 
-    // search through all the 32-bit formats
-    for (i = 0; i < img_total; i++) {
+    // search through the 32-bit formats
+    for (i = start; i < img_total; i++) {
         fmt = img_search[i];
         if (fmt == orig) {
             continue;   // don't retry twice
         }
 
         ret = try_image_format(fmt, image, pic);
-        if (ret != Q_ERR_NOENT) {
+        if (ret >= 0) {
             return ret; // found something
         }
+        if (ret != Q_ERR_NOENT) {
+            // broken replacement, keep looking
+            Com_WPrintf("Couldn't load %s: %s\n", image->name, Q_ErrorString(ret));
+        }
     }
 
     // fall back to 8-bit formats
@@ -1519,6 +1753,32 @@ static int try_other_formats(imageformat_t orig, image_t *image, byte **pic)
     return try_image_format(fmt, image, pic);
 }
 
+// tries to load the image with a different extension
+static int try_other_formats(imageformat_t orig, image_t *image, byte **pic)
+{
+    return try_formats_from(0, orig, image, pic);
+}
+
+// loads the formats following the given one in search order, synchronously
+static int try_next_formats(imageformat_t fmt, image_t *image, byte **pic)
+{
+    qboolean    async = img_async;
+    qerror_t    ret;
+    int         i;
+
+    for (i = 0; i < img_total; i++) {
+        if (img_search[i] == fmt) {
+            break;
+        }
+    }
+
+    img_async = qfalse;
+    ret = try_formats_from(i + 1, fmt, image, pic);
+    img_async = async;
+
+    return ret;
+}
+
 static void get_image_dimensions(imageformat_t fmt, image_t *image)
 {
     char        buffer[MAX_QPATH];
@@ -1679,7 +1939,10 @@ static qerror_t find_or_load_image(const char *name, size_t len,
     // if we are replacing 8-bit texture with a higher resolution 32-bit
     // texture, we need to recover original image dimensions
     if (fmt <= IM_WAL && ret > IM_WAL) {
-        get_image_dimensions(fmt, image);
+        if (image->load)
+            image->load->orig = fmt;
+        else
+            get_image_dimensions(fmt, image);
     }
 #else
     if (fmt == IM_MAX) {
@@ -1690,14 +1953,19 @@ static qerror_t find_or_load_image(const char *name, size_t len,
 #endif
 
     if (ret < 0) {
+        if (ret != Q_ERR_NOENT && ret != Q_ERR_INVALID_PATH) {
+            img_stats.failed++;
+        }
         memset(image, 0, sizeof(*image));
         return ret;
     }
 
     List_Append(&r_imageHash[hash], &image->entry);
 
-    // upload the image
-    IMG_Load(image, pic);
+    // upload the image, unless it is still being decoded
+    if (!image->load) {
+        upload_image(image, pic);
+    }
 
     *image_p = image;
     return Q_ERR_SUCCESS;
@@ -1743,9 +2011,39 @@ image_t *IMG_ForHandle(qhandle_t h)
         Com_Error(ERR_FATAL, "%s: %d out of range", __func__, h);
     }
 
+    IMG_FinishLoad(&r_images[h]);
     return &r_images[h];
 }
 
+#if USE_TESTS
+/*
+===============
+R_DecodePCX
+===============
+*/
+uint32_t *R_DecodePCX(byte *rawdata, size_t rawlen, int *width, int *height)
+{
+    byte        buffer[640 * 480], pal[768];
+    uint32_t    *pic;
+    int         i, w, h, c;
+
+    if (_IMG_LoadPCX(rawdata, rawlen, buffer, pal, &w, &h) < 0) {
+        return NULL;
+    }
+
+    pic = Z_Malloc(w * h * 4);
+    for (i = 0; i < w * h; i++) {
+        c = buffer[i];
+        pic[i] = MakeColor(pal[c * 3 + 0], pal[c * 3 + 1], pal[c * 3 + 2],
+                           c == 255 ? 0 : 255);
+    }
+
+    *width = w;
+    *height = h;
+    return pic;
+}
+#endif
+
 /*
 ===============
 R_RegisterImage
@@ -1840,6 +2138,8 @@ void IMG_FreeUnused(void)
     image_t *image;
     int i, count = 0;
 
+    IMG_FinishLoading();
+
     for (i = 1, image = r_images + 1; i < r_numImages; i++, image++) {
         if (image->registration_sequence == registration_sequence) {
             continue;        // used this sequence
@@ -1869,6 +2169,8 @@ void IMG_FreeAll(void)
     image_t *image;
     int i, count = 0;
 
+    IMG_FinishLoading();
+
     for (i = 1, image = r_images + 1; i < r_numImages; i++, image++) {
         if (!image->registration_sequence)
             continue;        // free image_t slot
@@ -1988,6 +2290,9 @@ void IMG_Init(void)
 #endif
 #endif // USE_PNG || USE_JPG || USE_TGA
 
+    r_async_images = Cvar_Get("r_async_images", "1", 0);
+    r_loadstats = Cvar_Get("r_loadstats", "0", 0);
+
     Cmd_Register(img_cmd);
 
     for (i = 0; i < RIMAGES_HASH; i++) {
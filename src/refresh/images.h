@@ -67,6 +67,7 @@ typedef struct image_s {
     int             registration_sequence; // 0 = free
     unsigned        texnum; // gl texture binding
     float           sl, sh, tl, th;
+    struct imgload_s *load; // pending asynchronous decode
 } image_t;
 
 #define MAX_RIMAGES     1024
@@ -81,6 +82,10 @@ extern int registration_sequence;
 extern uint32_t d_8to24table[256];
 
 image_t *IMG_Find(const char *name, imagetype_t type, imageflags_t flags);
+void IMG_FinishLoad(image_t *image);
+void IMG_FinishLoading(void);
+void IMG_BeginRegistration(void);
+void IMG_EndRegistration(void);
 void IMG_FreeUnused(void);
 void IMG_FreeAll(void);
 void IMG_Init(void);
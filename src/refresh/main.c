@@ -568,6 +568,11 @@ void R_BeginFrame(void)
 {
     memset(&c, 0, sizeof(c));
 
+    // registration may have been aborted by an error
+    if (q_unlikely(gl_static.registering)) {
+        IMG_FinishLoading();
+    }
+
     if (gl_finish->integer) {
         qglFinish();
     }
@@ -772,18 +777,8 @@ static void GL_SetupConfig(void)
 
 static void GL_InitTables(void)
 {
-    vec_t lat, lng;
-    const vec_t *v;
     int i;
 
-    for (i = 0; i < NUMVERTEXNORMALS; i++) {
-        v = bytedirs[i];
-        lat = acos(v[2]);
-        lng = atan2(v[1], v[0]);
-        gl_static.latlngtab[i][0] = (int)(lat * (255.0f / (2 * M_PI))) & 255;
-        gl_static.latlngtab[i][1] = (int)(lng * (255.0f / (2 * M_PI))) & 255;
-    }
-
     for (i = 0; i < 256; i++) {
         gl_static.sintab[i] = sin(i * (2 * M_PI / 255.0f));
     }
@@ -838,6 +833,8 @@ qboolean R_Init(qboolean total)
 
     GL_InitTables();
 
+    GL_InitMeshes();
+
     GL_PostInit();
 
     Com_Printf("----------------------\n");
@@ -894,6 +891,7 @@ void R_BeginRegistration(const char *name)
 
     gl_static.registering = qtrue;
     registration_sequence++;
+    IMG_BeginRegistration();
 
     memset(&glr, 0, sizeof(glr));
     glr.viewcluster1 = glr.viewcluster2 = -2;
@@ -909,6 +907,7 @@ R_EndRegistration
 */
 void R_EndRegistration(void)
 {
+    IMG_EndRegistration();
     IMG_FreeUnused();
     MOD_FreeUnused();
     Scrap_Upload();
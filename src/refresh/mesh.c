@@ -17,9 +17,26 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 */
 
 #include "gl.h"
+#include "system/system.h"
+
+#if (defined __GNUC__) && ((defined __i386__) || (defined __x86_64__))
+#define USE_TESS_X86    1
+#include <immintrin.h>
+#define TARGET(x)   __attribute__((target(x)))
+#endif
 
 typedef void (*tessfunc_t)(const maliasmesh_t *);
 
+typedef struct {
+    const char  *name;
+    tessfunc_t  static_plain;
+    tessfunc_t  static_shade;
+    tessfunc_t  static_shell;
+    tessfunc_t  lerped_plain;
+    tessfunc_t  lerped_shade;
+    tessfunc_t  lerped_shell;
+} tessfuncs_t;
+
 static int      oldframenum;
 static int      newframenum;
 static float    frontlerp;
@@ -39,6 +56,10 @@ static float    celscale;
 
 static GLfloat  shadowmatrix[16];
 
+static const tessfuncs_t    *tessfuncs;
+
+#define NORMAL_SCALE    (1.0f / 127)
+
 static void setup_dotshading(void)
 {
     float cp, cy, sp, sy;
@@ -77,91 +98,87 @@ static inline vec_t shadedot(const vec_t *normal)
     return d + 1;
 }
 
-static inline vec_t *get_static_normal(vec_t *normal, const maliasvert_t *vert)
+static inline vec_t *get_static_normal(vec_t *normal, const int8_t *norm, int stride)
 {
-    unsigned int lat = vert->norm[0];
-    unsigned int lng = vert->norm[1];
-
-    normal[0] = TAB_SIN(lat) * TAB_COS(lng);
-    normal[1] = TAB_SIN(lat) * TAB_SIN(lng);
-    normal[2] = TAB_COS(lat);
+    normal[0] = norm[0] * NORMAL_SCALE;
+    normal[1] = norm[stride] * NORMAL_SCALE;
+    normal[2] = norm[stride * 2] * NORMAL_SCALE;
 
     return normal;
 }
 
 static void tess_static_shell(const maliasmesh_t *mesh)
 {
-    maliasvert_t *src_vert = &mesh->verts[newframenum * mesh->numverts];
+    int stride = mesh->vertstride;
+    const int16_t *pos = &mesh->positions[newframenum * 3 * stride];
+    const int8_t *norm = &mesh->normals[newframenum * 3 * stride];
     vec_t *dst_vert = tess.vertices;
-    int count = mesh->numverts;
     vec3_t normal;
+    int i;
 
-    while (count--) {
-        get_static_normal(normal, src_vert);
+    for (i = 0; i < mesh->numverts; i++) {
+        get_static_normal(normal, &norm[i], stride);
 
         dst_vert[0] = normal[0] * shellscale +
-                      src_vert->pos[0] * newscale[0] + translate[0];
+                      pos[i] * newscale[0] + translate[0];
         dst_vert[1] = normal[1] * shellscale +
-                      src_vert->pos[1] * newscale[1] + translate[1];
+                      pos[i + stride] * newscale[1] + translate[1];
         dst_vert[2] = normal[2] * shellscale +
-                      src_vert->pos[2] * newscale[2] + translate[2];
+                      pos[i + stride * 2] * newscale[2] + translate[2];
         dst_vert += 4;
-
-        src_vert++;
     }
 }
 
 static void tess_static_shade(const maliasmesh_t *mesh)
 {
-    maliasvert_t *src_vert = &mesh->verts[newframenum * mesh->numverts];
+    int stride = mesh->vertstride;
+    const int16_t *pos = &mesh->positions[newframenum * 3 * stride];
+    const int8_t *norm = &mesh->normals[newframenum * 3 * stride];
     vec_t *dst_vert = tess.vertices;
-    int count = mesh->numverts;
     vec3_t normal;
     vec_t d;
+    int i;
 
-    while (count--) {
-        d = shadedot(get_static_normal(normal, src_vert));
+    for (i = 0; i < mesh->numverts; i++) {
+        d = shadedot(get_static_normal(normal, &norm[i], stride));
 
-        dst_vert[0] = src_vert->pos[0] * newscale[0] + translate[0];
-        dst_vert[1] = src_vert->pos[1] * newscale[1] + translate[1];
-        dst_vert[2] = src_vert->pos[2] * newscale[2] + translate[2];
+        dst_vert[0] = pos[i] * newscale[0] + translate[0];
+        dst_vert[1] = pos[i + stride] * newscale[1] + translate[1];
+        dst_vert[2] = pos[i + stride * 2] * newscale[2] + translate[2];
         dst_vert[4] = shadelight[0] * d;
         dst_vert[5] = shadelight[1] * d;
         dst_vert[6] = shadelight[2] * d;
         dst_vert[7] = shadelight[3];
         dst_vert += VERTEX_SIZE;
-
-        src_vert++;
     }
 }
 
 static void tess_static_plain(const maliasmesh_t *mesh)
 {
-    maliasvert_t *src_vert = &mesh->verts[newframenum * mesh->numverts];
+    int stride = mesh->vertstride;
+    const int16_t *pos = &mesh->positions[newframenum * 3 * stride];
     vec_t *dst_vert = tess.vertices;
-    int count = mesh->numverts;
+    int i;
 
-    while (count--) {
-        dst_vert[0] = src_vert->pos[0] * newscale[0] + translate[0];
-        dst_vert[1] = src_vert->pos[1] * newscale[1] + translate[1];
-        dst_vert[2] = src_vert->pos[2] * newscale[2] + translate[2];
+    for (i = 0; i < mesh->numverts; i++) {
+        dst_vert[0] = pos[i] * newscale[0] + translate[0];
+        dst_vert[1] = pos[i + stride] * newscale[1] + translate[1];
+        dst_vert[2] = pos[i + stride * 2] * newscale[2] + translate[2];
         dst_vert += 4;
-
-        src_vert++;
     }
 }
 
 static inline vec_t *get_lerped_normal(vec_t *normal,
-                                       const maliasvert_t *oldvert,
-                                       const maliasvert_t *newvert)
+                                       const int8_t *oldnorm,
+                                       const int8_t *newnorm, int stride)
 {
-    vec3_t oldnorm, newnorm, tmp;
+    vec3_t oldvec, newvec, tmp;
     vec_t len;
 
-    get_static_normal(oldnorm, oldvert);
-    get_static_normal(newnorm, newvert);
+    get_static_normal(oldvec, oldnorm, stride);
+    get_static_normal(newvec, newnorm, stride);
 
-    LerpVector2(oldnorm, newnorm, backlerp, frontlerp, tmp);
+    LerpVector2(oldvec, newvec, backlerp, frontlerp, tmp);
 
     // normalize result
     len = 1 / VectorLength(tmp);
@@ -172,87 +189,350 @@ static inline vec_t *get_lerped_normal(vec_t *normal,
 
 static void tess_lerped_shell(const maliasmesh_t *mesh)
 {
-    maliasvert_t *src_oldvert = &mesh->verts[oldframenum * mesh->numverts];
-    maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
+    int stride = mesh->vertstride;
+    const int16_t *oldpos = &mesh->positions[oldframenum * 3 * stride];
+    const int16_t *newpos = &mesh->positions[newframenum * 3 * stride];
+    const int8_t *oldnorm = &mesh->normals[oldframenum * 3 * stride];
+    const int8_t *newnorm = &mesh->normals[newframenum * 3 * stride];
     vec_t *dst_vert = tess.vertices;
-    int count = mesh->numverts;
     vec3_t normal;
+    int i;
 
-    while (count--) {
-        get_lerped_normal(normal, src_oldvert, src_newvert);
+    for (i = 0; i < mesh->numverts; i++) {
+        get_lerped_normal(normal, &oldnorm[i], &newnorm[i], stride);
 
         dst_vert[0] = normal[0] * shellscale +
-                      src_oldvert->pos[0] * oldscale[0] +
-                      src_newvert->pos[0] * newscale[0] + translate[0];
+                      oldpos[i] * oldscale[0] +
+                      newpos[i] * newscale[0] + translate[0];
         dst_vert[1] = normal[1] * shellscale +
-                      src_oldvert->pos[1] * oldscale[1] +
-                      src_newvert->pos[1] * newscale[1] + translate[1];
+                      oldpos[i + stride] * oldscale[1] +
+                      newpos[i + stride] * newscale[1] + translate[1];
         dst_vert[2] = normal[2] * shellscale +
-                      src_oldvert->pos[2] * oldscale[2] +
-                      src_newvert->pos[2] * newscale[2] + translate[2];
+                      oldpos[i + stride * 2] * oldscale[2] +
+                      newpos[i + stride * 2] * newscale[2] + translate[2];
         dst_vert += 4;
-
-        src_oldvert++;
-        src_newvert++;
     }
 }
 
 static void tess_lerped_shade(const maliasmesh_t *mesh)
 {
-    maliasvert_t *src_oldvert = &mesh->verts[oldframenum * mesh->numverts];
-    maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
+    int stride = mesh->vertstride;
+    const int16_t *oldpos = &mesh->positions[oldframenum * 3 * stride];
+    const int16_t *newpos = &mesh->positions[newframenum * 3 * stride];
+    const int8_t *oldnorm = &mesh->normals[oldframenum * 3 * stride];
+    const int8_t *newnorm = &mesh->normals[newframenum * 3 * stride];
     vec_t *dst_vert = tess.vertices;
-    int count = mesh->numverts;
     vec3_t normal;
     vec_t d;
+    int i;
 
-    while (count--) {
-        d = shadedot(get_lerped_normal(normal, src_oldvert, src_newvert));
+    for (i = 0; i < mesh->numverts; i++) {
+        d = shadedot(get_lerped_normal(normal, &oldnorm[i], &newnorm[i], stride));
 
         dst_vert[0] =
-            src_oldvert->pos[0] * oldscale[0] +
-            src_newvert->pos[0] * newscale[0] + translate[0];
+            oldpos[i] * oldscale[0] +
+            newpos[i] * newscale[0] + translate[0];
         dst_vert[1] =
-            src_oldvert->pos[1] * oldscale[1] +
-            src_newvert->pos[1] * newscale[1] + translate[1];
+            oldpos[i + stride] * oldscale[1] +
+            newpos[i + stride] * newscale[1] + translate[1];
         dst_vert[2] =
-            src_oldvert->pos[2] * oldscale[2] +
-            src_newvert->pos[2] * newscale[2] + translate[2];
+            oldpos[i + stride * 2] * oldscale[2] +
+            newpos[i + stride * 2] * newscale[2] + translate[2];
         dst_vert[4] = shadelight[0] * d;
         dst_vert[5] = shadelight[1] * d;
         dst_vert[6] = shadelight[2] * d;
         dst_vert[7] = shadelight[3];
         dst_vert += VERTEX_SIZE;
-
-        src_oldvert++;
-        src_newvert++;
     }
 }
 
 static void tess_lerped_plain(const maliasmesh_t *mesh)
 {
-    maliasvert_t *src_oldvert = &mesh->verts[oldframenum * mesh->numverts];
-    maliasvert_t *src_newvert = &mesh->verts[newframenum * mesh->numverts];
+    int stride = mesh->vertstride;
+    const int16_t *oldpos = &mesh->positions[oldframenum * 3 * stride];
+    const int16_t *newpos = &mesh->positions[newframenum * 3 * stride];
     vec_t *dst_vert = tess.vertices;
-    int count = mesh->numverts;
+    int i;
 
-    while (count--) {
+    for (i = 0; i < mesh->numverts; i++) {
         dst_vert[0] =
-            src_oldvert->pos[0] * oldscale[0] +
-            src_newvert->pos[0] * newscale[0] + translate[0];
+            oldpos[i] * oldscale[0] +
+            newpos[i] * newscale[0] + translate[0];
         dst_vert[1] =
-            src_oldvert->pos[1] * oldscale[1] +
-            src_newvert->pos[1] * newscale[1] + translate[1];
+            oldpos[i + stride] * oldscale[1] +
+            newpos[i + stride] * newscale[1] + translate[1];
         dst_vert[2] =
-            src_oldvert->pos[2] * oldscale[2] +
-            src_newvert->pos[2] * newscale[2] + translate[2];
+            oldpos[i + stride * 2] * oldscale[2] +
+            newpos[i + stride * 2] * newscale[2] + translate[2];
         dst_vert += 4;
+    }
+}
+
+static const tessfuncs_t tessfuncs_c = {
+    "scalar",
+    tess_static_plain,
+    tess_static_shade,
+    tess_static_shell,
+    tess_lerped_plain,
+    tess_lerped_shade,
+    tess_lerped_shell
+};
+
+#if USE_TESS_X86
+
+// vector versions process 4 vertices at a time and may read and write past
+// numverts, up to vertstride. operations are done in the same order as in
+// scalar code, except for normalization using single precision sqrt.
+
+static inline TARGET("sse2") __m128 load_pos_sse2(const int16_t *pos)
+{
+    __m128i v = _mm_loadl_epi64((const __m128i *)pos);
+
+    v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+    return _mm_cvtepi32_ps(v);
+}
+
+static inline TARGET("sse2") __m128 load_norm_sse2(const int8_t *norm)
+{
+    int32_t bits;
+    __m128i v;
+
+    memcpy(&bits, norm, sizeof(bits));
+    v = _mm_cvtsi32_si128(bits);
+    v = _mm_unpacklo_epi8(v, v);
+    v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 24);
+    return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(NORMAL_SCALE));
+}
+
+static inline TARGET("sse2") __m128 shadedot_sse2(__m128 nx, __m128 ny, __m128 nz)
+{
+    __m128 zero = _mm_setzero_ps();
+    __m128 d;
+
+    d = _mm_mul_ps(nx, _mm_set1_ps(shadedir[0]));
+    d = _mm_add_ps(d, _mm_mul_ps(ny, _mm_set1_ps(shadedir[1])));
+    d = _mm_add_ps(d, _mm_mul_ps(nz, _mm_set1_ps(shadedir[2])));
+
+    // d < 0 ? d * 0.3f : d
+    d = _mm_add_ps(_mm_max_ps(d, zero),
+                   _mm_mul_ps(_mm_min_ps(d, zero), _mm_set1_ps(0.3f)));
+
+    return _mm_add_ps(d, _mm_set1_ps(1));
+}
+
+static inline TARGET("sse2") void lerp_normal_sse2(__m128 *nx, __m128 *ny, __m128 *nz,
+                                                   const int8_t *oldnorm,
+                                                   const int8_t *newnorm, int stride)
+{
+    __m128 back = _mm_set1_ps(backlerp);
+    __m128 front = _mm_set1_ps(frontlerp);
+    __m128 x, y, z, len;
+
+    x = _mm_add_ps(_mm_mul_ps(load_norm_sse2(oldnorm), back),
+                   _mm_mul_ps(load_norm_sse2(newnorm), front));
+    y = _mm_add_ps(_mm_mul_ps(load_norm_sse2(oldnorm + stride), back),
+                   _mm_mul_ps(load_norm_sse2(newnorm + stride), front));
+    z = _mm_add_ps(_mm_mul_ps(load_norm_sse2(oldnorm + stride * 2), back),
+                   _mm_mul_ps(load_norm_sse2(newnorm + stride * 2), front));
+
+    len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+    len = _mm_div_ps(_mm_set1_ps(1), _mm_sqrt_ps(len));
+
+    *nx = _mm_mul_ps(x, len);
+    *ny = _mm_mul_ps(y, len);
+    *nz = _mm_mul_ps(z, len);
+}
+
+// position = pos * scale + translate
+static inline TARGET("sse2") __m128 static_pos_sse2(const int16_t *pos, int axis)
+{
+    return _mm_add_ps(_mm_mul_ps(load_pos_sse2(pos), _mm_set1_ps(newscale[axis])),
+                      _mm_set1_ps(translate[axis]));
+}
+
+// position = oldpos * oldscale + newpos * newscale + translate
+static inline TARGET("sse2") __m128 lerped_pos_sse2(__m128 sum, const int16_t *oldpos,
+                                                    const int16_t *newpos, int axis)
+{
+    sum = _mm_add_ps(sum, _mm_mul_ps(load_pos_sse2(oldpos), _mm_set1_ps(oldscale[axis])));
+    sum = _mm_add_ps(sum, _mm_mul_ps(load_pos_sse2(newpos), _mm_set1_ps(newscale[axis])));
+    return _mm_add_ps(sum, _mm_set1_ps(translate[axis]));
+}
+
+static inline TARGET("sse2") void store_pos_sse2(vec_t *dst, int step,
+                                                 __m128 x, __m128 y, __m128 z)
+{
+    __m128 w = _mm_setzero_ps();
+
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(dst + step * 0, x);
+    _mm_storeu_ps(dst + step * 1, y);
+    _mm_storeu_ps(dst + step * 2, z);
+    _mm_storeu_ps(dst + step * 3, w);
+}
+
+static inline TARGET("sse2") void store_color_sse2(vec_t *dst, __m128 d)
+{
+    __m128 r = _mm_mul_ps(_mm_set1_ps(shadelight[0]), d);
+    __m128 g = _mm_mul_ps(_mm_set1_ps(shadelight[1]), d);
+    __m128 b = _mm_mul_ps(_mm_set1_ps(shadelight[2]), d);
+    __m128 a = _mm_set1_ps(shadelight[3]);
+
+    _MM_TRANSPOSE4_PS(r, g, b, a);
+    _mm_storeu_ps(dst + VERTEX_SIZE * 0 + 4, r);
+    _mm_storeu_ps(dst + VERTEX_SIZE * 1 + 4, g);
+    _mm_storeu_ps(dst + VERTEX_SIZE * 2 + 4, b);
+    _mm_storeu_ps(dst + VERTEX_SIZE * 3 + 4, a);
+}
+
+static TARGET("sse2") void tess_static_shell_sse2(const maliasmesh_t *mesh)
+{
+    int stride = mesh->vertstride;
+    const int16_t *pos = &mesh->positions[newframenum * 3 * stride];
+    const int8_t *norm = &mesh->normals[newframenum * 3 * stride];
+    vec_t *dst_vert = tess.vertices;
+    __m128 scale = _mm_set1_ps(shellscale);
+    __m128 x, y, z;
+    int i;
+
+    for (i = 0; i < mesh->numverts; i += 4) {
+        x = _mm_mul_ps(load_norm_sse2(&norm[i]), scale);
+        y = _mm_mul_ps(load_norm_sse2(&norm[i + stride]), scale);
+        z = _mm_mul_ps(load_norm_sse2(&norm[i + stride * 2]), scale);
+        x = _mm_add_ps(x, _mm_mul_ps(load_pos_sse2(&pos[i]), _mm_set1_ps(newscale[0])));
+        y = _mm_add_ps(y, _mm_mul_ps(load_pos_sse2(&pos[i + stride]), _mm_set1_ps(newscale[1])));
+        z = _mm_add_ps(z, _mm_mul_ps(load_pos_sse2(&pos[i + stride * 2]), _mm_set1_ps(newscale[2])));
+        x = _mm_add_ps(x, _mm_set1_ps(translate[0]));
+        y = _mm_add_ps(y, _mm_set1_ps(translate[1]));
+        z = _mm_add_ps(z, _mm_set1_ps(translate[2]));
+        store_pos_sse2(dst_vert, 4, x, y, z);
+        dst_vert += 4 * 4;
+    }
+}
+
+static TARGET("sse2") void tess_static_shade_sse2(const maliasmesh_t *mesh)
+{
+    int stride = mesh->vertstride;
+    const int16_t *pos = &mesh->positions[newframenum * 3 * stride];
+    const int8_t *norm = &mesh->normals[newframenum * 3 * stride];
+    vec_t *dst_vert = tess.vertices;
+    __m128 d;
+    int i;
+
+    for (i = 0; i < mesh->numverts; i += 4) {
+        d = shadedot_sse2(load_norm_sse2(&norm[i]),
+                          load_norm_sse2(&norm[i + stride]),
+                          load_norm_sse2(&norm[i + stride * 2]));
+        store_pos_sse2(dst_vert, VERTEX_SIZE,
+                       static_pos_sse2(&pos[i], 0),
+                       static_pos_sse2(&pos[i + stride], 1),
+                       static_pos_sse2(&pos[i + stride * 2], 2));
+        store_color_sse2(dst_vert, d);
+        dst_vert += VERTEX_SIZE * 4;
+    }
+}
 
-        src_oldvert++;
-        src_newvert++;
+static TARGET("sse2") void tess_static_plain_sse2(const maliasmesh_t *mesh)
+{
+    int stride = mesh->vertstride;
+    const int16_t *pos = &mesh->positions[newframenum * 3 * stride];
+    vec_t *dst_vert = tess.vertices;
+    int i;
+
+    for (i = 0; i < mesh->numverts; i += 4) {
+        store_pos_sse2(dst_vert, 4,
+                       static_pos_sse2(&pos[i], 0),
+                       static_pos_sse2(&pos[i + stride], 1),
+                       static_pos_sse2(&pos[i + stride * 2], 2));
+        dst_vert += 4 * 4;
+    }
+}
+
+static TARGET("sse2") void tess_lerped_shell_sse2(const maliasmesh_t *mesh)
+{
+    int stride = mesh->vertstride;
+    const int16_t *oldpos = &mesh->positions[oldframenum * 3 * stride];
+    const int16_t *newpos = &mesh->positions[newframenum * 3 * stride];
+    const int8_t *oldnorm = &mesh->normals[oldframenum * 3 * stride];
+    const int8_t *newnorm = &mesh->normals[newframenum * 3 * stride];
+    vec_t *dst_vert = tess.vertices;
+    __m128 scale = _mm_set1_ps(shellscale);
+    __m128 x, y, z;
+    int i;
+
+    for (i = 0; i < mesh->numverts; i += 4) {
+        lerp_normal_sse2(&x, &y, &z, &oldnorm[i], &newnorm[i], stride);
+        store_pos_sse2(dst_vert, 4,
+                       lerped_pos_sse2(_mm_mul_ps(x, scale), &oldpos[i],
+                                       &newpos[i], 0),
+                       lerped_pos_sse2(_mm_mul_ps(y, scale), &oldpos[i + stride],
+                                       &newpos[i + stride], 1),
+                       lerped_pos_sse2(_mm_mul_ps(z, scale), &oldpos[i + stride * 2],
+                                       &newpos[i + stride * 2], 2));
+        dst_vert += 4 * 4;
+    }
+}
+
+static TARGET("sse2") void tess_lerped_shade_sse2(const maliasmesh_t *mesh)
+{
+    int stride = mesh->vertstride;
+    const int16_t *oldpos = &mesh->positions[oldframenum * 3 * stride];
+    const int16_t *newpos = &mesh->positions[newframenum * 3 * stride];
+    const int8_t *oldnorm = &mesh->normals[oldframenum * 3 * stride];
+    const int8_t *newnorm = &mesh->normals[newframenum * 3 * stride];
+    vec_t *dst_vert = tess.vertices;
+    __m128 zero = _mm_setzero_ps();
+    __m128 x, y, z;
+    int i;
+
+    for (i = 0; i < mesh->numverts; i += 4) {
+        lerp_normal_sse2(&x, &y, &z, &oldnorm[i], &newnorm[i], stride);
+        store_color_sse2(dst_vert, shadedot_sse2(x, y, z));
+        store_pos_sse2(dst_vert, VERTEX_SIZE,
+                       lerped_pos_sse2(zero, &oldpos[i], &newpos[i], 0),
+                       lerped_pos_sse2(zero, &oldpos[i + stride],
+                                       &newpos[i + stride], 1),
+                       lerped_pos_sse2(zero, &oldpos[i + stride * 2],
+                                       &newpos[i + stride * 2], 2));
+        dst_vert += VERTEX_SIZE * 4;
+    }
+}
+
+static TARGET("sse2") void tess_lerped_plain_sse2(const maliasmesh_t *mesh)
+{
+    int stride = mesh->vertstride;
+    const int16_t *oldpos = &mesh->positions[oldframenum * 3 * stride];
+    const int16_t *newpos = &mesh->positions[newframenum * 3 * stride];
+    vec_t *dst_vert = tess.vertices;
+    __m128 zero = _mm_setzero_ps();
+    int i;
+
+    for (i = 0; i < mesh->numverts; i += 4) {
+        store_pos_sse2(dst_vert, 4,
+                       lerped_pos_sse2(zero, &oldpos[i], &newpos[i], 0),
+                       lerped_pos_sse2(zero, &oldpos[i + stride],
+                                       &newpos[i + stride], 1),
+                       lerped_pos_sse2(zero, &oldpos[i + stride * 2],
+                                       &newpos[i + stride * 2], 2));
+        dst_vert += 4 * 4;
     }
 }
 
+static const tessfuncs_t tessfuncs_sse2 = {
+    "sse2",
+    tess_static_plain_sse2,
+    tess_static_shade_sse2,
+    tess_static_shell_sse2,
+    tess_lerped_plain_sse2,
+    tess_lerped_shade_sse2,
+    tess_lerped_shell_sse2
+};
+
+#endif // USE_TESS_X86
+
+static const tessfuncs_t    *tessfuncs_impls[2];
+static int                  tessfuncs_numimpls;
+
 static glCullResult_t cull_static_model(model_t *model)
 {
     maliasframe_t *newframe = &model->frames[newframenum];
@@ -674,13 +954,13 @@ void GL_DrawAliasModel(model_t *model)
         shellscale = (ent->flags & RF_WEAPONMODEL) ?
             WEAPONSHELL_SCALE : POWERSUIT_SCALE;
         tessfunc = newframenum == oldframenum ?
-            tess_static_shell : tess_lerped_shell;
+            tessfuncs->static_shell : tessfuncs->lerped_shell;
     } else if (shadelight) {
         tessfunc = newframenum == oldframenum ?
-            tess_static_shade : tess_lerped_shade;
+            tessfuncs->static_shade : tessfuncs->lerped_shade;
     } else {
         tessfunc = newframenum == oldframenum ?
-            tess_static_plain : tess_lerped_plain;
+            tessfuncs->static_plain : tessfuncs->lerped_plain;
     }
 
     GL_RotateForEntity(origin);
@@ -707,3 +987,147 @@ void GL_DrawAliasModel(model_t *model)
         qglFrontFace(GL_CW);
     }
 }
+
+void GL_InitMeshes(void)
+{
+    tessfuncs_numimpls = 0;
+    tessfuncs_impls[tessfuncs_numimpls++] = &tessfuncs_c;
+
+#if USE_TESS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        tessfuncs_impls[tessfuncs_numimpls++] = &tessfuncs_sse2;
+#endif
+
+    // last one is the fastest
+    tessfuncs = tessfuncs_impls[tessfuncs_numimpls - 1];
+
+    Com_DPrintf("Using %s tessellation kernels\n", tessfuncs->name);
+}
+
+const char *GL_TessImplName(int index)
+{
+    if (index < 0 || index >= tessfuncs_numimpls)
+        return NULL;
+
+    return tessfuncs_impls[index]->name;
+}
+
+static void setup_tess_frames(const model_t *model, int oldframe, int newframe)
+{
+    const maliasframe_t *frame1 = &model->frames[oldframe];
+    const maliasframe_t *frame2 = &model->frames[newframe];
+
+    oldframenum = oldframe;
+    newframenum = newframe;
+
+    if (oldframe == newframe) {
+        VectorCopy(frame2->scale, newscale);
+        VectorCopy(frame2->translate, translate);
+    } else {
+        backlerp = 0.25f;
+        frontlerp = 1.0f - backlerp;
+        VectorScale(frame1->scale, backlerp, oldscale);
+        VectorScale(frame2->scale, frontlerp, newscale);
+        LerpVector2(frame1->translate, frame2->translate,
+                    backlerp, frontlerp, translate);
+    }
+}
+
+static float compare_tess(const vec_t *ref, int numverts, int step)
+{
+    float diff, maxdiff = 0;
+    int i, j;
+
+    for (i = 0; i < numverts * step; i += step) {
+        for (j = 0; j < step; j++) {
+            // scalar code doesn't fill the 4th position component
+            if (j == 3)
+                continue;
+            diff = fabsf(tess.vertices[i + j] - ref[i + j]);
+            if (diff > maxdiff)
+                maxdiff = diff;
+        }
+    }
+
+    return maxdiff;
+}
+
+/*
+=================
+GL_TessAliasModel
+
+Tessellates every frame of the model, both static and lerped to the next
+frame, with each kind of tessfunc. Returns milliseconds spent by the given
+implementation and the largest difference from the scalar implementation.
+Runs on CPU only, nothing is drawn.
+=================
+*/
+unsigned GL_TessAliasModel(const model_t *model, int index, int iterations, float *maxerror)
+{
+    static const vec4_t testlight = { 0.8f, 0.6f, 0.4f, 1 };
+    const tessfuncs_t *ref = tessfuncs_impls[0];
+    const tessfuncs_t *impl = tessfuncs_impls[index];
+    const maliasmesh_t *mesh;
+    tessfunc_t funcs[6], reffuncs[6];
+    unsigned start, msec;
+    vec_t *buffer;
+    float error;
+    int i, j, k, n, step;
+
+    funcs[0] = impl->static_plain;
+    funcs[1] = impl->static_shade;
+    funcs[2] = impl->static_shell;
+    funcs[3] = impl->lerped_plain;
+    funcs[4] = impl->lerped_shade;
+    funcs[5] = impl->lerped_shell;
+
+    reffuncs[0] = ref->static_plain;
+    reffuncs[1] = ref->static_shade;
+    reffuncs[2] = ref->static_shell;
+    reffuncs[3] = ref->lerped_plain;
+    reffuncs[4] = ref->lerped_shade;
+    reffuncs[5] = ref->lerped_shell;
+
+    shellscale = POWERSUIT_SCALE;
+    shadelight = testlight;
+    shadedir[0] = cos(-M_PI / 4);
+    shadedir[1] = 0;
+    shadedir[2] = -sin(-M_PI / 4);
+
+    start = Sys_Milliseconds();
+    for (n = 0; n < iterations; n++) {
+        for (i = 0, mesh = model->meshes; i < model->nummeshes; i++, mesh++) {
+            for (j = 0; j < model->numframes; j++) {
+                for (k = 0; k < 6; k++) {
+                    setup_tess_frames(model, j, k < 3 ? j : (j + 1) % model->numframes);
+                    funcs[k](mesh);
+                }
+            }
+        }
+    }
+    msec = Sys_Milliseconds() - start;
+
+    *maxerror = 0;
+    if (impl == ref)
+        return msec;
+
+    buffer = Z_Malloc(sizeof(tess.vertices));
+    for (i = 0, mesh = model->meshes; i < model->nummeshes; i++, mesh++) {
+        for (j = 0; j < model->numframes; j++) {
+            for (k = 0; k < 6; k++) {
+                setup_tess_frames(model, j, k < 3 ? j : (j + 1) % model->numframes);
+                step = (k == 1 || k == 4) ? VERTEX_SIZE : 4;
+                reffuncs[k](mesh);
+                memcpy(buffer, tess.vertices, sizeof(buffer[0]) * step * mesh->numverts);
+                funcs[k](mesh);
+                error = compare_tess(buffer, mesh->numverts, step);
+                if (error > *maxerror)
+                    *maxerror = error;
+            }
+        }
+    }
+    Z_Free(buffer);
+
+    return msec;
+}
@@ -103,6 +103,50 @@ static void MOD_List_f(void)
     Com_Printf("Total resident: %"PRIz"\n", bytes);
 }
 
+static void MOD_TessBench_f(void)
+{
+    int         i, j, count, iterations;
+    unsigned    msec[8], total[8];
+    float       error, e;
+    const char  *name;
+    model_t     *model;
+
+    iterations = Cmd_Argc() > 1 ? atoi(Cmd_Argv(1)) : 10;
+    clamp(iterations, 1, 10000);
+
+    Com_Printf("%-32s", "model");
+    for (i = 0; i < 8 && (name = GL_TessImplName(i)); i++) {
+        Com_Printf(" %8s", name);
+        total[i] = 0;
+    }
+    count = i;
+    Com_Printf(" maxerror (msec for %d iterations)\n", iterations);
+
+    for (i = 0, model = r_models; i < r_numModels; i++, model++) {
+        if (model->type != MOD_ALIAS) {
+            continue;
+        }
+        error = 0;
+        for (j = 0; j < count; j++) {
+            msec[j] = GL_TessAliasModel(model, j, iterations, &e);
+            total[j] += msec[j];
+            if (e > error)
+                error = e;
+        }
+        Com_Printf("%-32.32s", model->name);
+        for (j = 0; j < count; j++) {
+            Com_Printf(" %8u", msec[j]);
+        }
+        Com_Printf(" %g\n", error);
+    }
+
+    Com_Printf("%-32s", "total");
+    for (j = 0; j < count; j++) {
+        Com_Printf(" %8u", total[j]);
+    }
+    Com_Printf("\n");
+}
+
 void MOD_FreeUnused(void)
 {
     model_t *model;
@@ -140,6 +184,40 @@ void MOD_FreeAll(void)
     r_numModels = 0;
 }
 
+// invalid MD2 normal indices map to this
+static const vec3_t nonormal = { 0, 0, 1 };
+
+static void MOD_AllocVerts(model_t *model, maliasmesh_t *mesh)
+{
+    int8_t *normals;
+    int i, j;
+
+    mesh->vertstride = ALIGN(mesh->numverts, 8);
+    mesh->positions = MOD_Malloc(sizeof(mesh->positions[0]) * 3 * mesh->vertstride * model->numframes);
+    mesh->normals = MOD_Malloc(sizeof(mesh->normals[0]) * 3 * mesh->vertstride * model->numframes);
+
+    // keep padding normals valid
+    for (i = 0; i < model->numframes; i++) {
+        normals = mesh->normals + (i * 3 + 2) * mesh->vertstride;
+        for (j = mesh->numverts; j < mesh->vertstride; j++) {
+            normals[j] = 127;
+        }
+    }
+}
+
+static void MOD_StoreVert(maliasmesh_t *mesh, int frame, int index,
+                          const int *pos, const vec3_t normal)
+{
+    int16_t *dst_pos = mesh->positions + frame * 3 * mesh->vertstride + index;
+    int8_t *dst_norm = mesh->normals + frame * 3 * mesh->vertstride + index;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        dst_pos[i * mesh->vertstride] = pos[i];
+        dst_norm[i * mesh->vertstride] = Q_rint(normal[i] * 127);
+    }
+}
+
 static qerror_t MOD_LoadSP2(model_t *model, const void *rawdata, size_t length)
 {
     dsp2header_t header;
@@ -278,10 +356,9 @@ static qerror_t MOD_LoadMD2(model_t *model, const void *rawdata, size_t length)
     dmd2stvert_t    *src_tc;
     char            *src_skin;
     maliasframe_t   *dst_frame;
-    maliasvert_t    *dst_vert;
     maliasmesh_t    *dst_mesh;
     maliastc_t      *dst_tc;
-    int             i, j, k, val;
+    int             i, j, k, val, pos[3];
     uint16_t        remap[TESS_MAX_INDICES];
     uint16_t        vertIndices[TESS_MAX_INDICES];
     uint16_t        tcIndices[TESS_MAX_INDICES];
@@ -383,7 +460,7 @@ static qerror_t MOD_LoadMD2(model_t *model, const void *rawdata, size_t length)
     dst_mesh->numindices = numindices;
     dst_mesh->numverts = numverts;
     dst_mesh->numskins = header.num_skins;
-    dst_mesh->verts = MOD_Malloc(numverts * header.num_frames * sizeof(maliasvert_t));
+    MOD_AllocVerts(model, dst_mesh);
     dst_mesh->tcoords = MOD_Malloc(numverts * sizeof(maliastc_t));
     dst_mesh->indices = MOD_Malloc(numindices * sizeof(QGL_INDEX_TYPE));
 
@@ -437,23 +514,20 @@ static qerror_t MOD_LoadMD2(model_t *model, const void *rawdata, size_t length)
                 continue;
             }
             src_vert = &src_frame->verts[vertIndices[i]];
-            dst_vert = &dst_mesh->verts[j * numverts + finalIndices[i]];
 
-            dst_vert->pos[0] = src_vert->v[0];
-            dst_vert->pos[1] = src_vert->v[1];
-            dst_vert->pos[2] = src_vert->v[2];
+            pos[0] = src_vert->v[0];
+            pos[1] = src_vert->v[1];
+            pos[2] = src_vert->v[2];
 
             val = src_vert->lightnormalindex;
             if (val >= NUMVERTEXNORMALS) {
-                dst_vert->norm[0] = 0;
-                dst_vert->norm[1] = 0;
+                MOD_StoreVert(dst_mesh, j, finalIndices[i], pos, nonormal);
             } else {
-                dst_vert->norm[0] = gl_static.latlngtab[val][0];
-                dst_vert->norm[1] = gl_static.latlngtab[val][1];
+                MOD_StoreVert(dst_mesh, j, finalIndices[i], pos, bytedirs[val]);
             }
 
             for (k = 0; k < 3; k++) {
-                val = dst_vert->pos[k];
+                val = pos[k];
                 if (val < mins[k])
                     mins[k] = val;
                 if (val > maxs[k])
@@ -491,12 +565,13 @@ static qerror_t MOD_LoadMD3Mesh(model_t *model, maliasmesh_t *mesh,
     dmd3coord_t     *src_tc;
     dmd3skin_t      *src_skin;
     uint32_t        *src_idx;
-    maliasvert_t    *dst_vert;
     maliastc_t      *dst_tc;
     QGL_INDEX_TYPE  *dst_idx;
     uint32_t        index;
     char            skinname[MAX_QPATH];
-    int             i;
+    int             i, j, pos[3];
+    unsigned        lat, lng;
+    vec3_t          normal;
 
     if (length < sizeof(header))
         return Q_ERR_BAD_EXTENT;
@@ -535,7 +610,7 @@ static qerror_t MOD_LoadMD3Mesh(model_t *model, maliasmesh_t *mesh,
     mesh->numindices = header.num_tris * 3;
     mesh->numverts = header.num_verts;
     mesh->numskins = header.num_skins;
-    mesh->verts = MOD_Malloc(sizeof(maliasvert_t) * header.num_verts * model->numframes);
+    MOD_AllocVerts(model, mesh);
     mesh->tcoords = MOD_Malloc(sizeof(maliastc_t) * header.num_verts);
     mesh->indices = MOD_Malloc(sizeof(QGL_INDEX_TYPE) * header.num_tris * 3);
 
@@ -550,16 +625,21 @@ static qerror_t MOD_LoadMD3Mesh(model_t *model, maliasmesh_t *mesh,
 
     // load all vertices
     src_vert = (dmd3vertex_t *)(rawdata + header.ofs_verts);
-    dst_vert = mesh->verts;
-    for (i = 0; i < header.num_verts * model->numframes; i++) {
-        dst_vert->pos[0] = (int16_t)LittleShort(src_vert->point[0]);
-        dst_vert->pos[1] = (int16_t)LittleShort(src_vert->point[1]);
-        dst_vert->pos[2] = (int16_t)LittleShort(src_vert->point[2]);
-
-        dst_vert->norm[0] = src_vert->norm[0];
-        dst_vert->norm[1] = src_vert->norm[1];
-
-        src_vert++; dst_vert++;
+    for (i = 0; i < model->numframes; i++) {
+        for (j = 0; j < header.num_verts; j++) {
+            pos[0] = (int16_t)LittleShort(src_vert->point[0]);
+            pos[1] = (int16_t)LittleShort(src_vert->point[1]);
+            pos[2] = (int16_t)LittleShort(src_vert->point[2]);
+
+            lat = src_vert->norm[0];
+            lng = src_vert->norm[1];
+            normal[0] = TAB_SIN(lat) * TAB_COS(lng);
+            normal[1] = TAB_SIN(lat) * TAB_SIN(lng);
+            normal[2] = TAB_COS(lat);
+
+            MOD_StoreVert(mesh, i, j, pos, normal);
+            src_vert++;
+        }
     }
 
     // load all texture coords
@@ -732,7 +812,7 @@ qhandle_t R_RegisterModel(const char *name)
         goto done;
     }
 
-    filelen = FS_LoadFile(normalized, (void **)&rawdata);
+    filelen = FS_LoadFileEx(normalized, (void **)&rawdata, FS_FLAG_MMAP, TAG_FILESYSTEM);
     if (!rawdata) {
         // don't spam about missing models
         if (filelen == Q_ERR_NOENT) {
@@ -823,10 +903,12 @@ void MOD_Init(void)
     }
 
     Cmd_AddCommand("modellist", MOD_List_f);
+    Cmd_AddCommand("tessbench", MOD_TessBench_f);
 }
 
 void MOD_Shutdown(void)
 {
     MOD_FreeAll();
     Cmd_RemoveCommand("modellist");
+    Cmd_RemoveCommand("tessbench");
 }
@@ -0,0 +1,452 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License along
+with this program; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "shared/shared.h"
+#include "common/common.h"
+#include "refresh/pixels.h"
+
+#if (defined __GNUC__) && ((defined __i386__) || (defined __x86_64__))
+#define USE_PIXELS_X86  1
+#include <immintrin.h>
+#define TARGET(x)   __attribute__((target(x)))
+#endif
+
+// all implementations must produce bit identical results, vector versions
+// process whole blocks of pixels and fall back to scalar code for the rest
+
+typedef void (*resamplerow_t)(byte *out, const byte *inrow1, const byte *inrow2,
+                              const unsigned *p1, const unsigned *p2, int count);
+
+static void resample(resamplerow_t func, const byte *in, int inwidth, int inheight,
+                     byte *out, int outwidth, int outheight)
+{
+    int i;
+    const byte  *inrow1, *inrow2;
+    unsigned    frac, fracstep;
+    unsigned    p1[MAX_RESAMPLE_WIDTH], p2[MAX_RESAMPLE_WIDTH];
+    float       heightScale;
+
+    if (outwidth > MAX_RESAMPLE_WIDTH) {
+        Com_Error(ERR_FATAL, "%s: outwidth > %d", __func__, MAX_RESAMPLE_WIDTH);
+    }
+
+    fracstep = inwidth * 0x10000 / outwidth;
+
+    frac = fracstep >> 2;
+    for (i = 0; i < outwidth; i++) {
+        p1[i] = 4 * (frac >> 16);
+        frac += fracstep;
+    }
+    frac = 3 * (fracstep >> 2);
+    for (i = 0; i < outwidth; i++) {
+        p2[i] = 4 * (frac >> 16);
+        frac += fracstep;
+    }
+
+    heightScale = (float)inheight / outheight;
+    inwidth <<= 2;
+    for (i = 0; i < outheight; i++) {
+        inrow1 = in + inwidth * (int)((i + 0.25f) * heightScale);
+        inrow2 = in + inwidth * (int)((i + 0.75f) * heightScale);
+        func(out, inrow1, inrow2, p1, p2, outwidth);
+        out += outwidth * 4;
+    }
+}
+
+/*
+===============================================================================
+
+SCALAR
+
+===============================================================================
+*/
+
+static void ResampleRow_C(byte *out, const byte *inrow1, const byte *inrow2,
+                          const unsigned *p1, const unsigned *p2, int count)
+{
+    const byte  *pix1, *pix2, *pix3, *pix4;
+    int         j;
+
+    for (j = 0; j < count; j++) {
+        pix1 = inrow1 + p1[j];
+        pix2 = inrow1 + p2[j];
+        pix3 = inrow2 + p1[j];
+        pix4 = inrow2 + p2[j];
+        out[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0]) >> 2;
+        out[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1]) >> 2;
+        out[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2]) >> 2;
+        out[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3]) >> 2;
+        out += 4;
+    }
+}
+
+static void Resample_C(const byte *in, int inwidth, int inheight,
+                       byte *out, int outwidth, int outheight)
+{
+    resample(ResampleRow_C, in, inwidth, inheight, out, outwidth, outheight);
+}
+
+static inline void mip_pixel(byte *out, const byte *in, int width)
+{
+    out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
+    out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
+    out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
+    out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
+}
+
+static void MipMap_C(byte *out, byte *in, int width, int height)
+{
+    int     i, j;
+
+    width <<= 2;
+    height >>= 1;
+    for (i = 0; i < height; i++, in += width) {
+        for (j = 0; j < width; j += 8, out += 4, in += 8) {
+            mip_pixel(out, in, width);
+        }
+    }
+}
+
+static void LightScale_C(byte *data, int count, const byte *table)
+{
+    int i;
+
+    for (i = 0; i < count; i++, data += 4) {
+        data[0] = table[data[0]];
+        data[1] = table[data[1]];
+        data[2] = table[data[2]];
+    }
+}
+
+static void GrayScale_C(byte *data, int count, float colorscale)
+{
+    int     i;
+    float   r, g, b, y;
+
+    for (i = 0; i < count; i++, data += 4) {
+        r = data[0];
+        g = data[1];
+        b = data[2];
+        y = r * 0.2126f + g * 0.7152f + b * 0.0722f;
+        data[0] = y + (r - y) * colorscale;
+        data[1] = y + (g - y) * colorscale;
+        data[2] = y + (b - y) * colorscale;
+    }
+}
+
+static const pixelops_t pixelops_c = {
+    "scalar", Resample_C, MipMap_C, LightScale_C, GrayScale_C
+};
+
+#if USE_PIXELS_X86
+
+/*
+===============================================================================
+
+SSE2
+
+===============================================================================
+*/
+
+static inline int load32(const byte *p)
+{
+    int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// averages four vectors of pixels
+TARGET("sse2")
+static inline __m128i average4_sse2(__m128i a, __m128i b, __m128i c, __m128i d)
+{
+    __m128i z = _mm_setzero_si128();
+    __m128i lo, hi;
+
+    lo = _mm_add_epi16(_mm_unpacklo_epi8(a, z), _mm_unpacklo_epi8(b, z));
+    lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(c, z));
+    lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(d, z));
+    hi = _mm_add_epi16(_mm_unpackhi_epi8(a, z), _mm_unpackhi_epi8(b, z));
+    hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(c, z));
+    hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(d, z));
+
+    return _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2));
+}
+
+TARGET("sse2")
+static void ResampleRow_SSE2(byte *out, const byte *inrow1, const byte *inrow2,
+                             const unsigned *p1, const unsigned *p2, int count)
+{
+    __m128i a, b, c, d;
+    int     j;
+
+    for (j = 0; j + 4 <= count; j += 4, out += 16) {
+        a = _mm_setr_epi32(load32(inrow1 + p1[j + 0]), load32(inrow1 + p1[j + 1]),
+                           load32(inrow1 + p1[j + 2]), load32(inrow1 + p1[j + 3]));
+        b = _mm_setr_epi32(load32(inrow1 + p2[j + 0]), load32(inrow1 + p2[j + 1]),
+                           load32(inrow1 + p2[j + 2]), load32(inrow1 + p2[j + 3]));
+        c = _mm_setr_epi32(load32(inrow2 + p1[j + 0]), load32(inrow2 + p1[j + 1]),
+                           load32(inrow2 + p1[j + 2]), load32(inrow2 + p1[j + 3]));
+        d = _mm_setr_epi32(load32(inrow2 + p2[j + 0]), load32(inrow2 + p2[j + 1]),
+                           load32(inrow2 + p2[j + 2]), load32(inrow2 + p2[j + 3]));
+        _mm_storeu_si128((__m128i *)out, average4_sse2(a, b, c, d));
+    }
+    ResampleRow_C(out, inrow1, inrow2, p1 + j, p2 + j, count - j);
+}
+
+static void Resample_SSE2(const byte *in, int inwidth, int inheight,
+                          byte *out, int outwidth, int outheight)
+{
+    resample(ResampleRow_SSE2, in, inwidth, inheight, out, outwidth, outheight);
+}
+
+// sums 2x2 blocks of 4 pixels from each row, returns 16-bit sums of 2 pixels
+TARGET("sse2")
+static inline __m128i mip_sum_sse2(__m128i r0, __m128i r1)
+{
+    __m128i z = _mm_setzero_si128();
+    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(r0, z), _mm_unpacklo_epi8(r1, z));
+    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(r0, z), _mm_unpackhi_epi8(r1, z));
+
+    return _mm_add_epi16(_mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+}
+
+// in place operation is safe because output never overtakes input
+TARGET("sse2")
+static void MipMap_SSE2(byte *out, byte *in, int width, int height)
+{
+    __m128i a, b;
+    int     i, j;
+
+    // scalar version steps past row end on odd widths
+    if (width & 1) {
+        MipMap_C(out, in, width, height);
+        return;
+    }
+
+    width <<= 2;
+    height >>= 1;
+    for (i = 0; i < height; i++, in += width) {
+        for (j = 0; j + 32 <= width; j += 32, out += 16, in += 32) {
+            a = mip_sum_sse2(_mm_loadu_si128((const __m128i *)in),
+                             _mm_loadu_si128((const __m128i *)(in + width)));
+            b = mip_sum_sse2(_mm_loadu_si128((const __m128i *)(in + 16)),
+                             _mm_loadu_si128((const __m128i *)(in + width + 16)));
+            a = _mm_srli_epi16(a, 2);
+            b = _mm_srli_epi16(b, 2);
+            _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(a, b));
+        }
+        for (; j < width; j += 8, out += 4, in += 8) {
+            mip_pixel(out, in, width);
+        }
+    }
+}
+
+TARGET("sse2")
+static void GrayScale_SSE2(byte *data, int count, float colorscale)
+{
+    __m128i mask = _mm_set1_epi32(0xff);
+    __m128i amask = _mm_set1_epi32(0xff000000);
+    __m128  kr = _mm_set1_ps(0.2126f);
+    __m128  kg = _mm_set1_ps(0.7152f);
+    __m128  kb = _mm_set1_ps(0.0722f);
+    __m128  s = _mm_set1_ps(colorscale);
+    __m128  r, g, b, y;
+    __m128i v, ri, gi, bi;
+    int     i;
+
+    // same operation order as scalar code for exact results
+    for (i = 0; i + 4 <= count; i += 4, data += 16) {
+        v = _mm_loadu_si128((const __m128i *)data);
+        r = _mm_cvtepi32_ps(_mm_and_si128(v, mask));
+        g = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 8), mask));
+        b = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 16), mask));
+        y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, kr), _mm_mul_ps(g, kg)), _mm_mul_ps(b, kb));
+        ri = _mm_cvttps_epi32(_mm_add_ps(y, _mm_mul_ps(_mm_sub_ps(r, y), s)));
+        gi = _mm_cvttps_epi32(_mm_add_ps(y, _mm_mul_ps(_mm_sub_ps(g, y), s)));
+        bi = _mm_cvttps_epi32(_mm_add_ps(y, _mm_mul_ps(_mm_sub_ps(b, y), s)));
+        v = _mm_or_si128(_mm_and_si128(v, amask), ri);
+        v = _mm_or_si128(v, _mm_slli_epi32(gi, 8));
+        v = _mm_or_si128(v, _mm_slli_epi32(bi, 16));
+        _mm_storeu_si128((__m128i *)data, v);
+    }
+    GrayScale_C(data, count - i, colorscale);
+}
+
+// there is no table lookup instruction in SSE2
+static const pixelops_t pixelops_sse2 = {
+    "sse2", Resample_SSE2, MipMap_SSE2, LightScale_C, GrayScale_SSE2
+};
+
+/*
+===============================================================================
+
+AVX2
+
+===============================================================================
+*/
+
+TARGET("avx2")
+static inline __m256i mip_sum_avx2(__m256i r0, __m256i r1)
+{
+    __m256i z = _mm256_setzero_si256();
+    __m256i lo = _mm256_add_epi16(_mm256_unpacklo_epi8(r0, z), _mm256_unpacklo_epi8(r1, z));
+    __m256i hi = _mm256_add_epi16(_mm256_unpackhi_epi8(r0, z), _mm256_unpackhi_epi8(r1, z));
+
+    return _mm256_add_epi16(_mm256_unpacklo_epi64(lo, hi), _mm256_unpackhi_epi64(lo, hi));
+}
+
+TARGET("avx2")
+static void MipMap_AVX2(byte *out, byte *in, int width, int height)
+{
+    __m256i a, b;
+    int     i, j;
+
+    if (width & 1) {
+        MipMap_C(out, in, width, height);
+        return;
+    }
+
+    width <<= 2;
+    height >>= 1;
+    for (i = 0; i < height; i++, in += width) {
+        for (j = 0; j + 64 <= width; j += 64, out += 32, in += 64) {
+            a = mip_sum_avx2(_mm256_loadu_si256((const __m256i *)in),
+                             _mm256_loadu_si256((const __m256i *)(in + width)));
+            b = mip_sum_avx2(_mm256_loadu_si256((const __m256i *)(in + 32)),
+                             _mm256_loadu_si256((const __m256i *)(in + width + 32)));
+            a = _mm256_packus_epi16(_mm256_srli_epi16(a, 2), _mm256_srli_epi16(b, 2));
+            // pack interleaves 128-bit lanes, restore pixel order
+            a = _mm256_permute4x64_epi64(a, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256((__m256i *)out, a);
+        }
+        for (; j < width; j += 8, out += 4, in += 8) {
+            mip_pixel(out, in, width);
+        }
+    }
+}
+
+TARGET("avx2")
+static void LightScale_AVX2(byte *data, int count, const byte *table)
+{
+    __m256i mask = _mm256_set1_epi32(0xff);
+    __m256i amask = _mm256_set1_epi32(0xff000000);
+    __m256i v, r, g, b;
+    int     table32[256];
+    int     i;
+
+    if (count < 64) {
+        LightScale_C(data, count, table);
+        return;
+    }
+
+    // gather needs 32-bit table entries
+    for (i = 0; i < 256; i++)
+        table32[i] = table[i];
+
+    for (i = 0; i + 8 <= count; i += 8, data += 32) {
+        v = _mm256_loadu_si256((const __m256i *)data);
+        r = _mm256_and_si256(v, mask);
+        g = _mm256_and_si256(_mm256_srli_epi32(v, 8), mask);
+        b = _mm256_and_si256(_mm256_srli_epi32(v, 16), mask);
+        r = _mm256_i32gather_epi32(table32, r, 4);
+        g = _mm256_i32gather_epi32(table32, g, 4);
+        b = _mm256_i32gather_epi32(table32, b, 4);
+        v = _mm256_or_si256(_mm256_and_si256(v, amask), r);
+        v = _mm256_or_si256(v, _mm256_slli_epi32(g, 8));
+        v = _mm256_or_si256(v, _mm256_slli_epi32(b, 16));
+        _mm256_storeu_si256((__m256i *)data, v);
+    }
+    LightScale_C(data, count - i, table);
+}
+
+TARGET("avx2")
+static void GrayScale_AVX2(byte *data, int count, float colorscale)
+{
+    __m256i mask = _mm256_set1_epi32(0xff);
+    __m256i amask = _mm256_set1_epi32(0xff000000);
+    __m256  kr = _mm256_set1_ps(0.2126f);
+    __m256  kg = _mm256_set1_ps(0.7152f);
+    __m256  kb = _mm256_set1_ps(0.0722f);
+    __m256  s = _mm256_set1_ps(colorscale);
+    __m256  r, g, b, y;
+    __m256i v, ri, gi, bi;
+    int     i;
+
+    for (i = 0; i + 8 <= count; i += 8, data += 32) {
+        v = _mm256_loadu_si256((const __m256i *)data);
+        r = _mm256_cvtepi32_ps(_mm256_and_si256(v, mask));
+        g = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 8), mask));
+        b = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 16), mask));
+        y = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(r, kr), _mm256_mul_ps(g, kg)), _mm256_mul_ps(b, kb));
+        ri = _mm256_cvttps_epi32(_mm256_add_ps(y, _mm256_mul_ps(_mm256_sub_ps(r, y), s)));
+        gi = _mm256_cvttps_epi32(_mm256_add_ps(y, _mm256_mul_ps(_mm256_sub_ps(g, y), s)));
+        bi = _mm256_cvttps_epi32(_mm256_add_ps(y, _mm256_mul_ps(_mm256_sub_ps(b, y), s)));
+        v = _mm256_or_si256(_mm256_and_si256(v, amask), ri);
+        v = _mm256_or_si256(v, _mm256_slli_epi32(gi, 8));
+        v = _mm256_or_si256(v, _mm256_slli_epi32(bi, 16));
+        _mm256_storeu_si256((__m256i *)data, v);
+    }
+    GrayScale_SSE2(data, count - i, colorscale);
+}
+
+// gathering scattered pixels is not faster than scalar loads for resample
+static const pixelops_t pixelops_avx2 = {
+    "avx2", Resample_SSE2, MipMap_AVX2, LightScale_AVX2, GrayScale_AVX2
+};
+
+#endif // USE_PIXELS_X86
+
+/*
+===============================================================================
+
+DISPATCH
+
+===============================================================================
+*/
+
+pixelops_t  pixelops = {
+    "scalar", Resample_C, MipMap_C, LightScale_C, GrayScale_C
+};
+
+static const pixelops_t *pixelops_impls[3];
+static int pixelops_numimpls;
+
+const pixelops_t *Pixels_GetImpl(int index)
+{
+    if (index < 0 || index >= pixelops_numimpls)
+        return NULL;
+
+    return pixelops_impls[index];
+}
+
+void Pixels_Init(void)
+{
+    pixelops_numimpls = 0;
+    pixelops_impls[pixelops_numimpls++] = &pixelops_c;
+
+#if USE_PIXELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        pixelops_impls[pixelops_numimpls++] = &pixelops_sse2;
+    if (__builtin_cpu_supports("avx2"))
+        pixelops_impls[pixelops_numimpls++] = &pixelops_avx2;
+#endif
+
+    // last one is the fastest
+    pixelops = *pixelops_impls[pixelops_numimpls - 1];
+
+    Com_DPrintf("Using %s pixel kernels\n", pixelops.name);
+}
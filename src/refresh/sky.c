@@ -383,7 +383,7 @@ void R_SetSky(const char *name, float rotate, vec3_t axis)
 {
     int     i;
     char    pathname[MAX_QPATH];
-    image_t *image;
+    image_t *images[6];
     size_t  len;
     // 3dstudio environment map names
     static const char suf[6][3] = { "rt", "bk", "lf", "ft", "up", "dn" };
@@ -404,11 +404,16 @@ void R_SetSky(const char *name, float rotate, vec3_t axis)
             return;
         }
         FS_NormalizePath(pathname, pathname);
-        image = IMG_Find(pathname, IT_SKY, IF_NONE);
-        if (image->texnum == TEXNUM_DEFAULT) {
+        images[i] = IMG_Find(pathname, IT_SKY, IF_NONE);
+    }
+
+    // let all sides decode in parallel
+    for (i = 0; i < 6; i++) {
+        IMG_FinishLoad(images[i]);
+        if (images[i]->texnum == TEXNUM_DEFAULT) {
             R_UnsetSky();
             return;
         }
-        sky_images[i] = image->texnum;
+        sky_images[i] = images[i]->texnum;
     }
 }
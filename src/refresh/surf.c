@@ -936,6 +936,9 @@ void GL_LoadWorld(const char *name)
         info->image = IMG_Find(buffer, IT_WALL, flags);
     }
 
+    // texture dimensions are needed to build surfaces
+    IMG_FinishLoading();
+
     // calculate vertex buffer size in bytes
     size = 0;
     for (i = 0, surf = bsp->faces; i < bsp->numfaces; i++, surf++) {
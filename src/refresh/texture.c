@@ -19,6 +19,8 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 
 #include "gl.h"
 #include "common/prompt.h"
+#include "refresh/hq2x.h"
+#include "refresh/pixels.h"
 
 static int gl_filter_min;
 static int gl_filter_max;
@@ -192,63 +194,11 @@ IMAGE PROCESSING
 static void IMG_ResampleTexture(const byte *in, int inwidth, int inheight,
                                 byte *out, int outwidth, int outheight)
 {
-    int i, j;
-    const byte  *inrow1, *inrow2;
-    unsigned    frac, fracstep;
-    unsigned    p1[MAX_TEXTURE_SIZE], p2[MAX_TEXTURE_SIZE];
-    const byte  *pix1, *pix2, *pix3, *pix4;
-    float       heightScale;
-
     if (outwidth > MAX_TEXTURE_SIZE) {
         Com_Error(ERR_FATAL, "%s: outwidth > %d", __func__, MAX_TEXTURE_SIZE);
     }
 
-    fracstep = inwidth * 0x10000 / outwidth;
-
-    frac = fracstep >> 2;
-    for (i = 0; i < outwidth; i++) {
-        p1[i] = 4 * (frac >> 16);
-        frac += fracstep;
-    }
-    frac = 3 * (fracstep >> 2);
-    for (i = 0; i < outwidth; i++) {
-        p2[i] = 4 * (frac >> 16);
-        frac += fracstep;
-    }
-
-    heightScale = (float)inheight / outheight;
-    inwidth <<= 2;
-    for (i = 0; i < outheight; i++) {
-        inrow1 = in + inwidth * (int)((i + 0.25f) * heightScale);
-        inrow2 = in + inwidth * (int)((i + 0.75f) * heightScale);
-        for (j = 0; j < outwidth; j++) {
-            pix1 = inrow1 + p1[j];
-            pix2 = inrow1 + p2[j];
-            pix3 = inrow2 + p1[j];
-            pix4 = inrow2 + p2[j];
-            out[0] = (pix1[0] + pix2[0] + pix3[0] + pix4[0]) >> 2;
-            out[1] = (pix1[1] + pix2[1] + pix3[1] + pix4[1]) >> 2;
-            out[2] = (pix1[2] + pix2[2] + pix3[2] + pix4[2]) >> 2;
-            out[3] = (pix1[3] + pix2[3] + pix3[3] + pix4[3]) >> 2;
-            out += 4;
-        }
-    }
-}
-
-static void IMG_MipMap(byte *out, byte *in, int width, int height)
-{
-    int     i, j;
-
-    width <<= 2;
-    height >>= 1;
-    for (i = 0; i < height; i++, in += width) {
-        for (j = 0; j < width; j += 8, out += 4, in += 8) {
-            out[0] = (in[0] + in[4] + in[width + 0] + in[width + 4]) >> 2;
-            out[1] = (in[1] + in[5] + in[width + 1] + in[width + 5]) >> 2;
-            out[2] = (in[2] + in[6] + in[width + 2] + in[width + 6]) >> 2;
-            out[3] = (in[3] + in[7] + in[width + 3] + in[width + 7]) >> 2;
-        }
-    }
+    Pixels_Resample(in, inwidth, inheight, out, outwidth, outheight);
 }
 
 /*
@@ -328,10 +278,6 @@ overall pixel luminance computed from weighted color sum
 */
 static int GL_GrayScaleTexture(byte *in, int inwidth, int inheight, imagetype_t type, imageflags_t flags)
 {
-    int     i, c;
-    byte    *p;
-    float   r, g, b, y;
-
     if (type != IT_WALL)
         return gl_tex_solid_format; // only grayscale world textures
     if (flags & IF_TURBULENT)
@@ -339,18 +285,7 @@ static int GL_GrayScaleTexture(byte *in, int inwidth, int inheight, imagetype_t
     if (colorscale == 1)
         return gl_tex_solid_format;
 
-    p = in;
-    c = inwidth * inheight;
-
-    for (i = 0; i < c; i++, p += 4) {
-        r = p[0];
-        g = p[1];
-        b = p[2];
-        y = LUMINANCE(r, g, b);
-        p[0] = y + (r - y) * colorscale;
-        p[1] = y + (g - y) * colorscale;
-        p[2] = y + (b - y) * colorscale;
-    }
+    Pixels_GrayScale(in, inwidth * inheight, colorscale);
 
     if (colorscale == 0 && (gl_config.caps & QGL_CAP_TEXTURE_BITS))
         return GL_LUMINANCE;
@@ -368,27 +303,13 @@ lighting range
 */
 static void GL_LightScaleTexture(byte *in, int inwidth, int inheight, imagetype_t type, imageflags_t flags)
 {
-    int     i, c;
-    byte    *p;
-
     if (r_config.flags & QVF_GAMMARAMP)
         return;
 
-    p = in;
-    c = inwidth * inheight;
-
     if (type == IT_WALL || type == IT_SKIN) {
-        for (i = 0; i < c; i++, p += 4) {
-            p[0] = gammaintensitytable[p[0]];
-            p[1] = gammaintensitytable[p[1]];
-            p[2] = gammaintensitytable[p[2]];
-        }
+        Pixels_LightScale(in, inwidth * inheight, gammaintensitytable);
     } else if (gl_gamma_scale_pics->integer) {
-        for (i = 0; i < c; i++, p += 4) {
-            p[0] = gammatable[p[0]];
-            p[1] = gammatable[p[1]];
-            p[2] = gammatable[p[2]];
-        }
+        Pixels_LightScale(in, inwidth * inheight, gammatable);
     }
 }
 
@@ -498,7 +419,7 @@ static void GL_Upload32(byte *data, int width, int height, int baselevel, imaget
         // optimized case, use faster mipmap operation
         scaled = data;
         while (width > scaled_width || height > scaled_height) {
-            IMG_MipMap(scaled, scaled, width, height);
+            Pixels_MipMap(scaled, scaled, width, height);
             width >>= 1;
             height >>= 1;
         }
@@ -533,7 +454,7 @@ static void GL_Upload32(byte *data, int width, int height, int baselevel, imaget
             int miplevel = 0;
 
             while (scaled_width > 1 || scaled_height > 1) {
-                IMG_MipMap(scaled, scaled, scaled_width, scaled_height);
+                Pixels_MipMap(scaled, scaled, scaled_width, scaled_height);
                 scaled_width >>= 1;
                 scaled_height >>= 1;
                 if (scaled_width < 1)
@@ -741,7 +662,7 @@ void IMG_Load(image_t *image, byte *pic)
 
 void IMG_Unload(image_t *image)
 {
-    if (image->texnum && !(image->flags & IF_SCRAP)) {
+    if (image->texnum && image->texnum != TEXNUM_DEFAULT && !(image->flags & IF_SCRAP)) {
         if (gls.texnums[0] == image->texnum)
             gls.texnums[0] = 0;
         qglDeleteTextures(1, &image->texnum);
@@ -1008,6 +929,8 @@ void GL_InitImages(void)
 
     max_texture_size = min(integer, MAX_TEXTURE_SIZE);
 
+    Pixels_Init();
+
     IMG_Init();
 
     IMG_GetPalette();
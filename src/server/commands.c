@@ -1563,6 +1563,11 @@ static const cmdreg_t c_server[] = {
     { "addfiltercmd", SV_AddFilterCmd_f, SV_AddFilterCmd_c },
     { "delfiltercmd", SV_DelFilterCmd_f, SV_DelFilterCmd_c },
     { "listfiltercmds", SV_ListFilterCmds_f },
+    { "sv_area_stats", SV_AreaStats_f },
+    { "sv_link_stats", SV_LinkStats_f },
+    { "sv_trace_stats", SV_TraceStats_f },
+    { "sv_visbench", SV_VisBench_f },
+    { "sv_download_cache", SV_DownloadCache_f },
 #if USE_MVD_CLIENT || USE_MVD_SERVER
     { "mvdrecord", SV_Record_f, SV_Record_c },
     { "mvdstop", SV_Stop_f },
@@ -156,7 +156,7 @@ static client_frame_t *get_last_frame(client_t *client)
         return NULL;
     }
 
-    if (svs.next_entity - frame->first_entity > svs.num_entities) {
+    if (svs.next_entity - frame->first_entity > svs.num_entities - svs.num_spare_entities) {
         // but entities are too old
         Com_DPrintf("%s: delta request from out-of-date entities.\n", client->name);
         return NULL;
@@ -170,9 +170,9 @@ static client_frame_t *get_last_frame(client_t *client)
 SV_WriteFrameToClient_Default
 ==================
 */
-void SV_WriteFrameToClient_Default(client_t *client)
+void SV_WriteFrameToClient_Default(client_t *client, client_frame_t *oldframe)
 {
-    client_frame_t  *frame, *oldframe;
+    client_frame_t  *frame;
     player_packed_t *oldstate;
     int             lastframe;
 
@@ -180,7 +180,6 @@ void SV_WriteFrameToClient_Default(client_t *client)
     frame = &client->frames[client->framenum & UPDATE_MASK];
 
     // this is the frame we are delta'ing from
-    oldframe = get_last_frame(client);
     if (oldframe) {
         oldstate = &oldframe->ps;
         lastframe = client->lastframe;
@@ -214,9 +213,9 @@ void SV_WriteFrameToClient_Default(client_t *client)
 SV_WriteFrameToClient_Enhanced
 ==================
 */
-void SV_WriteFrameToClient_Enhanced(client_t *client)
+void SV_WriteFrameToClient_Enhanced(client_t *client, client_frame_t *oldframe)
 {
-    client_frame_t  *frame, *oldframe;
+    client_frame_t  *frame;
     player_packed_t *oldstate;
     uint32_t        extraflags, delta;
     int             suppressed;
@@ -228,7 +227,6 @@ void SV_WriteFrameToClient_Enhanced(client_t *client)
     frame = &client->frames[client->framenum & UPDATE_MASK];
 
     // this is the frame we are delta'ing from
-    oldframe = get_last_frame(client);
     if (oldframe) {
         oldstate = &oldframe->ps;
         delta = client->framenum - client->lastframe;
@@ -370,15 +368,351 @@ fix_old_origin(client_t *client, entity_packed_t *state, edict_t *ent, int e)
 }
 #endif
 
+/*
+=============================================================================
+
+Per-frame visibility cache
+
+Many clients share the same clusters, so area and PVS checks of entities are
+done once per cluster and area, and stored as bitsets indexed by entity
+number. Entities visible to a client are then found by ORing rows of all
+clusters its fat PVS consists of.
+
+=============================================================================
+*/
+
+#define VIS_ENT_LONGS   (MAX_EDICTS / 32)
+
+typedef struct {
+    uint32_t    l[VIS_ENT_LONGS];
+} entbits_t;
+
+static struct {
+    int         maxclusters;
+    int         maxareas;
+    qboolean    active;     // rows are valid for current frame
+    unsigned    stamp;      // rows with this stamp are valid
+    int         numlongs;   // for current num_edicts
+    int         numcandidates;
+    short       candidates[MAX_EDICTS];
+    entbits_t   *pvs, *phs;     // indexed by cluster + 1
+    entbits_t   *areas;         // indexed by area
+    unsigned    *pvs_stamps, *phs_stamps, *area_stamps;
+    unsigned    rows;       // number of rows built
+} vis_cache;
+
+#define ENT_ROW(bits)   ((byte *)(bits)->l)
+
+static void alloc_vis_cache(int numclusters, int numareas)
+{
+    if (vis_cache.maxclusters < numclusters) {
+        Z_Free(vis_cache.pvs);
+        Z_Free(vis_cache.phs);
+        Z_Free(vis_cache.pvs_stamps);
+        Z_Free(vis_cache.phs_stamps);
+        vis_cache.maxclusters = numclusters;
+        vis_cache.pvs = Z_Malloc(sizeof(entbits_t) * (numclusters + 1));
+        vis_cache.phs = Z_Malloc(sizeof(entbits_t) * (numclusters + 1));
+        vis_cache.pvs_stamps = Z_Mallocz(sizeof(unsigned) * (numclusters + 1));
+        vis_cache.phs_stamps = Z_Mallocz(sizeof(unsigned) * (numclusters + 1));
+    }
+
+    if (vis_cache.maxareas < numareas) {
+        Z_Free(vis_cache.areas);
+        Z_Free(vis_cache.area_stamps);
+        vis_cache.maxareas = numareas;
+        vis_cache.areas = Z_Malloc(sizeof(entbits_t) * numareas);
+        vis_cache.area_stamps = Z_Mallocz(sizeof(unsigned) * numareas);
+    }
+}
+
+/*
+==================
+SV_FlushVisCache
+==================
+*/
+void SV_FlushVisCache(void)
+{
+    Z_Free(vis_cache.pvs);
+    Z_Free(vis_cache.phs);
+    Z_Free(vis_cache.areas);
+    Z_Free(vis_cache.pvs_stamps);
+    Z_Free(vis_cache.phs_stamps);
+    Z_Free(vis_cache.area_stamps);
+    memset(&vis_cache, 0, sizeof(vis_cache));
+}
+
+static void next_vis_stamp(void)
+{
+    if (++vis_cache.stamp == 0) {
+        // wrapped around, invalidate all rows
+        memset(vis_cache.pvs_stamps, 0, sizeof(unsigned) * (vis_cache.maxclusters + 1));
+        memset(vis_cache.phs_stamps, 0, sizeof(unsigned) * (vis_cache.maxclusters + 1));
+        memset(vis_cache.area_stamps, 0, sizeof(unsigned) * vis_cache.maxareas);
+        vis_cache.stamp = 1;
+    }
+}
+
+// bins entities that pass client independent checks
+static void find_vis_candidates(void)
+{
+    edict_t *ent;
+    int e;
+
+    vis_cache.numcandidates = 0;
+    vis_cache.numlongs = (ge->num_edicts + 31) >> 5;
+
+    for (e = 1; e < ge->num_edicts; e++) {
+        ent = EDICT_NUM(e);
+        if (!ent->inuse && (g_features->integer & GMF_PROPERINUSE))
+            continue;
+        if (ent->svflags & SVF_NOCLIENT)
+            continue;
+        if (!ent->s.modelindex && !ent->s.effects && !ent->s.sound && !ent->s.event)
+            continue;
+        vis_cache.candidates[vis_cache.numcandidates++] = e;
+    }
+}
+
+static void build_pvs_row(entbits_t *row, int cluster)
+{
+    byte mask[VIS_MAX_BYTES];
+    const byte *pvs;
+    edict_t *ent;
+    int i, e;
+
+    pvs = BSP_GetClusterVis(sv.cm.cache, mask, cluster, DVIS_PVS);
+
+    memset(row, 0, sizeof(uint32_t) * vis_cache.numlongs);
+    for (i = 0; i < vis_cache.numcandidates; i++) {
+        e = vis_cache.candidates[i];
+        ent = EDICT_NUM(e);
+        if (ent->s.renderfx & RF_BEAM)
+            continue;   // beams only check PHS
+        if (SV_EdictIsVisible(&sv.cm, ent, pvs))
+            Q_SetBit(ENT_ROW(row), e);
+    }
+
+    vis_cache.rows++;
+}
+
+static void build_phs_row(entbits_t *row, int cluster)
+{
+    byte mask[VIS_MAX_BYTES];
+    edict_t *ent;
+    int i, e;
+
+    memset(mask, 0, sizeof(mask));
+    BSP_ClusterVis(sv.cm.cache, mask, cluster, DVIS_PHS);
+
+    // beams just check one point for PHS
+    memset(row, 0, sizeof(uint32_t) * vis_cache.numlongs);
+    for (i = 0; i < vis_cache.numcandidates; i++) {
+        e = vis_cache.candidates[i];
+        ent = EDICT_NUM(e);
+        if ((ent->s.renderfx & RF_BEAM) && Q_IsBitSet(mask, ent->clusternums[0]))
+            Q_SetBit(ENT_ROW(row), e);
+    }
+
+    vis_cache.rows++;
+}
+
+static void build_area_row(entbits_t *row, int area)
+{
+    edict_t *ent;
+    int i, e;
+
+    // doors can legally straddle two areas
+    memset(row, 0, sizeof(uint32_t) * vis_cache.numlongs);
+    for (i = 0; i < vis_cache.numcandidates; i++) {
+        e = vis_cache.candidates[i];
+        ent = EDICT_NUM(e);
+        if (CM_AreasConnected(&sv.cm, area, ent->areanum) ||
+            CM_AreasConnected(&sv.cm, area, ent->areanum2))
+            Q_SetBit(ENT_ROW(row), e);
+    }
+
+    vis_cache.rows++;
+}
+
+// returns the number of unique clusters touched by fat PVS box
+static int fat_clusters(const vec3_t org, int *clusters)
+{
+    mleaf_t *leafs[64];
+    vec3_t  mins, maxs;
+    int     i, j, count, numclusters;
+
+    for (i = 0; i < 3; i++) {
+        mins[i] = org[i] - 8;
+        maxs[i] = org[i] + 8;
+    }
+
+    count = CM_BoxLeafs(&sv.cm, mins, maxs, leafs, 64, NULL);
+
+    numclusters = 0;
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < numclusters; j++) {
+            if (clusters[j] == leafs[i]->cluster) {
+                break;
+            }
+        }
+        if (j == numclusters) {
+            clusters[numclusters++] = leafs[i]->cluster;
+        }
+    }
+
+    return numclusters;
+}
+
+static void client_view_org(edict_t *clent, vec3_t org)
+{
+    player_state_t *ps = &clent->client->ps;
+
+    VectorMA(ps->viewoffset, 0.125f, ps->pmove.origin, org);
+}
+
+static qboolean cluster_valid(int cluster)
+{
+    return cluster >= -1 && cluster < sv.cm.cache->vis->numclusters;
+}
+
+static qboolean area_valid(int area)
+{
+    return area >= 0 && area < sv.cm.cache->numareas;
+}
+
+// builds all rows needed for the client
+static void prepare_client_rows(client_t *client)
+{
+    int         clusters[64];
+    int         i, count, cluster, area;
+    unsigned    stamp = vis_cache.stamp;
+    mleaf_t     *leaf;
+    vec3_t      org;
+
+    if (!client->edict->client)
+        return;
+
+    client_view_org(client->edict, org);
+
+    leaf = CM_PointLeaf(&sv.cm, org);
+    area = CM_LeafArea(leaf);
+    if (area_valid(area) && vis_cache.area_stamps[area] != stamp) {
+        build_area_row(&vis_cache.areas[area], area);
+        vis_cache.area_stamps[area] = stamp;
+    }
+
+    cluster = CM_LeafCluster(leaf);
+    if (cluster_valid(cluster) && vis_cache.phs_stamps[cluster + 1] != stamp) {
+        build_phs_row(&vis_cache.phs[cluster + 1], cluster);
+        vis_cache.phs_stamps[cluster + 1] = stamp;
+    }
+
+    count = fat_clusters(org, clusters);
+    for (i = 0; i < count; i++) {
+        cluster = clusters[i];
+        if (cluster_valid(cluster) && vis_cache.pvs_stamps[cluster + 1] != stamp) {
+            build_pvs_row(&vis_cache.pvs[cluster + 1], cluster);
+            vis_cache.pvs_stamps[cluster + 1] = stamp;
+        }
+    }
+}
+
+/*
+=============
+SV_PrepareClientFrames
+
+Fills visibility cache for all clients that are going to receive a frame.
+Must be called before SV_BuildClientFrame each frame, cache is not updated
+by SV_BuildClientFrame itself, so that it can run in parallel.
+=============
+*/
+static qboolean frame_pending(client_t *client)
+{
+    if (client->state != cs_spawned || client->download || client->nodata)
+        return qfalse;
+
+    return SV_CLIENTSYNC(client);
+}
+
+static void prepare_vis_cache(void)
+{
+    client_t *client;
+    bsp_t *bsp = sv.cm.cache;
+
+    vis_cache.active = qfalse;
+
+    if (sv.state != ss_game || !bsp || !bsp->vis || sv_novis->integer)
+        return;
+
+    alloc_vis_cache(bsp->vis->numclusters, bsp->numareas);
+    next_vis_stamp();
+    find_vis_candidates();
+
+    FOR_EACH_CLIENT(client) {
+        if (frame_pending(client))
+            prepare_client_rows(client);
+    }
+
+    vis_cache.active = qtrue;
+}
+
+void SV_PrepareClientFrames(void)
+{
+    if (sv_viscache->integer)
+        prepare_vis_cache();
+    else
+        vis_cache.active = qfalse;
+}
+
+// returns qfalse if some rows are missing and frame should be built
+// by walking all entities
+static qboolean get_visible_entities(client_t *client, const vec3_t org,
+                                     int clientarea, int clientcluster,
+                                     entbits_t *vis)
+{
+    int         clusters[64];
+    int         i, count, cluster;
+    unsigned    stamp = vis_cache.stamp;
+    size_t      bytes = sizeof(uint32_t) * vis_cache.numlongs;
+
+    if (!vis_cache.active || client->cm != &sv.cm)
+        return qfalse;
+
+    if (!area_valid(clientarea) || vis_cache.area_stamps[clientarea] != stamp)
+        return qfalse;
+    if (!cluster_valid(clientcluster) || vis_cache.phs_stamps[clientcluster + 1] != stamp)
+        return qfalse;
+
+    count = fat_clusters(org, clusters);
+    if (count < 1)
+        return qfalse;
+
+    // beams are only present in PHS rows, other entities in PVS rows
+    memcpy(vis, &vis_cache.phs[clientcluster + 1], bytes);
+    for (i = 0; i < count; i++) {
+        cluster = clusters[i];
+        if (!cluster_valid(cluster) || vis_cache.pvs_stamps[cluster + 1] != stamp)
+            return qfalse;
+        Bits_Or(ENT_ROW(vis), ENT_ROW(&vis_cache.pvs[cluster + 1]), bytes);
+    }
+
+    Bits_And(ENT_ROW(vis), ENT_ROW(&vis_cache.areas[clientarea]), bytes);
+    return qtrue;
+}
+
 /*
 =============
 SV_BuildClientFrame
 
 Decides which entities are going to be visible to the client, and
-copies off the playerstat and areabits.
+copies off the playerstat and areabits. Visible entities are packed into
+the given array, SV_CommitClientFrame moves them into the circular buffer.
+Doesn't touch any shared state, so may run for different clients in
+parallel. Returns qfalse if client is not in game yet.
 =============
 */
-void SV_BuildClientFrame(client_t *client)
+qboolean SV_BuildClientFrame(client_t *client, entity_packed_t *states)
 {
     int         e;
     vec3_t      org;
@@ -392,10 +726,12 @@ void SV_BuildClientFrame(client_t *client)
     mleaf_t     *leaf;
     byte        clientphs[VIS_MAX_BYTES];
     byte        clientpvs[VIS_MAX_BYTES];
+    entbits_t   clientvis;
+    qboolean    cached;
 
     clent = client->edict;
     if (!clent->client)
-        return;        // not in game yet
+        return qfalse;  // not in game yet
 
     // this is the frame we are creating
     frame = &client->frames[client->framenum & UPDATE_MASK];
@@ -430,12 +766,16 @@ void SV_BuildClientFrame(client_t *client)
         frame->clientNum = client->number;
     }
 
-    CM_FatPVS(client->cm, clientpvs, org);
-    BSP_ClusterVis(client->cm->cache, clientphs, clientcluster, DVIS_PHS);
+    // use precomputed visibility if possible
+    cached = !sv_novis->integer &&
+        get_visible_entities(client, org, clientarea, clientcluster, &clientvis);
+    if (!cached) {
+        CM_FatPVS(client->cm, clientpvs, org);
+        BSP_ClusterVis(client->cm->cache, clientphs, clientcluster, DVIS_PHS);
+    }
 
     // build up the list of visible entities
     frame->num_entities = 0;
-    frame->first_entity = svs.next_entity;
 
     for (e = 1; e < client->pool->num_edicts; e++) {
         ent = EDICT_POOL(client, e);
@@ -465,36 +805,40 @@ void SV_BuildClientFrame(client_t *client)
 
         // ignore if not touching a PV leaf
         if (ent != clent && !sv_novis->integer) {
-            // check area
-            if (!CM_AreasConnected(client->cm, clientarea, ent->areanum)) {
-                // doors can legally straddle two areas, so
-                // we may need to check another one
-                if (!CM_AreasConnected(client->cm, clientarea, ent->areanum2)) {
-                    continue;        // blocked by a door
-                }
-            }
-
-            // beams just check one point for PHS
-            if (ent->s.renderfx & RF_BEAM) {
-                l = ent->clusternums[0];
-                if (!Q_IsBitSet(clientphs, l))
+            if (cached) {
+                // area and PVS checks are already done
+                if (!Q_IsBitSet(ENT_ROW(&clientvis), e))
                     continue;
             } else {
-                if (!SV_EdictIsVisible(client->cm, ent, clientpvs)) {
-                    continue;
+                // check area
+                if (!CM_AreasConnected(client->cm, clientarea, ent->areanum)) {
+                    // doors can legally straddle two areas, so
+                    // we may need to check another one
+                    if (!CM_AreasConnected(client->cm, clientarea, ent->areanum2)) {
+                        continue;        // blocked by a door
+                    }
                 }
 
-                if (!ent->s.modelindex) {
-                    // don't send sounds if they will be attenuated away
-                    vec3_t    delta;
-                    float    len;
-
-                    VectorSubtract(org, ent->s.origin, delta);
-                    len = VectorLength(delta);
-                    if (len > 400)
+                // beams just check one point for PHS
+                if (ent->s.renderfx & RF_BEAM) {
+                    l = ent->clusternums[0];
+                    if (!Q_IsBitSet(clientphs, l))
                         continue;
+                } else if (!SV_EdictIsVisible(client->cm, ent, clientpvs)) {
+                    continue;
                 }
             }
+
+            if (!(ent->s.renderfx & RF_BEAM) && !ent->s.modelindex) {
+                // don't send sounds if they will be attenuated away
+                vec3_t    delta;
+                float    len;
+
+                VectorSubtract(org, ent->s.origin, delta);
+                len = VectorLength(delta);
+                if (len > 400)
+                    continue;
+            }
         }
 
         if (ent->s.number != e) {
@@ -503,8 +847,8 @@ void SV_BuildClientFrame(client_t *client)
             ent->s.number = e;
         }
 
-        // add it to the circular client_entities array
-        state = &svs.entities[svs.next_entity % svs.num_entities];
+        // add it to the list of visible entities
+        state = &states[frame->num_entities];
         MSG_PackEntity(state, &ent->s, Q2PRO_SHORTANGLES(client, e));
 
 #if USE_FPS
@@ -539,10 +883,150 @@ void SV_BuildClientFrame(client_t *client)
             state->solid = sv.entities[e].solid32;
         }
 
-        svs.next_entity++;
-
         if (++frame->num_entities == MAX_PACKET_ENTITIES) {
             break;
         }
     }
+
+    return qtrue;
+}
+
+/*
+=============
+SV_CommitClientFrame
+
+Copies entities of the frame built by SV_BuildClientFrame into the
+circular client_entities array. Must be called for clients in order.
+Returns the frame to delta from.
+=============
+*/
+client_frame_t *SV_CommitClientFrame(client_t *client, const entity_packed_t *states, qboolean built)
+{
+    client_frame_t  *frame;
+    unsigned        i, n;
+
+    if (built) {
+        frame = &client->frames[client->framenum & UPDATE_MASK];
+        frame->first_entity = svs.next_entity;
+
+        i = svs.next_entity % svs.num_entities;
+        n = min(frame->num_entities, svs.num_entities - i);
+        memcpy(&svs.entities[i], states, n * sizeof(*states));
+        memcpy(svs.entities, states + n, (frame->num_entities - n) * sizeof(*states));
+
+        svs.next_entity += frame->num_entities;
+    }
+
+    return get_last_frame(client);
+}
+
+/*
+=============
+SV_VisBench_f
+
+Builds frames for all clients with and without visibility cache, verifies
+that results match and prints timings.
+=============
+*/
+void SV_VisBench_f(void)
+{
+    static entity_packed_t  states[2][MAX_PACKET_ENTITIES];
+    client_t        *client;
+    client_frame_t  *frame, backup;
+    int             i, count, numclients, frames_sent, num_entities, mismatches;
+    unsigned        start, time_walk, time_cache, rows;
+
+    if (sv.state != ss_game) {
+        Com_Printf("No game running.\n");
+        return;
+    }
+
+    count = 100;
+    if (Cmd_Argc() > 1) {
+        count = atoi(Cmd_Argv(1));
+        clamp(count, 1, 100000);
+    }
+
+    numclients = 0;
+    FOR_EACH_CLIENT(client) {
+        if (frame_pending(client))
+            numclients++;
+    }
+    if (!numclients) {
+        Com_Printf("No clients to build frames for.\n");
+        return;
+    }
+
+    // walk all entities for each client
+    vis_cache.active = qfalse;
+    start = Sys_Milliseconds();
+    for (i = 0; i < count; i++) {
+        FOR_EACH_CLIENT(client) {
+            if (!frame_pending(client))
+                continue;
+            frame = &client->frames[client->framenum & UPDATE_MASK];
+            backup = *frame;
+            frames_sent = client->frames_sent;
+            SV_BuildClientFrame(client, states[0]);
+            *frame = backup;
+            client->frames_sent = frames_sent;
+        }
+    }
+    time_walk = Sys_Milliseconds() - start;
+
+    // fill cache once per frame, then OR cached rows for each client
+    rows = vis_cache.rows;
+    start = Sys_Milliseconds();
+    for (i = 0; i < count; i++) {
+        prepare_vis_cache();
+        FOR_EACH_CLIENT(client) {
+            if (!frame_pending(client))
+                continue;
+            frame = &client->frames[client->framenum & UPDATE_MASK];
+            backup = *frame;
+            frames_sent = client->frames_sent;
+            SV_BuildClientFrame(client, states[1]);
+            *frame = backup;
+            client->frames_sent = frames_sent;
+        }
+    }
+    time_cache = Sys_Milliseconds() - start;
+    rows = vis_cache.rows - rows;
+
+    // verify that both paths produce the same frames
+    mismatches = 0;
+    FOR_EACH_CLIENT(client) {
+        if (!frame_pending(client))
+            continue;
+        frame = &client->frames[client->framenum & UPDATE_MASK];
+        backup = *frame;
+        frames_sent = client->frames_sent;
+
+        memset(states, 0, sizeof(states));
+        vis_cache.active = qfalse;
+        SV_BuildClientFrame(client, states[0]);
+        num_entities = frame->num_entities;
+        prepare_vis_cache();
+        SV_BuildClientFrame(client, states[1]);
+        if (num_entities != frame->num_entities ||
+            memcmp(states[0], states[1], sizeof(states[0][0]) * num_entities)) {
+            Com_Printf("%s: frames differ\n", client->name);
+            mismatches++;
+        }
+
+        *frame = backup;
+        client->frames_sent = frames_sent;
+    }
+
+    // next frame will fill cache again
+    vis_cache.active = qfalse;
+
+    Com_Printf("%d clients, %d candidate entities, %d frames\n",
+               numclients, vis_cache.numcandidates, count);
+    Com_Printf("walk:  %u ms, %.1f usec per client frame\n",
+               time_walk, time_walk * 1000.0f / (count * numclients));
+    Com_Printf("cache: %u ms, %.1f usec per client frame, %.1f rows per frame\n",
+               time_cache, time_cache * 1000.0f / (count * numclients),
+               (float)rows / count);
+    Com_Printf("%d mismatches\n", mismatches);
 }
@@ -168,6 +168,7 @@ static void PF_bprintf(int level, const char *fmt, ...)
         Com_Printf("%s", string);
     }
 
+    SV_BeginMulticast();
     FOR_EACH_CLIENT(client) {
         if (client->state != cs_spawned)
             continue;
@@ -175,6 +176,7 @@ static void PF_bprintf(int level, const char *fmt, ...)
             SV_ClientAddMessage(client, MSG_RELIABLE);
         }
     }
+    SV_EndMulticast();
 
     SZ_Clear(&msg_write);
 }
@@ -397,6 +399,9 @@ static void PF_configstring(int index, const char *val)
     memcpy(dst, val, len);
     dst[len] = 0;
 
+    // compressed gamestate is no longer valid
+    SV_FlushGamestateCache();
+
     if (sv.state == ss_loading) {
         return;
     }
@@ -409,12 +414,14 @@ static void PF_configstring(int index, const char *val)
     MSG_WriteData(val, len);
     MSG_WriteByte(0);
 
+    SV_BeginMulticast();
     FOR_EACH_CLIENT(client) {
         if (client->state < cs_primed) {
             continue;
         }
         SV_ClientAddMessage(client, MSG_RELIABLE);
     }
+    SV_EndMulticast();
 
     SZ_Clear(&msg_write);
 }
@@ -428,6 +435,7 @@ static qboolean PF_inVIS(vec3_t p1, vec3_t p2, int vis)
 {
     mleaf_t *leaf1, *leaf2;
     byte mask[VIS_MAX_BYTES];
+    const byte *row;
     bsp_t *bsp = sv.cm.cache;
 
     if (!bsp) {
@@ -435,12 +443,12 @@ static qboolean PF_inVIS(vec3_t p1, vec3_t p2, int vis)
     }
 
     leaf1 = BSP_PointLeaf(bsp->nodes, p1);
-    BSP_ClusterVis(bsp, mask, leaf1->cluster, vis);
+    row = BSP_GetClusterVis(bsp, mask, leaf1->cluster, vis);
 
     leaf2 = BSP_PointLeaf(bsp->nodes, p2);
     if (leaf2->cluster == -1)
         return qfalse;
-    if (!Q_IsBitSet(mask, leaf2->cluster))
+    if (!Q_IsBitSet(row, leaf2->cluster))
         return qfalse;
     if (!CM_AreasConnected(&sv.cm, leaf1->area, leaf2->area))
         return qfalse;        // a door blocks it
@@ -518,6 +526,7 @@ static void PF_StartSound(edict_t *edict, int channel,
     vec3_t      origin;
     client_t    *client;
     byte        mask[VIS_MAX_BYTES];
+    const byte  *row;
     mleaf_t     *leaf;
     int         area;
     player_state_t      *ps;
@@ -573,8 +582,8 @@ static void PF_StartSound(edict_t *edict, int channel,
                     continue;        // blocked by a door
                 }
             }
-            BSP_ClusterVis(sv.cm.cache, mask, leaf->cluster, DVIS_PHS);
-            if (!SV_EdictIsVisible(&sv.cm, edict, mask)) {
+            row = BSP_GetClusterVis(sv.cm.cache, mask, leaf->cluster, DVIS_PHS);
+            if (!SV_EdictIsVisible(&sv.cm, edict, row)) {
                 continue; // not in PHS
             }
         }
@@ -415,8 +415,13 @@ void SV_InitGame(unsigned mvd_spawn)
     }
 
     svs.client_pool = SV_Mallocz(sizeof(client_t) * sv_maxclients->integer);
+    for (i = 0; i < CLIENT_HASH_SIZE; i++)
+        List_Init(&svs.client_hash[i]);
 
-    svs.num_entities = sv_maxclients->integer * UPDATE_BACKUP * MAX_PACKET_ENTITIES;
+    // keep one spare frame for each client, so that entities of delta
+    // frames survive until all frames are committed in parallel mode
+    svs.num_spare_entities = sv_maxclients->integer * MAX_PACKET_ENTITIES;
+    svs.num_entities = svs.num_spare_entities * (UPDATE_BACKUP + 1);
     svs.entities = SV_Mallocz(sizeof(entity_packed_t) * svs.num_entities);
 
     // initialize MVD server
@@ -52,6 +52,11 @@ cvar_t  *sv_show_name_changes;
 cvar_t  *sv_airaccelerate;
 cvar_t  *sv_qwmod;              // atu QW Physics modificator
 cvar_t  *sv_novis;
+cvar_t  *sv_threads;
+cvar_t  *sv_viscache;
+cvar_t  *sv_download_cache_size;
+cvar_t  *sv_area_depth;
+cvar_t  *sv_trace_cache;
 
 cvar_t  *sv_maxclients;
 cvar_t  *sv_reserved_slots;
@@ -102,6 +107,30 @@ qboolean sv_registered;
 
 //============================================================================
 
+// hashes IPv4 address or /48 IPv6 network, port is not included
+// so that translated ports can be fixed up without rehashing
+static unsigned client_hash(const netadr_t *adr)
+{
+    uint32_t h;
+
+    switch (adr->type) {
+    case NA_IP:
+        h = adr->ip.u32[0];
+        break;
+    case NA_IP6:
+        h = adr->ip.u32[0] ^ adr->ip.u16[2];
+        break;
+    default:
+        return 0;
+    }
+
+    h ^= h >> 16;
+    h *= 0x45d9f3b;
+    h ^= h >> 16;
+
+    return h & (CLIENT_HASH_SIZE - 1);
+}
+
 void SV_RemoveClient(client_t *client)
 {
     if (client->msg_pool) {
@@ -116,6 +145,7 @@ void SV_RemoveClient(client_t *client)
     // unlink them from active client list, but don't clear the list entry
     // itself to make code that traverses client list in a loop happy!
     List_Remove(&client->entry);
+    List_Remove(&client->hash_entry);
 
 #if USE_MVD_CLIENT
     // unlink them from MVD client list
@@ -703,7 +733,7 @@ static qboolean permit_connection(conn_params_t *p)
     // limit number of connections from single IPv4 address or /48 IPv6 network
     if (sv_iplimit->integer > 0) {
         count = 0;
-        FOR_EACH_CLIENT(cl) {
+        FOR_EACH_CLIENT_HASH(cl, client_hash(&net_from)) {
             netadr_t *adr = &cl->netchan->remote_address;
 
             if (net_from.type != adr->type)
@@ -921,7 +951,7 @@ static client_t *find_client_slot(conn_params_t *params)
     int i;
 
     // if there is already a slot for this ip, reuse it
-    FOR_EACH_CLIENT(cl) {
+    FOR_EACH_CLIENT_HASH(cl, client_hash(&net_from)) {
         if (NET_IsEqualAdr(&net_from, &cl->netchan->remote_address)) {
             if (cl->state == cs_zombie) {
                 strcpy(params->reconnect_var, cl->reconnect_var);
@@ -1155,6 +1185,7 @@ static void SVC_DirectConnect(void)
 
     // add them to the linked list of connected clients
     List_SeqAdd(&sv_clientlist, &newcl->entry);
+    List_SeqAdd(&svs.client_hash[client_hash(&net_from)], &newcl->hash_entry);
 
     Com_DPrintf("Going from cs_free to cs_assigned for %s\n", newcl->name);
     newcl->state = cs_assigned;
@@ -1436,7 +1467,7 @@ static void SV_PacketEvent(void)
     }
 
     // check for packets from connected clients
-    FOR_EACH_CLIENT(client) {
+    FOR_EACH_CLIENT_HASH(client, client_hash(&net_from)) {
         netchan = client->netchan;
         if (!NET_IsEqualBaseAdr(&net_from, &netchan->remote_address)) {
             continue;
@@ -1534,7 +1565,7 @@ void SV_ErrorEvent(netadr_t *from, int ee_errno, int ee_info)
     }
 
     // check for errors from connected clients
-    FOR_EACH_CLIENT(client) {
+    FOR_EACH_CLIENT_HASH(client, client_hash(from)) {
         if (client->state == cs_zombie) {
             continue; // already a zombie
         }
@@ -1641,6 +1672,9 @@ static void SV_PrepWorldFrame(void)
 
     sv.tracecount = 0;
 
+    // entities may have been changed by the game without relinking
+    SV_FlushTraceCache();
+
     if (!SV_FRAMESYNC)
         return;
 
@@ -2149,6 +2183,11 @@ void SV_Init(void)
     sv_reserved_password = Cvar_Get("sv_reserved_password", "", CVAR_PRIVATE);
     sv_locked = Cvar_Get("sv_locked", "0", 0);
     sv_novis = Cvar_Get("sv_novis", "0", 0);
+    sv_threads = Cvar_Get("sv_threads", "0", 0);
+    sv_viscache = Cvar_Get("sv_viscache", "1", 0);
+    sv_download_cache_size = Cvar_Get("sv_download_cache_size", "32", 0);
+    sv_area_depth = Cvar_Get("sv_area_depth", "0", 0);
+    sv_trace_cache = Cvar_Get("sv_trace_cache", "0", 0);
     sv_downloadserver = Cvar_Get("sv_downloadserver", "", 0);
     sv_redirect_address = Cvar_Get("sv_redirect_address", "", 0);
 
@@ -2307,6 +2346,9 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
 
     SV_MvdShutdown(type);
 
+    // send anything left queued by a frame aborted with error
+    NET_FlushPackets(NS_SERVER);
+
     SV_FinalMessage(finalmsg, type);
     SV_MasterShutdown();
     SV_ShutdownGameProgs();
@@ -2324,6 +2366,11 @@ void SV_Shutdown(const char *finalmsg, error_type_t type)
 #endif
     memset(&svs, 0, sizeof(svs));
 
+    // free cached downloads, all clients are gone by now
+    SV_FlushDownloadCache();
+    SV_FlushGamestateCache();
+    SV_FlushVisCache();
+
     // reset rate limits
     init_rate_limits();
 
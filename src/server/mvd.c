@@ -381,6 +381,7 @@ static int dummy_create(void)
     newcl->netchan->remote_address.type = NA_LOOPBACK;
 
     List_Init(&newcl->entry);
+    List_Init(&newcl->hash_entry);
 
     if (g_features->integer & GMF_EXTRA_USERINFO) {
         strcpy(userinfo, MVD_USERINFO1);
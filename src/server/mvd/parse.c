@@ -154,6 +154,7 @@ static void MVD_ParseMulticast(mvd_t *mvd, mvd_ops_t op, int extrabits)
     mvd_client_t    *client;
     client_t    *cl;
     byte        mask[VIS_MAX_BYTES];
+    const byte  *row = NULL;
     mleaf_t     *leaf1, *leaf2;
     vec3_t      org;
     qboolean    reliable = qfalse;
@@ -181,7 +182,7 @@ static void MVD_ParseMulticast(mvd_t *mvd, mvd_ops_t op, int extrabits)
             break;
         }
         leaf1 = CM_LeafNum(&mvd->cm, leafnum);
-        BSP_ClusterVis(mvd->cm.cache, mask, leaf1->cluster, DVIS_PHS);
+        row = BSP_GetClusterVis(mvd->cm.cache, mask, leaf1->cluster, DVIS_PHS);
         break;
     case mvd_multicast_pvs_r:
         reliable = qtrue;
@@ -193,7 +194,7 @@ static void MVD_ParseMulticast(mvd_t *mvd, mvd_ops_t op, int extrabits)
             break;
         }
         leaf1 = CM_LeafNum(&mvd->cm, leafnum);
-        BSP_ClusterVis(mvd->cm.cache, mask, leaf1->cluster, DVIS_PVS);
+        row = BSP_GetClusterVis(mvd->cm.cache, mask, leaf1->cluster, DVIS_PVS);
         break;
     default:
         MVD_Destroyf(mvd, "bad op");
@@ -236,7 +237,7 @@ static void MVD_ParseMulticast(mvd_t *mvd, mvd_ops_t op, int extrabits)
                 continue;
             if (leaf2->cluster == -1)
                 continue;
-            if (!Q_IsBitSet(mask, leaf2->cluster))
+            if (!Q_IsBitSet(row, leaf2->cluster))
                 continue;
         }
 
@@ -493,6 +494,7 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
     mvd_client_t        *client;
     client_t    *cl;
     byte        mask[VIS_MAX_BYTES];
+    const byte  *row;
     mleaf_t     *leaf;
     int         area;
     player_state_t      *ps;
@@ -549,8 +551,8 @@ static void MVD_ParseSound(mvd_t *mvd, int extrabits)
                     continue;        // blocked by a door
                 }
             }
-            BSP_ClusterVis(mvd->cm.cache, mask, leaf->cluster, DVIS_PHS);
-            if (!SV_EdictIsVisible(&mvd->cm, entity, mask)) {
+            row = BSP_GetClusterVis(mvd->cm.cache, mask, leaf->cluster, DVIS_PHS);
+            if (!SV_EdictIsVisible(&mvd->cm, entity, row)) {
                 continue; // not in PHS
             }
         }
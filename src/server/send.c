@@ -171,6 +171,7 @@ void SV_BroadcastPrintf(int level, const char *fmt, ...)
     MSG_WriteByte(level);
     MSG_WriteData(string, len + 1);
 
+    SV_BeginMulticast();
     FOR_EACH_CLIENT(client) {
         if (client->state != cs_spawned)
             continue;
@@ -178,6 +179,7 @@ void SV_BroadcastPrintf(int level, const char *fmt, ...)
             continue;
         SV_ClientAddMessage(client, MSG_RELIABLE);
     }
+    SV_EndMulticast();
 
     SZ_Clear(&msg_write);
 }
@@ -230,9 +232,11 @@ void SV_BroadcastCommand(const char *fmt, ...)
     MSG_WriteByte(svc_stufftext);
     MSG_WriteData(string, len + 1);
 
+    SV_BeginMulticast();
     FOR_EACH_CLIENT(client) {
         SV_ClientAddMessage(client, MSG_RELIABLE);
     }
+    SV_EndMulticast();
 
     SZ_Clear(&msg_write);
 }
@@ -256,6 +260,7 @@ void SV_Multicast(vec3_t origin, multicast_t to)
 {
     client_t    *client;
     byte        mask[VIS_MAX_BYTES];
+    const byte  *row = NULL;
     mleaf_t     *leaf1, *leaf2;
     int         leafnum q_unused;
     int         flags;
@@ -281,7 +286,7 @@ void SV_Multicast(vec3_t origin, multicast_t to)
     case MULTICAST_PHS:
         leaf1 = CM_PointLeaf(&sv.cm, origin);
         leafnum = leaf1 - sv.cm.cache->leafs;
-        BSP_ClusterVis(sv.cm.cache, mask, leaf1->cluster, DVIS_PHS);
+        row = BSP_GetClusterVis(sv.cm.cache, mask, leaf1->cluster, DVIS_PHS);
         break;
     case MULTICAST_PVS_R:
         flags |= MSG_RELIABLE;
@@ -289,13 +294,14 @@ void SV_Multicast(vec3_t origin, multicast_t to)
     case MULTICAST_PVS:
         leaf1 = CM_PointLeaf(&sv.cm, origin);
         leafnum = leaf1 - sv.cm.cache->leafs;
-        BSP_ClusterVis(sv.cm.cache, mask, leaf1->cluster, DVIS_PVS);
+        row = BSP_GetClusterVis(sv.cm.cache, mask, leaf1->cluster, DVIS_PVS);
         break;
     default:
         Com_Error(ERR_DROP, "SV_Multicast: bad to: %i", to);
     }
 
     // send the data to all relevent clients
+    SV_BeginMulticast();
     FOR_EACH_CLIENT(client) {
         if (client->state < cs_primed) {
             continue;
@@ -321,12 +327,13 @@ void SV_Multicast(vec3_t origin, multicast_t to)
                 continue;
             if (leaf2->cluster == -1)
                 continue;
-            if (!Q_IsBitSet(mask, leaf2->cluster))
+            if (!Q_IsBitSet(row, leaf2->cluster))
                 continue;
         }
 
         SV_ClientAddMessage(client, flags);
     }
+    SV_EndMulticast();
 
     // add to MVD datagram
     SV_MvdMulticast(leafnum, to);
@@ -418,6 +425,82 @@ clear:
     }
 }
 
+// large payload of msg_write currently being multicast
+static unsigned         msg_sequence;
+static unsigned         msg_multicast;  // sequence of current multicast, if any
+static message_shared_t *msg_shared;
+
+static inline void release_shared(message_shared_t *shared)
+{
+    if (--shared->refcount == 0) {
+        Z_Free(shared);
+    }
+}
+
+/*
+=======================
+SV_BeginMulticast
+
+Contents of the write buffer added to multiple clients until the matching
+SV_EndMulticast call are stored once in a shared buffer, instead of being
+copied into each client's message list. Write buffer must not be modified
+in between. Multicasts can't be nested, clients are dropped only after
+ending the current one.
+=======================
+*/
+void SV_BeginMulticast(void)
+{
+    if (msg_multicast) {
+        Com_Error(ERR_FATAL, "%s: nested multicast", __func__);
+    }
+
+    if (++msg_sequence == 0) {
+        msg_sequence = 1;
+    }
+    msg_multicast = msg_sequence;
+}
+
+void SV_EndMulticast(void)
+{
+    msg_multicast = 0;
+
+    if (msg_shared) {
+        release_shared(msg_shared);
+        msg_shared = NULL;
+    }
+}
+
+static message_shared_t *alloc_shared(byte *data, size_t len)
+{
+    message_shared_t *shared;
+    qboolean multicast;
+
+    // only the write buffer contents are shared, anything else added
+    // during multicast gets a private copy
+    multicast = msg_multicast && data == msg_write.data;
+
+    // reuse payload already stored for another client
+    if (multicast && msg_shared && msg_shared->sequence == msg_multicast &&
+        msg_shared->cursize == len) {
+        msg_shared->refcount++;
+        return msg_shared;
+    }
+
+    shared = SV_Malloc(sizeof(*shared) + len - 1);
+    shared->refcount = 1;
+    shared->sequence = msg_multicast;
+    shared->cursize = len;
+    memcpy(shared->data, data, len);
+
+    // keep a reference until SV_EndMulticast
+    if (multicast && !msg_shared) {
+        shared->refcount++;
+        msg_shared = shared;
+    }
+
+    return shared;
+}
+
 /*
 ===============================================================================
 
@@ -426,6 +509,11 @@ FRAME UPDATES - COMMON
 ===============================================================================
 */
 
+static inline uint8_t *msg_packet_data(message_packet_t *msg)
+{
+    return msg->cursize > MSG_TRESHOLD ? msg->shared->data : msg->data;
+}
+
 static inline void free_msg_packet(client_t *client, message_packet_t *msg)
 {
     List_Remove(&msg->entry);
@@ -435,10 +523,10 @@ static inline void free_msg_packet(client_t *client, message_packet_t *msg)
             Com_Error(ERR_FATAL, "%s: bad packet size", __func__);
         }
         client->msg_dynamic_bytes -= msg->cursize;
-        Z_Free(msg);
-    } else {
-        List_Insert(&client->msg_free_list, &msg->entry);
+        release_shared(msg->shared);
     }
+
+    List_Insert(&client->msg_free_list, &msg->entry);
 }
 
 #define FOR_EACH_MSG_SAFE(list) \
@@ -471,28 +559,29 @@ static void add_msg_packet(client_t    *client,
         return; // already dropped
     }
 
+    if (len > MAX_MSGLEN) {
+        Com_Error(ERR_FATAL, "%s: oversize packet", __func__);
+    }
+    if (len > MSG_TRESHOLD && client->msg_dynamic_bytes + len > MAX_MSGLEN) {
+        Com_WPrintf("%s: %s: out of dynamic memory\n",
+                    __func__, client->name);
+        goto overflowed;
+    }
+    if (LIST_EMPTY(&client->msg_free_list)) {
+        Com_WPrintf("%s: %s: out of message slots\n",
+                    __func__, client->name);
+        goto overflowed;
+    }
+
+    msg = MSG_FIRST(&client->msg_free_list);
+    List_Remove(&msg->entry);
+
     if (len > MSG_TRESHOLD) {
-        if (len > MAX_MSGLEN) {
-            Com_Error(ERR_FATAL, "%s: oversize packet", __func__);
-        }
-        if (client->msg_dynamic_bytes + len > MAX_MSGLEN) {
-            Com_WPrintf("%s: %s: out of dynamic memory\n",
-                        __func__, client->name);
-            goto overflowed;
-        }
-        msg = SV_Malloc(sizeof(*msg) + len - MSG_TRESHOLD);
+        msg->shared = alloc_shared(data, len);
         client->msg_dynamic_bytes += len;
     } else {
-        if (LIST_EMPTY(&client->msg_free_list)) {
-            Com_WPrintf("%s: %s: out of message slots\n",
-                        __func__, client->name);
-            goto overflowed;
-        }
-        msg = MSG_FIRST(&client->msg_free_list);
-        List_Remove(&msg->entry);
+        memcpy(msg->data, data, len);
     }
-
-    memcpy(msg->data, data, len);
     msg->cursize = (uint16_t)len;
 
     if (reliable) {
@@ -506,6 +595,8 @@ static void add_msg_packet(client_t    *client,
 
 overflowed:
     if (reliable) {
+        // dropping modifies the write buffer
+        SV_EndMulticast();
         free_all_messages(client);
         SV_DropClient(client, "reliable queue overflowed");
     }
@@ -579,7 +670,7 @@ static inline void write_msg(client_t *client, message_packet_t *msg, size_t max
 {
     // if this msg fits, write it
     if (msg_write.cursize + msg->cursize <= maxsize) {
-        MSG_WriteData(msg->data, msg->cursize);
+        MSG_WriteData(msg_packet_data(msg), msg->cursize);
     }
     free_msg_packet(client, msg);
 }
@@ -610,6 +701,7 @@ static void add_message_old(client_t *client, byte *data,
 {
     if (len > client->netchan->maxpacketlen) {
         if (reliable) {
+            SV_EndMulticast();
             SV_DropClient(client, "oversize reliable message");
         } else {
             Com_DPrintf("Dumped oversize unreliable for %s\n", client->name);
@@ -647,7 +739,7 @@ static void write_reliables_old(client_t *client, size_t maxsize)
         SV_DPrintf(1, "%s to %s: writing msg %d: %d bytes\n",
                    __func__, client->name, count, msg->cursize);
 
-        SZ_Write(&client->netchan->message, msg->data, msg->cursize);
+        SZ_Write(&client->netchan->message, msg_packet_data(msg), msg->cursize);
         free_msg_packet(client, msg);
         count++;
     }
@@ -657,6 +749,7 @@ static void write_reliables_old(client_t *client, size_t maxsize)
 static void repack_unreliables(client_t *client, size_t maxsize)
 {
     message_packet_t *msg, *next;
+    uint8_t *data;
 
     if (msg_write.cursize + 4 > maxsize) {
         return;
@@ -664,13 +757,17 @@ static void repack_unreliables(client_t *client, size_t maxsize)
 
     // temp entities first
     FOR_EACH_MSG_SAFE(&client->msg_unreliable_list) {
-        if (!msg->cursize || msg->data[0] != svc_temp_entity) {
+        if (!msg->cursize) {
+            continue;
+        }
+        data = msg_packet_data(msg);
+        if (data[0] != svc_temp_entity) {
             continue;
         }
         // ignore some low-priority effects, these checks come from r1q2
-        if (msg->data[1] == TE_BLOOD || msg->data[1] == TE_SPLASH ||
-            msg->data[1] == TE_GUNSHOT || msg->data[1] == TE_BULLET_SPARKS ||
-            msg->data[1] == TE_SHOTGUN) {
+        if (data[1] == TE_BLOOD || data[1] == TE_SPLASH ||
+            data[1] == TE_GUNSHOT || data[1] == TE_BULLET_SPARKS ||
+            data[1] == TE_SHOTGUN) {
             continue;
         }
         write_msg(client, msg, maxsize);
@@ -693,7 +790,7 @@ static void repack_unreliables(client_t *client, size_t maxsize)
 
     // then positioned sounds
     FOR_EACH_MSG_SAFE(&client->msg_unreliable_list) {
-        if (msg->cursize && msg->data[0] == svc_sound) {
+        if (msg->cursize && msg_packet_data(msg)[0] == svc_sound) {
             write_msg(client, msg, maxsize);
         }
     }
@@ -729,9 +826,7 @@ static void write_datagram_old(client_t *client)
         }
     }
 
-    // send over all the relevant entity_state_t
-    // and the player_state_t
-    client->WriteFrame(client);
+    // frame has already been written by the caller
     if (msg_write.cursize > maxsize) {
         SV_DPrintf(0, "Frame %d overflowed for %s: %"PRIz" > %"PRIz"\n",
                    client->framenum, client->name, msg_write.cursize, maxsize);
@@ -789,10 +884,7 @@ static void write_datagram_new(client_t *client)
 {
     size_t cursize;
 
-    // send over all the relevant entity_state_t
-    // and the player_state_t
-    client->WriteFrame(client);
-
+    // frame has already been written by the caller
     if (msg_write.overflowed) {
         // should never really happen
         Com_WPrintf("Frame overflowed for %s\n", client->name);
@@ -869,15 +961,22 @@ static void check_key_sync(client_t *client)
 }
 #endif
 
-/*
-=======================
-SV_SendClientMessages
+// builds the new frame and writes it into msg_write
+static void write_frame(client_t *client)
+{
+    entity_packed_t states[MAX_PACKET_ENTITIES];
+    client_frame_t  *oldframe;
+    qboolean        built;
 
-Called each game frame, sends svc_frame messages to spawned clients only.
-Clients in earlier connection state are handled in SV_SendAsyncPackets.
-=======================
-*/
-void SV_SendClientMessages(void)
+    built = SV_BuildClientFrame(client, states);
+    oldframe = SV_CommitClientFrame(client, states, built);
+
+    // send over all the relevant entity_state_t
+    // and the player_state_t
+    client->WriteFrame(client, oldframe);
+}
+
+static void send_client_messages_serial(void)
 {
     client_t    *client;
     size_t      cursize;
@@ -916,7 +1015,7 @@ void SV_SendClientMessages(void)
         }
 
         // build the new frame and write it
-        SV_BuildClientFrame(client);
+        write_frame(client);
         client->WriteDatagram(client);
 
 advance:
@@ -929,6 +1028,276 @@ finish:
     }
 }
 
+/*
+===============================================================================
+
+PARALLEL FRAME BUILDING
+
+Visibility checks and delta compression are done by worker threads, while
+everything that touches shared state (client_entities array, delta frame
+selection, reliable messages, netchan) stays on the main thread and is done
+in client order. Thus output is identical to the serial version.
+
+===============================================================================
+*/
+
+// each worker thread encodes frames into its own arena,
+// one frame may take up to MAX_MSGLEN bytes
+#define FRAME_ARENA_SIZE    (MAX_MSGLEN * 4)
+
+typedef enum {
+    FA_FINISH,      // only clear unreliable messages
+    FA_SKIP,        // not synced this frame
+    FA_ADVANCE,     // rate dropped
+    FA_FRAGMENT,    // transmit next fragment
+    FA_BUILD        // build the new frame and send it
+} frameaction_t;
+
+typedef struct {
+    client_t        *client;
+    client_frame_t  *oldframe;
+    qboolean        built;
+    byte            *data;      // NULL if frame didn't fit into arena
+    size_t          cursize;
+    entity_packed_t states[MAX_PACKET_ENTITIES];
+} framejob_t;
+
+static framejob_t   *frame_jobs;
+static int          frame_maxjobs;
+static int          frame_numjobs;
+static byte         *frame_actions;
+
+static byte         *frame_arenas;
+static int          frame_numarenas;
+static int          frame_numthreads;
+
+static void         (*frame_func)(void *, int);
+static deferred_error_t frame_errors[MAX_WORKER_THREADS];
+
+static void build_frames_thread(void *arg, int index)
+{
+    framejob_t *job;
+    int i;
+
+    for (i = index; i < frame_numjobs; i += frame_numthreads) {
+        job = &frame_jobs[i];
+        job->built = SV_BuildClientFrame(job->client, job->states);
+    }
+}
+
+static void write_frames_thread(void *arg, int index)
+{
+    byte *arena = frame_arenas + index * FRAME_ARENA_SIZE;
+    sizebuf_t saved = msg_write;
+    size_t used = 0;
+    framejob_t *job;
+    int i;
+
+    for (i = index; i < frame_numjobs; i += frame_numthreads) {
+        // leave the rest to main thread if arena is full
+        if (FRAME_ARENA_SIZE - used < MAX_MSGLEN)
+            break;
+
+        job = &frame_jobs[i];
+        SZ_TagInit(&msg_write, arena + used, MAX_MSGLEN, SZ_MSG_WRITE);
+        job->client->WriteFrame(job->client, job->oldframe);
+        job->data = arena + used;
+        job->cursize = msg_write.cursize;
+        used += msg_write.cursize;
+    }
+
+    msg_write = saved;
+}
+
+static void frame_thread(void *arg, int index)
+{
+    Com_DeferErrors(frame_func, arg, index, &frame_errors[index]);
+}
+
+// runs func on worker threads, then raises any error on main thread
+static void run_frame_threads(void (*func)(void *, int))
+{
+    int i;
+
+    frame_func = func;
+    Sys_RunThreads(frame_numthreads, frame_thread, NULL);
+
+    for (i = 0; i < frame_numthreads; i++) {
+        Com_RaiseDeferred(&frame_errors[i]);
+    }
+}
+
+// fix entity numbers in advance so that worker threads never modify edicts
+static void fix_entity_numbers(void)
+{
+    edict_t *ent;
+    int e;
+
+    for (e = 1; e < ge->num_edicts; e++) {
+        ent = EDICT_NUM(e);
+        if (!ent->inuse && (g_features->integer & GMF_PROPERINUSE))
+            continue;
+        if (ent->svflags & SVF_NOCLIENT)
+            continue;
+        if (!ent->s.modelindex && !ent->s.effects && !ent->s.sound && !ent->s.event)
+            continue;
+        if (ent->s.number != e) {
+            Com_WPrintf("%s: fixing ent->s.number: %d to %d\n",
+                        __func__, ent->s.number, e);
+            ent->s.number = e;
+        }
+    }
+}
+
+static void alloc_frame_jobs(int numthreads)
+{
+    if (frame_maxjobs < sv_maxclients->integer) {
+        Z_Free(frame_jobs);
+        Z_Free(frame_actions);
+        frame_maxjobs = sv_maxclients->integer;
+        frame_jobs = Z_Malloc(sizeof(frame_jobs[0]) * frame_maxjobs);
+        frame_actions = Z_Malloc(frame_maxjobs);
+    }
+
+    if (frame_numarenas < numthreads) {
+        Z_Free(frame_arenas);
+        frame_numarenas = numthreads;
+        frame_arenas = Z_Malloc(FRAME_ARENA_SIZE * frame_numarenas);
+    }
+}
+
+static frameaction_t classify_client(client_t *client)
+{
+    if (client->state != cs_spawned || client->download || client->nodata)
+        return FA_FINISH;
+
+    if (!SV_CLIENTSYNC(client))
+        return FA_SKIP;
+
+#if (defined _DEBUG) && USE_FPS
+    if (developer->integer)
+        check_key_sync(client);
+#endif
+
+    // don't overrun bandwidth
+    if (SV_RateDrop(client))
+        return FA_ADVANCE;
+
+    // don't write any frame data until all fragments are sent
+    if (client->netchan->fragment_pending)
+        return FA_FRAGMENT;
+
+    return FA_BUILD;
+}
+
+static qboolean send_client_messages_parallel(int numthreads)
+{
+    client_t    *client;
+    framejob_t  *job;
+    size_t      cursize;
+    int         i;
+
+    // dropping a client calls into game DLL and affects frames of other
+    // clients, fall back to serial version if that's going to happen
+    FOR_EACH_CLIENT(client) {
+        if (client->state != cs_spawned || client->download || client->nodata)
+            continue;
+        if (!SV_CLIENTSYNC(client))
+            continue;
+        if (client->netchan->message.overflowed)
+            return qfalse;
+    }
+
+    alloc_frame_jobs(numthreads);
+
+    // decide what to do with each client
+    frame_numjobs = 0;
+    FOR_EACH_CLIENT(client) {
+        frame_actions[client->number] = classify_client(client);
+        if (frame_actions[client->number] == FA_BUILD) {
+            job = &frame_jobs[frame_numjobs++];
+            job->client = client;
+            job->data = NULL;
+        }
+    }
+
+    if (frame_numjobs) {
+        fix_entity_numbers();
+
+        frame_numthreads = min(numthreads, frame_numjobs);
+        run_frame_threads(build_frames_thread);
+
+        // commit entities in client order and select delta frames
+        for (i = 0; i < frame_numjobs; i++) {
+            job = &frame_jobs[i];
+            job->oldframe = SV_CommitClientFrame(job->client, job->states, job->built);
+        }
+
+        run_frame_threads(write_frames_thread);
+    }
+
+    // send datagrams in client order
+    job = frame_jobs;
+    FOR_EACH_CLIENT(client) {
+        switch (frame_actions[client->number]) {
+        case FA_FINISH:
+            break;
+        case FA_SKIP:
+            continue;
+        case FA_FRAGMENT:
+            client->frameflags |= FF_SUPPRESSED;
+            cursize = client->netchan->TransmitNextFragment(client->netchan);
+            SV_CalcSendTime(client, cursize);
+            // fall through
+        case FA_ADVANCE:
+            client->framenum++;
+            break;
+        case FA_BUILD:
+            if (job->data) {
+                MSG_WriteData(job->data, job->cursize);
+            } else {
+                client->WriteFrame(client, job->oldframe);
+            }
+            job++;
+            client->WriteDatagram(client);
+            client->framenum++;
+            break;
+        }
+
+        // clear all unreliable messages still left
+        finish_frame(client);
+    }
+
+    return qtrue;
+}
+
+/*
+=======================
+SV_SendClientMessages
+
+Called each game frame, sends svc_frame messages to spawned clients only.
+Clients in earlier connection state are handled in SV_SendAsyncPackets.
+=======================
+*/
+void SV_SendClientMessages(void)
+{
+    int numthreads = Cvar_ClampInteger(sv_threads, 0, MAX_WORKER_THREADS);
+
+    // collect datagrams and send them all at once
+    NET_BatchPackets(NS_SERVER);
+
+    // find out entity visibility for all clients at once
+    SV_PrepareClientFrames();
+
+    // frames of MVD client are not built from game edicts
+    if (numthreads < 2 || sv.state != ss_game ||
+        !send_client_messages_parallel(numthreads)) {
+        send_client_messages_serial();
+    }
+
+    NET_FlushPackets(NS_SERVER);
+}
+
 static void write_pending_download(client_t *client)
 {
     sizebuf_t   *buf;
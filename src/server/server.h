@@ -21,6 +21,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include "shared/list.h"
 #include "shared/game.h"
 
+#include "common/bits.h"
 #include "common/bsp.h"
 #include "common/cmd.h"
 #include "common/cmodel.h"
@@ -110,6 +111,16 @@ typedef struct {
 
 typedef struct {
     int         solid32;
+    struct areanode_s   *areanode;  // area tree node entity is linked to
+    qboolean    areasolid;          // linked to solid list of that node
+
+    // results of the last full link, reused while bounds don't change
+    qboolean    linkvalid;
+    vec3_t      linkmins, linkmaxs;
+    int         num_clusters;
+    int         clusternums[MAX_ENT_CLUSTERS];
+    int         headnode;
+    int         areanum, areanum2;
 
 #if USE_FPS
 
@@ -217,11 +228,21 @@ typedef enum {
 
 #define MAX_SOUND_PACKET   14
 
+// payload of message larger than MSG_TRESHOLD, shared by all recipients
+// when multicast
+typedef struct {
+    unsigned            refcount;
+    unsigned            sequence;   // multicast that stored it, zero if none
+    size_t              cursize;
+    uint8_t             data[1];
+} message_shared_t;
+
 typedef struct {
     list_t              entry;
     uint16_t            cursize;    // zero means sound packet
     union {
         uint8_t         data[MSG_TRESHOLD];
+        message_shared_t    *shared;    // if cursize > MSG_TRESHOLD
         struct {
             uint8_t     flags;
             uint8_t     index;
@@ -239,6 +260,13 @@ typedef struct {
 #define FOR_EACH_CLIENT(client) \
     LIST_FOR_EACH(client_t, client, &sv_clientlist, entry)
 
+// clients are also hashed by IPv4 address or /48 IPv6 network
+// for quick lookup of incoming packets and per-address limits
+#define CLIENT_HASH_SIZE    256
+
+#define FOR_EACH_CLIENT_HASH(client, hash) \
+    LIST_FOR_EACH(client_t, client, &svs.client_hash[hash], hash_entry)
+
 #define PL_S2C(cl) (cl->frames_sent ? \
     (1.0f - (float)cl->frames_acked / cl->frames_sent) * 100.0f : 0.0f)
 #define PL_C2S(cl) (cl->netchan->total_received ? \
@@ -255,6 +283,7 @@ typedef struct {
 
 typedef struct client_s {
     list_t          entry;
+    list_t          hash_entry;     // in svs.client_hash, keyed by IP address
 
     // core info
     clstate_t       state;
@@ -312,7 +341,8 @@ typedef struct client_s {
     unsigned        send_time, send_delta;          // used to rate drop async packets
 
     // current download
-    byte            *download;      // file being downloaded
+    const byte      *download;      // file being downloaded
+    struct dlcache_s    *downloadcache; // shared cache entry download is from
     int             downloadsize;   // total bytes (can't use EOF because of paks)
     int             downloadcount;  // bytes sent
     char            *downloadname;  // name of the file
@@ -350,7 +380,7 @@ typedef struct client_s {
 
     // netchan type dependent methods
     void            (*AddMessage)(struct client_s *, byte *, size_t, qboolean);
-    void            (*WriteFrame)(struct client_s *);
+    void            (*WriteFrame)(struct client_s *, client_frame_t *);
     void            (*WriteDatagram)(struct client_s *);
 
     // netchan
@@ -453,8 +483,10 @@ typedef struct server_static_s {
     unsigned    realtime;           // always increasing, no clamping, etc
 
     client_t    *client_pool;   // [maxclients]
+    list_t      client_hash[CLIENT_HASH_SIZE];  // non-free clients
 
-    unsigned        num_entities;   // maxclients*UPDATE_BACKUP*MAX_PACKET_ENTITIES
+    unsigned        num_entities;   // maxclients*(UPDATE_BACKUP+1)*MAX_PACKET_ENTITIES
+    unsigned        num_spare_entities; // maxclients*MAX_PACKET_ENTITIES
     unsigned        next_entity;    // next state to use
     entity_packed_t *entities;      // [num_entities]
 
@@ -504,6 +536,11 @@ extern cvar_t       *sv_debug;
 extern cvar_t       *sv_pad_packets;
 #endif
 extern cvar_t       *sv_novis;
+extern cvar_t       *sv_threads;
+extern cvar_t       *sv_viscache;
+extern cvar_t       *sv_download_cache_size;
+extern cvar_t       *sv_area_depth;
+extern cvar_t       *sv_trace_cache;
 extern cvar_t       *sv_lan_force_rate;
 extern cvar_t       *sv_calcpings_method;
 extern cvar_t       *sv_changemapcmd;
@@ -600,6 +637,8 @@ void SV_BroadcastPrintf(int level, const char *fmt, ...) q_printf(2, 3);
 void SV_ClientCommand(client_t *cl, const char *fmt, ...) q_printf(2, 3);
 void SV_BroadcastCommand(const char *fmt, ...) q_printf(1, 2);
 void SV_ClientAddMessage(client_t *client, int flags);
+void SV_BeginMulticast(void);
+void SV_EndMulticast(void);
 void SV_ShutdownClientSend(client_t *client);
 void SV_InitClientSend(client_t *newcl);
 
@@ -692,6 +731,13 @@ void SV_New_f(void);
 void SV_Begin_f(void);
 void SV_ExecuteClientMessage(client_t *cl);
 void SV_CloseDownload(client_t *client);
+void SV_FlushDownloadCache(void);
+void SV_DownloadCache_f(void);
+#if USE_ZLIB
+void SV_FlushGamestateCache(void);
+#else
+#define SV_FlushGamestateCache() (void)0
+#endif
 #if USE_FPS
 void SV_AlignKeyFrames(client_t *client);
 #else
@@ -719,9 +765,13 @@ void SV_PrintMiscInfo(void);
     ((s)->modelindex || (s)->effects || (s)->sound || (s)->event)
 
 void SV_BuildProxyClientFrame(client_t *client);
-void SV_BuildClientFrame(client_t *client);
-void SV_WriteFrameToClient_Default(client_t *client);
-void SV_WriteFrameToClient_Enhanced(client_t *client);
+void SV_PrepareClientFrames(void);
+qboolean SV_BuildClientFrame(client_t *client, entity_packed_t *states);
+client_frame_t *SV_CommitClientFrame(client_t *client, const entity_packed_t *states, qboolean built);
+void SV_WriteFrameToClient_Default(client_t *client, client_frame_t *oldframe);
+void SV_WriteFrameToClient_Enhanced(client_t *client, client_frame_t *oldframe);
+void SV_VisBench_f(void);
+void SV_FlushVisCache(void);
 
 //
 // sv_game.c
@@ -778,7 +828,13 @@ int SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t **list, int maxcount, int ar
 // returns the number of pointers filled in
 // ??? does this always return the world?
 
-qboolean SV_EdictIsVisible(cm_t *cm, edict_t *ent, byte *mask);
+qboolean SV_EdictIsVisible(cm_t *cm, edict_t *ent, const byte *mask);
+
+void SV_AreaStats_f(void);
+void SV_LinkStats_f(void);
+void SV_TraceStats_f(void);
+void SV_FlushTraceCache(void);
+// prints area tree occupancy and average query cost
 
 //===================================================================
 
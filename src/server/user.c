@@ -37,13 +37,11 @@ to the clients -- only the fields that differ from the
 baseline will be transmitted
 ================
 */
-static void create_baselines(void)
+static void clear_baselines(void)
 {
     int        i;
-    edict_t    *ent;
-    entity_packed_t *base, **chunk;
+    entity_packed_t *base;
 
-    // clear baselines from previous level
     for (i = 0; i < SV_BASELINES_CHUNKS; i++) {
         base = sv_client->baselines[i];
         if (!base) {
@@ -51,6 +49,16 @@ static void create_baselines(void)
         }
         memset(base, 0, sizeof(*base) * SV_BASELINES_PER_CHUNK);
     }
+}
+
+static void create_baselines(void)
+{
+    int        i;
+    edict_t    *ent;
+    entity_packed_t *base, **chunk;
+
+    // clear baselines from previous level
+    clear_baselines();
 
     for (i = 1; i < sv_client->pool->num_edicts; i++) {
         ent = EDICT_POOL(sv_client, i);
@@ -157,14 +165,231 @@ static void write_plain_baselines(void)
 
 #if USE_ZLIB
 
+/*
+==============================================================================
+
+GAMESTATE CACHE
+
+Compressed gamestate is reused by clients connecting shortly after each
+other with the same protocol settings, e.g. when all clients reconnect after
+map change. For new netchan, baselines compressed into the gamestate are
+saved too and given to each client, since entities may have moved since.
+Entries are flushed when any configstring changes, and expire after
+GAMESTATE_CACHE_MSEC to keep baselines reasonably fresh.
+
+==============================================================================
+*/
+
+#define GAMESTATE_CACHE_SIZE    4
+#define GAMESTATE_CACHE_MSEC    1000
+
+typedef struct {
+    int             spawncount;
+    unsigned        time;
+    int             protocol;
+    int             version;
+    msgEsFlags_t    esFlags;
+    netchan_type_t  type;
+    size_t          maxpacketlen;
+    size_t          size;
+    byte            *data;      // gamestate, or length prefixed messages
+    int             numbaselines;
+    entity_packed_t *baselines;
+} gamestate_t;
+
+static gamestate_t  sv_gamestates[GAMESTATE_CACHE_SIZE];
+
+static void gamestate_free(gamestate_t *g)
+{
+    Z_Free(g->data);
+    Z_Free(g->baselines);
+    memset(g, 0, sizeof(*g));
+}
+
+/*
+==================
+SV_FlushGamestateCache
+==================
+*/
+void SV_FlushGamestateCache(void)
+{
+    int i;
+
+    for (i = 0; i < GAMESTATE_CACHE_SIZE; i++) {
+        if (sv_gamestates[i].data) {
+            gamestate_free(&sv_gamestates[i]);
+        }
+    }
+}
+
+static gamestate_t *gamestate_find(void)
+{
+    gamestate_t *g;
+    int i;
+
+    if (sv.state != ss_game) {
+        return NULL;
+    }
+
+    for (i = 0, g = sv_gamestates; i < GAMESTATE_CACHE_SIZE; i++, g++) {
+        if (!g->data)
+            continue;
+        if (g->spawncount != sv.spawncount)
+            continue;
+        if (svs.realtime - g->time >= GAMESTATE_CACHE_MSEC)
+            continue;
+        if (g->protocol != sv_client->protocol)
+            continue;
+        if (g->version != sv_client->version)
+            continue;
+        if (g->esFlags != sv_client->esFlags)
+            continue;
+        if (g->type != sv_client->netchan->type)
+            continue;
+        if (g->type == NETCHAN_OLD && g->maxpacketlen != sv_client->netchan->maxpacketlen)
+            continue;
+        return g;
+    }
+
+    return NULL;
+}
+
+// replaces empty or the oldest entry
+static gamestate_t *gamestate_alloc(void)
+{
+    gamestate_t *g, *oldest;
+    int i;
+
+    if (sv.state != ss_game) {
+        return NULL;
+    }
+
+    oldest = sv_gamestates;
+    for (i = 0, g = sv_gamestates; i < GAMESTATE_CACHE_SIZE; i++, g++) {
+        if (!g->data) {
+            oldest = g;
+            break;
+        }
+        if (g->time < oldest->time) {
+            oldest = g;
+        }
+    }
+
+    g = oldest;
+    gamestate_free(g);
+    g->spawncount = sv.spawncount;
+    g->time = svs.realtime;
+    g->protocol = sv_client->protocol;
+    g->version = sv_client->version;
+    g->esFlags = sv_client->esFlags;
+    g->type = sv_client->netchan->type;
+    g->maxpacketlen = sv_client->netchan->maxpacketlen;
+    return g;
+}
+
+static void gamestate_save_baselines(gamestate_t *g)
+{
+    entity_packed_t *base, *out;
+    int i, j, count;
+
+    count = 0;
+    for (i = 0; i < SV_BASELINES_CHUNKS; i++) {
+        base = sv_client->baselines[i];
+        if (!base) {
+            continue;
+        }
+        for (j = 0; j < SV_BASELINES_PER_CHUNK; j++, base++) {
+            if (base->number) {
+                count++;
+            }
+        }
+    }
+
+    g->numbaselines = count;
+    g->baselines = out = SV_Malloc(sizeof(*out) * count + 1);
+    for (i = 0; i < SV_BASELINES_CHUNKS; i++) {
+        base = sv_client->baselines[i];
+        if (!base) {
+            continue;
+        }
+        for (j = 0; j < SV_BASELINES_PER_CHUNK; j++, base++) {
+            if (base->number) {
+                *out++ = *base;
+            }
+        }
+    }
+}
+
+static void gamestate_load_baselines(const gamestate_t *g)
+{
+    const entity_packed_t *base;
+    entity_packed_t **chunk;
+    int i;
+
+    clear_baselines();
+
+    for (i = 0, base = g->baselines; i < g->numbaselines; i++, base++) {
+        chunk = &sv_client->baselines[base->number >> SV_BASELINES_SHIFT];
+        if (*chunk == NULL) {
+            *chunk = SV_Mallocz(sizeof(*base) * SV_BASELINES_PER_CHUNK);
+        }
+        (*chunk)[base->number & SV_BASELINES_MASK] = *base;
+    }
+}
+
+// appends length prefixed message
+static void gamestate_append(gamestate_t *g, const byte *data, size_t len)
+{
+    byte *p;
+
+    if (g->data)
+        g->data = Z_Realloc(g->data, g->size + 2 + len);
+    else
+        g->data = SV_Malloc(2 + len);
+    p = g->data + g->size;
+    p[0] = len & 255;
+    p[1] = (len >> 8) & 255;
+    memcpy(p + 2, data, len);
+    g->size += 2 + len;
+}
+
+static void write_cached_messages(const gamestate_t *g)
+{
+    const byte *p, *end;
+    size_t len;
+
+    p = g->data;
+    end = p + g->size;
+    while (p < end) {
+        len = p[0] | (p[1] << 8);
+        MSG_WriteData(p + 2, len);
+        SV_ClientAddMessage(sv_client, MSG_RELIABLE | MSG_CLEAR);
+        p += 2 + len;
+    }
+}
+
 static void write_compressed_gamestate(void)
 {
     sizebuf_t   *buf = &sv_client->netchan->message;
     entity_packed_t  *base;
     int         i, j;
-    size_t      length;
+    size_t      length, start;
     uint8_t     *patch;
     char        *string;
+    gamestate_t *g;
+
+    g = gamestate_find();
+    if (g) {
+        if (g->size > buf->maxsize - buf->cursize) {
+            SV_DropClient(sv_client, "oversize gamestate");
+            return;
+        }
+        SV_DPrintf(0, "%s: cached gamestate: %"PRIz" bytes\n",
+                   sv_client->name, g->size);
+        SZ_Write(buf, g->data, g->size);
+        gamestate_load_baselines(g);
+        return;
+    }
 
     MSG_WriteByte(svc_gamestate);
 
@@ -200,6 +425,7 @@ static void write_compressed_gamestate(void)
     }
     MSG_WriteShort(0);   // end of baselines
 
+    start = buf->cursize;
     SZ_WriteByte(buf, svc_zpacket);
     patch = SZ_GetSpace(buf, 2);
     SZ_WriteShort(buf, msg_write.cursize);
@@ -222,9 +448,18 @@ static void write_compressed_gamestate(void)
     patch[0] = svs.z.total_out & 255;
     patch[1] = (svs.z.total_out >> 8) & 255;
     buf->cursize += svs.z.total_out;
+
+    // save for other clients
+    g = gamestate_alloc();
+    if (g) {
+        g->size = buf->cursize - start;
+        g->data = SV_Malloc(g->size);
+        memcpy(g->data, buf->data + start, g->size);
+        gamestate_save_baselines(g);
+    }
 }
 
-static inline int z_flush(byte *buffer)
+static inline int z_flush(byte *buffer, gamestate_t *g)
 {
     int ret;
 
@@ -241,6 +476,10 @@ static inline int z_flush(byte *buffer)
     MSG_WriteShort(svs.z.total_in);
     MSG_WriteData(buffer, svs.z.total_out);
 
+    if (g) {
+        gamestate_append(g, msg_write.data, msg_write.cursize);
+    }
+
     SV_ClientAddMessage(sv_client, MSG_RELIABLE | MSG_CLEAR);
 
     return ret;
@@ -259,6 +498,17 @@ static void write_compressed_configstrings(void)
     size_t  length;
     byte    buffer[MAX_PACKETLEN_WRITABLE];
     char    *string;
+    gamestate_t *g;
+
+    g = gamestate_find();
+    if (g) {
+        SV_DPrintf(0, "%s: cached configstrings: %"PRIz" bytes\n",
+                   sv_client->name, g->size);
+        write_cached_messages(g);
+        return;
+    }
+
+    g = gamestate_alloc();
 
     z_reset(buffer);
 
@@ -276,7 +526,7 @@ static void write_compressed_configstrings(void)
         // check if this configstring will overflow
         if (svs.z.avail_out < length + 32) {
             // then flush compressed data
-            if (z_flush(buffer) != Z_STREAM_END) {
+            if (z_flush(buffer, g) != Z_STREAM_END) {
                 goto fail;
             }
             z_reset(buffer);
@@ -297,8 +547,11 @@ static void write_compressed_configstrings(void)
     }
 
     // finally flush all remaining compressed data
-    if (z_flush(buffer) != Z_STREAM_END) {
+    if (z_flush(buffer, g) != Z_STREAM_END) {
 fail:
+        if (g) {
+            gamestate_free(g);
+        }
         SV_DropClient(sv_client, "deflate() failed on configstrings");
     }
 }
@@ -534,12 +787,180 @@ void SV_Begin_f(void)
 
 //=============================================================================
 
+/*
+==============================================================================
+
+DOWNLOAD CACHE
+
+Files being downloaded are read into memory once and shared between all
+clients downloading the same file. Entries are keyed by path, modification
+time, size and transfer type (raw or deflated), reference counted by
+clients streaming from them, and kept around after last reference is
+dropped until total size exceeds sv_download_cache_size.
+
+==============================================================================
+*/
+
+typedef struct dlcache_s {
+    list_t      entry;
+    unsigned    refcount;
+    time_t      mtime;
+    int         cmd;        // svc_download or svc_zdownload
+    size_t      size;
+    byte        *data;
+    char        path[1];
+} dlcache_t;
+
+static LIST_DECL(sv_dlcache);   // in LRU order, most recently used last
+static size_t   dlcache_bytes;
+static unsigned dlcache_hits;
+static unsigned dlcache_misses;
+
+static void dlcache_free(dlcache_t *e)
+{
+    List_Remove(&e->entry);
+    dlcache_bytes -= e->size;
+    Z_Free(e->data);
+    Z_Free(e);
+}
+
+// evicts least recently used unreferenced entries until total size fits
+static void dlcache_trim(size_t limit)
+{
+    dlcache_t *e, *next;
+
+    LIST_FOR_EACH_SAFE(dlcache_t, e, next, &sv_dlcache, entry) {
+        if (dlcache_bytes <= limit)
+            break;
+        if (!e->refcount)
+            dlcache_free(e);
+    }
+}
+
+static size_t dlcache_limit(void)
+{
+    return Cvar_ClampInteger(sv_download_cache_size, 0, 4096) * 0x100000;
+}
+
+static dlcache_t *dlcache_find(const char *path, int cmd, time_t mtime, size_t size)
+{
+    dlcache_t *e, *next;
+
+    LIST_FOR_EACH_SAFE(dlcache_t, e, next, &sv_dlcache, entry) {
+        if (e->cmd != cmd || FS_pathcmp(e->path, path))
+            continue;
+        if (e->mtime == mtime && e->size == size)
+            return e;
+        // file has changed on disk, drop stale copy
+        if (!e->refcount)
+            dlcache_free(e);
+    }
+
+    return NULL;
+}
+
+// returns referenced cache entry for the file, reading it in if needed
+static dlcache_t *dlcache_acquire(const char *path, int cmd, size_t size, qhandle_t f)
+{
+    dlcache_t *e;
+    time_t mtime;
+    size_t len;
+
+    if (FS_ModTime(f, &mtime))
+        mtime = 0;
+
+    e = dlcache_find(path, cmd, mtime, size);
+    if (e) {
+        List_Remove(&e->entry);
+        dlcache_hits++;
+    } else {
+        len = strlen(path);
+        e = SV_Malloc(sizeof(*e) + len);
+        e->refcount = 0;
+        e->mtime = mtime;
+        e->cmd = cmd;
+        e->size = size;
+        e->data = SV_Malloc(size);
+        memcpy(e->path, path, len + 1);
+
+        if (FS_Read(e->data, size, f) != (ssize_t)size) {
+            Z_Free(e->data);
+            Z_Free(e);
+            return NULL;
+        }
+
+        dlcache_bytes += size;
+        dlcache_misses++;
+    }
+
+    List_Append(&sv_dlcache, &e->entry);
+    e->refcount++;
+
+    dlcache_trim(dlcache_limit());
+    return e;
+}
+
+static void dlcache_release(dlcache_t *e)
+{
+    if (!e->refcount)
+        Com_Error(ERR_FATAL, "%s: refcount already zero", __func__);
+
+    e->refcount--;
+
+    dlcache_trim(dlcache_limit());
+}
+
+/*
+==================
+SV_FlushDownloadCache
+
+Frees all unreferenced cache entries.
+==================
+*/
+void SV_FlushDownloadCache(void)
+{
+    dlcache_trim(0);
+}
+
+/*
+==================
+SV_DownloadCache_f
+==================
+*/
+void SV_DownloadCache_f(void)
+{
+    dlcache_t *e;
+    int count = 0;
+    unsigned refs = 0;
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "flush")) {
+        SV_FlushDownloadCache();
+    }
+
+    if (!LIST_EMPTY(&sv_dlcache)) {
+        Com_Printf("refs size     type path\n"
+                   "---- -------- ---- ----\n");
+        LIST_FOR_EACH(dlcache_t, e, &sv_dlcache, entry) {
+            Com_Printf("%4u %8"PRIz" %-4s %s\n", e->refcount, e->size,
+                       e->cmd == svc_zdownload ? "zlib" : "raw", e->path);
+            refs += e->refcount;
+            count++;
+        }
+    }
+
+    Com_Printf("%d entries, %u refs, %"PRIz" of %"PRIz" bytes, %u hits, %u misses\n",
+               count, refs, dlcache_bytes, dlcache_limit(), dlcache_hits, dlcache_misses);
+}
+
+//=============================================================================
+
 void SV_CloseDownload(client_t *client)
 {
-    if (client->download) {
-        Z_Free(client->download);
-        client->download = NULL;
+    if (client->downloadcache) {
+        dlcache_release(client->downloadcache);
+        client->downloadcache = NULL;
     }
+    client->download = NULL;
     if (client->downloadname) {
         Z_Free(client->downloadname);
         client->downloadname = NULL;
@@ -571,9 +992,9 @@ SV_BeginDownload_f
 static void SV_BeginDownload_f(void)
 {
     char    name[MAX_QPATH];
-    byte    *download;
+    dlcache_t *download;
     int     downloadcmd;
-    ssize_t downloadsize, maxdownloadsize, result;
+    ssize_t downloadsize, maxdownloadsize;
     int     offset = 0;
     cvar_t  *allow;
     size_t  len;
@@ -702,16 +1123,16 @@ static void SV_BeginDownload_f(void)
         return;
     }
 
-    download = SV_Malloc(downloadsize);
-    result = FS_Read(download, downloadsize, f);
-    if (result != downloadsize) {
+    download = dlcache_acquire(name, downloadcmd, downloadsize, f);
+    if (!download) {
         Com_DPrintf("Couldn't download %s to %s\n", name, sv_client->name);
-        goto fail3;
+        goto fail2;
     }
 
     FS_FCloseFile(f);
 
-    sv_client->download = download;
+    sv_client->downloadcache = download;
+    sv_client->download = download->data;
     sv_client->downloadsize = downloadsize;
     sv_client->downloadcount = offset;
     sv_client->downloadname = SV_CopyString(name);
@@ -721,8 +1142,6 @@ static void SV_BeginDownload_f(void)
     Com_DPrintf("Downloading %s to %s\n", name, sv_client->name);
     return;
 
-fail3:
-    Z_Free(download);
 fail2:
     FS_FCloseFile(f);
 fail1:
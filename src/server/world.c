@@ -30,31 +30,87 @@ FIXME: this use of "area" is different from the bsp file use
 
 typedef struct areanode_s {
     int     axis;       // -1 = leaf node
+    int     depth;
+    int     numedicts;  // total linked in this subtree
     float   dist;
+    struct areanode_s   *parent;
     struct areanode_s   *children[2];
     list_t  trigger_edicts;
     list_t  solid_edicts;
 } areanode_t;
 
-#define    AREA_DEPTH    4
-#define    AREA_NODES    32
+// Adaptive tree is subdivided until leaf nodes are at most AREA_CELL_SIZE
+// units wide. Its nodes are loose: each child extends AREA_MARGIN units past
+// the split plane, so that small entities straddling the split are still
+// pushed down the tree instead of piling up in the top nodes.
+#define AREA_MAX_DEPTH  8
+#define AREA_MAX_NODES  (1 << (AREA_MAX_DEPTH + 1))
+#define AREA_CELL_SIZE  512
+#define AREA_MARGIN     32
 
-static areanode_t   sv_areanodes[AREA_NODES];
+static areanode_t   sv_areanodes[AREA_MAX_NODES];
 static int          sv_numareanodes;
+static int          sv_areadepth;
+static float        sv_areamargin;
 
 static float    *area_mins, *area_maxs;
 static edict_t  **area_list;
 static int      area_count, area_maxcount;
 static int      area_type;
 
+static struct {
+    uint64_t    queries;
+    uint64_t    nodes;
+    uint64_t    candidates;
+    uint64_t    results;
+} area_stats;
+
+static struct {
+    uint64_t    full;
+    uint64_t    skipped;
+    int         framenum;
+} link_stats;
+
+// memoized SV_Trace results, valid until a solid entity is linked or
+// unlinked within bounds of the move, or until the next server frame
+#define TRACE_CACHE_SIZE    256     // must be power of two
+
+typedef struct {
+    vec3_t      start, end;
+    vec3_t      mins, maxs;
+    edict_t     *passedict;
+    edict_t     *passowner;
+    int         contentmask;
+    int         pad;
+} tracekey_t;
+
+typedef struct {
+    tracekey_t  key;
+    unsigned    generation;
+    vec3_t      absmins, absmaxs;   // bounds of the entire move
+    trace_t     trace;
+} tracecache_t;
+
+static tracecache_t trace_cache[TRACE_CACHE_SIZE];
+static unsigned     trace_generation;
+static qboolean     trace_cache_dirty;
+
+static struct {
+    uint64_t    hits;
+    uint64_t    misses;
+    uint64_t    invalidated;
+    int         framenum;
+} trace_stats;
+
 /*
 ===============
 SV_CreateAreaNode
 
-Builds a uniformly subdivided tree for the given world size
+Builds a tree for the given world size. Tree is either uniformly subdivided
+down to the fixed depth, or adaptively subdivided down to AREA_CELL_SIZE.
 ===============
 */
-static areanode_t *SV_CreateAreaNode(int depth, vec3_t mins, vec3_t maxs)
+static areanode_t *SV_CreateAreaNode(areanode_t *parent, int depth, vec3_t mins, vec3_t maxs)
 {
     areanode_t  *anode;
     vec3_t      size;
@@ -65,12 +121,8 @@ static areanode_t *SV_CreateAreaNode(int depth, vec3_t mins, vec3_t maxs)
 
     List_Init(&anode->trigger_edicts);
     List_Init(&anode->solid_edicts);
-
-    if (depth == AREA_DEPTH) {
-        anode->axis = -1;
-        anode->children[0] = anode->children[1] = NULL;
-        return anode;
-    }
+    anode->depth = depth;
+    anode->parent = parent;
 
     VectorSubtract(maxs, mins, size);
     if (size[0] > size[1])
@@ -78,6 +130,20 @@ static areanode_t *SV_CreateAreaNode(int depth, vec3_t mins, vec3_t maxs)
     else
         anode->axis = 1;
 
+    if (sv_areamargin) {
+        // tall maps benefit from vertical subdivision, too
+        if (size[2] > size[anode->axis])
+            anode->axis = 2;
+        if (size[anode->axis] <= AREA_CELL_SIZE)
+            depth = sv_areadepth;
+    }
+
+    if (depth == sv_areadepth) {
+        anode->axis = -1;
+        anode->children[0] = anode->children[1] = NULL;
+        return anode;
+    }
+
     anode->dist = 0.5 * (maxs[anode->axis] + mins[anode->axis]);
     VectorCopy(mins, mins1);
     VectorCopy(mins, mins2);
@@ -86,8 +152,8 @@ static areanode_t *SV_CreateAreaNode(int depth, vec3_t mins, vec3_t maxs)
 
     maxs1[anode->axis] = mins2[anode->axis] = anode->dist;
 
-    anode->children[0] = SV_CreateAreaNode(depth + 1, mins2, maxs2);
-    anode->children[1] = SV_CreateAreaNode(depth + 1, mins1, maxs1);
+    anode->children[0] = SV_CreateAreaNode(anode, depth + 1, mins2, maxs2);
+    anode->children[1] = SV_CreateAreaNode(anode, depth + 1, mins1, maxs1);
 
     return anode;
 }
@@ -105,17 +171,218 @@ void SV_ClearWorld(void)
     int i;
 
     memset(sv_areanodes, 0, sizeof(sv_areanodes));
+    memset(&area_stats, 0, sizeof(area_stats));
+    memset(&link_stats, 0, sizeof(link_stats));
+    memset(&trace_stats, 0, sizeof(trace_stats));
+    memset(trace_cache, 0, sizeof(trace_cache));
+    trace_generation = 1;
+    trace_cache_dirty = qfalse;
     sv_numareanodes = 0;
 
+    // zero means adaptive loose tree, otherwise uniform tree of fixed depth
+    sv_areadepth = Cvar_ClampInteger(sv_area_depth, 0, AREA_MAX_DEPTH);
+    if (sv_areadepth) {
+        sv_areamargin = 0;
+    } else {
+        sv_areadepth = AREA_MAX_DEPTH;
+        sv_areamargin = AREA_MARGIN;
+    }
+
     if (sv.cm.cache) {
         cm = &sv.cm.cache->models[0];
-        SV_CreateAreaNode(0, cm->mins, cm->maxs);
+        SV_CreateAreaNode(NULL, 0, cm->mins, cm->maxs);
     }
 
     // make sure all entities are unlinked
     for (i = 0; i < ge->max_edicts; i++) {
         ent = EDICT_NUM(i);
         ent->area.prev = ent->area.next = NULL;
+        sv.entities[i].linkvalid = qfalse;
+    }
+}
+
+/*
+===============
+SV_AreaStats_f
+
+Prints area tree occupancy and query statistics.
+===============
+*/
+void SV_AreaStats_f(void)
+{
+    int         solid[AREA_MAX_DEPTH + 1];
+    int         trigger[AREA_MAX_DEPTH + 1];
+    int         nodes[AREA_MAX_DEPTH + 1];
+    areanode_t  *node;
+    uint64_t    queries;
+    int         i;
+
+    if (!sv.cm.cache || !sv_numareanodes) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&area_stats, 0, sizeof(area_stats));
+        return;
+    }
+
+    memset(solid, 0, sizeof(solid));
+    memset(trigger, 0, sizeof(trigger));
+    memset(nodes, 0, sizeof(nodes));
+
+    for (i = 0, node = sv_areanodes; i < sv_numareanodes; i++, node++) {
+        nodes[node->depth]++;
+        solid[node->depth] += List_Count(&node->solid_edicts);
+        trigger[node->depth] += List_Count(&node->trigger_edicts);
+    }
+
+    Com_Printf("%s area tree, %d nodes\n",
+               sv_areamargin ? "Adaptive" : "Uniform", sv_numareanodes);
+    Com_Printf("depth nodes solid trigger\n"
+               "----- ----- ----- -------\n");
+    for (i = 0; i <= sv_areadepth; i++) {
+        if (nodes[i]) {
+            Com_Printf("%5d %5d %5d %7d\n", i, nodes[i], solid[i], trigger[i]);
+        }
+    }
+
+    queries = area_stats.queries ? area_stats.queries : 1;
+    Com_Printf("%"PRIu64" queries, per query: %.1f nodes, "
+               "%.1f candidates, %.1f results\n", area_stats.queries,
+               (double)area_stats.nodes / queries,
+               (double)area_stats.candidates / queries,
+               (double)area_stats.results / queries);
+}
+
+/*
+===============
+SV_LinkStats_f
+
+Prints number of full and skipped entity links.
+===============
+*/
+void SV_LinkStats_f(void)
+{
+    uint64_t    total;
+    int         frames;
+
+    if (!sv.cm.cache) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&link_stats, 0, sizeof(link_stats));
+        link_stats.framenum = sv.framenum;
+        return;
+    }
+
+    total = link_stats.full + link_stats.skipped;
+    frames = sv.framenum - link_stats.framenum;
+    if (frames < 1)
+        frames = 1;
+
+    Com_Printf("%"PRIu64" links, %"PRIu64" full, %"PRIu64" skipped (%.1f%%)\n",
+               total, link_stats.full, link_stats.skipped,
+               total ? link_stats.skipped * 100.0 / total : 0.0);
+    Com_Printf("per frame: %.1f full, %.1f skipped\n",
+               (double)link_stats.full / frames,
+               (double)link_stats.skipped / frames);
+}
+
+/*
+===============
+SV_TraceStats_f
+
+Prints trace cache hit rate.
+===============
+*/
+void SV_TraceStats_f(void)
+{
+    uint64_t    total;
+    int         frames;
+
+    if (!sv.cm.cache) {
+        Com_Printf("No map loaded.\n");
+        return;
+    }
+
+    if (Cmd_Argc() > 1 && !strcmp(Cmd_Argv(1), "reset")) {
+        memset(&trace_stats, 0, sizeof(trace_stats));
+        trace_stats.framenum = sv.framenum;
+        return;
+    }
+
+    if (!sv_trace_cache->integer) {
+        Com_Printf("Trace cache is disabled.\n");
+    }
+
+    total = trace_stats.hits + trace_stats.misses;
+    frames = sv.framenum - trace_stats.framenum;
+    if (frames < 1)
+        frames = 1;
+
+    Com_Printf("%"PRIu64" traces, %"PRIu64" hits (%.1f%%), %"PRIu64" misses\n",
+               total, trace_stats.hits,
+               total ? trace_stats.hits * 100.0 / total : 0.0,
+               trace_stats.misses);
+    Com_Printf("per frame: %.1f traces, %.1f hits, %.1f invalidated\n",
+               (double)total / frames,
+               (double)trace_stats.hits / frames,
+               (double)trace_stats.invalidated / frames);
+}
+
+/*
+===============
+SV_FlushTraceCache
+
+Invalidates all cached traces. Called at the start of each server frame,
+since game may have changed entities without relinking them.
+===============
+*/
+void SV_FlushTraceCache(void)
+{
+    if (!trace_cache_dirty)
+        return;
+
+    trace_cache_dirty = qfalse;
+
+    if (++trace_generation == 0) {
+        memset(trace_cache, 0, sizeof(trace_cache));
+        trace_generation = 1;
+    }
+}
+
+/*
+===============
+SV_InvalidateTraces
+
+Invalidates cached traces that could have been affected by solid entity
+with the given bounds. Entities outside bounds of the move are never
+clipped against, so other traces remain valid.
+===============
+*/
+static void SV_InvalidateTraces(const vec3_t mins, const vec3_t maxs)
+{
+    tracecache_t    *entry;
+    int             i;
+
+    if (!trace_cache_dirty)
+        return;
+
+    for (i = 0, entry = trace_cache; i < TRACE_CACHE_SIZE; i++, entry++) {
+        if (entry->generation != trace_generation)
+            continue;
+        if (mins[0] > entry->absmaxs[0]
+            || mins[1] > entry->absmaxs[1]
+            || mins[2] > entry->absmaxs[2]
+            || maxs[0] < entry->absmins[0]
+            || maxs[1] < entry->absmins[1]
+            || maxs[2] < entry->absmins[2])
+            continue;
+        entry->generation = 0;
+        trace_stats.invalidated++;
     }
 }
 
@@ -126,7 +393,7 @@ SV_EdictIsVisible
 Checks if edict is potentially visible from the given PVS row.
 ===============
 */
-qboolean SV_EdictIsVisible(cm_t *cm, edict_t *ent, byte *mask)
+qboolean SV_EdictIsVisible(cm_t *cm, edict_t *ent, const byte *mask)
 {
     int i;
 
@@ -153,15 +420,8 @@ General purpose routine shared between game DLL and MVD code.
 Links entity to PVS leafs.
 ===============
 */
-void SV_LinkEdict(cm_t *cm, edict_t *ent)
+static void SV_SetEdictBounds(edict_t *ent)
 {
-    mleaf_t     *leafs[MAX_TOTAL_ENT_LEAFS];
-    int         clusters[MAX_TOTAL_ENT_LEAFS];
-    int         num_leafs;
-    int         i, j;
-    int         area;
-    mnode_t     *topnode;
-
     // set the size
     VectorSubtract(ent->maxs, ent->mins, ent->size);
 
@@ -199,6 +459,16 @@ void SV_LinkEdict(cm_t *cm, edict_t *ent)
     ent->absmax[0] += 1;
     ent->absmax[1] += 1;
     ent->absmax[2] += 1;
+}
+
+static void SV_FindEdictLeafs(cm_t *cm, edict_t *ent)
+{
+    mleaf_t     *leafs[MAX_TOTAL_ENT_LEAFS];
+    int         clusters[MAX_TOTAL_ENT_LEAFS];
+    int         num_leafs;
+    int         i, j;
+    int         area;
+    mnode_t     *topnode;
 
 // link to PVS leafs
     ent->num_clusters = 0;
@@ -253,12 +523,66 @@ void SV_LinkEdict(cm_t *cm, edict_t *ent)
     }
 }
 
+void SV_LinkEdict(cm_t *cm, edict_t *ent)
+{
+    SV_SetEdictBounds(ent);
+    SV_FindEdictLeafs(cm, ent);
+}
+
+/*
+===============
+SV_LinkEdictCached
+
+Links entity to PVS leafs, reusing results of the last full link if
+absolute bounds didn't change. Game may have cleared edict in between,
+so cached results are always copied back.
+===============
+*/
+static void SV_LinkEdictCached(edict_t *ent, server_entity_t *sent)
+{
+    SV_SetEdictBounds(ent);
+
+    if (sent->linkvalid &&
+        VectorCompare(ent->absmin, sent->linkmins) &&
+        VectorCompare(ent->absmax, sent->linkmaxs)) {
+        ent->num_clusters = sent->num_clusters;
+        memcpy(ent->clusternums, sent->clusternums, sizeof(ent->clusternums));
+        ent->headnode = sent->headnode;
+        ent->areanum = sent->areanum;
+        ent->areanum2 = sent->areanum2;
+        link_stats.skipped++;
+        return;
+    }
+
+    SV_FindEdictLeafs(&sv.cm, ent);
+
+    sent->linkvalid = qtrue;
+    VectorCopy(ent->absmin, sent->linkmins);
+    VectorCopy(ent->absmax, sent->linkmaxs);
+    sent->num_clusters = ent->num_clusters;
+    memcpy(sent->clusternums, ent->clusternums, sizeof(sent->clusternums));
+    sent->headnode = ent->headnode;
+    sent->areanum = ent->areanum;
+    sent->areanum2 = ent->areanum2;
+    sent->areanode = NULL;   // find it again
+    link_stats.full++;
+}
+
 void PF_UnlinkEdict(edict_t *ent)
 {
+    areanode_t *node;
+
     if (!ent->area.prev)
         return;        // not linked in anywhere
     List_Remove(&ent->area);
     ent->area.prev = ent->area.next = NULL;
+
+    if (sv.entities[NUM_FOR_EDICT(ent)].areasolid)
+        SV_InvalidateTraces(ent->absmin, ent->absmax);
+
+    node = sv.entities[NUM_FOR_EDICT(ent)].areanode;
+    for (; node; node = node->parent)
+        node->numedicts--;
 }
 
 void PF_LinkEdict(edict_t *ent)
@@ -309,7 +633,7 @@ void PF_LinkEdict(edict_t *ent)
         break;
     }
 
-    SV_LinkEdict(&sv.cm, ent);
+    SV_LinkEdictCached(ent, sent);
 
     // if first time, make sure old_origin is valid
     if (!ent->linkcount) {
@@ -331,24 +655,40 @@ void PF_LinkEdict(edict_t *ent)
     if (ent->solid == SOLID_NOT)
         return;
 
-// find the first node that the ent's box crosses
-    node = sv_areanodes;
-    while (1) {
-        if (node->axis == -1)
-            break;
-        if (ent->absmin[node->axis] > node->dist)
-            node = node->children[0];
-        else if (ent->absmax[node->axis] < node->dist)
-            node = node->children[1];
-        else
-            break;        // crosses the node
+// find the first node that the ent's box crosses,
+// unless it was already found for the same bounds
+    node = sent->areanode;
+    if (!node) {
+        node = sv_areanodes;
+        while (1) {
+            if (node->axis == -1)
+                break;
+            if (ent->absmin[node->axis] > node->dist)
+                node = node->children[0];
+            else if (ent->absmax[node->axis] < node->dist)
+                node = node->children[1];
+            else if (ent->absmin[node->axis] > node->dist - sv_areamargin)
+                node = node->children[0];
+            else if (ent->absmax[node->axis] < node->dist + sv_areamargin)
+                node = node->children[1];
+            else
+                break;        // crosses the node
+        }
     }
 
     // link it in
-    if (ent->solid == SOLID_TRIGGER)
+    if (ent->solid == SOLID_TRIGGER) {
         List_Append(&node->trigger_edicts, &ent->area);
-    else
+        sent->areasolid = qfalse;
+    } else {
         List_Append(&node->solid_edicts, &ent->area);
+        sent->areasolid = qtrue;
+        SV_InvalidateTraces(ent->absmin, ent->absmax);
+    }
+
+    sent->areanode = node;
+    for (; node; node = node->parent)
+        node->numedicts++;
 }
 
 
@@ -363,6 +703,11 @@ static void SV_AreaEdicts_r(areanode_t *node)
     list_t      *start;
     edict_t     *check;
 
+    if (!node->numedicts)
+        return;        // empty subtree
+
+    area_stats.nodes++;
+
     // touch linked edicts
     if (area_type == AREA_SOLID)
         start = &node->solid_edicts;
@@ -370,6 +715,7 @@ static void SV_AreaEdicts_r(areanode_t *node)
         start = &node->trigger_edicts;
 
     LIST_FOR_EACH(edict_t, check, start, area) {
+        area_stats.candidates++;
         if (check->solid == SOLID_NOT)
             continue;        // deactivated
         if (check->absmin[0] > area_maxs[0]
@@ -393,9 +739,9 @@ static void SV_AreaEdicts_r(areanode_t *node)
         return;        // terminal node
 
     // recurse down both sides
-    if (area_maxs[node->axis] > node->dist)
+    if (area_maxs[node->axis] > node->dist - sv_areamargin)
         SV_AreaEdicts_r(node->children[0]);
-    if (area_mins[node->axis] < node->dist)
+    if (area_mins[node->axis] < node->dist + sv_areamargin)
         SV_AreaEdicts_r(node->children[1]);
 }
 
@@ -416,6 +762,9 @@ int SV_AreaEdicts(vec3_t mins, vec3_t maxs, edict_t **list,
 
     SV_AreaEdicts_r(sv_areanodes);
 
+    area_stats.queries++;
+    area_stats.results += area_count;
+
     return area_count;
 }
 
@@ -535,6 +884,73 @@ static void SV_ClipMoveToEntities(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t
     }
 }
 
+static void SV_ClipMove(trace_t *trace, vec3_t start, vec3_t mins, vec3_t maxs,
+                        vec3_t end, edict_t *passedict, int contentmask)
+{
+    // clip to world
+    CM_BoxTrace(trace, start, end, mins, maxs, sv.cm.cache->nodes, contentmask);
+    trace->ent = ge->edicts;
+    if (trace->fraction == 0) {
+        return;     // blocked by the world
+    }
+
+    // clip to other solid entities
+    SV_ClipMoveToEntities(start, mins, maxs, end, passedict, contentmask, trace);
+}
+
+/*
+==================
+SV_CachedClipMove
+
+Returns result of the identical trace made earlier if no solid entities
+were linked or unlinked near it since then, otherwise performs the trace
+and remembers result. Owner of passedict is part of the key, since it is
+excluded from clipping too.
+==================
+*/
+static void SV_CachedClipMove(trace_t *trace, vec3_t start, vec3_t mins, vec3_t maxs,
+                              vec3_t end, edict_t *passedict, int contentmask)
+{
+    tracekey_t      key;
+    tracecache_t    *entry;
+    uint32_t        hash, *w;
+    int             i;
+
+    memset(&key, 0, sizeof(key));
+    VectorCopy(start, key.start);
+    VectorCopy(end, key.end);
+    VectorCopy(mins, key.mins);
+    VectorCopy(maxs, key.maxs);
+    key.passedict = passedict;
+    key.passowner = passedict ? passedict->owner : NULL;
+    key.contentmask = contentmask;
+
+    hash = 2166136261;
+    for (i = 0, w = (uint32_t *)&key; i < sizeof(key) / sizeof(*w); i++, w++)
+        hash = (hash ^ *w) * 16777619;
+
+    entry = &trace_cache[(hash ^ (hash >> 16)) & (TRACE_CACHE_SIZE - 1)];
+    if (entry->generation == trace_generation && !memcmp(&entry->key, &key, sizeof(key))) {
+        *trace = entry->trace;
+        trace_stats.hits++;
+        return;
+    }
+
+    SV_ClipMove(trace, start, mins, maxs, end, passedict, contentmask);
+
+    // same bounds as used by SV_ClipMoveToEntities
+    for (i = 0; i < 3; i++) {
+        entry->absmins[i] = min(start[i], end[i]) + mins[i] - 1;
+        entry->absmaxs[i] = max(start[i], end[i]) + maxs[i] + 1;
+    }
+
+    entry->key = key;
+    entry->generation = trace_generation;
+    entry->trace = *trace;
+    trace_cache_dirty = qtrue;
+    trace_stats.misses++;
+}
+
 /*
 ==================
 SV_Trace
@@ -568,14 +984,10 @@ trace_t q_gameabi SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
     if (!maxs)
         maxs = vec3_origin;
 
-    // clip to world
-    CM_BoxTrace(&trace, start, end, mins, maxs, sv.cm.cache->nodes, contentmask);
-    trace.ent = ge->edicts;
-    if (trace.fraction == 0) {
-        return trace;   // blocked by the world
-    }
+    if (sv_trace_cache->integer)
+        SV_CachedClipMove(&trace, start, mins, maxs, end, passedict, contentmask);
+    else
+        SV_ClipMove(&trace, start, mins, maxs, end, passedict, contentmask);
 
-    // clip to other solid entities
-    SV_ClipMoveToEntities(start, mins, maxs, end, passedict, contentmask, &trace);
     return trace;
 }
@@ -38,9 +38,7 @@ with this program; if not, write to the Free Software Foundation, Inc.,
 #include <dlfcn.h>
 #include <errno.h>
 
-#if USE_CLIENT
 #include <pthread.h>
-#endif
 
 #if USE_SDL
 #include <SDL.h>
@@ -57,110 +55,240 @@ static qboolean flush_logs;
 /*
 ===============================================================================
 
-ASYNC WORK QUEUE
+THREADS AND SYNCHRONIZATION
 
 ===============================================================================
 */
 
-#if USE_CLIENT
+struct systhread_s {
+    pthread_t   thread;
+    void        (*func)(void *);
+    void        *arg;
+};
+
+struct sysmutex_s {
+    pthread_mutex_t mutex;
+};
 
-static qboolean work_initialized;
-static qboolean work_terminate;
-static pthread_mutex_t work_lock;
-static pthread_cond_t work_cond;
-static pthread_t work_thread;
-static asyncwork_t *pend_head;
-static asyncwork_t *done_head;
+struct syssem_s {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             count;
+};
 
-static void append_work(asyncwork_t **head, asyncwork_t *work)
+static void *thread_start(void *arg)
 {
-    asyncwork_t *c, **p;
-    for (p = head, c = *head; c; p = &c->next, c = c->next);
-    work->next = NULL;
-    *p = work;
+    systhread_t *thread = arg;
+
+    thread->func(thread->arg);
+    return NULL;
 }
 
-static void complete_work(void)
+systhread_t *Sys_CreateThread(void (*func)(void *), void *arg)
 {
-    asyncwork_t *work, *next;
+    systhread_t *thread = Z_Malloc(sizeof(*thread));
 
-    if (!work_initialized)
-        return;
-    if (pthread_mutex_trylock(&work_lock))
-        return;
-    if (q_unlikely(done_head)) {
-        for (work = done_head; work; work = next) {
-            next = work->next;
-            if (work->done_cb)
-                work->done_cb(work->cb_arg);
-            Z_Free(work);
-        }
-        done_head = NULL;
+    thread->func = func;
+    thread->arg = arg;
+    if (pthread_create(&thread->thread, NULL, thread_start, thread)) {
+        Z_Free(thread);
+        return NULL;
     }
-    pthread_mutex_unlock(&work_lock);
+
+    return thread;
+}
+
+void Sys_JoinThread(systhread_t *thread)
+{
+    pthread_join(thread->thread, NULL);
+    Z_Free(thread);
+}
+
+sysmutex_t *Sys_CreateMutex(void)
+{
+    sysmutex_t *mutex = Z_Malloc(sizeof(*mutex));
+
+    pthread_mutex_init(&mutex->mutex, NULL);
+    return mutex;
+}
+
+void Sys_DestroyMutex(sysmutex_t *mutex)
+{
+    pthread_mutex_destroy(&mutex->mutex);
+    Z_Free(mutex);
+}
+
+void Sys_LockMutex(sysmutex_t *mutex)
+{
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+void Sys_UnlockMutex(sysmutex_t *mutex)
+{
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+syssem_t *Sys_CreateSemaphore(void)
+{
+    syssem_t *sem = Z_Malloc(sizeof(*sem));
+
+    pthread_mutex_init(&sem->lock, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->count = 0;
+    return sem;
+}
+
+void Sys_DestroySemaphore(syssem_t *sem)
+{
+    pthread_mutex_destroy(&sem->lock);
+    pthread_cond_destroy(&sem->cond);
+    Z_Free(sem);
 }
 
-static void *thread_func(void *arg)
+void Sys_PostSemaphore(syssem_t *sem, int count)
 {
-    pthread_mutex_lock(&work_lock);
+    pthread_mutex_lock(&sem->lock);
+    sem->count += count;
+    if (count > 1)
+        pthread_cond_broadcast(&sem->cond);
+    else
+        pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->lock);
+}
+
+void Sys_WaitSemaphore(syssem_t *sem)
+{
+    pthread_mutex_lock(&sem->lock);
+    while (sem->count <= 0)
+        pthread_cond_wait(&sem->cond, &sem->lock);
+    sem->count--;
+    pthread_mutex_unlock(&sem->lock);
+}
+
+int Sys_NumProcessors(void)
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? count : 1;
+}
+
+/*
+===============================================================================
+
+WORKER THREADS
+
+===============================================================================
+*/
+
+static pthread_mutex_t  pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t   pool_done = PTHREAD_COND_INITIALIZER;
+static pthread_t        pool_threads[MAX_WORKER_THREADS];
+static unsigned         pool_spawned[MAX_WORKER_THREADS];  // generation at spawn time
+static int              pool_numthreads;    // number of spawned threads
+static qboolean         pool_terminate;
+static unsigned         pool_generation;    // incremented for each run
+static int              pool_pending;       // threads still running
+static int              pool_count;         // threads requested for this run
+static void             (*pool_func)(void *, int);
+static void             *pool_arg;
+
+static void *pool_thread_func(void *arg)
+{
+    int index = (int)(intptr_t)arg;
+    unsigned generation;
+
+    pthread_mutex_lock(&pool_lock);
+    generation = pool_spawned[index];
     while (1) {
-        while (!pend_head && !work_terminate)
-            pthread_cond_wait(&work_cond, &work_lock);
+        while (generation == pool_generation && !pool_terminate)
+            pthread_cond_wait(&pool_start, &pool_lock);
 
-        asyncwork_t *work = pend_head;
-        if (!work)
+        if (pool_terminate)
             break;
-        pend_head = work->next;
 
-        pthread_mutex_unlock(&work_lock);
-        work->work_cb(work->cb_arg);
-        pthread_mutex_lock(&work_lock);
+        generation = pool_generation;
+        if (index >= pool_count)
+            continue;
 
-        append_work(&done_head, work);
+        pthread_mutex_unlock(&pool_lock);
+        pool_func(pool_arg, index);
+        pthread_mutex_lock(&pool_lock);
+
+        if (--pool_pending == 0)
+            pthread_cond_signal(&pool_done);
     }
-    pthread_mutex_unlock(&work_lock);
+    pthread_mutex_unlock(&pool_lock);
 
     return NULL;
 }
 
-static void shutdown_work(void)
+static void shutdown_pool(void)
 {
-    if (!work_initialized)
+    int i;
+
+    if (!pool_numthreads)
         return;
 
-    pthread_mutex_lock(&work_lock);
-    work_terminate = qtrue;
-    pthread_cond_signal(&work_cond);
-    pthread_mutex_unlock(&work_lock);
+    pthread_mutex_lock(&pool_lock);
+    pool_terminate = qtrue;
+    pthread_cond_broadcast(&pool_start);
+    pthread_mutex_unlock(&pool_lock);
 
-    pthread_join(work_thread, NULL);
-    complete_work();
+    for (i = 1; i <= pool_numthreads; i++)
+        pthread_join(pool_threads[i], NULL);
 
-    pthread_mutex_destroy(&work_lock);
-    pthread_cond_destroy(&work_cond);
-    work_initialized = qfalse;
+    pool_numthreads = 0;
 }
 
-void Sys_QueueAsyncWork(asyncwork_t *work)
+void Sys_RunThreads(int numthreads, void (*func)(void *, int), void *arg)
 {
-    if (!work_initialized) {
-        pthread_mutex_init(&work_lock, NULL);
-        pthread_cond_init(&work_cond, NULL);
-        if (pthread_create(&work_thread, NULL, thread_func, NULL))
-            Sys_Error("Couldn't create async work thread");
-        work_initialized = qtrue;
+    int i, requested;
+
+    if (numthreads > MAX_WORKER_THREADS)
+        numthreads = MAX_WORKER_THREADS;
+
+    requested = numthreads;
+
+    // spawn more threads as needed, calling thread has index 0
+    pthread_mutex_lock(&pool_lock);
+    while (pool_numthreads < numthreads - 1) {
+        pool_spawned[pool_numthreads + 1] = pool_generation;
+        if (pthread_create(&pool_threads[pool_numthreads + 1], NULL,
+                           pool_thread_func, (void *)(intptr_t)(pool_numthreads + 1))) {
+            Com_EPrintf("Couldn't create worker thread\n");
+            numthreads = pool_numthreads + 1;
+            break;
+        }
+        pool_numthreads++;
     }
 
-    pthread_mutex_lock(&work_lock);
-    append_work(&pend_head, Z_CopyStruct(work));
-    pthread_cond_signal(&work_cond);
-    pthread_mutex_unlock(&work_lock);
-}
+    if (numthreads < 2) {
+        pthread_mutex_unlock(&pool_lock);
+        for (i = 0; i < requested; i++)
+            func(arg, i);
+        return;
+    }
 
-#else
-#define shutdown_work() (void)0
-#define complete_work() (void)0
-#endif
+    pool_func = func;
+    pool_arg = arg;
+    pool_count = numthreads;
+    pool_pending = numthreads - 1;
+    pool_generation++;
+    pthread_cond_broadcast(&pool_start);
+    pthread_mutex_unlock(&pool_lock);
+
+    func(arg, 0);
+
+    pthread_mutex_lock(&pool_lock);
+    while (pool_pending)
+        pthread_cond_wait(&pool_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+
+    // do the work of threads that failed to spawn
+    for (i = numthreads; i < requested; i++)
+        func(arg, i);
+}
 
 /*
 ===============================================================================
@@ -175,6 +303,27 @@ void Sys_DebugBreak(void)
     raise(SIGTRAP);
 }
 
+void *Sys_MapFile(FILE *fp, size_t size)
+{
+    void *base;
+    int fd;
+
+    fd = fileno(fp);
+    if (fd == -1 || !size)
+        return NULL;
+
+    base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED)
+        return NULL;
+
+    return base;
+}
+
+void Sys_UnmapFile(void *base, size_t size)
+{
+    munmap(base, size);
+}
+
 unsigned Sys_Milliseconds(void)
 {
     struct timeval tp;
@@ -182,6 +331,13 @@ unsigned Sys_Milliseconds(void)
     return tp.tv_sec * 1000UL + tp.tv_usec / 1000UL;
 }
 
+unsigned Sys_Microseconds(void)
+{
+    struct timeval tp;
+    gettimeofday(&tp, NULL);
+    return tp.tv_sec * 1000000UL + tp.tv_usec;
+}
+
 /*
 =================
 Sys_Quit
@@ -191,7 +347,7 @@ This function never returns.
 */
 void Sys_Quit(void)
 {
-    shutdown_work();
+    shutdown_pool();
     tty_shutdown_input();
 #if USE_SDL
     SDL_Quit();
@@ -570,7 +726,6 @@ int main(int argc, char **argv)
 
     Qcommon_Init(argc, argv);
     while (!terminate) {
-        complete_work();
         if (flush_logs) {
             Com_FlushLogs();
             flush_logs = qfalse;
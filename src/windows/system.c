@@ -538,120 +538,215 @@ fail:
 /*
 ===============================================================================
 
-ASYNC WORK QUEUE
+THREADS AND SYNCHRONIZATION
 
 ===============================================================================
 */
 
-#if USE_CLIENT
+struct systhread_s {
+    HANDLE      handle;
+    void        (*func)(void *);
+    void        *arg;
+};
 
-static qboolean work_initialized;
-static qboolean work_terminate;
-static CRITICAL_SECTION work_crit;
-static HANDLE work_event;
-static HANDLE work_thread;
-static asyncwork_t *pend_head;
-static asyncwork_t *done_head;
+struct sysmutex_s {
+    CRITICAL_SECTION crit;
+};
+
+struct syssem_s {
+    HANDLE      handle;
+};
 
-static void append_work(asyncwork_t **head, asyncwork_t *work)
+static DWORD WINAPI thread_start(LPVOID arg)
 {
-    asyncwork_t *c, **p;
-    for (p = head, c = *head; c; p = &c->next, c = c->next);
-    work->next = NULL;
-    *p = work;
+    systhread_t *thread = arg;
+
+    thread->func(thread->arg);
+    return 0;
 }
 
-static void complete_work(void)
+systhread_t *Sys_CreateThread(void (*func)(void *), void *arg)
 {
-    asyncwork_t *work, *next;
+    systhread_t *thread = Z_Malloc(sizeof(*thread));
 
-    if (!work_initialized)
-        return;
-    if (!TryEnterCriticalSection(&work_crit))
-        return;
-    if (q_unlikely(done_head)) {
-        for (work = done_head; work; work = next) {
-            next = work->next;
-            if (work->done_cb)
-                work->done_cb(work->cb_arg);
-            Z_Free(work);
-        }
-        done_head = NULL;
+    thread->func = func;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, thread_start, thread, 0, NULL);
+    if (!thread->handle) {
+        Z_Free(thread);
+        return NULL;
     }
-    LeaveCriticalSection(&work_crit);
+
+    return thread;
 }
 
-static DWORD WINAPI thread_func(LPVOID arg)
+void Sys_JoinThread(systhread_t *thread)
 {
-    EnterCriticalSection(&work_crit);
-    while (1) {
-        while (!pend_head && !work_terminate) {
-            LeaveCriticalSection(&work_crit);
-            if (WaitForSingleObject(work_event, INFINITE))
-                return 1;
-            EnterCriticalSection(&work_crit);
-        }
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    Z_Free(thread);
+}
 
-        asyncwork_t *work = pend_head;
-        if (!work)
-            break;
-        pend_head = work->next;
+sysmutex_t *Sys_CreateMutex(void)
+{
+    sysmutex_t *mutex = Z_Malloc(sizeof(*mutex));
+
+    InitializeCriticalSection(&mutex->crit);
+    return mutex;
+}
+
+void Sys_DestroyMutex(sysmutex_t *mutex)
+{
+    DeleteCriticalSection(&mutex->crit);
+    Z_Free(mutex);
+}
+
+void Sys_LockMutex(sysmutex_t *mutex)
+{
+    EnterCriticalSection(&mutex->crit);
+}
+
+void Sys_UnlockMutex(sysmutex_t *mutex)
+{
+    LeaveCriticalSection(&mutex->crit);
+}
+
+syssem_t *Sys_CreateSemaphore(void)
+{
+    syssem_t *sem = Z_Malloc(sizeof(*sem));
+
+    sem->handle = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+    if (!sem->handle)
+        Sys_Error("Couldn't create semaphore");
+    return sem;
+}
+
+void Sys_DestroySemaphore(syssem_t *sem)
+{
+    CloseHandle(sem->handle);
+    Z_Free(sem);
+}
+
+void Sys_PostSemaphore(syssem_t *sem, int count)
+{
+    ReleaseSemaphore(sem->handle, count, NULL);
+}
+
+void Sys_WaitSemaphore(syssem_t *sem)
+{
+    WaitForSingleObject(sem->handle, INFINITE);
+}
+
+int Sys_NumProcessors(void)
+{
+    SYSTEM_INFO info;
 
-        LeaveCriticalSection(&work_crit);
-        work->work_cb(work->cb_arg);
-        EnterCriticalSection(&work_crit);
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors ? info.dwNumberOfProcessors : 1;
+}
+
+/*
+===============================================================================
+
+WORKER THREADS
+
+===============================================================================
+*/
+
+static HANDLE           pool_threads[MAX_WORKER_THREADS];
+static HANDLE           pool_start[MAX_WORKER_THREADS];
+static HANDLE           pool_done[MAX_WORKER_THREADS];
+static int              pool_numthreads;    // number of spawned threads
+static qboolean         pool_terminate;
+static void             (*pool_func)(void *, int);
+static void             *pool_arg;
 
-        append_work(&done_head, work);
+static DWORD WINAPI pool_thread_func(LPVOID arg)
+{
+    int index = (int)(INT_PTR)arg;
+
+    while (1) {
+        if (WaitForSingleObject(pool_start[index], INFINITE))
+            return 1;
+        if (pool_terminate)
+            break;
+        pool_func(pool_arg, index);
+        SetEvent(pool_done[index]);
     }
-    LeaveCriticalSection(&work_crit);
 
     return 0;
 }
 
-static void shutdown_work(void)
+static void shutdown_pool(void)
 {
-    if (!work_initialized)
-        return;
+    int i;
 
-    EnterCriticalSection(&work_crit);
-    work_terminate = qtrue;
-    LeaveCriticalSection(&work_crit);
+    if (!pool_numthreads)
+        return;
 
-    SetEvent(work_event);
+    pool_terminate = qtrue;
+    for (i = 1; i <= pool_numthreads; i++)
+        SetEvent(pool_start[i]);
 
-    WaitForSingleObject(work_thread, INFINITE);
-    complete_work();
+    for (i = 1; i <= pool_numthreads; i++) {
+        WaitForSingleObject(pool_threads[i], INFINITE);
+        CloseHandle(pool_threads[i]);
+        CloseHandle(pool_start[i]);
+        CloseHandle(pool_done[i]);
+    }
 
-    DeleteCriticalSection(&work_crit);
-    CloseHandle(work_event);
-    CloseHandle(work_thread);
-    work_initialized = qfalse;
+    pool_numthreads = 0;
 }
 
-void Sys_QueueAsyncWork(asyncwork_t *work)
+void Sys_RunThreads(int numthreads, void (*func)(void *, int), void *arg)
 {
-    if (!work_initialized) {
-        InitializeCriticalSection(&work_crit);
-        work_event = CreateEvent(NULL, FALSE, FALSE, NULL);
-        if (!work_event)
-            Sys_Error("Couldn't create async work event");
-        work_thread = CreateThread(NULL, 0, thread_func, NULL, 0, NULL);
-        if (!work_thread)
-            Sys_Error("Couldn't create async work thread");
-        work_initialized = qtrue;
+    int i, requested;
+
+    if (numthreads > MAX_WORKER_THREADS)
+        numthreads = MAX_WORKER_THREADS;
+
+    requested = numthreads;
+
+    // spawn more threads as needed, calling thread has index 0
+    while (pool_numthreads < numthreads - 1) {
+        i = pool_numthreads + 1;
+        pool_start[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+        pool_done[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+        pool_threads[i] = NULL;
+        if (pool_start[i] && pool_done[i])
+            pool_threads[i] = CreateThread(NULL, 0, pool_thread_func,
+                                           (LPVOID)(INT_PTR)i, 0, NULL);
+        if (!pool_threads[i]) {
+            Com_EPrintf("Couldn't create worker thread\n");
+            if (pool_start[i])
+                CloseHandle(pool_start[i]);
+            if (pool_done[i])
+                CloseHandle(pool_done[i]);
+            numthreads = pool_numthreads + 1;
+            break;
+        }
+        pool_numthreads++;
     }
 
-    EnterCriticalSection(&work_crit);
-    append_work(&pend_head, Z_CopyStruct(work));
-    LeaveCriticalSection(&work_crit);
+    if (numthreads < 2) {
+        for (i = 0; i < requested; i++)
+            func(arg, i);
+        return;
+    }
 
-    SetEvent(work_event);
-}
+    pool_func = func;
+    pool_arg = arg;
+    for (i = 1; i < numthreads; i++)
+        SetEvent(pool_start[i]);
 
-#else
-#define shutdown_work() (void)0
-#define complete_work() (void)0
-#endif
+    func(arg, 0);
+
+    WaitForMultipleObjects(numthreads - 1, pool_done + 1, TRUE, INFINITE);
+
+    // do the work of threads that failed to spawn
+    for (i = numthreads; i < requested; i++)
+        func(arg, i);
+}
 
 /*
 ===============================================================================
@@ -732,7 +827,7 @@ This function never returns.
 */
 void Sys_Quit(void)
 {
-    shutdown_work();
+    shutdown_pool();
 
 #if USE_CLIENT
 #if USE_SYSCON
@@ -755,6 +850,33 @@ void Sys_DebugBreak(void)
     DebugBreak();
 }
 
+void *Sys_MapFile(FILE *fp, size_t size)
+{
+    HANDLE file, mapping;
+    void *base;
+
+    if (!size)
+        return NULL;
+
+    file = (HANDLE)_get_osfhandle(_fileno(fp));
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+
+    mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+        return NULL;
+
+    // view keeps mapping object alive
+    base = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    CloseHandle(mapping);
+    return base;
+}
+
+void Sys_UnmapFile(void *base, size_t size)
+{
+    UnmapViewOfFile(base);
+}
+
 unsigned Sys_Milliseconds(void)
 {
     LARGE_INTEGER tm;
@@ -762,6 +884,14 @@ unsigned Sys_Milliseconds(void)
     return tm.QuadPart * 1000ULL / timer_freq.QuadPart;
 }
 
+unsigned Sys_Microseconds(void)
+{
+    LARGE_INTEGER tm;
+    QueryPerformanceCounter(&tm);
+    return tm.QuadPart / timer_freq.QuadPart * 1000000ULL +
+           tm.QuadPart % timer_freq.QuadPart * 1000000ULL / timer_freq.QuadPart;
+}
+
 void Sys_AddDefaultConfig(void)
 {
 }
@@ -1120,7 +1250,6 @@ static int Sys_Main(int argc, char **argv)
 
     // main program loop
     while (1) {
-        complete_work();
         Qcommon_Frame();
         if (shouldExit) {
 #if USE_WINSVC